@@ -25,6 +25,16 @@ static const int MAX_PSMS = 10000000;
 // 14th decimal place
 static const double EPSILON = 0.00000000000001;
 
+/**
+ * A PSM taking part in q-value estimation: a row of the target (or
+ * concatenated) PSM table, or of the decoy PSM table.
+ */
+struct Competitor {
+  Competitor(PSMTable* table, int r) : psms(table), row(r) {}
+  PSMTable* psms;
+  int row;
+};
+
 /**
 * \returns a blank ComputeQValues object
 */
@@ -163,9 +173,9 @@ int AssignConfidenceApplication::main(const vector<string> input_files) {
       "with score: %s", score_param.c_str());
   }
 
-  // Create two match collections, for targets and decoys.
-  MatchCollection* decoy_matches = new MatchCollection();
+  // Collect the target matches, and the scores of the decoys.
   MatchCollection* target_matches = new MatchCollection();
+  vector<FLOAT_T> decoy_scores;
 
   bool distinct_matches = false;
   MatchCollectionParser parser;
@@ -197,12 +207,20 @@ int AssignConfidenceApplication::main(const vector<string> input_files) {
       decoy_path = "";
     }
 
-    MatchCollection* match_collection =
-      parser.create(target_path, Params::GetString("protein-database"));
-    distinct_matches = match_collection->getHasDistinctMatches();
+    // Every PSM is read into a table; Match objects are only built, at
+    // the end, for the target PSMs that are kept for output.
+    PSMTable target_table;
+    MatchCollection* match_collection = NULL;
+    bool tab_delimited = MatchCollectionParser::isTabDelimited(target_path);
+    if (tab_delimited) {
+      target_table.load(target_path);
+    } else {
+      match_collection = parser.create(target_path, Params::GetString("protein-database"));
+      target_table.load(match_collection);
+    }
+    distinct_matches = target_table.hasDistinctMatches();
 
-    carp(CARP_INFO, "Found %d PSMs in %s.", match_collection->getMatchTotal(),
-         target_path.c_str());
+    carp(CARP_INFO, "Found %d PSMs in %s.", target_table.size(), target_path.c_str());
     
     // If necessary, automatically identify the score type.
     if (score_type == INVALID_SCORER_TYPE) {
@@ -216,7 +234,7 @@ int AssignConfidenceApplication::main(const vector<string> input_files) {
       for (vector<SCORER_TYPE_T>::const_iterator i = scoreTypes.begin();
            i != scoreTypes.end();
            i++) {
-        if (match_collection->getScoredType(*i)) {
+        if (target_table.hasScore(*i)) {
           score_type = *i;
           carp(CARP_INFO, "Automatically detected score type: %s",
                scorer_type_to_string(score_type));
@@ -241,7 +259,7 @@ int AssignConfidenceApplication::main(const vector<string> input_files) {
          scorer_type_to_string(score_type),
          ascending ? "ascending" : "descending");
 
-    if (!match_collection->getScoredType(score_type)) {
+    if (!target_table.hasScore(score_type)) {
       const char* score_str = scorer_type_to_string(score_type);
       carp(CARP_FATAL, "The PSM feature \"%s\" was not found in file \"%s\".",
            score_str, target_path.c_str());
@@ -249,68 +267,71 @@ int AssignConfidenceApplication::main(const vector<string> input_files) {
 
     // Find and keep the best score for each peptide.
     if (estimation_method == PEPTIDE_LEVEL_METHOD) {
-      peptide_level_filtering(match_collection, &BestPeptideScore, score_type, ascending);
+      peptide_level_filtering(target_table, &BestPeptideScore, score_type, ascending);
       carp(CARP_INFO, "%d distinct target peptides.", BestPeptideScore.size());
     }
 
-    target_matches->setScoredType(score_type, match_collection->getScoredType(score_type));
-    target_matches->setScoredType(EVALUE, match_collection->getScoredType(EVALUE));
-    target_matches->setScoredType(DELTA_CN, match_collection->getScoredType(DELTA_CN));
-    target_matches->setScoredType(SP, match_collection->getScoredType(SP));
-    target_matches->setScoredType(BY_IONS_MATCHED, match_collection->getScoredType(BY_IONS_MATCHED));
-    target_matches->setScoredType(BY_IONS_TOTAL, match_collection->getScoredType(BY_IONS_TOTAL));
+    target_matches->setScoredType(score_type, target_table.hasScore(score_type));
+    target_matches->setScoredType(EVALUE, target_table.hasScore(EVALUE));
+    target_matches->setScoredType(DELTA_CN, target_table.hasScore(DELTA_CN));
+    target_matches->setScoredType(SP, target_table.hasScore(SP));
+    target_matches->setScoredType(BY_IONS_MATCHED, target_table.hasScore(BY_IONS_MATCHED));
+    target_matches->setScoredType(BY_IONS_TOTAL, target_table.hasScore(BY_IONS_TOTAL));
     target_matches->setScoredType(SIDAK_ADJUSTED, sidak);
-    decoy_matches->setScoredType(SIDAK_ADJUSTED, sidak);
 
     // Counters just to let the user know what's up.
     int num_target_rank_skipped = 0;
     int num_decoy_rank_skipped = 0;
     int num_target_peptide_skipped = 0;
     int num_decoy_peptide_skipped = 0;
-    
+
+    // The PSMs that go on to q-value estimation, in order: rows of the
+    // target (or concatenated) table, or of the separate decoy table.
+    vector<Competitor> competitors;
+    PSMTable decoy_table;
+
+    if (decoy_path == "" || estimation_method == MIXMAX_METHOD) {
+      for (int row = 0; row < target_table.size(); row++) {
+        competitors.push_back(Competitor(&target_table, row));
+      }
+    }
+
     if (decoy_path != "") {
-      MatchCollection* temp_collection = parser.create(decoy_path, Params::GetString("protein-database"));
-      carp(CARP_INFO, "Found %d PSMs in %s.", temp_collection->getMatchTotal(),
-           decoy_path.c_str());
+      decoy_table.load(decoy_path);
+      carp(CARP_INFO, "Found %d PSMs in %s.", decoy_table.size(), decoy_path.c_str());
 
       // Mark decoy matches
-      // key = (filename, scan number, charge, rank); value = index
+      // key = (filename, scan number, charge, rank); value = row + 1
       std::map<boost::tuple <int, int, int, int>, int> pairidx;
       int fileIndex;
       int scanid;
       int charge;
       int rank;
-      int cnt = 0;
-      MatchIterator* temp_iter = new MatchIterator(temp_collection);
-      while (temp_iter->hasNext()) {
-        Crux::Match* decoy_match = temp_iter->next();
-        cnt++;
-
+      for (int row = 0; row < decoy_table.size(); row++) {
         // Only use top-ranked matches.
-        if (decoy_match->getRank(XCORR) > top_match) {
+        if (decoy_table.getRank(XCORR, row) > top_match) {
           num_decoy_rank_skipped++;
           continue;
         }
 
-        fileIndex = stringToIndex(decoy_match->getSpectrum()->getFullFilename());
-        scanid = decoy_match->getSpectrum()->getFirstScan();
-        charge = decoy_match->getCharge();
-        rank   = decoy_match->getRank(XCORR);
+        fileIndex = stringToIndex(decoy_table.getFile(row));
+        scanid = decoy_table.getScan(row);
+        charge = decoy_table.getCharge(row);
+        rank   = decoy_table.getRank(XCORR, row);
         boost::tuple<int, int, int, int> myTuple (fileIndex, scanid, charge, rank);
 
-        decoy_match->setNullPeptide(true);
         switch (estimation_method) {
         case MIXMAX_METHOD:
           // Put match directly in the final set of decoys, because no TDC.
-          decoy_matches->addMatch(decoy_match);
+          competitors.push_back(Competitor(&decoy_table, row));
           break;
         case TDC_METHOD:
         case PEPTIDE_LEVEL_METHOD:
           // If the PSM is already there, that means there was a tie
           // for top-ranked decoys.  In that case, there is no need to
-          // store a pointer to the second one.
+          // store the second one.
           if (pairidx[myTuple] == 0) {
-            pairidx[myTuple] = cnt;
+            pairidx[myTuple] = row + 1;
           }
           break;
         case NUMBER_METHOD_TYPES:
@@ -318,11 +339,10 @@ int AssignConfidenceApplication::main(const vector<string> input_files) {
           carp(CARP_FATAL, "No estimation method specified.");
         }
       }
-      delete temp_iter;
 
       // Find and keep the best score for each decoy peptide.
       if (estimation_method == PEPTIDE_LEVEL_METHOD) {
-        peptide_level_filtering(temp_collection, &BestPeptideScore, score_type, ascending);
+        peptide_level_filtering(decoy_table, &BestPeptideScore, score_type, ascending);
         carp(CARP_INFO, "%d distinct target+decoy peptides.", BestPeptideScore.size());
       }
 
@@ -332,69 +352,62 @@ int AssignConfidenceApplication::main(const vector<string> input_files) {
         int numCompetitions = 0;
         int numLostDecoys = 0;
         int numTies = 0;
-        MatchCollection* tdc_collection = new MatchCollection();
-        tdc_collection->setScoredType(score_type, true);
-        MatchIterator* target_iter = new MatchIterator(match_collection);
-        MatchIterator* decoy_iter = new MatchIterator(temp_collection);
-        while (target_iter->hasNext()) {
-          Crux::Match* target_match = target_iter->next();
-
+        for (int target_row = 0; target_row < target_table.size(); target_row++) {
           // Only use top-ranked matches.
-          if (target_match->getRank(XCORR) > top_match) {
+          if (target_table.getRank(XCORR, target_row) > top_match) {
             num_target_rank_skipped++;
             continue;
           }
 
-          // Retrieve the index of the corresponding decoy PSM.
-          Crux::Match* decoy_match;
-          fileIndex = stringToIndex(target_match->getSpectrum()->getFullFilename());
-          scanid = target_match->getSpectrum()->getFirstScan();
-          charge = target_match->getCharge();
-          rank   = target_match->getRank(XCORR);
+          // Retrieve the row of the corresponding decoy PSM.
+          fileIndex = stringToIndex(target_table.getFile(target_row));
+          scanid = target_table.getScan(target_row);
+          charge = target_table.getCharge(target_row);
+          rank   = target_table.getRank(XCORR, target_row);
           decoy_idx = pairidx[boost::tuple <int, int, int, int>
                               (fileIndex, scanid, charge, rank)];
           if (decoy_idx == 0) {
             carp(CARP_DEBUG,
                  "Failed to find decoy for file=%s scan=%d charge=%d rank=%d.",
-                 target_match->getSpectrum()->getFullFilename(),
+                 target_table.getFile(target_row).c_str(),
                  scanid, charge, rank);
             numLostDecoys++;
           }
+          int decoy_row = decoy_idx - 1;
 
           if (estimation_method == PEPTIDE_LEVEL_METHOD) {
             if (decoy_idx > 0) {
-              decoy_match = decoy_iter->getMatch(decoy_idx - 1);
-              numCandidates = target_match->getTargetExperimentSize() + decoy_match->getTargetExperimentSize();
-              target_match->setTargetExperimentSize(numCandidates);
-              decoy_match->setTargetExperimentSize(numCandidates);
-              tdc_collection->addMatch(target_match);
-              tdc_collection->addMatch(decoy_match);
+              numCandidates = target_table.getExperimentSize(target_row) +
+                decoy_table.getExperimentSize(decoy_row);
+              target_table.setExperimentSize(target_row, numCandidates);
+              decoy_table.setExperimentSize(decoy_row, numCandidates);
+              competitors.push_back(Competitor(&target_table, target_row));
+              competitors.push_back(Competitor(&decoy_table, decoy_row));
             } else {
-              numCandidates = target_match->getTargetExperimentSize();
-              target_match->setTargetExperimentSize(numCandidates);
-              tdc_collection->addMatch(target_match);
+              competitors.push_back(Competitor(&target_table, target_row));
             }
           } else {
-            if (decoy_idx > 0) {
-              decoy_match = decoy_iter->getMatch(decoy_idx - 1);
-            } else {
-              tdc_collection->addMatch(target_match);
+            if (decoy_idx == 0) {
+              competitors.push_back(Competitor(&target_table, target_row));
               continue;
             }
-            numCandidates = target_match->getTargetExperimentSize() + decoy_match->getTargetExperimentSize();
-            target_match->setTargetExperimentSize(numCandidates);
-            decoy_match->setTargetExperimentSize(numCandidates);
+            numCandidates = target_table.getExperimentSize(target_row) +
+              decoy_table.getExperimentSize(decoy_row);
+            target_table.setExperimentSize(target_row, numCandidates);
+            decoy_table.setExperimentSize(decoy_row, numCandidates);
 
             // This is where the target-decoy competition happens.
+            FLOAT_T target_score = target_table.getScore(score_type, target_row);
+            FLOAT_T decoy_score = decoy_table.getScore(score_type, decoy_row);
             carp(CARP_DEBUG, "TDC: Comparing target (%d, +%d) with score %g to decoy (%d, +%d) with score %g.",
-                 target_match->getSpectrum()->getFirstScan(),
-                 target_match->getCharge(),
-                 target_match->getScore(score_type),
-                 decoy_match->getSpectrum()->getFirstScan(),
-                 decoy_match->getCharge(),
-                 decoy_match->getScore(score_type));
-
-            float score_difference = target_match->getScore(score_type) - decoy_match->getScore(score_type);
+                 target_table.getScan(target_row),
+                 target_table.getCharge(target_row),
+                 target_score,
+                 decoy_table.getScan(decoy_row),
+                 decoy_table.getCharge(decoy_row),
+                 decoy_score);
+
+            float score_difference = target_score - decoy_score;
             numCompetitions++;
             // Randomly break ties.
             if (fabs(score_difference) < 1e-10) {
@@ -405,17 +418,13 @@ int AssignConfidenceApplication::main(const vector<string> input_files) {
               score_difference *= -1.0;
             }
             if (score_difference >= 0.0) {
-              tdc_collection->addMatch(target_match);
+              competitors.push_back(Competitor(&target_table, target_row));
             } else {
-              tdc_collection->addMatch(decoy_match);
+              competitors.push_back(Competitor(&decoy_table, decoy_row));
             }
           }
         }
-        delete target_iter;
-        delete decoy_iter;
-        delete match_collection;
-        match_collection = tdc_collection;
-        carp(CARP_INFO, "%d tdc_collection", match_collection->getMatchTotal());
+        carp(CARP_INFO, "%d tdc_collection", (int)competitors.size());
         if (numCompetitions > 0) {
           carp(CARP_INFO, "Randomly broke %d ties in %d target-decoy competitions.",
                numTies, numCompetitions);
@@ -424,51 +433,38 @@ int AssignConfidenceApplication::main(const vector<string> input_files) {
           carp(CARP_INFO, "Failed to find %d decoys.", numLostDecoys);
         }
       }
-      delete temp_collection;
     }
 
-    // Iterate, gathering matches into one or two collections.
-    MatchIterator* match_iterator =
-      new MatchIterator(match_collection, score_type, false);
+    // Gather the competitors into the target rows to keep and the decoy
+    // scores.
+    vector<bool> keep_rows(target_table.size(), false);
+    vector<FLOAT_T> sidak_scores(sidak ? target_table.size() : 0);
     double sidak_adjustment;
-    while (match_iterator->hasNext()) {
-      Match* match = match_iterator->next();
-      bool is_decoy = match->getNullPeptide();
+    for (vector<Competitor>::const_iterator i = competitors.begin();
+         i != competitors.end();
+         i++) {
+      PSMTable& psms = *i->psms;
+      int row = i->row;
+      bool is_decoy = &psms == &decoy_table || psms.isDecoy(row);
 
       // Only use top-ranked matches.
-      if (score_type == BOTH_PVALUE) {
-        if (match->getRank(BOTH_PVALUE) > top_match) {
-          if (is_decoy) {
-            num_decoy_rank_skipped++;
-          } else {
-            num_target_rank_skipped++;
-          }
-          continue;
-        }
-      } else if (score_type == RESIDUE_EVIDENCE_PVAL) {
-        if (match->getRank(RESIDUE_EVIDENCE_PVAL) > top_match) {
-          if (is_decoy) {
-            num_decoy_rank_skipped++;
-          } else {
-            num_target_rank_skipped++;
-          }
-          continue;
-        }
-      } else {
-        if (match->getRank(XCORR) > top_match) {
-          if (is_decoy) {
-            num_decoy_rank_skipped++;
-          } else {
-            num_target_rank_skipped++;
-          }
-          continue;
+      SCORER_TYPE_T rank_type = XCORR;
+      if (score_type == BOTH_PVALUE || score_type == RESIDUE_EVIDENCE_PVAL) {
+        rank_type = score_type;
+      }
+      if (psms.getRank(rank_type, row) > top_match) {
+        if (is_decoy) {
+          num_decoy_rank_skipped++;
+        } else {
+          num_target_rank_skipped++;
         }
+        continue;
       }
+      FLOAT_T score = psms.getScore(score_type, row);
 
       // Find and keep the best score for each decoy peptide.
       if (estimation_method == PEPTIDE_LEVEL_METHOD) {
-        FLOAT_T score = match->getScore(score_type);
-        string peptideStr = getPeptideSeq(match);
+        string peptideStr = getPeptideSeq(psms, row);
 
         FLOAT_T bestScore;
         try {
@@ -490,22 +486,59 @@ int AssignConfidenceApplication::main(const vector<string> input_files) {
 
       // Do the Sidak correction.
       if (sidak) {
-        if (match->getRank(XCORR) > 1) {
+        if (psms.getRank(XCORR, row) > 1) {
           carp_once(CARP_WARNING, "Sidak correction is not defined for non-top-matches. Further warnings are not shown.");
         }
-        sidak_adjustment = 1.0 - pow(1.0 - match->getScore(score_type), match->getTargetExperimentSize());
-        match->setScore(SIDAK_ADJUSTED, sidak_adjustment);
+        sidak_adjustment = 1.0 - pow(1.0 - score, psms.getExperimentSize(row));
+        score = sidak_adjustment;
       }
 
-      // Add this match to one of the collections.
+      // Keep this target, or add its score to the decoys.
       if (is_decoy) {
-        decoy_matches->addMatch(match);
+        decoy_scores.push_back(score);
       } else {
+        keep_rows[row] = true;
+        if (sidak) {
+          sidak_scores[row] = score;
+        }
+      }
+    }
+
+    // Build matches for the kept targets. For a tab-delimited file only
+    // those are parsed, in the order of their rows; other formats were
+    // parsed whole, one match per row.
+    vector<int> match_rows;
+    if (tab_delimited) {
+      match_collection = parser.create(target_path, Params::GetString("protein-database"),
+                                       &keep_rows);
+      for (int row = 0; row < target_table.size(); row++) {
+        if (keep_rows[row]) {
+          match_rows.push_back(row);
+        }
+      }
+    } else {
+      for (int row = 0; row < target_table.size(); row++) {
+        match_rows.push_back(row);
+      }
+    }
+    if (match_collection->getMatchTotal() != (int)match_rows.size()) {
+      carp(CARP_FATAL, "Read %d PSMs from %s, expected %d.",
+           match_collection->getMatchTotal(), target_path.c_str(), (int)match_rows.size());
+    }
+    MatchIterator* match_iter = new MatchIterator(match_collection);
+    for (size_t i = 0; match_iter->hasNext(); i++) {
+      Match* match = match_iter->next();
+      int row = match_rows[i];
+      if (keep_rows[row]) {
+        match->setTargetExperimentSize(target_table.getExperimentSize(row));
+        if (sidak) {
+          match->setScore(SIDAK_ADJUSTED, sidak_scores[row]);
+        }
         target_matches->addMatch(match);
       }
       Match::freeMatch(match);
     }
-    delete match_iterator;
+    delete match_iter;
     delete match_collection;
     if (num_decoy_rank_skipped + num_target_rank_skipped > 0) {
       carp(CARP_INFO, "Skipped %d target and %d decoy PSMs with rank > %d.",
@@ -522,7 +555,6 @@ int AssignConfidenceApplication::main(const vector<string> input_files) {
   }
 
   target_matches->setScoredType(score_type, true);
-  decoy_matches->setScoredType(score_type, true);
 
 
   // get from the input files which columns to print in the output files
@@ -599,7 +631,6 @@ int AssignConfidenceApplication::main(const vector<string> input_files) {
 
   // Compute q-values.
   vector<FLOAT_T> target_scores = target_matches->extractScores(score_type);
-  vector<FLOAT_T> decoy_scores = decoy_matches->extractScores(score_type);
   carp(CARP_INFO, "There are %d target and %d decoy PSMs for q-value computation.",
        target_scores.size(), decoy_scores.size());
 
@@ -674,7 +705,6 @@ int AssignConfidenceApplication::main(const vector<string> input_files) {
     delete accepted_matches;
     delete match_iterator;
   }
-  delete decoy_matches;
   delete target_matches;
 
   return 0;
@@ -972,41 +1002,30 @@ vector<FLOAT_T> AssignConfidenceApplication::compute_decoy_qvalues_mixmax(
 }
 
 void AssignConfidenceApplication::peptide_level_filtering(
-  MatchCollection* match_collection,
-  std::map<string, FLOAT_T>* BestPeptideScore, 
+  const PSMTable& psms,
+  std::map<string, FLOAT_T>* BestPeptideScore,
   SCORER_TYPE_T score_type,
   bool ascending) {
 
-    MatchIterator* temp_iter = new MatchIterator(match_collection);
-
-    while (temp_iter->hasNext()) {
-      Crux::Match* match = temp_iter->next();
-      FLOAT_T score = match->getScore(score_type);
-      string peptideStr = getPeptideSeq(match);
+    for (int row = 0; row < psms.size(); row++) {
+      FLOAT_T score = psms.getScore(score_type, row);
+      string peptideStr = getPeptideSeq(psms, row);
 
-      FLOAT_T bestScore = 0.0;
-      try {
-        bestScore = BestPeptideScore->at(peptideStr);
-      } catch (const std::out_of_range& oor) {
+      map<string, FLOAT_T>::iterator best = BestPeptideScore->find(peptideStr);
+      if (best == BestPeptideScore->end()) {
         BestPeptideScore->insert(std::pair<string, FLOAT_T>(peptideStr, score));
-        continue;
-      }
-      if ((ascending && bestScore > score) || (!ascending && score > bestScore)) {
-        BestPeptideScore->at(peptideStr) = score;
+      } else if ((ascending && best->second > score) ||
+                 (!ascending && score > best->second)) {
+        best->second = score;
       }
     }
-    delete temp_iter;
 }
 
-string AssignConfidenceApplication::getPeptideSeq(Match* match) {
-  string peptideSeq;
-  if (Params::GetBool("combine-modified-peptides")) {
-    peptideSeq = match->getPeptide()->getSequence();
-  } else {
-    peptideSeq = match->getPeptide()->getModifiedSequenceWithMasses();
-  }
+string AssignConfidenceApplication::getPeptideSeq(const PSMTable& psms, int row) {
+  string peptideSeq = Params::GetBool("combine-modified-peptides") ?
+    psms.getSequence(row) : psms.getModifiedSequence(row);
   if (Params::GetBool("combine-charge-states")) {
-    peptideSeq += StringUtils::ToString(match->getCharge());
+    peptideSeq += StringUtils::ToString(psms.getCharge(row));
   }
   return peptideSeq;
 }
@@ -19,6 +19,7 @@
 #include "model/Scorer.h"
 #include "model/Match.h"
 #include "model/MatchCollection.h"
+#include "model/PSMTable.h"
 #include "io/OutputFiles.h"
 #include "model/Peptide.h"
 
@@ -51,7 +52,7 @@ class AssignConfidenceApplication : public CruxApplication {
   void setIterationCnt(unsigned int iteration_cnt);
   void setOutput(OutputFiles *output);
   unsigned int getAcceptedPSMs();
-  std::string getPeptideSeq(Crux::Match* match);
+  std::string getPeptideSeq(const PSMTable& psms, int row);
 
   /**
   * stores the name of the index file used in an iteration in Cascade Search.
@@ -133,7 +134,7 @@ class AssignConfidenceApplication : public CruxApplication {
     FLOAT_T  pi_zero);
 
   void peptide_level_filtering(
-    MatchCollection* match_collection,
+    const PSMTable& psms,
     std::map<string, FLOAT_T>* BestPeptideScore,
     SCORER_TYPE_T score_type,
     bool ascending);
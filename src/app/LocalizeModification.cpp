@@ -2,6 +2,7 @@
 #include "io/MatchCollectionParser.h"
 #include "tide/max_mz.h"
 #include "tide/modifications.h"
+#include "tide/search_config.h"
 #include "util/FileUtils.h"
 #include "util/Params.h"
 #include "io/SpectrumCollectionFactory.h"
@@ -99,6 +100,7 @@ int LocalizeModificationApplication::main(int argc, char** argv) {
   tps.binOffset_ = binOffset;
 
   int topMatch = Params::GetInt("top-match");
+  SearchConfig config;
   uint64_t curStep = 0;
   matchIter = new MatchIterator(matches);
   while (matchIter->hasNext()) {
@@ -142,7 +144,8 @@ int LocalizeModificationApplication::main(int argc, char** argv) {
     double neutralMass = match->getNeutralMass();
     int maxPrecursorMass = MassConstants::mass2bin(neutralMass + MAX_XCORR_OFFSET + 30) + 50;
     vector<double> evidence = spectrum.CreateEvidenceVector(binWidth, binOffset, charge,
-      (MassConstants::mass2bin(cruxPeptide->calcModifiedMass()) - 0.5 + binOffset) * binWidth, maxPrecursorMass);
+      (MassConstants::mass2bin(cruxPeptide->calcModifiedMass()) - 0.5 + binOffset) * binWidth,
+      maxPrecursorMass, config);
     for (vector<pb::Peptide>::const_iterator i = peptides.begin(); i != peptides.end(); i++) {
       Peptide peptide(*i, proteins);
       tps.Clear();
@@ -151,7 +154,8 @@ int LocalizeModificationApplication::main(int argc, char** argv) {
       if (i == peptides.begin() + 1) {
         // After we've scored the unmodified peptide, create new evidence vector for scoring the modified peptides
         evidence = spectrum.CreateEvidenceVector(binWidth, binOffset, charge,
-          (MassConstants::mass2bin(neutralMass) - 0.5 + binOffset) * binWidth, maxPrecursorMass);
+          (MassConstants::mass2bin(neutralMass) - 0.5 + binOffset) * binWidth,
+          maxPrecursorMass, config);
       }
 
       double xcorr = 0;
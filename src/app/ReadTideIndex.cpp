@@ -5,6 +5,7 @@
 #include "parameter.h"
 #include "app/tide/records_to_vector-inl.h"
 #include "app/tide/peptide.h"
+#include "app/tide/peptide_reader.h"
 #include "util/Params.h"
 #include <vector>
 
@@ -45,8 +46,8 @@ int ReadTideIndex::main(int argc, char** argv) {
   // Read peptides index file
   carp(CARP_INFO, "Reading peptides...");
   pb::Header peptides_header;
-  HeadedRecordReader peptide_reader(peptides_file, &peptides_header);
-  if (peptides_header.file_type() != pb::Header::PEPTIDES ||
+  PeptideReader* reader = PeptideReader::Open(peptides_file, &peptides_header);
+  if (reader == NULL || peptides_header.file_type() != pb::Header::PEPTIDES ||
       !peptides_header.has_peptides_header()) {
     carp(CARP_FATAL, "Error reading index (%s)", peptides_file.c_str());
   }
@@ -63,7 +64,6 @@ int ReadTideIndex::main(int argc, char** argv) {
   *output_stream << get_column_header(SEQUENCE_COL) << '\t'
                  << get_column_header(PROTEIN_ID_COL) << endl;
 
-  RecordReader* reader = peptide_reader.Reader();
   while (!reader->Done()) {
     // Read peptide
     pb::Peptide pb_peptide;
@@ -90,6 +90,7 @@ int ReadTideIndex::main(int argc, char** argv) {
 
   output_stream->close();
   delete output_stream;
+  delete reader;
 
   return 0;
 }
@@ -26,34 +26,6 @@ class SortColumn: public CruxApplication {
   bool header_;               ///<print out the header?
   unsigned int col_sort_idx_; ///<column index to sort by
 
-  //private methods.
-  /**
-   * sorts the delimited file based upon the column type parameter
-   */
-  void sortDelimited(
-    DelimitedFile* delimited
-  );
-
-  /**
-   * merges a list of sorted delimited files and prints 
-   * out the resulting sorted file.
-   */
-  void mergeDelimitedFiles(
-    std::vector<std::string>& temp_filenames
-  );
-
-  /**
-   * /returns the result of comparing two file(s) current row and column: 
-   * 1 : file1 > file2
-   * -1 : file1 < file2
-   * 0 : file1 = file2
-   */
-  int compare(
-    DelimitedFileReader* file1,
-    DelimitedFileReader* file2
-  );
-
-
  public:
 
   /**
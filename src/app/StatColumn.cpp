@@ -5,9 +5,14 @@
  *****************************************************************************/
 #include "StatColumn.h"
 
-#include "io/DelimitedFile.h"
+#include "io/DelimitedFileSorter.h"
+#include "util/FileUtils.h"
 #include "util/Params.h"
 
+#include <algorithm>
+
+#include <boost/thread.hpp>
+
 using namespace std;
 
 
@@ -43,54 +48,97 @@ int StatColumn::main(int argc, char** argv) {
     return(-1);
   }
 
+  //the values are kept in memory and only handed to an external sorter,
+  //which spills sorted runs to temp-dir, once they exceed max-memory.
+  //a max-memory of 0 means no limit, so they are never handed off.
+  size_t max_memory = (size_t)Params::GetInt("max-memory") << 20;
   vector<FLOAT_T> data;
+  size_t max_values = max_memory == 0 ? data.max_size() :
+    max(max_memory / sizeof(FLOAT_T), (size_t)1);
+  DelimitedFileSorter* sorter = NULL;
 
   FLOAT_T sum = 0;
+  FLOAT_T min = 0.0;
+  FLOAT_T max = 0.0;
+  unsigned int num_points = 0;
+  string no_row;
 
   while (delimited_file.hasNext()) {
 
     FLOAT_T current = delimited_file.getFloat(col_idx);
-    data.push_back(current);
+    if (num_points == 0 || current < min) {
+      min = current;
+    }
+    if (num_points == 0 || current > max) {
+      max = current;
+    }
+    if (sorter != NULL) {
+      sorter->push(no_row, current);
+    } else if (data.size() < max_values) {
+      data.push_back(current);
+    } else {
+      int num_threads = Params::GetInt("num-threads");
+      if (num_threads < 1) {
+        num_threads = boost::thread::hardware_concurrency();
+      }
+      string temp_dir = Params::GetString("temp-dir");
+      sorter = new DelimitedFileSorter(COLTYPE_REAL, true,
+        FileUtils::Join(temp_dir.empty() ? "." : temp_dir, "StatColumn"),
+        max_memory, num_threads);
+      for (size_t idx = 0; idx < data.size(); idx++) {
+        sorter->push(no_row, data[idx]);
+      }
+      vector<FLOAT_T>().swap(data);
+      sorter->push(no_row, current);
+    }
     sum += current;
+    num_points++;
     delimited_file.next();
 
   }
-  
-  sort(data.begin(), data.end(), less<FLOAT_T>());
-
-  unsigned int num_points = data.size();
 
-  FLOAT_T min = data.front();
-  FLOAT_T max = data.back();
-  
   FLOAT_T average = sum / (FLOAT_T)num_points;
- 
-  FLOAT_T std_dev = 0.0;
 
-  if (num_points >= 2) {
+  FLOAT_T std_dev = 0.0;
+  FLOAT_T median = 0.0;
+  unsigned int half = num_points / 2;
 
-    for (unsigned int idx = 0 ; idx < num_points ; idx++) {
-      FLOAT_T temp = data.at(idx) - average;
+  if (sorter == NULL) {
+    for (size_t idx = 0; idx < data.size(); idx++) {
+      FLOAT_T temp = data[idx] - average;
       std_dev += temp * temp;
     }
+    if (!data.empty()) {
+      //only the middle values need to be in sorted position
+      nth_element(data.begin(), data.begin() + half, data.end());
+      median = data[half];
+      if (num_points % 2 == 0) {
+        median = (median + *max_element(data.begin(), data.begin() + half)) / 2.0;
+      }
+    }
+  } else {
+    //walk the spilled values in order for the standard deviation and median
+    double current;
+    double below_half = 0.0;
+    for (unsigned int idx = 0 ; sorter->next(&no_row, &current) ; idx++) {
+      FLOAT_T temp = current - average;
+      std_dev += temp * temp;
+      if (idx + 1 == half) {
+        below_half = current;
+      } else if (idx == half) {
+        median = (num_points % 2 == 0) ? (current + below_half) / 2.0 : current;
+      }
+    }
+    delete sorter;
+  }
+
+  if (num_points >= 2) {
     std_dev = std_dev / (1.0 / (double)(num_points - 1));
     std_dev = sqrt(std_dev);
   }
-  
 
-
- 
-  FLOAT_T median = 0.0;
-
-  if (data.size() == 0) {
+  if (num_points == 0) {
     carp(CARP_WARNING, "Warning no data!");
-  } else {
-    int half = data.size() / 2;
-    if (data.size() % 2 == 0) {
-      median = (data[half] + data[half-1]) / 2.0;
-    } else {
-      median = data[half];
-    }
   }
 
   //print out the header
@@ -152,7 +200,10 @@ vector<string> StatColumn::getOptions() const {
   string arr[] = {
     "delimiter",
     "header",
+    "max-memory",
+    "num-threads",
     "precision",
+    "temp-dir",
     "verbosity"
   };
   return vector<string>(arr, arr + sizeof(arr) / sizeof(string));
@@ -12,6 +12,7 @@
 #include "util/FileUtils.h"
 #include "io/carp.h"
 #include "app/tide/abspath.h"
+#include "app/tide/peptide_reader.h"
 #include "app/tide/records_to_vector-inl.h"
 
 #define CHECK(x) GOOGLE_CHECK(x)
@@ -56,7 +57,11 @@ int SubtractIndexApplication::main(int argc, char** argv) {
   carp(CARP_DEBUG, "Read %d proteins", proteins1.size());
   
   pb::Header peptides_header1;
-  HeadedRecordReader peptide_reader1(peptides_file1, &peptides_header1);
+  PeptideReader* peptide_reader1 =
+    PeptideReader::Open(peptides_file1, &peptides_header1);
+  if (peptide_reader1 == NULL) {
+    carp(CARP_FATAL, "Error reading index (%s)", peptides_file1.c_str());
+  }
   if (peptides_header1.file_type() != pb::Header::PEPTIDES ||
     !peptides_header1.has_peptides_header()) {
     carp(CARP_FATAL, "Error reading index (%s)", peptides_file1.c_str());
@@ -79,7 +84,11 @@ int SubtractIndexApplication::main(int argc, char** argv) {
   string proteins_file2 = index2 + "/protix";
   carp(CARP_INFO, "Reading index %s", index2.c_str());
   pb::Header peptides_header2;
-  HeadedRecordReader peptide_reader2(peptides_file2, &peptides_header2);
+  PeptideReader* peptide_reader2 =
+    PeptideReader::Open(peptides_file2, &peptides_header2);
+  if (peptide_reader2 == NULL) {
+    carp(CARP_FATAL, "Error reading index (%s)", peptides_file2.c_str());
+  }
   ProteinVec proteins2;
   pb::Header protein_header2;
   if (!ReadRecordsToVector<pb::Protein, const pb::Protein>(&proteins2,
@@ -133,25 +142,25 @@ int SubtractIndexApplication::main(int argc, char** argv) {
   pb::Header_Source* source = new_header.add_source();
   source->mutable_header()->CopyFrom(peptides_header1);
   HeadedRecordWriter writer(out_peptides, new_header);
-  CHECK(peptide_reader1.OK());
-  CHECK(peptide_reader2.OK());
+  CHECK(peptide_reader1->OK());
+  CHECK(peptide_reader2->OK());
   CHECK(writer.OK());
 
   int mass_precision = Params::GetInt("mass-precision");
   vector< pair<pb::Peptide, bool> > pepList1;
   vector<pb::Peptide> pepList2;
   bool done = false;
-  while (!peptide_reader1.Done()) {
+  while (!peptide_reader1->Done()) {
     // populate lists of peptides
     pb::Peptide pep1;
-    peptide_reader1.Read(&pep1);
+    peptide_reader1->Read(&pep1);
     pepList1.push_back(make_pair(pep1, false));
     while (pepList1.front().first.mass() == pepList1.back().first.mass()) {
-      if (peptide_reader1.Done()) {
+      if (peptide_reader1->Done()) {
         done = true;
         break;
       }
-      peptide_reader1.Read(&pep1);
+      peptide_reader1->Read(&pep1);
       pepList1.push_back(make_pair(pep1, false));
     }
     if (done) {
@@ -162,9 +171,9 @@ int SubtractIndexApplication::main(int argc, char** argv) {
       pepList2.clear();
     }
     if (pepList2.empty() || pepList2.front().mass() == curMass) {
-      while (!peptide_reader2.Done()) {
+      while (!peptide_reader2->Done()) {
         pb::Peptide pep2;
-        peptide_reader2.Read(&pep2);
+        peptide_reader2->Read(&pep2);
         if (pep2.mass() < curMass) {
           continue;
         }
@@ -266,6 +275,8 @@ int SubtractIndexApplication::main(int argc, char** argv) {
     }
   }
 
+  delete peptide_reader1;
+  delete peptide_reader2;
   return 0;
 }
 
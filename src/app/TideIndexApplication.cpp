@@ -1,5 +1,7 @@
 #include <cstdio>
 #include <fstream>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
 #include "io/carp.h"
 #include "util/CarpStreamBuf.h"
 #include "util/AminoAcidUtil.h"
@@ -11,6 +13,7 @@
 #include "TideMatchSet.h"
 #include "app/tide/modifications.h"
 #include "app/tide/records_to_vector-inl.h"
+#include "app/tide/telemetry.h"
 
 #ifdef _MSC_VER
 #include <io.h>
@@ -18,7 +21,8 @@
 
 extern void AddTheoreticalPeaks(const vector<const pb::Protein*>& proteins,
                                 const string& input_filename,
-                                const string& output_filename);
+                                const string& output_filename,
+                                bool columnar);
 extern void AddMods(HeadedRecordReader* reader,
                     string out_file,
                     string tmpDir,                    
@@ -29,6 +33,15 @@ DECLARE_int32(max_mods);
 DECLARE_int32(min_mods);
 DECLARE_int32(modsoutputter_file_threshold);
 
+// Number of residues of protein sequence read from the FASTA file at a time
+// and cleaved in parallel.
+static const size_t DIGEST_BATCH_RESIDUES = 1 << 22;
+// Number of peptides read or written at a time for each sorted run, and the
+// smallest run written.
+static const size_t SORT_RUN_BUFFER = 1 << 14;
+// Largest number of sorted runs merged at once.
+static const size_t MAX_MERGE_RUNS = 128;
+
 TideIndexApplication::TideIndexApplication() {
 }
 
@@ -48,6 +61,11 @@ int TideIndexApplication::main(
 ) {
   carp(CARP_INFO, "Running tide-index...");
 
+  if (Params::GetBool("telemetry")) {
+    Telemetry::Enable();
+  }
+  Telemetry::Thread telemetry_thread("main");
+
   if (cmd_line.empty()) {
     cmd_line = "crux tide-index " + fasta + " " + index;
   }
@@ -168,15 +186,33 @@ int TideIndexApplication::main(
     }
   }
 
+  int num_threads = Params::GetInt("num-threads");
+  if (num_threads < 1) {
+    num_threads = boost::thread::hardware_concurrency();
+    if (num_threads < 1) {
+      num_threads = 1;
+    }
+  }
+  carp(CARP_INFO, "Number of Threads: %d", num_threads);
+  size_t max_memory = (size_t)Params::GetInt("max-memory") << 20;
+  string temp_dir = Params::GetString("temp-dir");
+  string sort_prefix = temp_dir.empty() ? out_peptides :
+    FileUtils::Join(temp_dir, "pepix");
+
   // Start tide-index
   carp(CARP_INFO, "Reading %s and computing unmodified peptides...",
        fasta.c_str());
   pb::Header proteinPbHeader;
-  vector<TideIndexPeptide> peptideHeap;
   vector<string*> proteinSequences;
-  fastaToPb(cmd_line, enzyme_t, digestion, missed_cleavages, min_mass, max_mass,
-            min_length, max_length, allowDups, mass_type, decoy_type, decoy_generator, fasta, out_proteins,
-            proteinPbHeader, peptideHeap, proteinSequences, out_decoy_fasta);
+  PeptideSorter peptideSorter(proteinSequences, sort_prefix, max_memory,
+                              num_threads);
+  {
+    Telemetry::Scope scope(Telemetry::DIGEST);
+    fastaToPb(cmd_line, enzyme_t, digestion, missed_cleavages, min_mass, max_mass,
+              min_length, max_length, allowDups, mass_type, decoy_type, decoy_generator, fasta, out_proteins,
+              proteinPbHeader, peptideSorter, proteinSequences, out_decoy_fasta,
+              num_threads);
+  }
 
   pb::Header header_with_mods;
 
@@ -214,14 +250,16 @@ int TideIndexApplication::main(
   string basic_peptides = need_mods ? modless_peptides : peakless_peptides;
   carp(CARP_DETAILED_DEBUG, "basic_peptides=%s", basic_peptides.c_str());
 
-  writePeptidesAndAuxLocs(peptideHeap, basic_peptides, out_aux, header_no_mods);
+  {
+    Telemetry::Scope scope(Telemetry::INDEX_WRITE);
+    writePeptidesAndAuxLocs(peptideSorter, basic_peptides, out_aux, header_no_mods);
+  }
   // Do some clean up
   for (vector<string*>::iterator i = proteinSequences.begin();
        i != proteinSequences.end();
        ++i) {
     delete *i;
   }
-  vector<TideIndexPeptide>().swap(peptideHeap);
   ProteinVec proteins;
   if (!ReadRecordsToVector<pb::Protein>(&proteins, out_proteins)) {
     carp(CARP_FATAL, "Error reading proteins file");
@@ -230,12 +268,14 @@ int TideIndexApplication::main(
   if (need_mods) {
     carp(CARP_INFO, "Computing modified peptides...");
     HeadedRecordReader reader(modless_peptides, NULL, 1024 << 10); // 1024kb buffer
+    Telemetry::Scope scope(Telemetry::DIGEST);
     AddMods(&reader, peakless_peptides, Params::GetString("temp-dir"), header_with_mods, proteins, &var_mod_table);
   }
 
   if (out_target_list) {
     // Write peptide lists
     carp(CARP_INFO, "Writing peptide lists...");
+    Telemetry::Scope scope(Telemetry::INDEX_WRITE);
 
     // This set holds target peptide strings
     set<string> targetPepStrs;
@@ -304,7 +344,15 @@ int TideIndexApplication::main(
   }
 
   carp(CARP_INFO, "Precomputing theoretical spectra...");
-  AddTheoreticalPeaks(proteins, peakless_peptides, out_peptides);
+  string index_format = Params::GetString("peptide-index-format");
+  if (index_format != "records" && index_format != "columnar") {
+    carp(CARP_FATAL, "Unknown peptide index format '%s'", index_format.c_str());
+  }
+  {
+    Telemetry::Scope scope(Telemetry::INDEX_WRITE);
+    AddTheoreticalPeaks(proteins, peakless_peptides, out_peptides,
+                        index_format == "columnar");
+  }
 
   // Clean up
   for (vector<const pb::Protein*>::iterator i = proteins.begin();
@@ -323,6 +371,12 @@ int TideIndexApplication::main(
   FileUtils::Remove(modless_peptides);
   FileUtils::Remove(peakless_peptides);
 
+  if (Telemetry::Enabled()) {
+    string telemetry_file = make_file_path("tide-index.telemetry.txt");
+    if (!Telemetry::WriteReport(telemetry_file)) {
+      carp(CARP_ERROR, "Error writing '%s'.", telemetry_file.c_str());
+    }
+  }
   return 0;
 }
 
@@ -378,6 +432,7 @@ vector<string> TideIndexApplication::getOptions() const {
     "mass-precision",
     "max-length",
     "max-mass",
+    "max-memory",
     "max-mods",
     "min-length",
     "min-mass",
@@ -387,11 +442,14 @@ vector<string> TideIndexApplication::getOptions() const {
     "mods-spec",
     "nterm-peptide-mods-spec",
     "nterm-protein-mods-spec",
+    "num-threads",
     "output-dir",
     "overwrite",
     "parameter-file",
+    "peptide-index-format",
     "peptide-list",
     "seed",
+    "telemetry",
     "temp-dir",
     "verbosity"
   };
@@ -410,6 +468,10 @@ vector< pair<string, string> > TideIndexApplication::getOutputs() const {
   outputs.push_back(make_pair("tide-index.log.txt",
     "a log file containing a copy of all messages that were printed to the "
     "screen during execution."));
+  outputs.push_back(make_pair("tide-index.telemetry.txt",
+    "a tab-delimited file giving, for each thread, the time spent digesting "
+    "proteins, sorting peptides and writing the index. This file will only "
+    "be created if --telemetry is T."));
   return outputs;
 }
 
@@ -437,9 +499,10 @@ void TideIndexApplication::fastaToPb(
   const string& fasta,
   const string& proteinPbFile,
   pb::Header& outProteinPbHeader,
-  vector<TideIndexPeptide>& outPeptideHeap,
+  PeptideSorter& outPeptides,
   vector<string*>& outProteinSequences,
-  ofstream* decoyFasta
+  ofstream* decoyFasta,
+  int numThreads
 ) {
   typedef GeneratePeptides::CleavedPeptide PeptideInfo;
 
@@ -453,7 +516,6 @@ void TideIndexApplication::fastaToPb(
   unsigned int invalidPepCnt = 0;
   unsigned int failedDecoyCnt = 0;
 
-  outPeptideHeap.clear();
   outProteinSequences.clear();
 
   HeadedRecordWriter proteinWriter(proteinPbFile, outProteinPbHeader);
@@ -462,51 +524,102 @@ void TideIndexApplication::fastaToPb(
   string proteinName;
   string* proteinSequence = new string;
   int curProtein = -1;
+  // Only the peptides pushed to outPeptides are held within max-memory. The
+  // cleaved peptides of every protein, and the distinct target sequences used
+  // to pick decoys and drop duplicates, are all kept in memory until decoys
+  // have been generated, so they still grow with the database.
   vector< pair< ProteinInfo, vector<PeptideInfo> > > cleavedPeptideInfo;
   set<string> setTargets, setDecoys;
   map<const string*, TargetInfo> targetInfo;
 
-  // Iterate over all proteins in FASTA file
+  // Iterate over all proteins in FASTA file. Proteins are read in batches,
+  // each batch is cleaved by several threads at once, and then the peptides
+  // are collected in the order of the proteins in the file, so that the index
+  // does not depend on the number of threads.
   unsigned int targetsGenerated = 0, decoysGenerated = 0;
-  while (GeneratePeptides::getNextProtein(fastaStream, &proteinName, proteinSequence)) {
-    outProteinSequences.push_back(proteinSequence);
-    cleavedPeptideInfo.push_back(make_pair(
-      ProteinInfo(proteinName, proteinSequence), vector<PeptideInfo>()));
-    const ProteinInfo& proteinInfo = cleavedPeptideInfo.back().first;
-    vector<PeptideInfo>& cleavedPeptides = cleavedPeptideInfo.back().second;
-    // Write pb::Protein
-    getPbProtein(++curProtein, proteinName, *proteinSequence, pbProtein);
-    proteinWriter.Write(&pbProtein);
-    cleavedPeptides = GeneratePeptides::cleaveProtein(
-      *proteinSequence, enzyme, digestion, missedCleavages, minLength, maxLength);
-    // Iterate over all generated peptides for this protein
-    for (vector<PeptideInfo>::iterator i = cleavedPeptides.begin();
-         i != cleavedPeptides.end(); ) {
-      FLOAT_T pepMass = calcPepMassTide(i->Sequence(), massType);
-      if (pepMass < 0.0) {
-        // Sequence contained some invalid character
-        carp(CARP_DEBUG, "Ignoring invalid sequence <%s>", i->Sequence().c_str());
-        ++invalidPepCnt;
-        i = cleavedPeptides.erase(i);
-        continue;
-      } else if (pepMass < minMass || pepMass > maxMass) {
-        // Skip to next peptide if not in mass range
-        ++i;
-        continue;
+  DigestSettings digestSettings;
+  digestSettings.enzyme = enzyme;
+  digestSettings.digestion = digestion;
+  digestSettings.missedCleavages = missedCleavages;
+  digestSettings.minLength = minLength;
+  digestSettings.maxLength = maxLength;
+  digestSettings.massType = massType;
+  vector<string*> batchSequences;
+  vector<string> batchNames;
+  vector< vector<PeptideInfo> > batchPeptides;
+  vector< vector<FLOAT_T> > batchMasses;
+  bool moreProteins = true;
+  while (moreProteins) {
+    batchSequences.clear();
+    batchNames.clear();
+    size_t batchResidues = 0;
+    while (batchResidues < DIGEST_BATCH_RESIDUES &&
+           (moreProteins = GeneratePeptides::getNextProtein(
+              fastaStream, &proteinName, proteinSequence))) {
+      batchSequences.push_back(proteinSequence);
+      batchNames.push_back(proteinName);
+      batchResidues += proteinSequence->length();
+      proteinSequence = new string;
+    }
+    batchPeptides.assign(batchSequences.size(), vector<PeptideInfo>());
+    batchMasses.assign(batchSequences.size(), vector<FLOAT_T>());
+    if (numThreads > 1 && batchSequences.size() > 1) {
+      boost::thread_group threads;
+      for (int t = 0; t < numThreads; t++) {
+        threads.create_thread(boost::bind(&TideIndexApplication::digestProteins,
+          &digestSettings, &batchSequences, t, numThreads, &batchPeptides,
+          &batchMasses));
       }
-      // Add target to heap
-      TideIndexPeptide pepTarget(
-        pepMass, i->Length(), proteinSequence, curProtein, i->Position(), false);
-      outPeptideHeap.push_back(pepTarget);
-      push_heap(outPeptideHeap.begin(), outPeptideHeap.end(), greater<TideIndexPeptide>());
-      if (!allowDups && decoyType != NO_DECOYS) {
-        const string* setTarget = &*(setTargets.insert(i->Sequence()).first);
-        targetInfo.insert(make_pair(setTarget, TargetInfo(proteinInfo, i->Position(), pepMass)));
+      threads.join_all();
+    } else {
+      digestProteins(&digestSettings, &batchSequences, 0, 1, &batchPeptides,
+                     &batchMasses);
+    }
+
+    for (size_t b = 0; b < batchSequences.size(); b++) {
+      string* curSequence = batchSequences[b];
+      outProteinSequences.push_back(curSequence);
+      cleavedPeptideInfo.push_back(make_pair(
+        ProteinInfo(batchNames[b], curSequence), vector<PeptideInfo>()));
+      const ProteinInfo& proteinInfo = cleavedPeptideInfo.back().first;
+      vector<PeptideInfo>& cleavedPeptides = cleavedPeptideInfo.back().second;
+      cleavedPeptides.swap(batchPeptides[b]);
+      const vector<FLOAT_T>& masses = batchMasses[b];
+      // Write pb::Protein
+      getPbProtein(++curProtein, batchNames[b], *curSequence, pbProtein);
+      proteinWriter.Write(&pbProtein);
+      // Iterate over all generated peptides for this protein. Peptides with
+      // invalid characters were given a negative mass.
+      vector<PeptideInfo>::iterator keep = cleavedPeptides.begin();
+      for (size_t j = 0; j < masses.size(); j++) {
+        const PeptideInfo& cleaved = cleavedPeptides[j];
+        FLOAT_T pepMass = masses[j];
+        if (pepMass < 0.0) {
+          // Sequence contained some invalid character
+          carp(CARP_DEBUG, "Ignoring invalid sequence <%s>", cleaved.Sequence().c_str());
+          ++invalidPepCnt;
+          continue;
+        }
+        if (&*keep != &cleaved) {
+          *keep = cleaved;
+        }
+        ++keep;
+        if (pepMass < minMass || pepMass > maxMass) {
+          // Skip to next peptide if not in mass range
+          continue;
+        }
+        // Add target
+        TideIndexPeptide pepTarget(
+          pepMass, cleaved.Length(), curSequence, curProtein, cleaved.Position(), false);
+        outPeptides.push(pepTarget);
+        if (!allowDups && decoyType != NO_DECOYS) {
+          const string* setTarget = &*(setTargets.insert(cleaved.Sequence()).first);
+          targetInfo.insert(make_pair(setTarget, TargetInfo(proteinInfo, cleaved.Position(), pepMass)));
+        }
+        ++targetsGenerated;
       }
-      ++targetsGenerated;
-      ++i;
+      cleavedPeptides.erase(keep, cleavedPeptides.end());
     }
-    proteinSequence = new string;
   }
   delete proteinSequence;
   if (targetsGenerated == 0) {
@@ -530,7 +643,7 @@ void TideIndexApplication::fastaToPb(
 	FLOAT_T pepMass = targetLookup->second.mass;
 	if(generateCustomDecoy(setTargetString, targetToDecoy, &setTargets, &setDecoys, allowDups, failedDecoyCnt,
 			 decoysGenerated, curProtein, proteinInfo, startLoc, pbProtein,
-			 pepMass, outPeptideHeap, outProteinSequences)) {
+			 pepMass, outPeptides, outProteinSequences)) {
 	  proteinWriter.Write(&pbProtein);
 	} else {
 	  continue;
@@ -575,12 +688,10 @@ void TideIndexApplication::fastaToPb(
         getDecoyPbProtein(++curProtein, ProteinInfo(i->first.name, &decoyProtein),
                           *decoySequence, j->Position(), pbProtein);
         proteinWriter.Write(&pbProtein);
-        // Add decoy to heap
+        // Add decoy
         TideIndexPeptide pepDecoy(pepMass, j->Length(), decoySequence,
           curProtein, (j->Position() > 0) ? 1 : 0, true);
-        outPeptideHeap.push_back(pepDecoy);
-        push_heap(outPeptideHeap.begin(), outPeptideHeap.end(),
-          greater<TideIndexPeptide>());
+        outPeptides.push(pepDecoy);
         ++decoysGenerated;
       }
     }
@@ -596,7 +707,7 @@ void TideIndexApplication::fastaToPb(
       FLOAT_T pepMass = targetLookup->second.mass;
       if(generateDecoy(*setTarget, targetToDecoy, &setTargets, &setDecoys, decoyType, allowDups, failedDecoyCnt,
                     decoysGenerated, curProtein, proteinInfo, startLoc, pbProtein,
-                    pepMass, outPeptideHeap, outProteinSequences)) {
+                    pepMass, outPeptides, outProteinSequences)) {
         proteinWriter.Write(&pbProtein);
       } else {
         continue;
@@ -616,7 +727,7 @@ void TideIndexApplication::fastaToPb(
         FLOAT_T pepMass = calcPepMassTide(j->Sequence(), massType);
         if(generateDecoy(setTarget, targetToDecoy, NULL, NULL, decoyType, allowDups, failedDecoyCnt,
                       decoysGenerated, curProtein, proteinInfo, startLoc, pbProtein,
-                      pepMass, outPeptideHeap, outProteinSequences)) {
+                      pepMass, outPeptides, outProteinSequences)) {
           proteinWriter.Write(&pbProtein);
         } else {
           continue;
@@ -660,7 +771,7 @@ void TideIndexApplication::fastaToPb(
 }
 
 void TideIndexApplication::writePeptidesAndAuxLocs(
-  vector<TideIndexPeptide>& peptideHeap,
+  PeptideSorter& peptides,
   const string& peptidePbFile,
   const string& auxLocsPbFile,
   pb::Header& pbHeader
@@ -722,19 +833,18 @@ void TideIndexApplication::writePeptidesAndAuxLocs(
   pb::Peptide pbPeptide;
   pb::AuxLocation pbAuxLoc;
   int auxLocIdx = -1;
-  carp(CARP_DEBUG, "%d peptides in heap", peptideHeap.size());
+  carp(CARP_DEBUG, "%llu peptides to sort", (unsigned long long)peptides.size());
   int count = 0;
-  sort_heap(peptideHeap.begin(), peptideHeap.end(),
-            greater<TideIndexPeptide>());
-  while (!peptideHeap.empty()) {
-    TideIndexPeptide curPeptide(peptideHeap.back());
-    peptideHeap.pop_back();
+  TideIndexPeptide curPeptide, nextPeptide;
+  bool haveNext = peptides.next(&nextPeptide);
+  while (haveNext) {
+    curPeptide = nextPeptide;
     // For duplicate peptides we only record the location
-    while (!peptideHeap.empty() && peptideHeap.back() == curPeptide) {
+    while ((haveNext = peptides.next(&nextPeptide)) &&
+           nextPeptide == curPeptide) {
       pb::Location* location = pbAuxLoc.add_location();
-      location->set_protein_id(peptideHeap.back().getProteinId());
-      location->set_pos(peptideHeap.back().getProteinPos());
-      peptideHeap.pop_back();
+      location->set_protein_id(nextPeptide.getProteinId());
+      location->set_pos(nextPeptide.getProteinPos());
     }
     getPbPeptide(count, curPeptide, pbPeptide);
     // Not all peptides have aux locations associated with them. Check to see
@@ -862,6 +972,333 @@ void TideIndexApplication::addAuxLoc(
   location->set_pos(proteinPos);
 }
 
+void TideIndexApplication::digestProteins(
+  const DigestSettings* settings,
+  const vector<string*>* sequences,
+  int thread,
+  int numThreads,
+  vector< vector<GeneratePeptides::CleavedPeptide> >* outPeptides,
+  vector< vector<FLOAT_T> >* outMasses
+) {
+  Telemetry::Thread telemetry_thread("digest-" + StringUtils::ToString(thread));
+  Telemetry::Scope scope(Telemetry::DIGEST);
+  for (size_t i = thread; i < sequences->size(); i += numThreads) {
+    vector<GeneratePeptides::CleavedPeptide>& peptides = (*outPeptides)[i];
+    peptides = GeneratePeptides::cleaveProtein(
+      *(*sequences)[i], settings->enzyme, settings->digestion,
+      settings->missedCleavages, settings->minLength, settings->maxLength);
+    vector<FLOAT_T>& masses = (*outMasses)[i];
+    masses.reserve(peptides.size());
+    for (vector<GeneratePeptides::CleavedPeptide>::const_iterator j = peptides.begin();
+         j != peptides.end();
+         ++j) {
+      masses.push_back(calcPepMassTide(j->Sequence(), settings->massType));
+    }
+    Telemetry::Count(Telemetry::PEPTIDES, peptides.size());
+  }
+}
+
+TideIndexApplication::PeptideSorter::PeptideSorter(
+  const vector<string*>& proteinSequences,
+  const string& tempPrefix,
+  size_t maxBytes,
+  int numThreads
+) : proteinSequences_(proteinSequences), tempPrefix_(tempPrefix),
+    maxPeptides_(maxBytes / sizeof(TideIndexPeptide)),
+    numThreads_(max(numThreads, 1)), size_(0), bufferPos_(0), runCount_(0),
+    merging_(false) {
+  if (maxBytes > 0 && maxPeptides_ < SORT_RUN_BUFFER) {
+    maxPeptides_ = SORT_RUN_BUFFER;
+  }
+}
+
+TideIndexApplication::PeptideSorter::~PeptideSorter() {
+  for (size_t i = 0; i < runs_.size(); i++) {
+    if (runs_[i].file) {
+      fclose(runs_[i].file);
+    }
+  }
+  for (size_t i = 0; i < runFiles_.size(); i++) {
+    remove(runFiles_[i].c_str());
+  }
+}
+
+void TideIndexApplication::PeptideSorter::push(const TideIndexPeptide& peptide) {
+  if (merging_) {
+    carp(CARP_FATAL, "Peptide added after sorting began");
+  }
+  buffer_.push_back(peptide);
+  ++size_;
+  if (maxPeptides_ > 0 && buffer_.size() >= maxPeptides_) {
+    spill();
+  }
+}
+
+void TideIndexApplication::PeptideSorter::sortRange(Iter begin, Iter end) {
+  stable_sort(begin, end);
+}
+
+void TideIndexApplication::PeptideSorter::mergeRanges(
+  Iter begin,
+  Iter middle,
+  Iter end
+) {
+  inplace_merge(begin, middle, end);
+}
+
+/**
+ * Sort buffer_ with numThreads_ threads: each sorts a slice, and then the
+ * slices are merged pairwise, again in parallel, until one remains. Both
+ * steps are stable, so duplicates keep the order they were pushed in
+ * whatever the number of threads.
+ */
+void TideIndexApplication::PeptideSorter::sortBuffer() {
+  Telemetry::Scope scope(Telemetry::PEPTIDE_SORT);
+  size_t n = buffer_.size();
+  size_t slices = min((size_t)numThreads_, max(n / SORT_RUN_BUFFER, (size_t)1));
+  if (slices <= 1) {
+    stable_sort(buffer_.begin(), buffer_.end());
+    return;
+  }
+  vector<Iter> bounds;
+  for (size_t i = 0; i <= slices; i++) {
+    bounds.push_back(buffer_.begin() + n * i / slices);
+  }
+  boost::thread_group sorters;
+  for (size_t i = 0; i < slices; i++) {
+    sorters.create_thread(boost::bind(&PeptideSorter::sortRange, bounds[i], bounds[i + 1]));
+  }
+  sorters.join_all();
+  while (bounds.size() > 2) {
+    vector<Iter> merged;
+    boost::thread_group mergers;
+    size_t i = 0;
+    for (; i + 2 < bounds.size(); i += 2) {
+      mergers.create_thread(boost::bind(&PeptideSorter::mergeRanges,
+                                        bounds[i], bounds[i + 1], bounds[i + 2]));
+      merged.push_back(bounds[i]);
+    }
+    mergers.join_all();
+    for (; i < bounds.size(); i++) {
+      merged.push_back(bounds[i]);
+    }
+    bounds.swap(merged);
+  }
+}
+
+/**
+ * Sort buffer_ as tide-index did before it could write sorted runs: the
+ * peptides go on a heap in the order they were pushed, and the heap is
+ * sorted. Duplicates, and so the locations written for them, then come out
+ * in the same order as in indexes built before.
+ */
+void TideIndexApplication::PeptideSorter::heapSortBuffer() {
+  Telemetry::Scope scope(Telemetry::PEPTIDE_SORT);
+  for (Iter i = buffer_.begin(); i != buffer_.end(); ) {
+    push_heap(buffer_.begin(), ++i, greater<TideIndexPeptide>());
+  }
+  sort_heap(buffer_.begin(), buffer_.end(), greater<TideIndexPeptide>());
+  reverse(buffer_.begin(), buffer_.end());
+}
+
+FILE* TideIndexApplication::PeptideSorter::createRun(string* outFile) {
+  *outFile = tempPrefix_ + ".run" + StringUtils::ToString(runCount_++) + ".tmp";
+  FILE* file = fopen(outFile->c_str(), "wb");
+  if (file == NULL) {
+    carp(CARP_FATAL, "Could not open %s for writing", outFile->c_str());
+  }
+  runFiles_.push_back(*outFile);
+  return file;
+}
+
+void TideIndexApplication::PeptideSorter::writeRecords(
+  FILE* file,
+  const string& runFile,
+  const vector<RunRecord>& records
+) {
+  if (!records.empty() &&
+      fwrite(&records[0], sizeof(RunRecord), records.size(), file) != records.size()) {
+    carp(CARP_FATAL, "Error writing to %s", runFile.c_str());
+  }
+}
+
+TideIndexApplication::PeptideSorter::RunRecord
+TideIndexApplication::PeptideSorter::toRecord(const TideIndexPeptide& peptide) {
+  RunRecord record;
+  record.mass = peptide.getMass();
+  record.length = peptide.getLength();
+  record.proteinId = peptide.getProteinId();
+  record.proteinPos = peptide.getProteinPos();
+  record.decoy = peptide.isDecoy() ? 1 : 0;
+  return record;
+}
+
+/**
+ * Write the peptides in memory to a new sorted run.
+ */
+void TideIndexApplication::PeptideSorter::spill() {
+  sortBuffer();
+  string runFile;
+  FILE* file = createRun(&runFile);
+  vector<RunRecord> records;
+  records.reserve(SORT_RUN_BUFFER);
+  for (size_t i = 0; i < buffer_.size(); ) {
+    records.clear();
+    for (; i < buffer_.size() && records.size() < SORT_RUN_BUFFER; i++) {
+      records.push_back(toRecord(buffer_[i]));
+    }
+    writeRecords(file, runFile, records);
+  }
+  if (fclose(file) != 0) {
+    carp(CARP_FATAL, "Error writing to %s", runFile.c_str());
+  }
+  carp(CARP_DEBUG, "Wrote %d peptides to sorted run %s", buffer_.size(), runFile.c_str());
+  buffer_.clear();
+}
+
+void TideIndexApplication::PeptideSorter::openRuns(const vector<string>& runFiles) {
+  runs_.resize(runFiles.size());
+  for (size_t i = 0; i < runs_.size(); i++) {
+    runs_[i].file = fopen(runFiles[i].c_str(), "rb");
+    if (runs_[i].file == NULL) {
+      carp(CARP_FATAL, "Could not open %s for reading", runFiles[i].c_str());
+    }
+    runs_[i].buffer.clear();
+    runs_[i].pos = 0;
+  }
+  mergeHeap_.clear();
+  for (int source = 0; source < (int)runs_.size(); source++) {
+    TideIndexPeptide peptide;
+    if (readNext(source, &peptide)) {
+      mergeHeap_.push_back(MergeItem(peptide, source));
+    }
+  }
+  make_heap(mergeHeap_.begin(), mergeHeap_.end(), MergeGreater());
+}
+
+/**
+ * Merge each group of MAX_MERGE_RUNS consecutive sorted runs into a single
+ * new run, keeping the runs in order, so that fewer files need be open at
+ * once and duplicates keep the order they were pushed in.
+ */
+void TideIndexApplication::PeptideSorter::collapseRuns() {
+  Telemetry::Scope scope(Telemetry::PEPTIDE_SORT);
+  vector<string> allInputs;
+  allInputs.swap(runFiles_);
+  for (size_t begin = 0; begin < allInputs.size(); begin += MAX_MERGE_RUNS) {
+    size_t end = min(begin + MAX_MERGE_RUNS, allInputs.size());
+    if (end - begin == 1) {
+      runFiles_.push_back(allInputs[begin]);
+      continue;
+    }
+    vector<string> inputs(allInputs.begin() + begin, allInputs.begin() + end);
+    openRuns(inputs);
+    string runFile;
+    FILE* file = createRun(&runFile);
+    vector<RunRecord> records;
+    records.reserve(SORT_RUN_BUFFER);
+    TideIndexPeptide peptide;
+    bool more = true;
+    while (more) {
+      records.clear();
+      while (records.size() < SORT_RUN_BUFFER && (more = popNext(&peptide))) {
+        records.push_back(toRecord(peptide));
+      }
+      writeRecords(file, runFile, records);
+    }
+    if (fclose(file) != 0) {
+      carp(CARP_FATAL, "Error writing to %s", runFile.c_str());
+    }
+    runs_.clear();
+    for (size_t i = 0; i < inputs.size(); i++) {
+      remove(inputs[i].c_str());
+    }
+  }
+}
+
+void TideIndexApplication::PeptideSorter::startMerge() {
+  merging_ = true;
+  bufferPos_ = 0;
+  if (runFiles_.empty()) {
+    heapSortBuffer();
+  } else {
+    sortBuffer();
+    carp(CARP_INFO, "Merging %d sorted runs of peptides", runFiles_.size() + 1);
+  }
+  while (runFiles_.size() > MAX_MERGE_RUNS) {
+    collapseRuns();
+  }
+  openRuns(runFiles_);
+  // The buffer holds the latest peptides, so it is the last source.
+  int source = runs_.size();
+  TideIndexPeptide peptide;
+  if (readNext(source, &peptide)) {
+    mergeHeap_.push_back(MergeItem(peptide, source));
+    push_heap(mergeHeap_.begin(), mergeHeap_.end(), MergeGreater());
+  }
+}
+
+/**
+ * Read the next peptide of a source: runs_[source], or the buffer in memory
+ * if source is past the runs.
+ */
+bool TideIndexApplication::PeptideSorter::readNext(
+  int source,
+  TideIndexPeptide* outPeptide
+) {
+  if (source >= (int)runs_.size()) {
+    if (bufferPos_ >= buffer_.size()) {
+      vector<TideIndexPeptide>().swap(buffer_);
+      return false;
+    }
+    *outPeptide = buffer_[bufferPos_++];
+    return true;
+  }
+  Run& run = runs_[source];
+  if (run.pos >= run.buffer.size()) {
+    run.buffer.resize(SORT_RUN_BUFFER);
+    size_t n = run.file ?
+      fread(&run.buffer[0], sizeof(RunRecord), SORT_RUN_BUFFER, run.file) : 0;
+    run.buffer.resize(n);
+    run.pos = 0;
+    if (n == 0) {
+      if (run.file) {
+        fclose(run.file);
+        run.file = NULL;
+      }
+      return false;
+    }
+  }
+  const RunRecord& record = run.buffer[run.pos++];
+  *outPeptide = TideIndexPeptide(record.mass, record.length,
+                                 proteinSequences_[record.proteinId],
+                                 record.proteinId, record.proteinPos,
+                                 record.decoy != 0);
+  return true;
+}
+
+bool TideIndexApplication::PeptideSorter::popNext(TideIndexPeptide* outPeptide) {
+  if (mergeHeap_.empty()) {
+    return false;
+  }
+  pop_heap(mergeHeap_.begin(), mergeHeap_.end(), MergeGreater());
+  MergeItem& item = mergeHeap_.back();
+  *outPeptide = item.first;
+  if (readNext(item.second, &item.first)) {
+    push_heap(mergeHeap_.begin(), mergeHeap_.end(), MergeGreater());
+  } else {
+    mergeHeap_.pop_back();
+  }
+  return true;
+}
+
+bool TideIndexApplication::PeptideSorter::next(TideIndexPeptide* outPeptide) {
+  if (!merging_) {
+    startMerge();
+  }
+  return popNext(outPeptide);
+}
+
 void TideIndexApplication::processParams() {
   // Update mods-spec parameter for default cysteine mod
   string default_cysteine = "C+" + StringUtils::ToString(CYSTEINE_DEFAULT);
@@ -930,7 +1367,7 @@ bool TideIndexApplication::generateDecoy(
   const int startLoc,
   pb::Protein& pbProtein,
   FLOAT_T pepMass,
-  vector<TideIndexPeptide>& outPeptideHeap,
+  PeptideSorter& outPeptides,
   vector<string*>& outProteinSequences
 ) {
   const map<const string, const string*>::const_iterator decoyCheck =
@@ -966,12 +1403,10 @@ bool TideIndexApplication::generateDecoy(
   // Write pb::Protein
   getDecoyPbProtein(++curProtein, proteinInfo, *decoySequence,
                     startLoc, pbProtein);
-  // Add decoy to heap
+  // Add decoy
   TideIndexPeptide pepDecoy(
               pepMass, setTarget.length(), decoySequence, curProtein, (startLoc > 0) ? 1 : 0, true);
-  outPeptideHeap.push_back(pepDecoy);
-  push_heap(outPeptideHeap.begin(), outPeptideHeap.end(),
-    greater<TideIndexPeptide>());
+  outPeptides.push(pepDecoy);
   ++decoysGenerated;
   return true;
 }
@@ -1055,7 +1490,7 @@ bool TideIndexApplication::generateCustomDecoy(
   const int startLoc,
   pb::Protein& pbProtein,
   FLOAT_T pepMass,
-  vector<TideIndexPeptide>& outPeptideHeap,
+  PeptideSorter& outPeptides,
   vector<string*>& outProteinSequences
 ) {
   const map<const string, const string*>::const_iterator decoyCheck =
@@ -1077,12 +1512,10 @@ bool TideIndexApplication::generateCustomDecoy(
   // Write pb::Protein
   getDecoyPbProtein(++curProtein, proteinInfo, *decoySequence,
                     startLoc, pbProtein);
-  // Add decoy to heap
+  // Add decoy
   TideIndexPeptide pepDecoy(
               pepMass, setTarget.length(), decoySequence, curProtein, (startLoc > 0) ? 1 : 0, true);
-  outPeptideHeap.push_back(pepDecoy);
-  push_heap(outPeptideHeap.begin(), outPeptideHeap.end(),
-    greater<TideIndexPeptide>());
+  outPeptides.push(pepDecoy);
   ++decoysGenerated;
   return true;
 }
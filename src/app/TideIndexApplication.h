@@ -5,6 +5,7 @@
 
 #include <sys/stat.h>
 #include <sys/wait.h>
+#include <cstdio>
 #include <cstring>
 #include <unistd.h>
 #ifndef _MSC_VER
@@ -13,6 +14,7 @@
 #include <errno.h>
 #include <gflags/gflags.h>
 #include "header.pb.h"
+#include "GeneratePeptides.h"
 #include "tide/records.h"
 #include "tide/peptide.h"
 #include "tide/theoretical_peak_set.h"
@@ -115,22 +117,26 @@ class TideIndexApplication : public CruxApplication {
     string getSequence() const { return string(residues_, length_); }
     bool isDecoy() const { return decoy_; }
 
-    friend bool operator >(
+    friend bool operator <(
       const TideIndexPeptide& lhs, const TideIndexPeptide& rhs) {
       if (&lhs == &rhs) {
         return false;
       } else if (lhs.mass_ != rhs.mass_) {
-        return lhs.mass_ > rhs.mass_;
+        return lhs.mass_ < rhs.mass_;
       } else if (lhs.length_ != rhs.length_) {
-        return lhs.length_ > rhs.length_;
+        return lhs.length_ < rhs.length_;
       } else {
         int strncmpResult = strncmp(lhs.residues_, rhs.residues_, lhs.length_);
         if (strncmpResult != 0) {
-          return strncmpResult > 0;
+          return strncmpResult < 0;
         }
       }
       return false;
     }
+    friend bool operator >(
+      const TideIndexPeptide& lhs, const TideIndexPeptide& rhs) {
+      return rhs < lhs;
+    }
     friend bool operator ==(
       const TideIndexPeptide& lhs, const TideIndexPeptide& rhs) {
       return (lhs.mass_ == rhs.mass_ && lhs.length_ == rhs.length_ &&
@@ -138,6 +144,91 @@ class TideIndexApplication : public CruxApplication {
     }
   };
 
+  /**
+   * Collects peptides in any order and hands them back sorted. Peptides are
+   * held in memory until they exceed a budget; then they are sorted, using
+   * several threads, and written to a temporary file as a sorted run. The
+   * runs and the peptides left in memory are merged as they are read back.
+   *
+   * If nothing was written to a run, the peptides are heap sorted as they
+   * always were, so duplicates come back in the same order as before. Once
+   * runs are written, duplicates come back in the order they were pushed.
+   */
+  class PeptideSorter {
+   public:
+    PeptideSorter(
+      const std::vector<string*>& proteinSequences, ///< indexed by protein id
+      const std::string& tempPrefix, ///< path prefix for the sorted runs
+      size_t maxBytes, ///< memory budget for peptides, 0 for no limit
+      int numThreads
+    );
+    ~PeptideSorter();
+
+    void push(const TideIndexPeptide& peptide);
+    uint64_t size() const { return size_; }
+
+    /**
+     * Returns the next peptide in sorted order, or false if there are none
+     * left. No more peptides may be pushed after the first call.
+     */
+    bool next(TideIndexPeptide* outPeptide);
+
+   private:
+    struct RunRecord {
+      double mass;
+      int length;
+      int proteinId;
+      int proteinPos;
+      int decoy;
+    };
+    struct Run {
+      FILE* file;
+      std::vector<RunRecord> buffer;
+      size_t pos;
+    };
+    typedef std::pair<TideIndexPeptide, int> MergeItem; // peptide, source
+
+    struct MergeGreater {
+      bool operator()(const MergeItem& lhs, const MergeItem& rhs) const {
+        if (rhs.first < lhs.first) {
+          return true;
+        } else if (lhs.first < rhs.first) {
+          return false;
+        }
+        return lhs.second > rhs.second; // earlier sources first
+      }
+    };
+
+    typedef std::vector<TideIndexPeptide>::iterator Iter;
+    static RunRecord toRecord(const TideIndexPeptide& peptide);
+    static void sortRange(Iter begin, Iter end);
+    static void mergeRanges(Iter begin, Iter middle, Iter end);
+    void sortBuffer();
+    void heapSortBuffer();
+    void spill();
+    FILE* createRun(std::string* outFile);
+    void writeRecords(FILE* file, const std::string& runFile,
+                      const std::vector<RunRecord>& records);
+    void openRuns(const std::vector<std::string>& runFiles);
+    void collapseRuns();
+    void startMerge();
+    bool popNext(TideIndexPeptide* outPeptide);
+    bool readNext(int source, TideIndexPeptide* outPeptide);
+
+    const std::vector<string*>& proteinSequences_;
+    std::string tempPrefix_;
+    size_t maxPeptides_;
+    int numThreads_;
+    uint64_t size_;
+    std::vector<TideIndexPeptide> buffer_;
+    size_t bufferPos_;
+    std::vector<std::string> runFiles_;
+    int runCount_;
+    std::vector<Run> runs_;
+    std::vector<MergeItem> mergeHeap_;
+    bool merging_;
+  };
+
   struct ProteinInfo {
     string name;
     const string* sequence;
@@ -169,18 +260,41 @@ class TideIndexApplication : public CruxApplication {
     const std::string& fasta,
     const std::string& proteinPbFile,
     pb::Header& outProteinPbHeader,
-    std::vector<TideIndexPeptide>& outPeptideHeap,
+    PeptideSorter& outPeptides,
     std::vector<string*>& outProteinSequences,
-    std::ofstream* decoyFasta
+    std::ofstream* decoyFasta,
+    int numThreads
   );
 
   static void writePeptidesAndAuxLocs(
-    std::vector<TideIndexPeptide>& peptideHeap, // will be destroyed.
+    PeptideSorter& peptides, // will be emptied
     const std::string& peptidePbFile,
     const std::string& auxLocsPbFile,
     pb::Header& pbHeader
   );
 
+  /**
+   * Cleaves the proteins of a batch read from the FASTA file, and computes the
+   * mass of each peptide. Thread i handles every numThreads-th protein.
+   */
+  struct DigestSettings {
+    ENZYME_T enzyme;
+    DIGEST_T digestion;
+    int missedCleavages;
+    int minLength;
+    int maxLength;
+    MASS_TYPE_T massType;
+  };
+
+  static void digestProteins(
+    const DigestSettings* settings,
+    const std::vector<string*>* sequences,
+    int thread,
+    int numThreads,
+    std::vector< std::vector<GeneratePeptides::CleavedPeptide> >* outPeptides,
+    std::vector< std::vector<FLOAT_T> >* outMasses
+  );
+
   static FLOAT_T calcPepMassTide(
     const std::string& sequence,
     MASS_TYPE_T massType
@@ -231,7 +345,7 @@ class TideIndexApplication : public CruxApplication {
     const int startLoc,
     pb::Protein& pbProtein,
     FLOAT_T pepMass,
-    vector<TideIndexPeptide>& outPeptideHeap,
+    PeptideSorter& outPeptides,
     vector<string*>& outProteinSequences
   );
   static bool generateCustomDecoy(
@@ -247,7 +361,7 @@ class TideIndexApplication : public CruxApplication {
   const int startLoc,
   pb::Protein& pbProtein,
   FLOAT_T pepMass,
-  vector<TideIndexPeptide>& outPeptideHeap,
+  PeptideSorter& outPeptides,
   vector<string*>& outProteinSequences
 					   );
   //this needs to be static, since fastatopb is static
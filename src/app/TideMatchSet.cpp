@@ -1,10 +1,10 @@
 /*
  * There are two versions of the report function, which writes matches to output
- * files. The first version, which takes ofstreams as arguments, is used when
- * only tab-delimited output is required. It does not perform any object
- * conversions. The second version takes an OutputFiles object as an argument
- * and is used when any non-tab-delimited output is required. It must convert
- * the data from Tide into Crux objects, which increases runtime.
+ * files: one for peptide-centric and one for spectrum-centric search. Both
+ * write tab-delimited text without any object conversions. When other formats
+ * are requested, the spectrum-centric version also converts the matches from
+ * Tide into Crux objects and passes them to a TideMatchWriter, which increases
+ * runtime.
  */
 
 #include <fstream>
@@ -12,7 +12,12 @@
 
 #include "TideIndexApplication.h"
 #include "TideMatchSet.h"
+#include "TideMatchWriter.h"
 #include "TideSearchApplication.h"
+#include "model/Match.h"
+#include "model/MatchCollection.h"
+#include "tide/telemetry.h"
+#include "util/GlobalParams.h"
 #include "util/Params.h"
 #include "util/StringUtils.h"
 
@@ -20,12 +25,16 @@ string TideMatchSet::CleavageType;
 char TideMatchSet::match_collection_loc_[] = {0};
 char TideMatchSet::decoy_match_collection_loc_[] = {0};
 
-TideMatchSet::TideMatchSet(Arr* matches, double max_mz)
-  : matches_(matches), max_mz_(max_mz), exact_pval_search_(false), elution_window_(0) {
+TideMatchSet::TideMatchSet(Arr* matches, double max_mz, const SearchConfig& config)
+  : exact_pval_search_(false), elution_window_(0),
+    target_writer_(NULL), decoy_writer_(NULL), buffered_output_(false),
+    matches_(matches), max_mz_(max_mz), config_(config) {
 }
 
-TideMatchSet::TideMatchSet(Peptide* peptide, double max_mz)
-  : peptide_(peptide), max_mz_(max_mz), exact_pval_search_(false), elution_window_(0) {
+TideMatchSet::TideMatchSet(Peptide* peptide, double max_mz, const SearchConfig& config)
+  : exact_pval_search_(false), elution_window_(0),
+    target_writer_(NULL), decoy_writer_(NULL), buffered_output_(false),
+    peptide_(peptide), max_mz_(max_mz), config_(config) {
 }
 
 TideMatchSet::~TideMatchSet() {
@@ -36,8 +45,8 @@ TideMatchSet::~TideMatchSet() {
  * This is for writing tab-delimited only
  */
 void TideMatchSet::report(
-  ofstream* target_file,  ///< target file to write to
-  ofstream* decoy_file, ///< decoy file to write to
+  ostream* target_file,  ///< target file to write to
+  ostream* decoy_file, ///< decoy file to write to
   int top_matches,
   const ActivePeptideQueue* peptides, ///< peptide queue
   const ProteinVec& proteins, ///< proteins corresponding with peptides
@@ -47,6 +56,7 @@ void TideMatchSet::report(
   if (peptide_->spectrum_matches_array.size() == 0) {
     return;
   }
+  Telemetry::Scope scope(Telemetry::RESULT_FORMAT);
 
   carp(CARP_DETAILED_DEBUG, "TideMatchSet reporting top %d of %d peptide centric matches",
        top_matches, peptide_->spectrum_matches_array.size());
@@ -140,8 +150,8 @@ void TideMatchSet::report(
     }
   }
   // target peptide or concat search
-  ofstream* file =
-    (Params::GetBool("concat") || !peptide_->IsDecoy()) ? target_file : decoy_file;
+  ostream* file =
+    (config_.concat || !peptide_->IsDecoy()) ? target_file : decoy_file;
   writeToFile(file, peptides, proteins, locations, compute_sp);
 }
 
@@ -149,7 +159,7 @@ void TideMatchSet::report(
  * Helper function for tab delimited report function for peptide centric search
  */
 void TideMatchSet::writeToFile(
-  ofstream* file,
+  ostream* file,
   const ActivePeptideQueue* peptides,
   const ProteinVec& proteins,
   const vector<const pb::AuxLocation*>& locations,
@@ -169,7 +179,7 @@ void TideMatchSet::writeToFile(
   getFlankingAAs(peptide, protein, pos, &n_term, &c_term);
   flankingAAs = n_term + c_term;
 
-  int precision = Params::GetInt("precision");
+  int precision = config_.precision;
 
   // look for other locations
   if (peptide->HasAuxLocationsIndex()) {
@@ -223,7 +233,7 @@ void TideMatchSet::writeToFile(
     }
     *file << i->score3_ << '\t';
 
-    if (Params::GetBool("concat")) {
+    if (config_.concat) {
       *file << peptides->ActiveTargets() + peptides->ActiveDecoys() << '\t';
     } else {
       *file << (!peptide->IsDecoy() ? peptides->ActiveTargets() : peptides->ActiveDecoys()) << '\t';
@@ -239,7 +249,7 @@ void TideMatchSet::writeToFile(
       const string& residues = protein->residues();
       *file << '\t'
             << residues.substr(residues.length() - peptide->Len());
-    } else if (Params::GetBool("concat") && !TideSearchApplication::proteinLevelDecoys()) {
+    } else if (config_.concat && !TideSearchApplication::proteinLevelDecoys()) {
       *file << '\t'
             << cruxPep.getUnshuffledSequence();
     }
@@ -252,8 +262,8 @@ void TideMatchSet::writeToFile(
  * This is for writing tab-delimited only
  */
 void TideMatchSet::report(
-  ofstream* target_file,  ///< target file to write to
-  ofstream* decoy_file, ///< decoy file to write to
+  ostream* target_file,  ///< target file to write to
+  ostream* decoy_file, ///< decoy file to write to
   int top_n,  ///< number of matches to report
   const string& spectrum_filename, ///< name of spectrum file
   const Spectrum* spectrum, ///< spectrum for matches
@@ -268,6 +278,7 @@ void TideMatchSet::report(
   if (matches_->size() == 0) {
     return;
   }
+  Telemetry::Scope scope(Telemetry::RESULT_FORMAT);
 
   carp(CARP_DETAILED_DEBUG, "Tide MatchSet reporting top %d of %d matches",
        top_n, matches_->size());
@@ -277,8 +288,8 @@ void TideMatchSet::report(
 
   map<Arr::iterator, FLOAT_T> delta_cn_map;
   map<Arr::iterator, FLOAT_T> delta_lcn_map;
-  computeDeltaCns(targets, &delta_cn_map, &delta_lcn_map);
-  computeDeltaCns(decoys, &delta_cn_map, &delta_lcn_map);
+  computeDeltaCns(targets, &delta_cn_map, &delta_lcn_map, config_.exact_p_value);
+  computeDeltaCns(decoys, &delta_cn_map, &delta_lcn_map, config_.exact_p_value);
 
   map<Arr::iterator, pair<const SpScorer::SpScoreData, int> > sp_map;
   if (compute_sp) {
@@ -286,19 +297,27 @@ void TideMatchSet::report(
     computeSpData(targets, &sp_map, &sp_scorer, peptides);
     computeSpData(decoys, &sp_map, &sp_scorer, peptides);
   }
+  boost::mutex* file_lock = buffered_output_ ? NULL : rwlock;
   writeToFile(target_file, top_n, targets, spectrum_filename, spectrum, charge,
               peptides, proteins, locations, delta_cn_map, delta_lcn_map,
-              compute_sp ? &sp_map : NULL, rwlock);
+              compute_sp ? &sp_map : NULL, file_lock);
   writeToFile(decoy_file, top_n, decoys, spectrum_filename, spectrum, charge,
               peptides, proteins, locations, delta_cn_map, delta_lcn_map,
-              compute_sp ? &sp_map : NULL, rwlock);
+              compute_sp ? &sp_map : NULL, file_lock);
+  writeToWriter(target_writer_, top_n, targets, spectrum_filename, spectrum, charge,
+                peptides, proteins, locations, delta_cn_map, delta_lcn_map,
+                compute_sp ? &sp_map : NULL, rwlock);
+  writeToWriter(decoy_writer_, top_n, decoys, spectrum_filename, spectrum, charge,
+                peptides, proteins, locations, delta_cn_map, delta_lcn_map,
+                compute_sp ? &sp_map : NULL, rwlock);
 }
 
 /**
- * Helper function for tab delimited report function
+ * Helper function for tab delimited report function. Each row is written
+ * under rwlock, unless it is NULL.
  */
 void TideMatchSet::writeToFile(
-  ofstream* file,
+  ostream* file,
   int top_n,
   const vector<Arr::iterator>& vec,
   const string& spectrum_filename,
@@ -316,8 +335,8 @@ void TideMatchSet::writeToFile(
     return;
   }
 
-  int massPrecision = Params::GetInt("mass-precision");
-  int precision = Params::GetInt("precision");
+  int massPrecision = config_.mass_precision;
+  int precision = config_.precision;
 
   int cur = 0;
   int concatDistinctMatches = peptides->ActiveTargets() + peptides->ActiveDecoys();
@@ -352,8 +371,10 @@ void TideMatchSet::writeToFile(
     Crux::Peptide cruxPep = getCruxPeptide(peptide);
     const SpScorer::SpScoreData* sp_data = sp_map ? &(sp_map->at(*i).first) : NULL;
 
-    rwlock->lock();
-    if (Params::GetBool("file-column")) {
+    if (rwlock) {
+      Telemetry::Lock(rwlock);
+    }
+    if (config_.file_column) {
       *file << spectrum_filename << '\t';
     }
     *file << spectrum->SpectrumNumber() << '\t'
@@ -402,7 +423,7 @@ void TideMatchSet::writeToFile(
             << sp_data->total_ions << '\t';
     }
 
-    if (Params::GetBool("concat")) {
+    if (config_.concat) {
       *file << concatDistinctMatches << '\t';
     } else {
       *file << (!peptide->IsDecoy() ? peptides->ActiveTargets() : peptides->ActiveDecoys()) << '\t';
@@ -423,13 +444,147 @@ void TideMatchSet::writeToFile(
       const string& residues = protein->residues();
       *file << '\t'
             << residues.substr(residues.length() - peptide->Len());
-    } else if (Params::GetBool("concat") && !TideSearchApplication::proteinLevelDecoys()) {
+    } else if (config_.concat && !TideSearchApplication::proteinLevelDecoys()) {
       *file << '\t'
             << cruxPep.getUnshuffledSequence();
     }
     *file << endl;
-    rwlock->unlock();
+    if (rwlock) {
+      rwlock->unlock();
+    }
+  }
+}
+
+/**
+ * Helper function for writing matches in formats other than tab delimited.
+ * Builds the same Crux objects psm-convert would parse from the tab-delimited
+ * output, but with the proteins taken from the index.
+ */
+void TideMatchSet::writeToWriter(
+  TideMatchWriter* writer,
+  int top_n,
+  const vector<Arr::iterator>& vec,
+  const string& spectrum_filename,
+  const Spectrum* spectrum,
+  int charge,
+  const ActivePeptideQueue* peptides,
+  const ProteinVec& proteins,
+  const vector<const pb::AuxLocation*>& locations,
+  const map<Arr::iterator, FLOAT_T>& delta_cn_map,
+  const map<Arr::iterator, FLOAT_T>& delta_lcn_map,
+  const map<Arr::iterator, pair<const SpScorer::SpScoreData, int> >* sp_map,
+  boost::mutex * rwlock
+) {
+  if (!writer || vec.empty()) {
+    return;
+  }
+  Telemetry::Scope scope(Telemetry::RESULT_WRITE);
+
+  bool concat = config_.concat;
+  int concatDistinctMatches = peptides->ActiveTargets() + peptides->ActiveDecoys();
+  DIGEST_T digestion = GlobalParams::getDigestion();
+  string filename = config_.file_column ? spectrum_filename : "";
+  bool xcorr_pval = (cur_score_function_ == XCORR_SCORE && exact_pval_search_) ||
+    cur_score_function_ == BOTH_SCORE;
+  bool resev_pval = (cur_score_function_ == RESIDUE_EVIDENCE_MATRIX && exact_pval_search_) ||
+    cur_score_function_ == BOTH_SCORE;
+
+  Crux::Spectrum* cruxSpectrum = new Crux::Spectrum(
+    spectrum->SpectrumNumber(), spectrum->SpectrumNumber(), spectrum->PrecursorMZ(),
+    vector<int>(1, charge), filename);
+  SpectrumZState zState((spectrum->PrecursorMZ() - MASS_PROTON) * charge, charge);
+
+  MatchCollection* collection = new MatchCollection();
+  collection->preparePostProcess();
+  collection->setHasDistinctMatches(true);
+  collection->setScoredType(DELTA_CN, true);
+  collection->setScoredType(DELTA_LCN, true);
+  collection->setScoredType(SP, sp_map != NULL);
+  collection->setScoredType(BY_IONS_MATCHED, sp_map != NULL);
+  collection->setScoredType(BY_IONS_TOTAL, sp_map != NULL);
+  collection->setScoredType(XCORR, cur_score_function_ == XCORR_SCORE && !exact_pval_search_);
+  collection->setScoredType(TIDE_SEARCH_EXACT_PVAL, xcorr_pval);
+  collection->setScoredType(TIDE_SEARCH_REFACTORED_XCORR, xcorr_pval);
+  collection->setScoredType(RESIDUE_EVIDENCE_PVAL, resev_pval);
+  collection->setScoredType(RESIDUE_EVIDENCE_SCORE, cur_score_function_ != XCORR_SCORE);
+  collection->setScoredType(BOTH_PVALUE, cur_score_function_ == BOTH_SCORE);
+
+  const vector<Arr::iterator>::const_iterator cutoff =
+    (vec.size() >= top_n) ? vec.begin() + top_n : vec.end();
+
+  // The writer's files and protein cache are shared by all threads.
+  Telemetry::Lock(rwlock);
+  int cur = 0;
+  for (vector<Arr::iterator>::const_iterator i = vec.begin(); i != cutoff; ++i) {
+    const Peptide* peptide = peptides->GetPeptide((*i)->rank);
+    Crux::Peptide* cruxPep = new Crux::Peptide(peptide->Seq(), getMods(peptide));
+    cruxPep->addPeptideSrc(new PeptideSrc(digestion,
+      writer->getProtein(*proteins[peptide->FirstLocProteinId()]),
+      peptide->FirstLocPos() + 1));
+    if (peptide->HasAuxLocationsIndex()) {
+      const pb::AuxLocation* aux = locations[peptide->AuxLocationsIndex()];
+      for (int j = 0; j < aux->location_size(); ++j) {
+        const pb::Location& location = aux->location(j);
+        cruxPep->addPeptideSrc(new PeptideSrc(digestion,
+          writer->getProtein(*proteins[location.protein_id()]), location.pos() + 1));
+      }
+    }
+
+    Crux::Match* match = new Crux::Match(cruxPep, cruxSpectrum, zState, peptide->IsDecoy());
+    if (!filename.empty()) {
+      match->setFilePath(filename);
+    }
+    if (sp_map) {
+      const SpScorer::SpScoreData& sp_data = sp_map->at(*i).first;
+      match->setScore(SP, sp_data.sp_score);
+      match->setRank(SP, sp_map->at(*i).second);
+      match->setScore(BY_IONS_MATCHED, sp_data.matched_ions);
+      match->setScore(BY_IONS_TOTAL, sp_data.total_ions);
+    } else {
+      match->setScore(SP, NOT_SCORED);
+      match->setRank(SP, 0);
+    }
+    match->setScore(DELTA_CN, delta_cn_map.at(*i));
+    match->setScore(DELTA_LCN, delta_lcn_map.at(*i));
+
+    ++cur;
+    switch (cur_score_function_) {
+    case XCORR_SCORE:
+      match->setScore(XCORR, (*i)->xcorr_score);
+      if (exact_pval_search_) {
+        match->setScore(TIDE_SEARCH_EXACT_PVAL, (*i)->xcorr_pval);
+        match->setScore(TIDE_SEARCH_REFACTORED_XCORR, (*i)->xcorr_score);
+      }
+      break;
+    case RESIDUE_EVIDENCE_MATRIX:
+      match->setScore(RESIDUE_EVIDENCE_SCORE, (*i)->resEv_score);
+      match->setScore(RESIDUE_EVIDENCE_PVAL, exact_pval_search_ ? (*i)->resEv_pval : 0);
+      match->setRank(RESIDUE_EVIDENCE_PVAL, cur);
+      break;
+    case BOTH_SCORE:
+      match->setScore(TIDE_SEARCH_EXACT_PVAL, (*i)->xcorr_pval);
+      match->setScore(TIDE_SEARCH_REFACTORED_XCORR, (*i)->xcorr_score);
+      match->setScore(RESIDUE_EVIDENCE_SCORE, (*i)->resEv_score);
+      match->setScore(RESIDUE_EVIDENCE_PVAL, (*i)->resEv_pval);
+      match->setScore(BOTH_PVALUE, (*i)->combinedPval);
+      match->setRank(BOTH_PVALUE, cur);
+      break;
+    }
+    // Rank is also what the pin writer filters and names PSMs by.
+    match->setRank(XCORR, cur);
+
+    int experimentSize = concat ? concatDistinctMatches :
+      (!peptide->IsDecoy() ? peptides->ActiveTargets() : peptides->ActiveDecoys());
+    match->setTargetExperimentSize(experimentSize);
+    match->setLnExperimentSize(experimentSize > 0 ? log((FLOAT_T)experimentSize) : 0);
+
+    collection->addMatchToPostMatchCollection(match);
+    Crux::Match::freeMatch(match);  // the collection holds it now
   }
+  writer->write(collection);
+  delete collection;
+  rwlock->unlock();
+  delete cruxSpectrum;
 }
 
 /**
@@ -582,7 +737,7 @@ void TideMatchSet::gatherTargetsAndDecoys(
     break;
   }
 
-  if (!Params::GetBool("concat") && TideSearchApplication::hasDecoys()) {
+  if (!config_.concat && TideSearchApplication::hasDecoys()) {
     for (Arr::iterator i = matches_->end(); i != matches_->begin(); ) {
       switch (cur_score_function_) {
       case XCORR_SCORE:
@@ -696,18 +851,19 @@ void TideMatchSet::getFlankingAAs(
 void TideMatchSet::computeDeltaCns(
   const vector<Arr::iterator>& vec, // xcorr*100000000.0, high to low
   map<Arr::iterator, FLOAT_T>* delta_cn_map, // map to add delta cn scores to
-  map<Arr::iterator, FLOAT_T>* delta_lcn_map // map to add delta cn scores to
+  map<Arr::iterator, FLOAT_T>* delta_lcn_map, // map to add delta cn scores to
+  bool exact_pval // whether the scores are exact p-values
 ) {
   vector<FLOAT_T> scores;
   for (vector<Arr::iterator>::const_iterator i = vec.begin(); i != vec.end(); i++) {
-    if (Params::GetBool("exact-p-value")) {
+    if (exact_pval) {
       scores.push_back((*i)->xcorr_pval);
     } else {
       scores.push_back((*i)->xcorr_score);
     }
   }
   vector< pair<FLOAT_T, FLOAT_T> > deltaCns = MatchCollection::calculateDeltaCns(
-    scores, !Params::GetBool("exact-p-value") ? XCORR : TIDE_SEARCH_EXACT_PVAL);
+    scores, !exact_pval ? XCORR : TIDE_SEARCH_EXACT_PVAL);
   for (int i = 0; i < vec.size(); i++) {
     delta_cn_map->insert(make_pair(vec[i], deltaCns[i].first));
     delta_lcn_map->insert(make_pair(vec[i], deltaCns[i].second));
@@ -8,6 +8,7 @@
 #include "tide/active_peptide_queue.h"  // no include guard
 #include "tide/fixed_cap_array.h"
 #include "tide/peptide.h"
+#include "tide/search_config.h"
 #include "tide/sp_scorer.h"
 #include "tide/spectrum_collection.h"
 
@@ -16,6 +17,8 @@
 
 using namespace std;
 
+class TideMatchWriter;
+
 typedef vector<const pb::Protein*> ProteinVec;
 
 class TideMatchSet {
@@ -24,6 +27,13 @@ class TideMatchSet {
   bool exact_pval_search_;
   int elution_window_;
   SCORE_FUNCTION_T cur_score_function_;
+  // When set, spectrum-centric matches are also written in the other
+  // requested formats (see TideMatchWriter.h).
+  TideMatchWriter* target_writer_;
+  TideMatchWriter* decoy_writer_;
+  // Set when the spectrum-centric target and decoy files are the reporting
+  // thread's own buffers (see TideResultBuffers.h), which need no lock.
+  bool buffered_output_;
 
   typedef pair<int, int> Pair2;
   typedef FixedCapacityArray<Pair2> Arr2;
@@ -47,11 +57,13 @@ class TideMatchSet {
   // counter in the matches buffer by decrementing the counter.
   TideMatchSet(
     Arr* matches,
-    double max_mz
+    double max_mz,
+    const SearchConfig& config
   );
   TideMatchSet(
     Peptide* peptide,
-    double max_mz
+    double max_mz,
+    const SearchConfig& config
   );
 
   ~TideMatchSet();
@@ -60,8 +72,8 @@ class TideMatchSet {
    * Write peptide centric matches to output files
    */
   void report(
-    ofstream* target_file,  ///< target file to write to
-    ofstream* decoy_file, ///< decoy file to write to
+    ostream* target_file,  ///< target file to write to
+    ostream* decoy_file, ///< decoy file to write to
     int top_matches,
     const ActivePeptideQueue* peptides, ///< peptide queue
     const ProteinVec& proteins, ///< proteins corresponding with peptides
@@ -73,8 +85,8 @@ class TideMatchSet {
    * Write spectrum centric to output files
    */
   void report(
-    ofstream* target_file,  ///< target file to write to
-    ofstream* decoy_file, ///< decoy file to write to
+    ostream* target_file,  ///< target file to write to
+    ostream* decoy_file, ///< decoy file to write to
     int top_n,  ///< number of matches to report
     const string& spectrum_filename, ///< name of spectrum file
     const Spectrum* spectrum, ///< spectrum for matches
@@ -103,6 +115,7 @@ class TideMatchSet {
   Arr2* matches2_;
   Peptide* peptide_;
   double max_mz_;
+  const SearchConfig& config_;
 
   // For allocation
   static char match_collection_loc_[sizeof(MatchCollection)];
@@ -152,7 +165,7 @@ class TideMatchSet {
    * Helper function for tab delimited report function for peptide centric
    */
   void writeToFile(
-    ofstream* file,
+    ostream* file,
     const ActivePeptideQueue* peptides,
     const ProteinVec& proteins,
     const vector<const pb::AuxLocation*>& locations,
@@ -163,7 +176,27 @@ class TideMatchSet {
    * Helper function for tab delimited report function
    */
   void writeToFile(
-    ofstream* file,
+    ostream* file,
+    int top_n,
+    const vector<Arr::iterator>& vec,
+    const string& spectrum_filename,
+    const Spectrum* spectrum,
+    int charge,
+    const ActivePeptideQueue* peptides,
+    const ProteinVec& proteins,
+    const vector<const pb::AuxLocation*>& locations,
+    const map<Arr::iterator, FLOAT_T>& delta_cn_map,
+    const map<Arr::iterator, FLOAT_T>& delta_lcn_map,
+    const map<Arr::iterator, pair<const SpScorer::SpScoreData, int> >* sp_map,
+    boost::mutex * rwlock
+  );
+
+  /**
+   * Helper function for writing the matches in formats other than tab
+   * delimited
+   */
+  void writeToWriter(
+    TideMatchWriter* writer,
     int top_n,
     const vector<Arr::iterator>& vec,
     const string& spectrum_filename,
@@ -218,7 +251,8 @@ class TideMatchSet {
   static void computeDeltaCns(
     const vector<Arr::iterator>& vec, // xcorr*100000000.0, high to low
     map<Arr::iterator, FLOAT_T>* delta_cn_map, // map to add delta cn scores to
-    map<Arr::iterator, FLOAT_T>* delta_lcn_map
+    map<Arr::iterator, FLOAT_T>* delta_lcn_map,
+    bool exact_pval // whether the scores are exact p-values
   );
 
   static void computeSpData(
@@ -0,0 +1,130 @@
+#include <cstdlib>
+
+#include "io/carp.h"
+#include "util/Params.h"
+#include "TideMatchWriter.h"
+#include "model/ProteinMatchCollection.h"
+#include "util/crux-utils.h"
+
+// Highest charge with a pin feature.
+static const int MAX_PIN_CHARGE = 9;
+
+TideMatchWriter::TideMatchWriter(const string& fileroot, int num_proteins)
+  : pin_(NULL), pin_max_charge_(0), pin_features_set_(false),
+    top_match_(Params::GetInt("top-match")), pepxml_(NULL), sqt_(NULL), mzid_(NULL) {
+  // File names are as psm-convert would give them.
+  if (Params::GetBool("pin-output")) {
+    // The pin header lists one charge feature per charge up to the highest
+    // that can be searched, so that it is known before the first row.
+    string charge = Params::GetString("spectrum-charge");
+    pin_max_charge_ = (charge == "all") ?
+      Params::GetInt("max-precursor-charge") : atoi(charge.c_str());
+    pin_max_charge_ = min(pin_max_charge_, MAX_PIN_CHARGE);
+    pin_ = new PinWriter();
+    pin_->openFile(make_file_path(fileroot + "pin"), "",
+                   Params::GetBool("overwrite"));
+  }
+  if (Params::GetBool("pepxml-output")) {
+    pepxml_ = new PMCPepXMLWriter();
+    pepxml_->openFile(make_file_path(fileroot + "pep.xml"),
+                      Params::GetBool("overwrite"));
+    pepxml_->writeHeader();
+  }
+  if (Params::GetBool("mzid-output")) {
+    mzid_ = new MzIdentMLWriter();
+    mzid_->openFile(make_file_path(fileroot + "mzid"),
+                    Params::GetBool("overwrite"));
+  }
+  if (Params::GetBool("sqt-output")) {
+    sqt_ = new PMCSQTWriter();
+    sqt_->openFile(NULL, make_file_path(fileroot + "sqt"), PSMWriter::PSMS);
+    sqt_->writeHeader(Params::GetString("protein-database"), num_proteins);
+  }
+}
+
+TideMatchWriter::~TideMatchWriter() {
+  close();
+  for (map<int, Crux::Protein*>::iterator i = proteins_.begin();
+       i != proteins_.end();
+       ++i) {
+    delete i->second;
+  }
+}
+
+bool TideMatchWriter::requested() {
+  return Params::GetBool("pin-output") || Params::GetBool("pepxml-output") ||
+    Params::GetBool("mzid-output") || Params::GetBool("sqt-output");
+}
+
+Crux::Protein* TideMatchWriter::getProtein(const pb::Protein& protein) {
+  map<int, Crux::Protein*>::iterator i = proteins_.find(protein.id());
+  if (i != proteins_.end()) {
+    return i->second;
+  }
+  const string& residues = protein.residues();
+  Crux::Protein* crux_protein = new Crux::Protein(
+    protein.name().c_str(), residues.c_str(), residues.length(), "", 0,
+    protein.id(), NULL);
+  proteins_[protein.id()] = crux_protein;
+  return crux_protein;
+}
+
+void TideMatchWriter::write(MatchCollection* matches) {
+  if (matches->getMatchTotal() == 0) {
+    return;
+  }
+  if (pin_) {
+    if (!pin_features_set_) {
+      pin_->enableFeatures(matches, pin_max_charge_);
+      pin_->printHeader();
+      pin_features_set_ = true;
+    }
+    pin_->write(matches, vector<MatchCollection*>(), top_match_);
+  }
+  if (mzid_) {
+    mzid_->addMatches(matches);
+  }
+  if (pepxml_ || sqt_) {
+    ProteinMatchCollection protein_matches(matches);
+    if (pepxml_) {
+      pepxml_->writePSMs(&protein_matches);
+    }
+    if (sqt_) {
+      sqt_->writePSMs(&protein_matches);
+    }
+  }
+}
+
+void TideMatchWriter::close() {
+  if (pin_) {
+    closePin();
+  }
+  if (pepxml_) {
+    pepxml_->writeFooter();
+    pepxml_->closeFile();
+    delete pepxml_;
+    pepxml_ = NULL;
+  }
+  if (mzid_) {
+    mzid_->closeFile();
+    delete mzid_;
+    mzid_ = NULL;
+  }
+  if (sqt_) {
+    sqt_->closeFile();
+    delete sqt_;
+    sqt_ = NULL;
+  }
+}
+
+/**
+ * Close the pin file, writing the header if there were no matches.
+ */
+void TideMatchWriter::closePin() {
+  if (!pin_features_set_) {
+    pin_->printHeader();
+  }
+  pin_->closeFile();
+  delete pin_;
+  pin_ = NULL;
+}
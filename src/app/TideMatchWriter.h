@@ -0,0 +1,82 @@
+#ifndef TIDE_MATCH_WRITER_H
+#define TIDE_MATCH_WRITER_H
+
+#include <map>
+#include <string>
+#include "raw_proteins.pb.h"
+#include "model/MatchCollection.h"
+#include "model/Protein.h"
+#include "io/MzIdentMLWriter.h"
+#include "io/PinWriter.h"
+#include "io/PMCPepXMLWriter.h"
+#include "io/PMCSQTWriter.h"
+
+using namespace std;
+
+/**
+ * Writes tide-search matches in the formats requested by the pin-output,
+ * pepxml-output, mzid-output and sqt-output parameters, as they are found.
+ * The matches of each spectrum are passed to every format in turn, so the
+ * tab-delimited results never need to be read back and converted.
+ */
+class TideMatchWriter {
+
+ public:
+  /**
+   * Open <fileroot>pin, <fileroot>pep.xml, <fileroot>mzid and <fileroot>sqt,
+   * for whichever of those formats were requested.
+   */
+  TideMatchWriter(
+    const string& fileroot, ///< e.g. "tide-search.target."
+    int num_proteins ///< number of proteins searched, for the SQT header
+  );
+
+  ~TideMatchWriter();
+
+  /**
+   * Whether any format written by this class was requested.
+   */
+  static bool requested();
+
+  /**
+   * Get the Crux protein for a Tide protein, creating it on first use. Not
+   * thread-safe; callers hold the results lock, as for write().
+   */
+  Crux::Protein* getProtein(
+    const pb::Protein& protein
+  );
+
+  /**
+   * Write the matches of one spectrum to each open file.
+   */
+  void write(
+    MatchCollection* matches
+  );
+
+  /**
+   * Finish and close the files. Called by the destructor if not before.
+   */
+  void close();
+
+ protected:
+  void closePin();
+
+  PinWriter* pin_;
+  int pin_max_charge_;
+  bool pin_features_set_;
+  int top_match_;
+  PMCPepXMLWriter* pepxml_;
+  PMCSQTWriter* sqt_;
+  MzIdentMLWriter* mzid_;
+
+  map<int, Crux::Protein*> proteins_;
+};
+
+#endif
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 2
+ * End:
+ */
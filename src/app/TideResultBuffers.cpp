@@ -0,0 +1,133 @@
+#include "io/carp.h"
+#include "TideResultBuffers.h"
+#include "tide/telemetry.h"
+
+// Chunks that may wait for the writer, per search thread, before threads
+// handing off more are made to wait.
+static const size_t MAX_QUEUED_PER_THREAD = 4;
+
+TideResultBuffers::TideResultBuffers(ostream* target_file, ostream* decoy_file,
+                                     int num_threads, bool ordered)
+  : target_file_(target_file), decoy_file_(decoy_file), ordered_(ordered),
+    max_queued_(MAX_QUEUED_PER_THREAD * num_threads), done_(false), next_(0) {
+  for (int i = 0; i < num_threads; i++) {
+    Buffer* buffer = new Buffer;
+    buffer->target = new ostringstream;
+    buffer->decoy = new ostringstream;
+    buffers_.push_back(buffer);
+  }
+  writer_ = new boost::thread(boost::bind(&TideResultBuffers::writeLoop, this));
+}
+
+TideResultBuffers::~TideResultBuffers() {
+  finish();
+  for (vector<Buffer*>::iterator i = buffers_.begin(); i != buffers_.end(); ++i) {
+    delete (*i)->target;
+    delete (*i)->decoy;
+    delete *i;
+  }
+}
+
+void TideResultBuffers::endChunk(int thread, int begin, int end) {
+  handOff(thread, begin, end);
+}
+
+void TideResultBuffers::flush(int thread) {
+  Buffer* buffer = buffers_[thread];
+  if (buffer->target->tellp() <= 0 && buffer->decoy->tellp() <= 0) {
+    return;
+  }
+  if (ordered_) {
+    carp(CARP_FATAL, "Search results outside of any chunk of spectra.");
+  }
+  handOff(thread, -1, -1);
+}
+
+void TideResultBuffers::handOff(int thread, int begin, int end) {
+  Buffer* buffer = buffers_[thread];
+  Chunk* chunk = new Chunk;
+  chunk->begin = begin;
+  chunk->end = end;
+  chunk->target = buffer->target->str();
+  chunk->decoy = buffer->decoy->str();
+  buffer->target->str("");
+  buffer->decoy->str("");
+
+  Telemetry::Lock(&mutex_);
+  boost::unique_lock<boost::mutex> lock(mutex_, boost::adopt_lock);
+  if (queue_.size() >= max_queued_) {
+    // The writer is behind.
+    Telemetry::Scope scope(Telemetry::LOCK_WAIT);
+    while (queue_.size() >= max_queued_) {
+      space_.wait(lock);
+    }
+  }
+  queue_.push_back(chunk);
+  ready_.notify_one();
+}
+
+void TideResultBuffers::finish() {
+  if (writer_ == NULL) {
+    return;
+  }
+  {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    done_ = true;
+    ready_.notify_one();
+  }
+  writer_->join();
+  delete writer_;
+  writer_ = NULL;
+  if (!pending_.empty()) {
+    carp(CARP_FATAL, "Search results for spectrum-charge pairs from %d were "
+         "never written.", next_);
+  }
+  if ((target_file_ && !target_file_->good()) ||
+      (decoy_file_ && !decoy_file_->good())) {
+    carp(CARP_FATAL, "Error writing search results.");
+  }
+}
+
+void TideResultBuffers::writeLoop() {
+  Telemetry::Thread telemetry_thread("writer");
+  deque<Chunk*> chunks;
+  boost::unique_lock<boost::mutex> lock(mutex_);
+  while (true) {
+    while (queue_.empty() && !done_) {
+      ready_.wait(lock);
+    }
+    if (queue_.empty()) {
+      break;
+    }
+    // Take everything queued at once, and write it without the lock.
+    chunks.swap(queue_);
+    space_.notify_all();
+    lock.unlock();
+    for (deque<Chunk*>::iterator i = chunks.begin(); i != chunks.end(); ++i) {
+      if (!ordered_) {
+        writeChunk(*i);
+        continue;
+      }
+      pending_[(*i)->begin] = *i;
+      map<int, Chunk*>::iterator next;
+      while (!pending_.empty() && (next = pending_.begin())->first == next_) {
+        next_ = next->second->end;
+        writeChunk(next->second);
+        pending_.erase(next);
+      }
+    }
+    chunks.clear();
+    lock.lock();
+  }
+}
+
+void TideResultBuffers::writeChunk(Chunk* chunk) {
+  Telemetry::Scope scope(Telemetry::RESULT_WRITE);
+  if (target_file_) {
+    target_file_->write(chunk->target.data(), chunk->target.size());
+  }
+  if (decoy_file_) {
+    decoy_file_->write(chunk->decoy.data(), chunk->decoy.size());
+  }
+  delete chunk;
+}
@@ -0,0 +1,115 @@
+#ifndef TIDE_RESULT_BUFFERS_H
+#define TIDE_RESULT_BUFFERS_H
+
+#include <deque>
+#include <map>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <boost/thread.hpp>
+
+using namespace std;
+
+/**
+ * Collects the tab-delimited tide-search results of each search thread in a
+ * buffer of its own, so that matches are formatted without holding a lock.
+ * When a thread finishes a chunk of spectrum-charge pairs (see
+ * SpectrumScheduler), it hands that chunk's text to a writer thread, which
+ * writes whatever has been handed over in batches.
+ *
+ * In ordered mode the chunks are written in the order of the
+ * spectrum-charge pairs they came from, so the files do not depend on the
+ * number of threads. Chunks finished ahead of that order are held in memory
+ * until the chunks before them arrive. Otherwise chunks are written as they
+ * arrive.
+ */
+class TideResultBuffers {
+
+ public:
+  TideResultBuffers(
+    ostream* target_file, ///< target results, or NULL
+    ostream* decoy_file, ///< decoy results, or NULL
+    int num_threads,
+    bool ordered ///< write chunks in spectrum-charge order
+  );
+
+  /**
+   * Writes anything still buffered; see finish().
+   */
+  ~TideResultBuffers();
+
+  /**
+   * Streams for thread to write its target and decoy results to. NULL where
+   * the corresponding file is.
+   */
+  ostream* target(int thread) { return target_file_ ? buffers_[thread]->target : NULL; }
+  ostream* decoy(int thread) { return decoy_file_ ? buffers_[thread]->decoy : NULL; }
+
+  /**
+   * Hand the results written by thread since its last chunk to the writer,
+   * as those of spectrum-charge pairs [begin, end).
+   */
+  void endChunk(
+    int thread,
+    int begin,
+    int end
+  );
+
+  /**
+   * Hand whatever thread has written since its last chunk to the writer. In
+   * ordered mode there should be nothing, as all results belong to a chunk.
+   */
+  void flush(
+    int thread
+  );
+
+  /**
+   * Wait for the writer to write everything handed to it, and stop it.
+   */
+  void finish();
+
+ protected:
+  struct Buffer {
+    ostringstream* target;
+    ostringstream* decoy;
+  };
+
+  struct Chunk {
+    int begin;
+    int end;
+    string target;
+    string decoy;
+  };
+
+  void handOff(int thread, int begin, int end);
+  void writeLoop();
+  void writeChunk(Chunk* chunk);
+
+  ostream* target_file_;
+  ostream* decoy_file_;
+  bool ordered_;
+  vector<Buffer*> buffers_;
+
+  // Shared with the writer thread, under mutex_.
+  boost::mutex mutex_;
+  boost::condition_variable ready_;  // chunks queued, or done_
+  boost::condition_variable space_;  // queue drained
+  deque<Chunk*> queue_;
+  size_t max_queued_;
+  bool done_;
+
+  // Writer thread only.
+  map<int, Chunk*> pending_;  // ordered mode: chunks waiting for next_
+  int next_;
+  boost::thread* writer_;
+};
+
+#endif
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 2
+ * End:
+ */
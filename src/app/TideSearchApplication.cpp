@@ -10,10 +10,17 @@
 #include "ParamMedicApplication.h"
 #include "PSMConvertApplication.h"
 #include "tide/mass_constants.h"
+#include "tide/peptide_reader.h"
+#include "tide/peptide_stream.h"
+#include "tide/score_engine.h"
+#include "tide/telemetry.h"
 #include "TideMatchSet.h"
+#include "TideMatchWriter.h"
 #include "util/Params.h"
 #include "util/FileUtils.h"
 #include "util/StringUtils.h"
+#include <climits>
+#include <limits>
 #include <math.h> //Added by Andy Lin
 #include <map> //Added by Andy Lin
 
@@ -35,11 +42,29 @@ const double TideSearchApplication::XCORR_SCALING = 100000000.0;
  * tide/spectrum_preprocess2.cc). */
 const double TideSearchApplication::RESCALE_FACTOR = 20.0;
 
+/* Number of spectrum-charge pairs a peptide-centric search thread goes
+ * through between handing its results to the writer. */
+static const int PEPTIDE_CENTRIC_CHUNK_SIZE = 256;
+
+/* Open the peptides of an index, which may be stored either as records or in
+ * the columnar format (see tide/peptide_reader.h). */
+static PeptideReader* openPeptideReader(const string& peptides_file,
+                                        pb::Header* header) {
+  PeptideReader* reader = PeptideReader::Open(peptides_file, header);
+  if (reader == NULL) {
+    carp(CARP_FATAL, "Error reading index (%s)", peptides_file.c_str());
+  }
+  return reader;
+}
+
 TideSearchApplication::TideSearchApplication():
-  exact_pval_search_(false), remove_index_(""), spectrum_flag_(NULL) {
+  spectrum_flag_(NULL), config_(NULL), remove_index_(""),
+  target_writer_(NULL), decoy_writer_(NULL),
+  exact_pval_search_(false), detach_peptide_stream_(true) {
 }
 
 TideSearchApplication::~TideSearchApplication() {
+  delete config_;
   if (!remove_index_.empty()) {
     carp(CARP_DEBUG, "Removing temp index '%s'", remove_index_.c_str());
     FileUtils::Remove(remove_index_);
@@ -56,13 +81,12 @@ int TideSearchApplication::main(const vector<string>& input_files) {
 int TideSearchApplication::main(const vector<string>& input_files, const string input_index) {
   carp(CARP_INFO, "Running tide-search...");
 
-  // prevent different output formats from using threading
-  if (!Params::GetBool("peptide-centric-search")) {
-    NUM_THREADS = Params::GetInt("num-threads");
-  } else {
-    carp(CARP_INFO, "Threading for peptide-centric formats is not yet supported.");
-    NUM_THREADS = 1;
+  if (Params::GetBool("telemetry")) {
+    Telemetry::Enable();
   }
+  Telemetry::Thread telemetry_thread("main");
+
+  NUM_THREADS = Params::GetInt("num-threads");
   if (NUM_THREADS < 1) {
     NUM_THREADS = boost::thread::hardware_concurrency(); // MINIMUM # = 1.
     // (Meaning just main thread) Do not make this value below 1.
@@ -72,6 +96,23 @@ int TideSearchApplication::main(const vector<string>& input_files, const string
   }
   carp(CARP_INFO, "Number of Threads: %d", NUM_THREADS);
 
+  if (!ScoreEngine::Select(Params::GetString("score-engine"))) {
+    carp(CARP_FATAL, "Unknown score engine '%s'",
+         Params::GetString("score-engine").c_str());
+  }
+  carp(CARP_INFO, "Score engine: %s", ScoreEngine::Description().c_str());
+
+  // With a memory limit, spectra are sorted on disk and searched in segments
+  // rather than loaded all at once. Peptide-centric search holds on to every
+  // spectrum until the end, so it always loads them.
+  size_t max_spectrum_memory = (size_t)Params::GetInt("max-memory") << 20;
+  bool stream_spectra = max_spectrum_memory > 0;
+  if (stream_spectra && Params::GetBool("peptide-centric-search")) {
+    carp(CARP_WARNING, "max-memory is not supported for peptide-centric search; "
+                       "all spectra will be loaded.");
+    stream_spectra = false;
+  }
+
   const string index = input_index;
   string peptides_file = FileUtils::Join(index, "pepix");
   string proteins_file = FileUtils::Join(index, "protix");
@@ -113,6 +154,9 @@ int TideSearchApplication::main(const vector<string>& input_files, const string
     carp(CARP_INFO, "Searching scan range %d to %d.", min_scan, max_scan);
   }
 
+  delete config_;
+  config_ = new SearchConfig();
+
   // check to compute exact p-value
   exact_pval_search_ = Params::GetBool("exact-p-value");
   bin_width_  = Params::GetDouble("mz-bin-width");
@@ -188,7 +232,8 @@ int TideSearchApplication::main(const vector<string>& input_files, const string
 
   if (curScoreFunction == RESIDUE_EVIDENCE_MATRIX || curScoreFunction == BOTH_SCORE) {
     pb::Header aaf_peptides_header;
-    HeadedRecordReader aaf_peptide_reader(peptides_file, &aaf_peptides_header);
+    PeptideReader* aaf_peptide_reader =
+      openPeptideReader(peptides_file, &aaf_peptides_header);
 
     if (aaf_peptides_header.file_type() != pb::Header::PEPTIDES ||
         !aaf_peptides_header.has_peptides_header()) {
@@ -201,17 +246,19 @@ int TideSearchApplication::main(const vector<string>& input_files, const string
                         bin_width_, bin_offset_);
 
     ActivePeptideQueue* active_peptide_queue =
-      new ActivePeptideQueue(aaf_peptide_reader.Reader(), proteins);
+      new ActivePeptideQueue(aaf_peptide_reader, proteins);
 
     nAARes = active_peptide_queue->CountAAFrequencyRes(bin_width_, bin_offset_,
                                                        dAAFreqN, dAAFreqI, dAAFreqC, dAAMass);
     delete active_peptide_queue;
+    delete aaf_peptide_reader;
   }
 
   // For SCORE_FUNCTION=="XCORR_SCORE" with p-val=T or SCORE_FUNCTION=="BOTH_SCORE"
   if (exact_pval_search_ && (curScoreFunction == XCORR_SCORE || curScoreFunction == BOTH_SCORE)) {
     pb::Header aaf_peptides_header;
-    HeadedRecordReader aaf_peptide_reader(peptides_file, &aaf_peptides_header);
+    PeptideReader* aaf_peptide_reader =
+      openPeptideReader(peptides_file, &aaf_peptides_header);
 
     if (( aaf_peptides_header.file_type() != pb::Header::PEPTIDES) ||
          !aaf_peptides_header.has_peptides_header()) {
@@ -224,11 +271,12 @@ int TideSearchApplication::main(const vector<string>& input_files, const string
                         bin_width_, bin_offset_);
 
     ActivePeptideQueue* active_peptide_queue =
-      new ActivePeptideQueue(aaf_peptide_reader.Reader(), proteins);
+      new ActivePeptideQueue(aaf_peptide_reader, proteins);
 
     nAA = active_peptide_queue->CountAAFrequency(bin_width_, bin_offset_,
                                                  &aaFreqN, &aaFreqI, &aaFreqC, &aaMass);
     delete active_peptide_queue;
+    delete aaf_peptide_reader;
   } // End calculation of amino acid frequencies.
 
   // Read auxlocs index file
@@ -241,9 +289,17 @@ int TideSearchApplication::main(const vector<string>& input_files, const string
   // Read peptides index file
   pb::Header peptides_header;
 
-  vector<HeadedRecordReader*> peptide_reader;
-  for (int i = 0; i < NUM_THREADS; i++) {
-    peptide_reader.push_back(new HeadedRecordReader(peptides_file, &peptides_header));
+  // When several threads run the compiled XCorr search they share a single
+  // reader: each peptide is decoded and compiled once, by a PeptideStream,
+  // rather than once per thread.
+  bool share_peptide_stream = NUM_THREADS > 1 &&
+    curScoreFunction == XCORR_SCORE && !exact_pval_search_ &&
+    !Params::GetBool("peptide-centric-search");
+  int num_readers = share_peptide_stream ? 1 : NUM_THREADS;
+
+  vector<PeptideReader*> peptide_reader;
+  for (int i = 0; i < num_readers; i++) {
+    peptide_reader.push_back(openPeptideReader(peptides_file, &peptides_header));
   }
 
   if ((peptides_header.file_type() != pb::Header::PEPTIDES) ||
@@ -293,38 +349,84 @@ int TideSearchApplication::main(const vector<string>& input_files, const string
     TideMatchSet::writeHeaders(decoy_file, true, compute_sp);
   }
 
-  vector<InputFile> sr = getInputFiles(input_files);
+  // Other formats are written along with the tab-delimited results, except
+  // for peptide-centric search, whose results are converted at the end.
+  bool convert_results = false;
+  if (TideMatchWriter::requested()) {
+    if (Params::GetBool("peptide-centric-search")) {
+      convert_results = true;
+    } else if (!Params::GetBool("concat")) {
+      target_writer_ = new TideMatchWriter("tide-search.target.", proteins.size());
+      if (HAS_DECOYS) {
+        decoy_writer_ = new TideMatchWriter("tide-search.decoy.", proteins.size());
+      }
+    } else {
+      target_writer_ = new TideMatchWriter("tide-search.", proteins.size());
+    }
+  }
+
+  vector<InputFile> sr;
+  {
+    Telemetry::Scope scope(Telemetry::SPECTRUM_READ);
+    sr = getInputFiles(input_files);
+  }
 
   // Loop through spectrum files
   for (vector<InputFile>::const_iterator f = sr.begin(); f != sr.end(); f++) {
     if (!peptide_reader[0]) {
-      for (int i = 0; i < NUM_THREADS; i++) {
-        peptide_reader[i] = new HeadedRecordReader(peptides_file, &peptides_header);
+      for (int i = 0; i < num_readers; i++) {
+        peptide_reader[i] = openPeptideReader(peptides_file, &peptides_header);
       }
     }
 
+    PeptideStream* peptide_stream = NULL;
+    if (share_peptide_stream) {
+      peptide_stream = new PeptideStream(peptide_reader[0], proteins, NUM_THREADS);
+    }
     vector<ActivePeptideQueue*> active_peptide_queue;
     for (int i = 0; i < NUM_THREADS; i++) {
-      active_peptide_queue.push_back(new ActivePeptideQueue(peptide_reader[i]->Reader(), proteins));
+      if (peptide_stream) {
+        active_peptide_queue.push_back(new ActivePeptideQueue(peptide_stream, i, proteins));
+      } else {
+        active_peptide_queue.push_back(new ActivePeptideQueue(peptide_reader[i], proteins));
+      }
       active_peptide_queue[i]->SetBinSize(bin_width_, bin_offset_);
     }
 
     string spectra_file = f->SpectrumRecords;
     SpectrumCollection* spectra = NULL;
+    SpectrumSorter* spectrum_sorter = NULL;
+    double max_mz, last_neutral_mass = 0;
+    int64_t spectrum_num;
     map<string, SpectrumCollection*>::iterator spectraIter = spectra_.find(spectra_file);
-    if (spectraIter == spectra_.end()) {
-      carp(CARP_INFO, "Reading spectrum file %s.", spectra_file.c_str());
-      spectra = loadSpectra(spectra_file);
-      carp(CARP_INFO, "Read %d spectra.", spectra->Size());
+    if (spectraIter == spectra_.end() && stream_spectra) {
+      carp(CARP_INFO, "Sorting spectrum file %s.", spectra_file.c_str());
+      Telemetry::Scope scope(Telemetry::SPECTRUM_READ);
+      spectrum_sorter = sortSpectra(spectra_file, max_spectrum_memory);
+      carp(CARP_INFO, "Read %d spectra.", spectrum_sorter->NumSpectra());
+      max_mz = spectrum_sorter->HighestMZ();
+      last_neutral_mass = spectrum_sorter->LastNeutralMass();
+      spectrum_num = spectrum_sorter->NumSpecCharges();
     } else {
-      spectra = spectraIter->second;
+      if (spectraIter == spectra_.end()) {
+        carp(CARP_INFO, "Reading spectrum file %s.", spectra_file.c_str());
+        Telemetry::Scope scope(Telemetry::SPECTRUM_READ);
+        spectra = loadSpectra(spectra_file);
+        carp(CARP_INFO, "Read %d spectra.", spectra->Size());
+      } else {
+        spectra = spectraIter->second;
+      }
+      max_mz = spectra->FindHighestMZ();
+      spectrum_num = spectra->SpecCharges()->size();
+      if (spectrum_num > 0) {
+        last_neutral_mass = spectra->SpecCharges()->back().neutral_mass;
+      }
     }
 
-    double highest_mz = spectra->FindHighestMZ();
-    unsigned int spectrum_num = spectra->SpecCharges()->size();
+    double highest_mz = max_mz;
     if (spectrum_num > 0 &&
         (exact_pval_search_ || curScoreFunction == RESIDUE_EVIDENCE_MATRIX || curScoreFunction == BOTH_SCORE)) {
-      highest_mz = spectra->SpecCharges()->at(spectrum_num - 1).neutral_mass;
+      highest_mz = last_neutral_mass;
     }
     carp(CARP_DEBUG, "Maximum observed m/z = %f.", highest_mz);
     MaxBin::SetGlobalMax(highest_mz);
@@ -333,24 +435,41 @@ int TideSearchApplication::main(const vector<string>& input_files, const string
     if (spectrum_flag_ == NULL) {
       resetMods();
     }
-    search(f->OriginalName, spectra->SpecCharges(), active_peptide_queue, proteins,
-           locations, Params::GetDouble("precursor-window"),
-           string_to_window_type(Params::GetString("precursor-window-type")),
-           Params::GetDouble("spectrum-min-mz"), Params::GetDouble("spectrum-max-mz"),
-           min_scan, max_scan, Params::GetInt("min-peaks"), charge_to_search,
-           Params::GetInt("top-match"), spectra->FindHighestMZ(),
-           target_file, decoy_file, compute_sp,
-           nAA, aaFreqN, aaFreqI, aaFreqC, aaMass,
-           nAARes, dAAFreqN, dAAFreqI, dAAFreqC, dAAMass,
-           pepHeader.mods(), pepHeader.nterm_mods(), pepHeader.cterm_mods(),
-           &negative_isotope_errors);
+    // Sorted spectra are searched in segments of increasing mass, each read
+    // in when the previous one is done. The active peptide queues carry on
+    // from one segment to the next.
+    bool more_spectra = true;
+    while (more_spectra) {
+      SpectrumCollection* segment = spectra;
+      if (spectrum_sorter != NULL) {
+        segment = new SpectrumCollection();
+        Telemetry::Scope scope(Telemetry::SPECTRUM_READ);
+        spectrum_sorter->NextSegment(segment);
+        carp(CARP_DEBUG, "Searching %d spectrum-charge combinations.",
+             segment->SpecCharges()->size());
+      }
+      more_spectra = spectrum_sorter != NULL && !spectrum_sorter->Done();
+      detach_peptide_stream_ = !more_spectra;
+      search(f->OriginalName, segment->SpecCharges(), active_peptide_queue, proteins,
+             locations, Params::GetDouble("precursor-window"),
+             string_to_window_type(Params::GetString("precursor-window-type")),
+             Params::GetDouble("spectrum-min-mz"), Params::GetDouble("spectrum-max-mz"),
+             min_scan, max_scan, Params::GetInt("min-peaks"), charge_to_search,
+             Params::GetInt("top-match"), max_mz,
+             target_file, decoy_file, compute_sp,
+             nAA, aaFreqN, aaFreqI, aaFreqC, aaMass,
+             nAARes, dAAFreqN, dAAFreqI, dAAFreqC, dAAMass,
+             pepHeader.mods(), pepHeader.nterm_mods(), pepHeader.cterm_mods(),
+             &negative_isotope_errors);
+      if (segment != spectra) {
+        delete segment;
+      }
+    }
 
+    delete spectrum_sorter;
     if (spectraIter == spectra_.end()) {
       delete spectra;
     }
-    // convert tab delimited to other file formats.
-    convertResults();
-
     // Delete temporary spectrumrecords file
     if (!f->Keep) {
       carp(CARP_DEBUG, "Deleting %s", spectra_file.c_str());
@@ -360,6 +479,9 @@ int TideSearchApplication::main(const vector<string>& input_files, const string
     // Clean up
     for (int i = 0; i < NUM_THREADS; i++) {
       delete active_peptide_queue[i];
+    }
+    delete peptide_stream;
+    for (int i = 0; i < num_readers; i++) {
       delete peptide_reader[i];
       peptide_reader[i] = NULL;
     }
@@ -375,11 +497,24 @@ int TideSearchApplication::main(const vector<string>& input_files, const string
       delete decoy_file;
     }
   }
+  delete target_writer_;
+  delete decoy_writer_;
+  target_writer_ = decoy_writer_ = NULL;
+  if (convert_results) {
+    // convert tab delimited to other file formats.
+    convertResults();
+  }
   delete[] aaFreqN;
   delete[] aaFreqI;
   delete[] aaFreqC;
   delete[] aaMass;
 
+  if (Telemetry::Enabled()) {
+    string telemetry_file = make_file_path("tide-search.telemetry.txt");
+    if (!Telemetry::WriteReport(telemetry_file)) {
+      carp(CARP_ERROR, "Error writing '%s'.", telemetry_file.c_str());
+    }
+  }
   return 0;
 }
 
@@ -412,17 +547,23 @@ vector<int> TideSearchApplication::getNegativeIsotopeErrors() const {
   return negative_isotope_errors;
 }
 
+// Only the header is read, so that large inputs need not be held in memory
+// before they are searched; see sortSpectra().
+static bool isSpectrumRecords(const string& file) {
+  pb::Header header;
+  HeadedRecordReader reader(file, &header);
+  return reader.OK() && header.file_type() == pb::Header::SPECTRA;
+}
+
 vector<TideSearchApplication::InputFile> TideSearchApplication::getInputFiles(
   const vector<string>& filepaths
 ) const {
   // Try to read all spectrum files as spectrumrecords, convert those that fail
   vector<InputFile> input_sr;
   for (vector<string>::const_iterator f = filepaths.begin(); f != filepaths.end(); f++) {
-    SpectrumCollection spectra;
-    pb::Header spectrum_header;
     string spectrumrecords = *f;
     bool keepSpectrumrecords = true;
-    if (!spectra.ReadSpectrumRecords(spectrumrecords, &spectrum_header)) {
+    if (!isSpectrumRecords(spectrumrecords)) {
       // Failed, try converting to spectrumrecords file
       carp(CARP_INFO, "Converting %s to spectrumrecords format", f->c_str());
       carp(CARP_INFO, "Elapsed time starting conversion: %.3g s", wall_clock() / 1e6);
@@ -440,7 +581,7 @@ vector<TideSearchApplication::InputFile> TideSearchApplication::getInputFiles(
       }
       carp(CARP_DEBUG, "Reading converted spectrum file %s", spectrumrecords.c_str());
       // Re-read converted file as spectrumrecords file
-      if (!spectra.ReadSpectrumRecords(spectrumrecords, &spectrum_header)) {
+      if (!isSpectrumRecords(spectrumrecords)) {
         carp(CARP_DEBUG, "Deleting %s", spectrumrecords.c_str());
         FileUtils::Remove(spectrumrecords);
         carp(CARP_FATAL, "Error reading spectra file %s", spectrumrecords.c_str());
@@ -451,6 +592,22 @@ vector<TideSearchApplication::InputFile> TideSearchApplication::getInputFiles(
   return input_sr;
 }
 
+SpectrumSorter* TideSearchApplication::sortSpectra(const string& file,
+                                                   size_t max_memory) const {
+  string temp_dir = Params::GetString("temp-dir");
+  string temp_prefix = temp_dir.empty() ?
+    make_file_path(FileUtils::BaseName(file)) :
+    FileUtils::Join(temp_dir, FileUtils::BaseName(file));
+  double key_window =
+    string_to_window_type(Params::GetString("precursor-window-type")) == WINDOW_MZ ?
+    Params::GetDouble("precursor-window") : 0;
+  SpectrumSorter* sorter = new SpectrumSorter(temp_prefix, max_memory, key_window);
+  if (!sorter->Sort(file)) {
+    carp(CARP_FATAL, "Error reading spectrum file %s", file.c_str());
+  }
+  return sorter;
+}
+
 SpectrumCollection* TideSearchApplication::loadSpectra(const string& file) {
   SpectrumCollection* spectra = new SpectrumCollection();
   pb::Header header;
@@ -483,10 +640,17 @@ void TideSearchApplication::search(void* threadarg) {
   int search_charge = my_data->search_charge;
   int top_matches = my_data->top_matches;
   double highest_mz = my_data->highest_mz;
-  ofstream* target_file = my_data->target_file;
-  ofstream* decoy_file = my_data->decoy_file;
   bool compute_sp = my_data->compute_sp;
   int64_t thread_num = my_data->thread_num;
+  Telemetry::Thread telemetry_thread("search-" + StringUtils::ToString(thread_num));
+  // Spectrum-centric results are formatted into this thread's own buffers,
+  // when there are any; see TideResultBuffers.h.
+  TideResultBuffers* buffers = my_data->buffers;
+  bool buffered_output = buffers != NULL;
+  ostream* target_file = buffered_output ?
+    buffers->target(thread_num) : my_data->target_file;
+  ostream* decoy_file = buffered_output ?
+    buffers->decoy(thread_num) : my_data->decoy_file;
   int64_t num_threads = my_data->num_threads;
   int nAA = my_data->nAA;
   double* aaFreqN = my_data->aaFreqN;
@@ -504,6 +668,8 @@ void TideSearchApplication::search(void* threadarg) {
 
   vector<boost::mutex*> locks_array = my_data->locks_array;
   vector<int>* negative_isotope_errors = my_data->negative_isotope_errors;
+  SpectrumScheduler* scheduler = my_data->scheduler;
+  const PeptideBands* bands = my_data->bands;
 
   double bin_width = my_data->bin_width;
   double bin_offset = my_data->bin_offset;
@@ -512,6 +678,7 @@ void TideSearchApplication::search(void* threadarg) {
 
   int* sc_index = my_data->sc_index;
   int* total_candidate_peptides = my_data->total_candidate_peptides;
+  const SearchConfig& config = *config_;
 
   // params
   bool peptide_centric = Params::GetBool("peptide-centric-search");
@@ -527,6 +694,26 @@ void TideSearchApplication::search(void* threadarg) {
                            use_neutral_loss_peaks,
                            use_flanking_peaks);
 
+  // Spectra with overlapping precursor windows may be scored in batches; see
+  // scoreSpectrumBatch(). Each entry of the batch has its own workspace.
+  size_t batch_size = (curScoreFunction == XCORR_SCORE && !exact_pval_search_ &&
+                       !peptide_centric) ?
+    (size_t)Params::GetInt("spectrum-batch-size") : 1;
+  vector<SpectrumBatchEntry> batch;
+  vector<ObservedPeakSet*> batch_observed;
+  double batch_max_range = 0.0;
+  if (batch_size > 1) {
+    batch.reserve(batch_size);
+    for (size_t i = 0; i < batch_size; ++i) {
+      batch_observed.push_back(new ObservedPeakSet(bin_width, bin_offset,
+                                                   use_neutral_loss_peaks,
+                                                   use_flanking_peaks));
+    }
+  }
+
+  // Reused by every exact p-value and residue evidence dynamic program.
+  DynProgWorkspace dyn_prog;
+
   // Keep track of observed peaks that get filtered out in various ways.
   long int num_range_skipped = 0;
   long int num_precursors_skipped = 0;
@@ -537,16 +724,62 @@ void TideSearchApplication::search(void* threadarg) {
   FLOAT_T sc_total = (FLOAT_T)spec_charges->size();
   int print_interval = Params::GetInt("print-search-progress");
 
-  for (vector<SpectrumCollection::SpecCharge>::const_iterator sc = spec_charges->begin()+thread_num;
-       sc < spec_charges->begin() + (spec_charges->size());
-       sc = sc + num_threads) {
-    locks_array[LOCK_REPORTING]->lock();
-    ++(*sc_index);
-    if (print_interval > 0 && *sc_index > 0 && *sc_index % print_interval == 0) {
-      carp(CARP_INFO, "%d spectrum-charge combinations searched, %.0f%% complete",
-           *sc_index, *sc_index / sc_total * 100);
+  // The scheduler hands this thread contiguous chunks [sc_next, sc_end) of
+  // spec_charges, in increasing mass order. Progress is counted, and the
+  // results handed to the writer, a chunk at a time.
+  //
+  // In peptide-centric search, each thread instead goes through all of
+  // spec_charges in order, searching the spectrum-charge pairs whose windows
+  // overlap its band of peptides (see PeptideBands). Progress counts the
+  // thread's equal share of spec_charges.
+  bool ordered_output = Params::GetBool("deterministic-output");
+  int num_sc = (int)spec_charges->size();
+  int own_begin = (int)(thread_num * num_sc / num_threads);
+  int own_end = (int)((thread_num + 1) * num_sc / num_threads);
+  int sc_next = 0, sc_end = 0, chunk_begin = 0;
+  while (true) {
+    if (sc_next == sc_end) {
+      if (chunk_begin < sc_end) {
+        if (buffered_output && ordered_output && !batch.empty()) {
+          // The chunk's results must all be written before it is handed off.
+          scoreSpectrumBatch(&batch, active_peptide_queue, spectrum_filename,
+                             proteins, locations, top_matches, highest_mz,
+                             target_file, decoy_file, buffered_output,
+                             compute_sp, locks_array, total_candidate_peptides);
+          batch.clear();
+        }
+        if (bands != NULL) {
+          buffers->flush(thread_num);
+        } else if (buffered_output) {
+          buffers->endChunk(thread_num, chunk_begin, sc_end);
+        }
+        int chunk_searched = (bands == NULL) ? sc_end - chunk_begin :
+          max(0, min(sc_end, own_end) - max(chunk_begin, own_begin));
+        Telemetry::Lock(locks_array[LOCK_REPORTING]);
+        int searched = *sc_index;
+        *sc_index += chunk_searched;
+        if (print_interval > 0 && *sc_index / print_interval > searched / print_interval) {
+          carp(CARP_INFO, "%d spectrum-charge combinations searched, %.0f%% complete",
+               *sc_index, *sc_index / sc_total * 100);
+        }
+        locks_array[LOCK_REPORTING]->unlock();
+      }
+      if (bands != NULL) {
+        if (sc_end == num_sc) {
+          break;
+        }
+        sc_next = sc_end;
+        sc_end = min(sc_end + PEPTIDE_CENTRIC_CHUNK_SIZE, num_sc);
+      } else if (!scheduler->Next(thread_num, &sc_next, &sc_end)) {
+        break;
+      }
+      chunk_begin = sc_next;
     }
-    locks_array[LOCK_REPORTING]->unlock();
+    int sc_cur = sc_next++;
+    if (bands != NULL && !bands->Overlaps(thread_num, sc_cur)) {
+      continue;
+    }
+    vector<SpectrumCollection::SpecCharge>::const_iterator sc = spec_charges->begin() + sc_cur;
 
     Spectrum* spectrum = sc->spectrum;
     double precursor_mz = spectrum->PrecursorMZ();
@@ -554,7 +787,7 @@ void TideSearchApplication::search(void* threadarg) {
     int charge = sc->charge;
     int scan_num = spectrum->SpectrumNumber();
     if (spectrum_flag != NULL) {
-      locks_array[LOCK_CASCADE]->lock();
+      Telemetry::Lock(locks_array[LOCK_CASCADE]);
       map<pair<string, unsigned int>, bool>::iterator spectrum_id;
       spectrum_id = spectrum_flag->find(pair<string, unsigned int>(
         spectrum_filename, scan_num * 10 + charge));
@@ -571,6 +804,9 @@ void TideSearchApplication::search(void* threadarg) {
         (search_charge != 0 && charge != search_charge) || charge > max_charge) {
       continue;
     }
+    if (bands == NULL || (own_begin <= sc_cur && sc_cur < own_end)) {
+      Telemetry::Count(Telemetry::SPECTRA, 1);
+    }
     // The active peptide queue holds the candidate peptides for spectrum.
     // Calculate and set the window, depending on the window type.
     vector<double>* min_mass = new vector<double>();
@@ -582,11 +818,37 @@ void TideSearchApplication::search(void* threadarg) {
 
     //TODO throw error when fragment-tolerance and evidence-granularity parameters are defined
 
-    if (curScoreFunction == XCORR_SCORE && !exact_pval_search_) {  //execute original tide-search program
+    if (batch_size > 1) {
+      if (!batch.empty() &&
+          (batch.size() == batch_size || min_range > batch_max_range)) {
+        scoreSpectrumBatch(&batch, active_peptide_queue, spectrum_filename,
+                           proteins, locations, top_matches, highest_mz,
+                           target_file, decoy_file, buffered_output,
+                           compute_sp, locks_array,
+                           total_candidate_peptides);
+        batch.clear();
+      }
+      if (batch.empty() || max_range > batch_max_range) {
+        batch_max_range = max_range;
+      }
+      batch.push_back(SpectrumBatchEntry());
+      SpectrumBatchEntry& entry = batch.back();
+      entry.sc = &(*sc);
+      entry.observed = batch_observed[batch.size() - 1];
+      entry.min_mass = *min_mass;
+      entry.max_mass = *max_mass;
+      entry.min_range = min_range;
+      entry.max_range = max_range;
+      entry.nCandPeptide = 0;
+      entry.observed->PreprocessSpectrum(*spectrum, charge, config, &num_range_skipped,
+                                         &num_precursors_skipped,
+                                         &num_isotopes_skipped, &num_retained);
+    } else if (curScoreFunction == XCORR_SCORE && !exact_pval_search_) {  //execute original tide-search program
+      Telemetry::Scope scoring_scope(Telemetry::SCORING);
       // Normalize the observed spectrum and compute the cache of
       // frequently-needed values for taking dot products with theoretical
       // spectra.
-      observed.PreprocessSpectrum(*spectrum, charge, &num_range_skipped,
+      observed.PreprocessSpectrum(*spectrum, charge, config, &num_range_skipped,
                                   &num_precursors_skipped,
                                   &num_isotopes_skipped, &num_retained);
       int nCandPeptide = active_peptide_queue->SetActiveRange(
@@ -594,9 +856,13 @@ void TideSearchApplication::search(void* threadarg) {
       if (nCandPeptide == 0) {
         continue;
       }
-      locks_array[LOCK_CANDIDATES]->lock();
-      *total_candidate_peptides += nCandPeptide;
-      locks_array[LOCK_CANDIDATES]->unlock();
+      // Spectra searched by several peptide-centric threads count once.
+      if (bands == NULL || (own_begin <= sc_cur && sc_cur < own_end)) {
+        Telemetry::Count(Telemetry::CANDIDATES, nCandPeptide);
+        Telemetry::Lock(locks_array[LOCK_CANDIDATES]);
+        *total_candidate_peptides += nCandPeptide;
+        locks_array[LOCK_CANDIDATES]->unlock();
+      }
 
       int candidatePeptideStatusSize = candidatePeptideStatus->size();
       TideMatchSet::Arr2 match_arr2(candidatePeptideStatusSize); // Scored peptides will go here.
@@ -616,7 +882,8 @@ void TideSearchApplication::search(void* threadarg) {
         TideMatchSet::Arr2::iterator it = match_arr2.begin();
         for (; it != match_arr2.end(); ++iter_, ++it) {
           int peptide_idx = candidatePeptideStatusSize - (it->second);
-          if ((*candidatePeptideStatus)[peptide_idx]) {
+          if ((*candidatePeptideStatus)[peptide_idx] &&
+              bands->Owns(thread_num, (*iter_)->Mass())) {
             (*iter_)->AddHit(spectrum, it->first, 0.0, it->second, charge);
           }
         }
@@ -634,15 +901,19 @@ void TideSearchApplication::search(void* threadarg) {
           }
         }
 
-        TideMatchSet matches(&match_arr, highest_mz);
+        TideMatchSet matches(&match_arr, highest_mz, config);
         matches.exact_pval_search_ = exact_pval_search;
         matches.cur_score_function_ = curScoreFunction;
+        matches.target_writer_ = target_writer_;
+        matches.decoy_writer_ = decoy_writer_;
+        matches.buffered_output_ = buffered_output;
 
         matches.report(target_file, decoy_file, top_matches, spectrum_filename,
                        spectrum, charge, active_peptide_queue, proteins,
                        locations, compute_sp, true, locks_array[LOCK_RESULTS]);
       }  //end peptide_centric == false
     } else { //This runs curScoreFunction=BOTH_SCORE, curScoreFunction=RESIUDUE_EVIDENCE_MATRIX, and xcorr p-val
+      Telemetry::Scope scoring_scope(Telemetry::SCORING);
 
       int nCandPeptide = active_peptide_queue->SetActiveRangeBIons(min_mass, max_mass, min_range, max_range, candidatePeptideStatus);
       int candidatePeptideStatusSize = candidatePeptideStatus->size();
@@ -650,7 +921,8 @@ void TideSearchApplication::search(void* threadarg) {
         continue;
       }
 
-      locks_array[LOCK_CANDIDATES]->lock();
+      Telemetry::Count(Telemetry::CANDIDATES, nCandPeptide);
+      Telemetry::Lock(locks_array[LOCK_CANDIDATES]);
       *total_candidate_peptides += nCandPeptide;
       locks_array[LOCK_CANDIDATES]->unlock();
 
@@ -665,8 +937,8 @@ void TideSearchApplication::search(void* threadarg) {
         }
       }
       int maxPrecurMassBin = floor(MaxBin::Global().CacheBinEnd() + 50.0);
-      double fragTol = Params::GetDouble("fragment-tolerance");
-      int granularityScale = Params::GetInt("evidence-granularity");
+      double fragTol = config.fragment_tolerance;
+      int granularityScale = config.evidence_granularity;
 
       //TODO look at this
       int minDeltaMass;
@@ -771,7 +1043,7 @@ void TideSearchApplication::search(void* threadarg) {
           //preprocess to create one integerized evidence vector for each cluster of masses among selected peptides
           double pepMassMonoMean = (pepMaInt - 0.5 + bin_offset_) * bin_width_;
           evidenceObs[pe] = spectrum->CreateEvidenceVectorDiscretized(
-            bin_width, bin_offset, charge, pepMassMonoMean, maxPrecurMassBin,
+            bin_width, bin_offset, charge, pepMassMonoMean, maxPrecurMassBin, config,
             &num_range_skipped, &num_precursors_skipped, &num_isotopes_skipped, &num_retained);
         }
         //END XCORR
@@ -782,7 +1054,7 @@ void TideSearchApplication::search(void* threadarg) {
           // aaMassDouble contains amino acids masses in float form
           // aaMass contains amino acid asses in integer form
           // precursorMass is the neutral mass
-          observed.CreateResidueEvidenceMatrix(*spectrum, charge, maxPrecurMassBin, precursorMass,
+          observed.CreateResidueEvidenceMatrix(*spectrum, charge, config, maxPrecurMassBin, precursorMass,
                                                nAARes, aaMassDouble, fragTol, granularityScale,
                                                nTermMass, cTermMass,&num_range_skipped, 
                                                &num_precursors_skipped, &num_isotopes_skipped, &num_retained,
@@ -843,7 +1115,7 @@ void TideSearchApplication::search(void* threadarg) {
 
           //RES-EV
           if (curScoreFunction != XCORR_SCORE) {
-            vector<vector<double> > curResidueEvidenceMatrix = residueEvidenceMatrix[pepMassIntIdx];
+            const vector<vector<double> >& curResidueEvidenceMatrix = residueEvidenceMatrix[pepMassIntIdx];
             Peptide* curPeptide = (*iter_);
 
             vector<unsigned int> intensArrayTheorResEv;
@@ -908,7 +1180,7 @@ void TideSearchApplication::search(void* threadarg) {
           scoreOffsetObs[pe] = calcScoreCount(maxPrecurMassBin, &evidenceObs[pe][0], pepMaInt,
                                maxEvidence, minEvidence, maxScore, minScore,
                                nAA, aaFreqN, aaFreqI, aaFreqC, aaMass,
-                               pValueScoreObs[pe]);
+                               pValueScoreObs[pe], &dyn_prog);
         }
       }
       //END XCORR
@@ -923,7 +1195,7 @@ void TideSearchApplication::search(void* threadarg) {
             continue;
           }
 
-          vector<vector<double> > curResidueEvidenceMatrix = residueEvidenceMatrix[pe];
+          vector<vector<double> >& curResidueEvidenceMatrix = residueEvidenceMatrix[pe];
           vector<int> maxColEvidence(curPepMassInt,0);
 
           //maxColEvidence is edited by reference
@@ -942,7 +1214,7 @@ void TideSearchApplication::search(void* threadarg) {
           calcResidueScoreCount(nAARes,curPepMassInt,curResidueEvidenceMatrix,aaMassInt,
                                 dAAFreqN, dAAFreqI, dAAFreqC,nTermMassBin,cTermMassBin,
                                 minDeltaMass,maxDeltaMass,maxEvidence,maxScore,
-                                scoreResidueCount,scoreOffset);
+                                scoreResidueCount,scoreOffset,&dyn_prog);
           scoreResidueOffsetObs[curPepMassInt] = scoreOffset;
 
           double totalCount = 0;
@@ -1053,9 +1325,12 @@ void TideSearchApplication::search(void* threadarg) {
         // matches will arrange the results in a heap by score, return the top
         // few, and recover the association between counter and peptide. We output
         // the top matches.
-        TideMatchSet matches(&match_arr, highest_mz);
+        TideMatchSet matches(&match_arr, highest_mz, config);
         matches.exact_pval_search_ = exact_pval_search_;
         matches.cur_score_function_ = curScoreFunction;
+        matches.target_writer_ = target_writer_;
+        matches.decoy_writer_ = decoy_writer_;
+        matches.buffered_output_ = buffered_output;
 
         if (curScoreFunction == RESIDUE_EVIDENCE_MATRIX && exact_pval_search_ == false) {
           matches.report(target_file, decoy_file, top_matches, spectrum_filename,
@@ -1072,9 +1347,32 @@ void TideSearchApplication::search(void* threadarg) {
     delete max_mass;
     delete candidatePeptideStatus;
   }
+  if (!batch.empty()) {
+    scoreSpectrumBatch(&batch, active_peptide_queue, spectrum_filename,
+                       proteins, locations, top_matches, highest_mz,
+                       target_file, decoy_file, buffered_output,
+                       compute_sp, locks_array,
+                       total_candidate_peptides);
+  }
+  if (bands != NULL) {
+    // The peptides still queued have all their hits.
+    active_peptide_queue->ReportRemainingHits();
+  }
+  if (buffered_output) {
+    buffers->flush(thread_num);
+  }
+  for (vector<ObservedPeakSet*>::iterator i = batch_observed.begin();
+       i != batch_observed.end();
+       ++i) {
+    delete *i;
+  }
+  // Let a shared peptide stream release what this thread was holding.
+  if (detach_peptide_stream_) {
+    active_peptide_queue->DetachStream();
+  }
 
-  if (!Params::GetBool("skip-preprocessing")) {
-    locks_array[LOCK_REPORTING]->lock();
+  if (!config.skip_preprocessing) {
+    Telemetry::Lock(locks_array[LOCK_REPORTING]);
     if (curScoreFunction == BOTH_SCORE) {
       num_precursors_skipped = num_precursors_skipped / 2;
       num_isotopes_skipped = num_isotopes_skipped / 2;
@@ -1144,7 +1442,7 @@ void TideSearchApplication::search(
   bool peptide_centric = Params::GetBool("peptide-centric-search");
 
   // initialize fields required for output
-  int* sc_index = new int(-1);
+  int* sc_index = new int(0);
   int* total_candidate_peptides = new int(0);
   FLOAT_T sc_total = (FLOAT_T)spec_charges->size();
 
@@ -1169,9 +1467,30 @@ void TideSearchApplication::search(
     }
   }
 
+  // Spectrum-charge pairs are handed out to the threads in contiguous chunks.
+  // Threads sharing a peptide stream take turns along the mass range so that
+  // the stream only holds the peptides around the current masses; otherwise
+  // each thread starts on its own band of masses.
+  SpectrumScheduler scheduler(spec_charges->size(), NUM_THREADS,
+                              active_peptide_queue[0]->SharesStream());
+
+  // Threads format their tab-delimited results into buffers of their own,
+  // written out by a separate thread. Peptide-centric results are written as
+  // the peptides leave the threads' queues, in no particular order.
+  TideResultBuffers* buffers =
+    new TideResultBuffers(target_file, decoy_file, NUM_THREADS,
+                          !peptide_centric && Params::GetBool("deterministic-output"));
+
+  PeptideBands* bands = NULL;
+  if (peptide_centric) {
+    bands = makePeptideBands(spec_charges, window_type, precursor_window,
+                             negative_isotope_errors);
+  }
+
   for (int i = 0; i < NUM_THREADS; i++) {
     active_peptide_queue[i]->SetOutputs(
-      NULL, &locations, top_matches, compute_sp, target_file, decoy_file, highest_mz);
+      NULL, &locations, top_matches, compute_sp, buffers->target(i),
+      buffers->decoy(i), highest_mz, config_);
   }
 
   // Creating structs to hold information required for each thread to search through
@@ -1186,7 +1505,8 @@ void TideSearchApplication::search(
       i, NUM_THREADS, nAA, aaFreqN, aaFreqI, aaFreqC, aaMass,
       nAARes, &dAAFreqN, &dAAFreqI, &dAAFreqC, &dAAMass,
       &mod_table, &nterm_mod_table, &cterm_mod_table, locks_array, //TODO do I need to delete pointer somewhere?
-      bin_width_, bin_offset_, exact_pval_search_, spectrum_flag_, sc_index, total_candidate_peptides, negative_isotope_errors));
+      bin_width_, bin_offset_, exact_pval_search_, spectrum_flag_, sc_index, total_candidate_peptides, negative_isotope_errors,
+      &scheduler, buffers, bands));
   }
 
   boost::thread_group threadgroup;
@@ -1202,6 +1522,9 @@ void TideSearchApplication::search(
 
   // Join threads
   threadgroup.join_all();
+  buffers->finish();
+  delete buffers;
+  delete bands;
 
   carp(CARP_INFO, "Time per spectrum-charge combination: %lf s.", wall_clock() / (1e6*sc_total));
   carp(CARP_INFO, "Average number of candidates per spectrum-charge combination: %lf ",
@@ -1225,9 +1548,6 @@ void TideSearchApplication::collectScoresCompiled(
   if (!active_peptide_queue->HasNext()) {
     return;
   }
-  // prog gets the address of the dot-product program for the first peptide
-  // in the active queue.
-  const void* prog = active_peptide_queue->NextPeptide()->Prog(charge);
   const int* cache = observed.GetCache();
   // results will get (score, counter) pairs, where score is the dot product
   // of the observed peak set with a candidate peptide. The candidate
@@ -1236,6 +1556,42 @@ void TideSearchApplication::collectScoresCompiled(
   // simplifies the generated programs, which now simply dump the counter.
   pair<int, int>* results = match_arr->data();
 
+  scorePeptides(active_peptide_queue->iter_, queue_size, charge, cache, results);
+
+  // match_arr is filled by the compiled programs, not by calls to
+  // push_back(). We have to set the final size explicitly.
+  match_arr->set_size(queue_size);
+}
+
+void TideSearchApplication::scorePeptides(
+  deque<Peptide*>::const_iterator peptide,
+  int num_peptides,
+  int charge,
+  const int* cache,
+  pair<int, int>* results
+) {
+  if (ScoreEngine::Compiled()) {
+    // Run the chain of programs beginning with that of the first peptide.
+    runCompiledPrograms((*peptide)->Prog(charge), cache, num_peptides, results);
+    return;
+  }
+  // Store the same (score, counter) pairs as the compiled programs would.
+  for (int counter = num_peptides; counter > 0; --counter, ++peptide, ++results) {
+    const int* codes;
+    int num_codes = (*peptide)->Peaks(charge, &codes);
+    results->first = ScoreEngine::DotProd(cache, codes, num_codes);
+    results->second = counter;
+  }
+}
+
+void TideSearchApplication::runCompiledPrograms(
+  const void* prog,
+  const int* cache,
+  int num_programs,
+  pair<int, int>* results
+) {
+  int queue_size = num_programs;
+
   // See compiler.h for a description of the programs beginning at prog and
   // how they are generated. Here we initialize certain registers to the
   // values expected by the programs and call the first one (*prog).
@@ -1320,10 +1676,131 @@ void TideSearchApplication::collectScoresCompiled(
                          "D" (results)
   );
 #endif
+}
 
-  // match_arr is filled by the compiled programs, not by calls to
-  // push_back(). We have to set the final size explicitly.
-  match_arr->set_size(queue_size);
+void TideSearchApplication::scoreSpectrumBatch(
+  vector<SpectrumBatchEntry>* batch,
+  ActivePeptideQueue* active_peptide_queue,
+  const string& spectrum_filename,
+  ProteinVec& proteins,
+  vector<const pb::AuxLocation*>& locations,
+  int top_matches,
+  double highest_mz,
+  ostream* target_file,
+  ostream* decoy_file,
+  bool buffered_output,
+  bool compute_sp,
+  vector<boost::mutex*>& locks_array,
+  int* total_candidate_peptides
+) {
+  // Number of consecutive peptide programs run against each spectrum of the
+  // batch before moving on to the next tile. Small enough that the programs
+  // of a tile stay in the instruction cache while the batch is scored.
+  const int PEPTIDE_TILE_SIZE = 32;
+
+  Telemetry::Scope scoring_scope(Telemetry::SCORING);
+
+  // Load the candidates for the whole batch with a single call, then select
+  // each spectrum's own window among them.
+  double min_range = (*batch)[0].min_range;
+  double max_range = (*batch)[0].max_range;
+  for (vector<SpectrumBatchEntry>::const_iterator i = batch->begin() + 1;
+       i != batch->end();
+       ++i) {
+    min_range = min(min_range, i->min_range);
+    max_range = max(max_range, i->max_range);
+  }
+  int lo = INT_MAX, hi = 0;
+  int total_size = 0;
+  for (vector<SpectrumBatchEntry>::iterator i = batch->begin(); i != batch->end(); ++i) {
+    if (i == batch->begin()) {
+      i->nCandPeptide = active_peptide_queue->SetActiveRange(
+        &i->min_mass, &i->max_mass, min_range, max_range, &i->candidatePeptideStatus);
+    } else {
+      i->nCandPeptide = active_peptide_queue->SetActiveWindow(
+        &i->min_mass, &i->max_mass, &i->candidatePeptideStatus);
+    }
+    if (i->nCandPeptide == 0) {
+      continue;
+    }
+    i->window = active_peptide_queue->GetActiveWindow();
+    lo = min(lo, i->window.offset);
+    hi = max(hi, i->window.offset + (int)i->candidatePeptideStatus.size());
+    total_size += i->candidatePeptideStatus.size();
+  }
+  if (total_size == 0) {
+    return;
+  }
+
+  // Scores for spectrum i go to results, starting at result_offset[i].
+  vector< pair<int, int> > results(total_size);
+  vector<int> result_offset(batch->size());
+  int offset = 0;
+  for (size_t i = 0; i < batch->size(); ++i) {
+    result_offset[i] = offset;
+    if ((*batch)[i].nCandPeptide > 0) {
+      offset += (*batch)[i].candidatePeptideStatus.size();
+    }
+  }
+
+  // Peptide-outer, spectrum-inner: each tile of programs is run against all
+  // the spectra whose windows it overlaps.
+  for (int tile = lo; tile < hi; tile += PEPTIDE_TILE_SIZE) {
+    for (size_t i = 0; i < batch->size(); ++i) {
+      const SpectrumBatchEntry& entry = (*batch)[i];
+      if (entry.nCandPeptide == 0) {
+        continue;
+      }
+      int begin = max(tile, entry.window.offset);
+      int end = min(tile + PEPTIDE_TILE_SIZE,
+                    entry.window.offset + (int)entry.candidatePeptideStatus.size());
+      if (begin >= end) {
+        continue;
+      }
+      scorePeptides(entry.window.iter + (begin - entry.window.offset), end - begin,
+                    entry.sc->charge, entry.observed->GetCache(),
+                    &results[result_offset[i] + begin - entry.window.offset]);
+    }
+  }
+
+  for (size_t i = 0; i < batch->size(); ++i) {
+    const SpectrumBatchEntry& entry = (*batch)[i];
+    if (entry.nCandPeptide == 0) {
+      continue;
+    }
+    Telemetry::Count(Telemetry::CANDIDATES, entry.nCandPeptide);
+    Telemetry::Lock(locks_array[LOCK_CANDIDATES]);
+    *total_candidate_peptides += entry.nCandPeptide;
+    locks_array[LOCK_CANDIDATES]->unlock();
+
+    // The programs were run a tile at a time, so the counters they stored
+    // are relative to the tile. Convert each to the index within the
+    // spectrum's window, counting from the back, as collectScoresCompiled()
+    // would have produced.
+    int candidatePeptideStatusSize = entry.candidatePeptideStatus.size();
+    TideMatchSet::Arr match_arr(entry.nCandPeptide);
+    for (int peptide_idx = 0; peptide_idx < candidatePeptideStatusSize; ++peptide_idx) {
+      if (entry.candidatePeptideStatus[peptide_idx]) {
+        TideMatchSet::Scores curScore;
+        curScore.xcorr_score =
+          (double)(results[result_offset[i] + peptide_idx].first / XCORR_SCALING);
+        curScore.rank = candidatePeptideStatusSize - peptide_idx;
+        match_arr.push_back(curScore);
+      }
+    }
+
+    active_peptide_queue->RestoreActiveWindow(entry.window);
+    TideMatchSet matches(&match_arr, highest_mz, *config_);
+    matches.exact_pval_search_ = false;
+    matches.cur_score_function_ = XCORR_SCORE;
+    matches.target_writer_ = target_writer_;
+    matches.decoy_writer_ = decoy_writer_;
+    matches.buffered_output_ = buffered_output;
+
+    matches.report(target_file, decoy_file, top_matches, spectrum_filename,
+                   entry.sc->spectrum, entry.sc->charge, active_peptide_queue,
+                   proteins, locations, compute_sp, true, locks_array[LOCK_RESULTS]);
+  }
 }
 
 void TideSearchApplication::convertResults() const {
@@ -1375,6 +1852,40 @@ void TideSearchApplication::convertResults() const {
   }
 }
 
+/**
+ * Divide the peptide masses among the threads for peptide-centric search,
+ * so that each thread's band starts at the window of an equal share of
+ * spec_charges.
+ */
+TideSearchApplication::PeptideBands* TideSearchApplication::makePeptideBands(
+  const vector<SpectrumCollection::SpecCharge>* spec_charges,
+  WINDOW_TYPE_T window_type,
+  double precursor_window,
+  vector<int>* negative_isotope_errors
+) {
+  PeptideBands* bands = new PeptideBands;
+  int max_charge = Params::GetInt("max-precursor-charge");
+  int num_sc = (int)spec_charges->size();
+  bands->min_range.resize(num_sc);
+  bands->max_range.resize(num_sc);
+  vector<double> min_mass, max_mass;
+  for (int i = 0; i < num_sc; i++) {
+    min_mass.clear();
+    max_mass.clear();
+    computeWindow((*spec_charges)[i], window_type, precursor_window, max_charge,
+                  negative_isotope_errors, &min_mass, &max_mass,
+                  &bands->min_range[i], &bands->max_range[i]);
+  }
+  bands->bounds.push_back(-numeric_limits<double>::max());
+  for (int t = 1; t < NUM_THREADS; t++) {
+    int first = (int)((int64_t)t * num_sc / NUM_THREADS);
+    double bound = first < num_sc ? bands->min_range[first] : bands->bounds.back();
+    bands->bounds.push_back(max(bound, bands->bounds.back()));
+  }
+  bands->bounds.push_back(numeric_limits<double>::max());
+  return bands;
+}
+
 void TideSearchApplication::computeWindow(
   const SpectrumCollection::SpecCharge& sc,
   WINDOW_TYPE_T window_type,
@@ -1485,12 +1996,14 @@ vector<string> TideSearchApplication::getOptions() const {
     "compute-sp",
     "concat",
     "deisotope",
+    "deterministic-output",
     "elution-window-size",
     "exact-p-value",
     "file-column",
     "fileroot",
     "isotope-error",
     "mass-precision",
+    "max-memory",
     "max-precursor-charge",
     "min-peaks",
     "mod-precision",
@@ -1503,6 +2016,7 @@ vector<string> TideSearchApplication::getOptions() const {
     "parameter-file",
     "peptide-centric-search",
     "score-function",
+    "score-engine",
     "fragment-tolerance",
     "evidence-granularity",
     "pepxml-output",
@@ -1527,6 +2041,7 @@ vector<string> TideSearchApplication::getOptions() const {
     "remove-precursor-tolerance",
     "scan-number",
     "skip-preprocessing",
+    "spectrum-batch-size",
     "spectrum-charge",
     "spectrum-max-mz",
     "spectrum-min-mz",
@@ -1534,6 +2049,8 @@ vector<string> TideSearchApplication::getOptions() const {
     "sqt-output",
     "store-index",
     "store-spectra",
+    "telemetry",
+    "temp-dir",
     "top-match",
     "txt-output",
     "use-flanking-peaks",
@@ -1560,6 +2077,10 @@ vector< pair<string, string> > TideSearchApplication::getOutputs() const {
   outputs.push_back(make_pair("tide-search.log.txt",
     "a log file containing a copy of all messages that were printed to the "
     "screen during execution."));
+  outputs.push_back(make_pair("tide-search.telemetry.txt",
+    "a tab-delimited file giving, for each thread, the time spent in each "
+    "phase of the search and the number of spectra and candidate peptides "
+    "searched. This file will only be created if --telemetry is T."));
   return outputs;
 }
 bool TideSearchApplication::needsOutputDirectory() const {
@@ -1570,10 +2091,91 @@ COMMAND_T TideSearchApplication::getCommand() const {
   return TIDE_SEARCH_COMMAND;
 }
 
+void TideSearchApplication::DynProgWorkspace::Reset(int rows, int cols) {
+  nRow = rows;
+  size_t size = (size_t)rows * cols;
+  if (counts.size() < size) {
+    counts.resize(size);
+  }
+  bandFirst.assign(cols, rows);
+  bandLast.assign(cols, -1);
+}
+
+void TideSearchApplication::DynProgWorkspace::Widen(int col, int first, int last) {
+  if (first > last) {
+    return;
+  }
+  double* column = Column(col);
+  if (Empty(col)) {
+    std::fill(column + first, column + last + 1, 0.0);
+    bandFirst[col] = first;
+    bandLast[col] = last;
+    return;
+  }
+  if (first < bandFirst[col]) {
+    std::fill(column + first, column + bandFirst[col], 0.0);
+    bandFirst[col] = first;
+  }
+  if (last > bandLast[col]) {
+    std::fill(column + bandLast[col] + 1, column + last + 1, 0.0);
+    bandLast[col] = last;
+  }
+}
+
+void TideSearchApplication::DynProgWorkspace::Step(
+  int col,
+  int rowFirst,
+  int rowLast,
+  int nAa,
+  const int* aaMass,
+  const double* aaFreq,
+  bool replace
+) {
+  // Rows of col reachable from the bands of the preceding columns.
+  int first = rowLast + 1;
+  int last = rowFirst - 1;
+  for (int de = 0; de < nAa; de++) {
+    int src = col - aaMass[de];
+    if (!Empty(src)) {
+      first = min(first, max(bandFirst[src] + shift[de], rowFirst));
+      last = max(last, min(bandLast[src] + shift[de], rowLast));
+    }
+  }
+  double* out = Column(col);
+  if (replace && !Empty(col)) {
+    int zeroFirst = max(bandFirst[col], rowFirst);
+    int zeroLast = min(bandLast[col], rowLast);
+    if (zeroFirst <= zeroLast) {
+      std::fill(out + zeroFirst, out + zeroLast + 1, 0.0);
+    }
+  }
+  Widen(col, first, last);
+  // Amino acids are added in the same order for every row, as a row at a
+  // time would, so the sums are unchanged; the loop over contiguous rows
+  // vectorizes.
+  for (int de = 0; de < nAa; de++) {
+    int src = col - aaMass[de];
+    if (Empty(src)) {
+      continue;
+    }
+    int e = shift[de];
+    int f = max(bandFirst[src] + e, rowFirst);
+    int l = min(bandLast[src] + e, rowLast);
+    const double* in = Column(src);
+    double freq = aaFreq[de];
+    for (int row = f; row <= l; row++) {
+      out[row] += in[row - e] * freq;
+    }
+  }
+}
+
 /* Calculates counts of peptides with various XCorr scores, given a preprocessed
  * MS2 spectrum, using dynamic programming.
  * Written by Jeff Howbert, October, 2012 (as function calcScoreCount).
  * Ported to and integrated with Tide by Jeff Howbert, November, 2013.
+ *
+ * Only the band of reachable scores of each mass column is computed; see
+ * DynProgWorkspace.
  */
 int TideSearchApplication::calcScoreCount(
   int numelEvidenceObs,
@@ -1588,8 +2190,10 @@ int TideSearchApplication::calcScoreCount(
   double* aaFreqI,
   double* aaFreqC,
   int* aaMass,
-  double* pValueScoreObs
+  double* pValueScoreObs,
+  DynProgWorkspace* workspace
 ) {
+  Telemetry::Scope scope(Telemetry::PVALUE);
   const int nDeltaMass = nAA;
   int minDeltaMass = aaMass[0];
   int maxDeltaMass = aaMass[nDeltaMass - 1];
@@ -1598,10 +2202,7 @@ int TideSearchApplication::calcScoreCount(
   int row;
   int col;
   int ma;
-  int evidence;
   int de;
-  int evidenceRow;
-  double sumScore;
 
   int bottomRowBuffer = maxEvidence + 1;
   int topRowBuffer = -minEvidence;
@@ -1619,91 +2220,54 @@ int TideSearchApplication::calcScoreCount(
   int initCountRow = bottomRowBuffer - minScore;
   int initCountCol = maxDeltaMass + colStart;
 
-  double** dynProgArray = new double*[nRow];
-  for (row = 0; row < nRow; row++) {
-    dynProgArray[row] = new double[nCol];
-    for (col = 0; col < nCol; col++) {
-      dynProgArray[row][col] = 0.0;
-    }
-  }
-  double* scoreCountBinAdjust = 0;
-  scoreCountBinAdjust = new double[nRow];
-  for (row = 0; row < nRow; row++) {
-    scoreCountBinAdjust[row] = 0.0;
-  }
+  workspace->Reset(nRow, nCol);
+  workspace->shift.resize(nDeltaMass);
 
-  dynProgArray[initCountRow][initCountCol] = 1.0; // initial count of peptides with mass = 1
-  vector<int> deltaMassCol(nDeltaMass);
-  // populate matrix with scores for first (i.e. N-terminal) amino acid in sequence
+  // populate matrix with scores for first (i.e. N-terminal) amino acid in
+  // sequence, starting from a count of 1 for peptides with mass = 1
   for (de = 0; de < nDeltaMass; de++) {
     ma = aaMass[de];
     row = initCountRow + evidenceObs[ma + colStart];
     col = initCountCol + ma;
     if (col <= maxDeltaMass + colLast) {
-      dynProgArray[row][col] += dynProgArray[initCountRow][initCountCol] * aaFreqN[de];
+      workspace->Widen(col, row, row);
+      workspace->Column(col)[row] += 1.0 * aaFreqN[de];
     }
   }
-  // set to zero now that score counts for first amino acid are in matrix
-  dynProgArray[initCountRow][initCountCol] = 0.0;
   // populate matrix with score counts for non-terminal amino acids in sequence
   for (ma = colFirst; ma < colLast; ma++) {
     col = maxDeltaMass + ma;
-    evidence = evidenceObs[ma];
-    for (de = 0; de < nDeltaMass; de++) {
-      deltaMassCol[de] = col - aaMass[de];
-    }
-    for (row = rowFirst; row <= rowLast; row++) {
-      evidenceRow = row - evidence;
-      sumScore = dynProgArray[row][col];
-      for (de = 0; de < nDeltaMass; de++) {
-        sumScore += dynProgArray[evidenceRow][deltaMassCol[de]] * aaFreqI[de];
-      }
-      dynProgArray[row][col] = sumScore;
-    }
+    std::fill(workspace->shift.begin(), workspace->shift.end(), evidenceObs[ma]);
+    workspace->Step(col, rowFirst, rowLast, nDeltaMass, aaMass, aaFreqI, false);
   }
   // populate matrix with score counts for last (i.e. C-terminal) amino acid in sequence
   ma = colLast;
   col = maxDeltaMass + ma;
-  evidence = 0; // no evidence should be added for last amino acid in sequence
-  for (de = 0; de < nDeltaMass; de++) {
-    deltaMassCol[de] = col - aaMass[de];
-  }
-  for (row = rowFirst; row <= rowLast; row++) {
-    evidenceRow = row - evidence;
-    sumScore = 0.0;
-    for (de = 0; de < nDeltaMass; de++) {
-      sumScore += dynProgArray[evidenceRow][deltaMassCol[de]] * aaFreqC[de];  // C-terminal residue
-    }
-    dynProgArray[row][col] = sumScore;
-  }
+  // no evidence should be added for last amino acid in sequence
+  std::fill(workspace->shift.begin(), workspace->shift.end(), 0);
+  workspace->Step(col, rowFirst, rowLast, nDeltaMass, aaMass, aaFreqC, true);
 
   int colScoreCount = maxDeltaMass + colLast;
   double totalCount = 0.0;
   for (row = 0; row < nRow; row++) {
     // at this point pValueScoreObs just holds counts from last column of dynamic programming array
-    pValueScoreObs[row] = dynProgArray[row][colScoreCount];
+    pValueScoreObs[row] = workspace->Count(colScoreCount, row);
     totalCount += pValueScoreObs[row];
-    scoreCountBinAdjust[row] = pValueScoreObs[row] / 2.0;
   }
-  // convert from counts to cumulative sum of counts
-  for (row = nRow - 2; row >= 0; row--) {
-    pValueScoreObs[row] += pValueScoreObs[row + 1];
+  // convert from counts to cumulative sum of counts, adjusted to reflect
+  // the center of each bin, not its edge
+  double cumulative = 0.0;
+  for (row = nRow - 1; row >= 0; row--) {
+    double count = pValueScoreObs[row];
+    cumulative += count;
+    pValueScoreObs[row] = cumulative - count / 2.0;
   }
   double logTotalCount = log(totalCount);
   for (row = 0; row < nRow; row++) {
-    // adjust counts to reflect center of bin, not edge
-    pValueScoreObs[row] -= scoreCountBinAdjust[row];
     // normalize distribution; use exp( log ) to avoid potential underflow
     pValueScoreObs[row] = exp(log(pValueScoreObs[row]) - logTotalCount);
   }
 
-  // clean up
-  for (row = 0; row < nRow; row++) {
-    delete [] dynProgArray[row];
-  }
-  delete [] dynProgArray;
-  delete [] scoreCountBinAdjust;
-
   return scoreOffsetObs;
 }
 
@@ -1724,6 +2288,9 @@ int TideSearchApplication::calcScoreCount(
  *
  * Added by Andy Lin, March 2-16
  * Edited to work within Crux code instead of with original MATLAB code
+ *
+ * As for calcScoreCount(), only the band of reachable scores of each mass
+ * column is computed.
  */
 void TideSearchApplication::calcResidueScoreCount (
   int nAa,
@@ -1740,18 +2307,17 @@ void TideSearchApplication::calcResidueScoreCount (
   int maxEvidence,
   int maxScore,
   vector<double>& scoreCount, //this is returned for later use
-  int& scoreOffset //this is returned for later use
+  int& scoreOffset, //this is returned for later use
+  DynProgWorkspace* workspace
 ) {
+  Telemetry::Scope scope(Telemetry::PVALUE);
   int minEvidence  = 0;
   int minScore     = 0;
 
   int row;
   int col;
   int ma;
-  int evid;
   int de;
-  int evidRow;
-  double sumScore;
 
   int bottomRowBuffer = maxEvidence;
   int topRowBuffer = -minEvidence;
@@ -1774,19 +2340,13 @@ void TideSearchApplication::calcResidueScoreCount (
   initCountRow = initCountRow - 1;
   initCountCol = initCountCol - 1;
 
-  double** dynProgArray = 0;
-  dynProgArray = new double*[nRow];
-  for (row = 0; row < nRow; row++) {
-    dynProgArray[row] = new double[nCol];
-    for (col = 0; col < nCol; col++) {
-      dynProgArray[row][col] = 0.0;
-    }
-  }
+  workspace->Reset(nRow, nCol);
+  workspace->shift.resize(nAa);
 
-  // initial count of peptides with mass = nTermMass
-  dynProgArray[initCountRow][initCountCol] = 1.0;
+  // initial count of peptides with mass = nTermMass. It is kept out of the
+  // matrix, whose cell for it is zero once the first amino acid is added.
+  double initCount = 1.0;
 
-  int* aaMassCol = new int[nAa];
   // populate matrix with scores for first (i.e. N-terminal) amino acid in sequence
   for (de = 0; de < nAa; de++) {
     ma = aaMass[de];
@@ -1805,29 +2365,24 @@ void TideSearchApplication::calcResidueScoreCount (
 //    if ( col <= maxAaMass + colLast ) { //original
     if (col <= maxAaMass + colLast && col >= initCountCol) { //TODO not sure if below or above is correct
       //dynProgArray[ row ][ col ] += dynProgArray[ initCountRow ][ initCountCol ];
-      dynProgArray[row][col] += dynProgArray[initCountRow][initCountCol] * aaFreqN[de];
+      double count = initCount * aaFreqN[de];
+      if (row == initCountRow && col == initCountCol) {
+        initCount += count;
+      } else {
+        workspace->Widen(col, row, row);
+        workspace->Column(col)[row] += count;
+      }
     }
   }
 
-  //set to zero now that score counts for first amino acid are in matrix
-  dynProgArray[initCountRow][initCountCol] = 0.0;
-
   // populate matrix with score counts for non-terminal amino acids in sequence
   for (ma = colFirst; ma < colLast; ma++) {
     col = maxAaMass + ma;
-
     for (de = 0; de < nAa; de++) {
-      aaMassCol[de] = col - aaMass[de];
-    }
-    for (row = rowFirst; row <= rowLast; row++) {
-      sumScore = dynProgArray[row][col];
-      for (de = 0; de < nAa; de++) {
-        evidRow = row - residueEvidenceMatrix[de][ma];
-        //sumScore += dynProgArray[ evidRow ][ aaMassCol[ de ] ];
-        sumScore += dynProgArray[evidRow][aaMassCol[de]] * aaFreqI[de];
-      }
-      dynProgArray[row][col] = sumScore;
+      // evidence is integral; see ObservedPeakSet::CreateResidueEvidenceMatrix()
+      workspace->shift[de] = (int)residueEvidenceMatrix[de][ma];
     }
+    workspace->Step(col, rowFirst, rowLast, nAa, &aaMass[0], &aaFreqI[0], false);
   }
 
   // populate matrix with score counts for last (i.e. C-terminal) amino acid in sequence
@@ -1835,33 +2390,15 @@ void TideSearchApplication::calcResidueScoreCount (
   col = maxAaMass + ma;
 
   //no evidence should be added for last amino acid in sequence
-  evid = 0;
-  for (de = 0; de < nAa; de++) {
-    aaMassCol[de] = col - aaMass[de];
-  }
-  for (row = rowFirst; row <= rowLast; row++) {
-    evidRow = row - evid;
-    sumScore = 0.0;
-    for (de = 0; de < nAa; de++) {
-      //sumScore += dynProgArray[ evidRow ][ aaMassCol[ de ] ];
-      sumScore += dynProgArray[evidRow][aaMassCol[de]] * aaFreqC[de];
-    }
-    dynProgArray[row][col] = sumScore;
-  }
+  std::fill(workspace->shift.begin(), workspace->shift.end(), 0);
+  workspace->Step(col, rowFirst, rowLast, nAa, &aaMass[0], &aaFreqC[0], true);
 
   int colScoreCount = maxAaMass + colLast;
   scoreCount.resize(nRow);
   for (int row = 0; row < nRow; row++) {
-    scoreCount[row] = dynProgArray[row][colScoreCount];
+    scoreCount[row] = workspace->Count(colScoreCount, row);
   }
   scoreOffset = initCountRow;
-
-  // clean up
-  for (int row = 0; row < nRow; row++) {
-    delete [] dynProgArray[row];
-  }
-  delete [] dynProgArray;
-  delete [] aaMassCol;
 }
 
 void TideSearchApplication::processParams() {
@@ -1887,7 +2424,7 @@ void TideSearchApplication::processParams() {
     // Index is Tide index directory
     pb::Header peptides_header;
     string peptides_file = FileUtils::Join(index, "pepix");
-    HeadedRecordReader peptide_reader(peptides_file, &peptides_header);
+    delete openPeptideReader(peptides_file, &peptides_header);
     if ((peptides_header.file_type() != pb::Header::PEPTIDES) ||
         !peptides_header.has_peptides_header()) {
       carp(CARP_FATAL, "Error reading index (%s).", peptides_file.c_str());
@@ -3,6 +3,7 @@
 
 #include "CruxApplication.h"
 #include "TideMatchSet.h"
+#include "TideResultBuffers.h"
 
 #include <iostream>
 #include <fstream>
@@ -12,6 +13,8 @@
 #include "spectrum.pb.h"
 #include "tide/theoretical_peak_set.h"
 #include "tide/max_mz.h"
+#include "tide/spectrum_scheduler.h"
+#include "tide/spectrum_sorter.h"
 
 using namespace std;
 
@@ -92,6 +95,7 @@ private:
   vector<int> getNegativeIsotopeErrors() const;
   vector<InputFile> getInputFiles(const vector<string>& filepaths) const;
   static SpectrumCollection* loadSpectra(const std::string& file);
+  SpectrumSorter* sortSpectra(const std::string& file, size_t max_memory) const;
 
   /**
    * Function that contains the search algorithm and performs the search
@@ -154,8 +158,136 @@ private:
     int charge
   );
 
+  /**
+   * Runs num_programs consecutive compiled dot-product programs, beginning
+   * with prog, against the given observed peak cache, storing (score,
+   * counter) pairs in results. See compiler.h.
+   */
+  static void runCompiledPrograms(
+    const void* prog,
+    const int* cache,
+    int num_programs,
+    pair<int, int>* results
+  );
+
+  /**
+   * Scores num_peptides consecutive peptides, beginning with the given one,
+   * against the observed peak cache with the selected ScoreEngine. Stores
+   * (score, counter) pairs in results as the compiled programs do.
+   */
+  static void scorePeptides(
+    deque<Peptide*>::const_iterator peptide,
+    int num_peptides,
+    int charge,
+    const int* cache,
+    pair<int, int>* results
+  );
+
+  /**
+   * A spectrum-charge pair waiting to be scored as part of a batch.
+   */
+  struct SpectrumBatchEntry {
+    const SpectrumCollection::SpecCharge* sc;
+    ObservedPeakSet* observed;
+    vector<double> min_mass;
+    vector<double> max_mass;
+    double min_range;
+    double max_range;
+    vector<bool> candidatePeptideStatus;
+    int nCandPeptide;
+    ActivePeptideQueue::ActiveWindow window;
+  };
+
+  /**
+   * Peptide-centric search divides the peptide mass range into one band per
+   * thread. A thread keeps the hits of the peptides in its own band only,
+   * so each peptide's hits are all found by one thread and can be reported
+   * when it leaves that thread's queue. The thread searches every spectrum
+   * whose precursor window overlaps its band.
+   */
+  struct PeptideBands {
+    vector<double> bounds;     // band t is [bounds[t], bounds[t + 1])
+    vector<double> min_range;  // precursor window of each spectrum-charge pair
+    vector<double> max_range;
+
+    bool Owns(int thread, double mass) const {
+      return bounds[thread] <= mass && mass < bounds[thread + 1];
+    }
+    bool Overlaps(int thread, int sc) const {
+      return max_range[sc] >= bounds[thread] && min_range[sc] < bounds[thread + 1];
+    }
+  };
+
+  /**
+   * Storage for the dynamic programs of calcScoreCount() and
+   * calcResidueScoreCount(). Each search thread keeps one and reuses it for
+   * every call, so the count matrix is only allocated when it must grow.
+   *
+   * The matrix is stored a mass column at a time, with the score rows of a
+   * column contiguous. Each column also records the band of rows that may
+   * hold nonzero counts; rows outside it are never read or written, so the
+   * matrix never needs clearing.
+   */
+  struct DynProgWorkspace {
+    int nRow;
+    vector<double> counts;
+    vector<int> bandFirst;
+    vector<int> bandLast;
+    vector<int> shift;  // per amino acid, for Step()
+
+    // Start a new program with all columns empty.
+    void Reset(int rows, int cols);
+    double* Column(int col) { return &counts[(size_t)col * nRow]; }
+    bool Empty(int col) const { return bandFirst[col] > bandLast[col]; }
+    // Count of row in column col, 0 outside its band.
+    double Count(int col, int row) const {
+      return (row < bandFirst[col] || row > bandLast[col]) ?
+        0.0 : counts[(size_t)col * nRow + row];
+    }
+    // Widen the band of column col to include rows [first, last], zeroing
+    // the rows added to it.
+    void Widen(int col, int first, int last);
+    // For rows [rowFirst, rowLast] of column col, add the counts of column
+    // col - aaMass[i], moved up by shift[i] rows and weighted by aaFreq[i],
+    // for each amino acid i in turn. If replace, those rows are first set to
+    // zero instead of added to.
+    void Step(int col, int rowFirst, int rowLast, int nAa, const int* aaMass,
+              const double* aaFreq, bool replace);
+  };
+
+  /**
+   * Scores a batch of preprocessed spectrum-charge pairs, sorted by mass and
+   * with overlapping precursor windows, and reports their matches. The
+   * candidate peptides for the whole batch are loaded at once, and each
+   * small tile of peptides is scored against every spectrum of the batch in
+   * turn, so that their programs or peaks are read into cache once per batch
+   * instead of once per spectrum.
+   */
+  void scoreSpectrumBatch(
+    vector<SpectrumBatchEntry>* batch,
+    ActivePeptideQueue* active_peptide_queue,
+    const string& spectrum_filename,
+    ProteinVec& proteins,
+    vector<const pb::AuxLocation*>& locations,
+    int top_matches,
+    double highest_mz,
+    ostream* target_file,
+    ostream* decoy_file,
+    bool buffered_output,
+    bool compute_sp,
+    vector<boost::mutex*>& locks_array,
+    int* total_candidate_peptides
+  );
+
   void convertResults() const;
 
+  PeptideBands* makePeptideBands(
+    const vector<SpectrumCollection::SpecCharge>* spec_charges,
+    WINDOW_TYPE_T window_type,
+    double precursor_window,
+    vector<int>* negative_isotope_errors
+  );
+
   void computeWindow(
     const SpectrumCollection::SpecCharge& sc,
     WINDOW_TYPE_T window_type,
@@ -180,6 +312,10 @@ private:
   double bin_width_;
   double bin_offset_;
 
+  // Parameters consulted per spectrum or per match, resolved when main()
+  // begins.
+  SearchConfig* config_;
+
   std::string remove_index_;
 
   // this map can be used to preload spectra
@@ -187,6 +323,11 @@ private:
   // the SpectrumCollection must be sorted
   std::map<std::string, SpectrumCollection*> spectra_;
 
+  // Writers for the requested formats other than tab-delimited, or NULL.
+  // Peptide-centric search converts its tab-delimited results instead.
+  TideMatchWriter* target_writer_;
+  TideMatchWriter* decoy_writer_;
+
  public:
 
   // See TideSearchApplication.cpp for descriptions of these two constants
@@ -195,6 +336,10 @@ private:
 
   bool exact_pval_search_;
 
+  // False while more spectra are to be searched after the current call to
+  // search(), so that the threads stay attached to a shared peptide stream.
+  bool detach_peptide_stream_;
+
   /**
    * Constructor
    */
@@ -297,6 +442,9 @@ private:
     int* sc_index;
     int* total_candidate_peptides;
     vector<int>* negative_isotope_errors;
+    SpectrumScheduler* scheduler;
+    TideResultBuffers* buffers;
+    const PeptideBands* bands;
 
     thread_data (const string& spectrum_filename_, const vector<SpectrumCollection::SpecCharge>* spec_charges_,
             ActivePeptideQueue* active_peptide_queue_, ProteinVec proteins_,
@@ -311,7 +459,8 @@ private:
             const pb::ModTable* mod_table_, const pb::ModTable* nterm_mod_table_, const pb::ModTable* cterm_mod_table_,
             vector<boost::mutex*> locks_array_, double bin_width_, double bin_offset_, bool exact_pval_search_,
             map<pair<string, unsigned int>, bool>* spectrum_flag_, int* sc_index_, int* total_candidate_peptides_,
-            vector<int>* negative_isotope_errors_) :
+            vector<int>* negative_isotope_errors_, SpectrumScheduler* scheduler_,
+            TideResultBuffers* buffers_, const PeptideBands* bands_) :
             spectrum_filename(spectrum_filename_), spec_charges(spec_charges_), active_peptide_queue(active_peptide_queue_),
             proteins(proteins_), locations(locations_), precursor_window(precursor_window_), window_type(window_type_),
             spectrum_min_mz(spectrum_min_mz_), spectrum_max_mz(spectrum_max_mz_), min_scan(min_scan_), max_scan(max_scan_),
@@ -321,7 +470,8 @@ private:
             aaMass(aaMass_), nAARes(nAARes_), dAAFreqN(dAAFreqN_), dAAFreqI(dAAFreqI_), dAAFreqC(dAAFreqC_), dAAMass(dAAMass_),
             mod_table(mod_table_), nterm_mod_table(nterm_mod_table_), cterm_mod_table(cterm_mod_table_),
             locks_array(locks_array_), bin_width(bin_width_), bin_offset(bin_offset_), exact_pval_search(exact_pval_search_),
-            spectrum_flag(spectrum_flag_), sc_index(sc_index_), total_candidate_peptides(total_candidate_peptides_), negative_isotope_errors(negative_isotope_errors_) {}
+            spectrum_flag(spectrum_flag_), sc_index(sc_index_), total_candidate_peptides(total_candidate_peptides_), negative_isotope_errors(negative_isotope_errors_),
+            scheduler(scheduler_), buffers(buffers_), bands(bands_) {}
   };
 
   int calcScoreCount(
@@ -337,7 +487,8 @@ private:
     double* aaFreqI,
     double* aaFreqC,
     int* aaMass,
-    double* pValueScoreObs
+    double* pValueScoreObs,
+    DynProgWorkspace* workspace
   );
 
   void calcResidueScoreCount (
@@ -355,7 +506,8 @@ private:
     int maxEvidence,
     int maxScore,
     vector<double>& scoreCount, //this is returned for later use
-    int& scoreOffSet //this is returned for later use
+    int& scoreOffSet, //this is returned for later use
+    DynProgWorkspace* workspace
   );
 
   double calcCombinedPval( //calculates combined p-value
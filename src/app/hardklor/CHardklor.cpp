@@ -108,6 +108,9 @@ void CHardklor::SetMercury(CMercury8 *m){
 
 int CHardklor::GoHardklor(CHardklorSetting sett, Spectrum* s){
 	cs = sett;
+
+  //Peaks of similar mass share averagine formulas, and so distributions
+  mercury->CacheSize(10000);
   Analyze(s);
   return 0;
 }
@@ -385,11 +388,13 @@ void CHardklor::Analyze(Spectrum* s) {
 
     //Update the percentage indicator
 		if(bEcho){
-			if (r.getPercent() > iPercent){
+			//with boxcar averaging, scans are read by the noise reduction buffer
+			int percent = cs.boxcar==0 ? r.getPercent() : nr.getPercent();
+			if (percent > iPercent){
 				if(iPercent<10) cout << "\b";
 				else cout << "\b\b";
 				cout.flush();
-				iPercent=r.getPercent();
+				iPercent=percent;
 				cout << iPercent;
 				cout.flush();
 			}
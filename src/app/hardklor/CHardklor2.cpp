@@ -1,4 +1,5 @@
 #include "CHardklor2.h"
+#include <boost/bind.hpp>
 
 CHardklor2::CHardklor2(CAveragine *a, CMercury8 *m, CModelLibrary *lib){
   averagine=a;
@@ -7,6 +8,8 @@ CHardklor2::CHardklor2(CAveragine *a, CMercury8 *m, CModelLibrary *lib){
 	bEcho=true;
   bMem=false;
 	PT=NULL;
+  pipeBudget=0;
+  pipeDone=true;
 }
 
 CHardklor2::~CHardklor2(){
@@ -39,6 +42,7 @@ int CHardklor2::GoHardklor(CHardklorSetting sett, Spectrum* s){
 	int minutes, seconds;
 	int i;
 	vector<pepHit> vPeps;
+	bool bPipe;
 
 	//initialize variables
 	cs=sett;
@@ -53,6 +57,9 @@ int CHardklor2::GoHardklor(CHardklorSetting sett, Spectrum* s){
 
   vResults.clear();
 
+  //Analyze scans on several threads when a whole file is written to disk
+  bPipe = (s==NULL && !bMem && cs.threads>1);
+
 	//For noise reduction
 	CNoiseReduction nr(&r,cs);
 
@@ -116,7 +123,9 @@ int CHardklor2::GoHardklor(CHardklorSetting sett, Spectrum* s){
   }
 
 	//Write scan information to output file.
-  if(!bMem){
+  if(bPipe){
+    StartPipeline(fout);
+  } else if(!bMem){
     if(cs.reducedOutput) WriteScanLine(curSpec,fout,2);
     else if(cs.xml) WriteScanLine(curSpec,fout,1);
     else WriteScanLine(curSpec,fout,0);
@@ -133,39 +142,34 @@ int CHardklor2::GoHardklor(CHardklorSetting sett, Spectrum* s){
 		getExactTime(startTime);
 		TotalScans++;
 		
-		//Smooth if requested
-		if(cs.smooth>0) SG_Smooth(curSpec,cs.smooth,4);
-
-		//Centroid if needed; notice that this copy wastes a bit of time.
-		//TODO: make this more efficient
-		if(cs.boxcar==0 && !cs.centroid) Centroid(curSpec,c);
-		else c=curSpec;
-
-		//There is a bug when using noise reduction that results in out of order m/z values
-		//TODO: fix noise reduction so sorting isn't needed
-		if(c.size()>0) c.sortMZ();
-
-		//Analyze
-		QuickHardklor(c,vPeps);
-
-		//export results
-		for(i=0;i<(int)vPeps.size();i++){
-      if(!bMem){
-			  if(cs.reducedOutput) WritePepLine(vPeps[i],c,fout,2);
-			  else if(cs.xml) WritePepLine(vPeps[i],c,fout,1);
-			  else WritePepLine(vPeps[i],c,fout,0);
-      } else {
-        ResultToMem(vPeps[i],c);
-      }
+		if(bPipe){
+			//Hand the scan to the workers; blocks while the budget is full
+			QueueScan(curSpec);
+		} else {
+			//Analyze
+			AnalyzeScan(curSpec,c,vPeps);
+
+			//export results
+			for(i=0;i<(int)vPeps.size();i++){
+				if(!bMem){
+					if(cs.reducedOutput) WritePepLine(vPeps[i],c,fout,2);
+					else if(cs.xml) WritePepLine(vPeps[i],c,fout,1);
+					else WritePepLine(vPeps[i],c,fout,0);
+				} else {
+					ResultToMem(vPeps[i],c);
+				}
+			}
 		}
 
 		//Update progress
 		if(bEcho){
-			if (r.getPercent() > iPercent){
+			//with boxcar averaging, scans are read by the noise reduction buffer
+			int percent = cs.boxcar==0 ? r.getPercent() : nr.getPercent();
+			if (percent > iPercent){
 				if(iPercent<10) cout << "\b";
 				else cout << "\b\b";
 				cout.flush();
-				iPercent=r.getPercent();
+				iPercent=percent;
 				cout << iPercent;
 				cout.flush();
 			}
@@ -204,8 +208,10 @@ int CHardklor2::GoHardklor(CHardklorSetting sett, Spectrum* s){
 		tmpTime2=toMicroSec(startTime);
 		loadTime+=(tmpTime1-tmpTime2);
 
-		if(curSpec.getScanNumber()!=0){
-			//Write scan information to output file.
+		if(curSpec.getScanNumber()==0) break;
+
+		//Write scan information to output file; the pipeline writes its own.
+		if(!bPipe){
 			if(cs.reducedOutput){
 				WriteScanLine(curSpec,fout,2);
 			} else if(cs.xml) {
@@ -214,11 +220,10 @@ int CHardklor2::GoHardklor(CHardklorSetting sett, Spectrum* s){
 			} else {
 				WriteScanLine(curSpec,fout,0);
 			}
-		} else {
-			break;
 		}
 	}
 
+	if(bPipe) StopPipeline();
 	if(!bMem) fclose(fout);
 
 	if(bEcho) {
@@ -256,6 +261,53 @@ int CHardklor2::GoHardklor(CHardklorSetting sett, Spectrum* s){
 
 }
 
+//Smooths, centroids and analyzes one scan. The scan is smoothed in place.
+void CHardklor2::AnalyzeScan(Spectrum& s, Spectrum& c, vector<pepHit>& vPeps){
+
+	//Smooth if requested
+	if(cs.smooth>0) SG_Smooth(s,cs.smooth,4);
+
+	//Centroid if needed; notice that this copy wastes a bit of time.
+	//TODO: make this more efficient
+	if(cs.boxcar==0 && !cs.centroid) Centroid(s,c);
+	else c=s;
+
+	//There is a bug when using noise reduction that results in out of order m/z values
+	//TODO: fix noise reduction so sorting isn't needed
+	if(c.size()>0) c.sortMZ();
+
+	//Analyze
+	QuickHardklor(c,vPeps);
+}
+
+//Worker thread of the parallel pipeline. Runs on a worker's own CHardklor2,
+//because the analysis keeps scratch data in members, and takes scans from
+//the queue of pipe until it is empty and no more scans will be queued.
+void CHardklor2::AnalyzeScans(CHardklor2* pipe){
+	hkScanJob* job;
+
+	while(true){
+		{
+			boost::mutex::scoped_lock lock(pipe->pipeMutex);
+			while(pipe->pipeQueue.empty() && !pipe->pipeDone) pipe->pipeChanged.wait(lock);
+			if(pipe->pipeQueue.empty()) break;
+			job=pipe->pipeQueue.front();
+			pipe->pipeQueue.pop_front();
+		}
+
+		getExactTime(startTime);
+		AnalyzeScan(job->scan,job->centroid,job->peps);
+		getExactTime(stopTime);
+		tmpTime1=toMicroSec(stopTime);
+		tmpTime2=toMicroSec(startTime);
+		analysisTime+=tmpTime1-tmpTime2;
+
+		boost::mutex::scoped_lock lock(pipe->pipeMutex);
+		job->analyzed=true;
+		pipe->pipeChanged.notify_all();
+	}
+}
+
 int CHardklor2::BinarySearch(Spectrum& s, double mz, bool floor){
 
 	int mid=s.size()/2;
@@ -792,6 +844,20 @@ double CHardklor2::PeakMatcherB(vector<Result>& vMR, Spectrum& s, double lower,
 	return corr;
 }
 
+//Queues a scan for the workers and the writer, waiting while the number of
+//scans in flight is at the budget.
+void CHardklor2::QueueScan(Spectrum& s){
+	hkScanJob* job=new hkScanJob;
+	job->scan=s;
+	job->analyzed=false;
+
+	boost::mutex::scoped_lock lock(pipeMutex);
+	while((int)pipeOrder.size()>=pipeBudget) pipeChanged.wait(lock);
+	pipeOrder.push_back(job);
+	pipeQueue.push_back(job);
+	pipeChanged.notify_all();
+}
+
 void CHardklor2::QuickCharge(Spectrum& s, int index, vector<int>& v){
 
 	int i,j;
@@ -1362,6 +1428,51 @@ int CHardklor2::Size(){
   return vResults.size();
 }
 
+//Starts cs.threads workers, each with its own copy of the settings, and the
+//thread that writes their results to fptr. At most four scans per worker
+//are kept in flight.
+void CHardklor2::StartPipeline(FILE* fptr){
+	int i;
+	CHardklor2* w;
+
+	pipeDone=false;
+	pipeBudget=4*cs.threads;
+	for(i=0;i<cs.threads;i++){
+		w=new CHardklor2(averagine,mercury,models);
+		w->cs=cs;
+		w->PT=PT;
+		w->bEcho=false;
+		w->analysisTime=0;
+		workers.push_back(w);
+		pipeThreads.push_back(new boost::thread(boost::bind(&CHardklor2::AnalyzeScans,w,this)));
+	}
+	pipeThreads.push_back(new boost::thread(boost::bind(&CHardklor2::WriteScans,this,fptr)));
+}
+
+//Waits for the queued scans to be analyzed and written, then stops the
+//pipeline. The analysis time becomes the time spent by all workers.
+void CHardklor2::StopPipeline(){
+	int i;
+
+	{
+		boost::mutex::scoped_lock lock(pipeMutex);
+		pipeDone=true;
+		pipeChanged.notify_all();
+	}
+	for(i=0;i<(int)pipeThreads.size();i++){
+		pipeThreads[i]->join();
+		delete pipeThreads[i];
+	}
+	pipeThreads.clear();
+
+	analysisTime=0;
+	for(i=0;i<(int)workers.size();i++){
+		analysisTime+=workers[i]->analysisTime;
+		delete workers[i];
+	}
+	workers.clear();
+}
+
 void CHardklor2::WritePepLine(pepHit& ph, Spectrum& s, FILE* fptr, int format){
   int i,j;
 
@@ -1481,4 +1592,37 @@ void CHardklor2::WriteScanLine(Spectrum& s, FILE* fptr, int format){
 	} else if(format==2) {
 		fprintf(fptr, "Scan=%d	RT=%.4f\n", s.getScanNumber(),s.getRTime());
 	}
+}
+
+//Writer thread of the parallel pipeline. Writes each scan and its results
+//once it and every scan before it have been analyzed.
+void CHardklor2::WriteScans(FILE* fptr){
+	hkScanJob* job;
+	bool first=true;
+	int format;
+	int i;
+
+	if(cs.reducedOutput) format=2;
+	else if(cs.xml) format=1;
+	else format=0;
+
+	while(true){
+		{
+			boost::mutex::scoped_lock lock(pipeMutex);
+			while( (pipeOrder.empty() && !pipeDone) || (!pipeOrder.empty() && !pipeOrder.front()->analyzed) ) pipeChanged.wait(lock);
+			if(pipeOrder.empty()) break;
+			job=pipeOrder.front();
+		}
+
+		if(format==1 && !first) fprintf(fptr,"</Spectrum>\n");
+		WriteScanLine(job->scan,fptr,format);
+		for(i=0;i<(int)job->peps.size();i++) WritePepLine(job->peps[i],job->centroid,fptr,format);
+		first=false;
+
+		//the scan stays in flight until it is written
+		boost::mutex::scoped_lock lock(pipeMutex);
+		pipeOrder.pop_front();
+		delete job;
+		pipeChanged.notify_all();
+	}
 }
\ No newline at end of file
@@ -6,6 +6,8 @@
 #include <vector>
 #include <list>
 #include <cmath>
+#include <deque>
+#include <boost/thread.hpp>
 
 #include "MSObject.h"
 #include "MSReader.h"
@@ -44,7 +46,17 @@ class CHardklor2{
  protected:
 
  private:
+  //A scan in flight in the parallel pipeline
+  struct hkScanJob {
+    Spectrum        scan;       //scan as read
+    Spectrum        centroid;   //scan as analyzed
+    vector<pepHit>  peps;       //results of the analysis
+    bool            analyzed;
+  };
+
   //Methods:
+  void    AnalyzeScan(Spectrum& s, Spectrum& c, vector<pepHit>& vPeps);
+  void    AnalyzeScans(CHardklor2* pipe);
   int     BinarySearch(Spectrum& s, double mz, bool floor);
   double  CalcFWHM(double mz,double res,int iType);
   void    Centroid(Spectrum& s, Spectrum& out);
@@ -54,11 +66,15 @@ class CHardklor2{
   bool    MatchSubSpectrum(Spectrum& s, int peakIndex, pepHit& pep);
   double  PeakMatcher(vector<Result>& vMR, Spectrum& s, double lower, double upper, double deltaM, int matchIndex, int& matchCount, int& indexOverlap, vector<int>& vMatchIndex, vector<float>& vMatchIntensity);
   double  PeakMatcherB(vector<Result>& vMR, Spectrum& s, double lower, double upper, double deltaM, int matchIndex, int& matchCount, vector<int>& vMatchIndex, vector<float>& vMatchIntensity);
+  void    QueueScan(Spectrum& s);
   void    QuickHardklor(Spectrum& s, vector<pepHit>& vPeps);
   void    RefineHits(vector<pepHit>& vPeps, Spectrum& s);
   void    ResultToMem(pepHit& ph, Spectrum& s);
+  void    StartPipeline(FILE* fptr);
+  void    StopPipeline();
   void    WritePepLine(pepHit& ph, Spectrum& s, FILE* fptr, int format=0); 
   void    WriteScanLine(Spectrum& s, FILE* fptr, int format=0); 
+  void    WriteScans(FILE* fptr);
 
   static int CompareBPI(const void *p1, const void *p2);
 
@@ -77,6 +93,18 @@ class CHardklor2{
   //Vector for holding results in memory should that be needed
   vector<hkMem> vResults;
 
+  //Parallel pipeline: the reading thread queues scans, workers analyze them
+  //and the writing thread outputs them in file order. At most pipeBudget
+  //scans are held between reading and writing.
+  vector<CHardklor2*>       workers;
+  vector<boost::thread*>    pipeThreads;
+  boost::mutex              pipeMutex;
+  boost::condition_variable pipeChanged;
+  deque<hkScanJob*>         pipeQueue;  //scans waiting for a worker
+  deque<hkScanJob*>         pipeOrder;  //scans waiting to be written, in file order
+  int                       pipeBudget;
+  bool                      pipeDone;   //no more scans will be queued
+
   //Temporary Data Members:
   char bestCh[200];
   double BestCorr;
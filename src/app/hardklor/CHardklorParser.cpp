@@ -269,6 +269,9 @@ void CHardklorParser::parse(char* cmd) {
 		if(atoi(tok)!=0) global.staticSN=true;
 		else global.staticSN=false;
 
+	} else if(strcmp(param,"threads")==0){
+		global.threads=atoi(tok);
+
 	} else if(strcmp(param,"xml")==0){
 		if(atoi(tok)!=0) global.xml=true;
 		else global.xml=false;
@@ -11,6 +11,7 @@ CHardklorSetting::CHardklorSetting(){
   depth=3;
   peptide=10;
   smooth=0;
+  threads=1;
   corr=0.85;
   sn=1.0;
   scan.iLower=0;
@@ -75,6 +76,7 @@ CHardklorSetting::CHardklorSetting(const CHardklorSetting& c){
   depth=c.depth;
   peptide=c.peptide;
   smooth=c.smooth;
+  threads=c.threads;
   corr=c.corr;
   sn=c.sn;
   scan.iLower=c.scan.iLower;
@@ -140,6 +142,7 @@ CHardklorSetting& CHardklorSetting::operator=(const CHardklorSetting& c){
     depth=c.depth;
 		peptide=c.peptide;
     smooth=c.smooth;
+    threads=c.threads;
     corr=c.corr;
     sn=c.sn;
     scan.iLower=c.scan.iLower;
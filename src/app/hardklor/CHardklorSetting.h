@@ -56,6 +56,7 @@ class CHardklorSetting {
   //int rawAvgWidth;  //Number of scans on either side of target to average (1 = +/-1 scan)
   int sl;           //sensitivity level
   int smooth;       //Savitsky-Golay smoothing window size
+  int threads;      //number of scans analyzed at once
   //int sna;          //Signal-to-noise algorithm; 0=THRASH, 1=Persistent peaks (PP)
 
   double corr;      //correlation threshold
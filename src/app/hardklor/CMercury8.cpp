@@ -50,6 +50,7 @@ CMercury8::CMercury8(){
   bAccMass = false;
   bRelAbun = true;
   zeroMass=0;
+  cacheSize=0;
 }
 
 CMercury8::CMercury8(char* fn){
@@ -58,6 +59,7 @@ CMercury8::CMercury8(char* fn){
   bAccMass = false;
   bRelAbun = true;
   zeroMass=0;
+  cacheSize=0;
 }
 
 CMercury8::~CMercury8(){
@@ -481,12 +483,29 @@ int CMercury8::GoMercury(char* MolForm, int Charge, char* filename) {
   unsigned int i;
   int	 NumElements=0;			/* Number of elements in molecular formula */
   FILE	 *outfile;			/* output file pointer */
+  string key;
+  map<string,CachedDist>::iterator it;
   
   //MolForm is the only required data
   if (strlen(MolForm) == 0) {
     //printf("\nNo molecular formula!\n");
     return 1;
   }
+
+  //Reuse the distribution if it was computed recently
+  if(cacheSize>0 && filename[0]==0 && !showOutput){
+    CacheKey(MolForm,Charge,key);
+    it=cache.find(key);
+    if(it!=cache.end()){
+      FixedData=it->second.FixedData;
+      FracAbunData=it->second.FracAbunData;
+      monoMass=it->second.monoMass;
+      zeroMass=it->second.zeroMass;
+      cacheAge.splice(cacheAge.begin(),cacheAge,it->second.age);
+      Reset();
+      return 0;
+    }
+  }
   
   //Parse the formula, check for validity
   if (ParseMF(MolForm,&NumElements) == -1)     {
@@ -502,6 +521,21 @@ int CMercury8::GoMercury(char* MolForm, int Charge, char* filename) {
   //If the user requested relative abundance, convert data
   if(bRelAbun) RelativeAbundance(FixedData);
 
+  //Keep the distribution, forgetting the least recently used one if full
+  if(key.size()>0){
+    cacheAge.push_front(key);
+    CachedDist& cd=cache[key];
+    cd.FixedData=FixedData;
+    cd.FracAbunData=FracAbunData;
+    cd.monoMass=monoMass;
+    cd.zeroMass=zeroMass;
+    cd.age=cacheAge.begin();
+    if((int)cache.size()>cacheSize){
+      cache.erase(cacheAge.back());
+      cacheAge.pop_back();
+    }
+  }
+
   //If the user requested the data to file, output it here.
   if (filename[0]!=0){
     if ((outfile = fopen(filename,"w")) == NULL) {
@@ -958,6 +992,36 @@ void CMercury8::RelAbun(bool b) {
   bRelAbun = b;
 }
 
+//Identifies a distribution by its formula, charge, options and the isotope
+//abundances of any enriched elements
+void CMercury8::CacheKey(char* MolForm, int Charge, string& key){
+  char str[32];
+  unsigned int i;
+  int j;
+
+  key=MolForm;
+  sprintf(str," %d %d%d",Charge,(int)bAccMass,(int)bRelAbun);
+  key+=str;
+  for(i=0;i<EnrichAtoms.size();i++){
+    sprintf(str," %d",EnrichAtoms[i]);
+    key+=str;
+    for(j=0;j<Element[EnrichAtoms[i]].NumIsotopes;j++){
+      sprintf(str,":%.9g",Element[EnrichAtoms[i]].IsoProb[j]);
+      key+=str;
+    }
+  }
+}
+
+//Keeps up to n recently computed distributions, so that repeated GoMercury
+//calls for the same formula are not recomputed. 0 turns the cache off.
+void CMercury8::CacheSize(int n){
+  cacheSize=n;
+  while((int)cache.size()>cacheSize){
+    cache.erase(cacheAge.back());
+    cacheAge.pop_back();
+  }
+}
+
 double CMercury8::getZeroMass(){
   return zeroMass;
 }
@@ -7,6 +7,10 @@
 #include <cstring>
 #include "ctype.h"
 #include <ctime>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
 #include "mercury.h"
 #include "FFT.h"
 using namespace std;
@@ -35,9 +39,22 @@ class CMercury8 {
   double monoMass;
   double zeroMass;
 
+  //Recently computed distributions, by formula, charge and enrichment
+  typedef struct {
+    vector<Result> FixedData;
+    vector<Result> FracAbunData;
+    double monoMass;
+    double zeroMass;
+    list<string>::iterator age;
+  } CachedDist;
+  int cacheSize;
+  map<string,CachedDist> cache;
+  list<string> cacheAge;  //keys from most to least recently used
+
   //Functions:
   void AccurateMass(int,int);
   void AddElement(char[],int,int);
+  void CacheKey(char*, int, string&);
   void CalcFreq(complex*, int, int, int, int);
   void CalcMassRange(int*, double, int, int);
   void CalcVariances(double*, double*, int);
@@ -63,6 +80,7 @@ class CMercury8 {
 
   //Functions:
   void AccMass(bool);
+  void CacheSize(int);
   void Echo(bool);
   void Enrich(int,int,double d=0.99);
   double getMonoMass();
@@ -1,4 +1,8 @@
 #include "CModelLibrary.h"
+#include <cstring>
+
+//Identifies the layout of library files
+#define LIBRARY_FORMAT "HKMODEL1"
 
 CModelLibrary::CModelLibrary(CAveragine* avg, CMercury8* mer){
 	averagine=avg;
@@ -8,28 +12,28 @@ CModelLibrary::CModelLibrary(CAveragine* avg, CMercury8* mer){
 	chargeMin=0;
 	chargeCount=0;
 	varCount=0;
-	merCount=0;
+	merCount=1000;
+	bChanged=false;
 }
 
 CModelLibrary::~CModelLibrary(){
+	map<string,mercuryModel*>::iterator it;
+
 	averagine=NULL;
 	mercury=NULL;
 	if(libModel!=NULL) {
 		eraseLibrary();
 		libModel=NULL;
 	}
+	for(it=modelSets.begin();it!=modelSets.end();it++) deleteModels(it->second);
+	modelSets.clear();
 }
 
 bool CModelLibrary::buildLibrary(int lowCharge, int highCharge, vector<CHardklorVariant>& pepVariants){
 
-	int i,j,k;
-	unsigned int n;
-
-	vector<Peak_T> vMR;
-	Peak_T p;
-	float da;
-	double mass;
-	char av[64];
+	int i,j;
+	string key;
+	map<string,mercuryModel*>::iterator it;
 
 	if(libModel!=NULL) {
 		cout << "library memory already in use." << endl;
@@ -40,48 +44,22 @@ bool CModelLibrary::buildLibrary(int lowCharge, int highCharge, vector<CHardklor
 	chargeMin=lowCharge;
 	chargeCount=highCharge+1;
 	varCount=pepVariants.size();
-	merCount=1000;
 
+	//Build only the models that were not built or read before
 	libModel = new mercuryModel**[chargeCount];
 	for(i=chargeMin;i<chargeCount;i++){
 
 		libModel[i] = new mercuryModel*[varCount];
 		for(j=0;j<varCount;j++){
 
-			libModel[i][j] = new mercuryModel[merCount];
-			libModel[i][j][0].area=0.0f;
-			libModel[i][j][0].size=0;
-			libModel[i][j][0].zeroMass=0.0;
-			libModel[i][j][0].peaks=NULL;
-			for(k=1;k<merCount;k++){
-
-				mass=k*5*i-(1.007276466*i);
-				averagine->clear();
-				averagine->calcAveragine(mass,pepVariants[j]);
-				averagine->getAveragine(&av[0]);
-        //cout << mass << "\t" << pepVariants[j].sizeAtom() << "\t" << pepVariants[j].sizeEnrich() << "\t" << av << endl;
-        for(n=0;n<(unsigned int)pepVariants[j].sizeEnrich();n++){
-          mercury->Enrich(pepVariants[j].atEnrich(n).atomNum,pepVariants[j].atEnrich(n).isotope,pepVariants[j].atEnrich(n).ape);
-        }
-				mercury->GoMercury(&av[0],i);
-
-				vMR.clear();
-				da=0.0f;
-				for(n=0; n<mercury->FixedData.size(); n++) {
-					if(mercury->FixedData[n].data<1.0) continue;
-					p.intensity=(float)mercury->FixedData[n].data;
-					p.mz=mercury->FixedData[n].mass;
-					da+=p.intensity;
-					vMR.push_back(p);
-				}
-				da/=100.0f;
-
-				libModel[i][j][k].area = da;
-				libModel[i][j][k].size = vMR.size();
-				libModel[i][j][k].peaks = new Peak_T[vMR.size()];
-				libModel[i][j][k].zeroMass = mercury->getZeroMass();
-
-				for(n=0;n<vMR.size();n++) libModel[i][j][k].peaks[n]=vMR[n];
+			key=modelKey(i,pepVariants[j]);
+			it=modelSets.find(key);
+			if(it!=modelSets.end()) {
+				libModel[i][j]=it->second;
+			} else {
+				libModel[i][j]=buildModels(i,pepVariants[j]);
+				modelSets[key]=libModel[i][j];
+				bChanged=true;
 			}
 		}
 	}
@@ -90,19 +68,74 @@ bool CModelLibrary::buildLibrary(int lowCharge, int highCharge, vector<CHardklor
 
 }
 
+//Builds the models of one charge state and variant, one for every 5 m/z
+mercuryModel* CModelLibrary::buildModels(int charge, CHardklorVariant& var){
+
+	int k;
+	unsigned int n;
+
+	vector<Peak_T> vMR;
+	Peak_T p;
+	float da;
+	double mass;
+	char av[64];
+	mercuryModel* m;
+
+	m = new mercuryModel[merCount];
+	m[0].area=0.0f;
+	m[0].size=0;
+	m[0].zeroMass=0.0;
+	m[0].peaks=NULL;
+	for(k=1;k<merCount;k++){
+
+		mass=k*5*charge-(1.007276466*charge);
+		averagine->clear();
+		averagine->calcAveragine(mass,var);
+		averagine->getAveragine(&av[0]);
+    //cout << mass << "\t" << var.sizeAtom() << "\t" << var.sizeEnrich() << "\t" << av << endl;
+    for(n=0;n<(unsigned int)var.sizeEnrich();n++){
+      mercury->Enrich(var.atEnrich(n).atomNum,var.atEnrich(n).isotope,var.atEnrich(n).ape);
+    }
+		mercury->GoMercury(&av[0],charge);
+
+		vMR.clear();
+		da=0.0f;
+		for(n=0; n<mercury->FixedData.size(); n++) {
+			if(mercury->FixedData[n].data<1.0) continue;
+			p.intensity=(float)mercury->FixedData[n].data;
+			p.mz=mercury->FixedData[n].mass;
+			da+=p.intensity;
+			vMR.push_back(p);
+		}
+		da/=100.0f;
+
+		m[k].area = da;
+		m[k].size = vMR.size();
+		m[k].peaks = new Peak_T[vMR.size()];
+		m[k].zeroMass = mercury->getZeroMass();
+
+		for(n=0;n<vMR.size();n++) m[k].peaks[n]=vMR[n];
+	}
+
+	return m;
+
+}
+
+void CModelLibrary::deleteModels(mercuryModel* m){
+	int k;
+	for(k=0;k<merCount;k++) delete [] m[k].peaks;
+	delete [] m;
+}
+
+//Releases the library of the last buildLibrary call. The models themselves
+//are kept for later calls.
 void CModelLibrary::eraseLibrary(){
 
-	int i,j,k;
+	int i;
 
 	if(libModel==NULL) return;
 
 	for(i=chargeMin;i<chargeCount;i++){
-		for(j=0;j<varCount;j++){
-			for(k=0;k<merCount;k++){
-				delete [] libModel[i][j][k].peaks;
-			}
-			delete [] libModel[i][j];
-		}
 		delete [] libModel[i];
 	}
 	delete [] libModel;
@@ -116,4 +149,162 @@ mercuryModel* CModelLibrary::getModel(int charge, int var, double mz){
 	int intMZ=(int)(mz/5);
 	return &libModel[charge][var][intMZ];
 
+}
+
+//True if models were built that are not in the library file
+bool CModelLibrary::isChanged(){
+	return bChanged;
+}
+
+//Reads the models stored in a library file. Returns false, having read
+//none, if the file is missing or was made with other isotope data, as
+//identified by dataKey.
+bool CModelLibrary::loadLibrary(const char* fn, const char* dataKey){
+
+	FILE* f;
+	char format[8];
+	int i,n;
+	string key;
+	mercuryModel* m;
+
+	f=fopen(fn,"rb");
+	if(f==NULL) return false;
+
+	if(fread(format,1,8,f)!=8 || memcmp(format,LIBRARY_FORMAT,8)!=0 ||
+		 fread(&n,sizeof(int),1,f)!=1 || n!=merCount ||
+		 !readString(f,key) || key!=dataKey ||
+		 fread(&n,sizeof(int),1,f)!=1){
+		fclose(f);
+		return false;
+	}
+
+	for(i=0;i<n;i++){
+		if(!readString(f,key)) break;
+		m=readModels(f);
+		if(m==NULL) break;
+		if(modelSets.find(key)==modelSets.end()) modelSets[key]=m;
+		else deleteModels(m);
+	}
+	fclose(f);
+
+	if(i<n) cout << "Model library " << fn << " is truncated." << endl;
+	return i==n;
+
+}
+
+//Identifies a model set by its charge state and the atoms and enrichments
+//of its variant
+string CModelLibrary::modelKey(int charge, CHardklorVariant& var){
+	char str[64];
+	string key;
+	int i;
+
+	sprintf(str,"+%d",charge);
+	key=str;
+	for(i=0;i<var.sizeAtom();i++){
+		sprintf(str," %d:%d",var.atAtom(i).iLower,var.atAtom(i).iUpper);
+		key+=str;
+	}
+	for(i=0;i<var.sizeEnrich();i++){
+		sprintf(str," %d_%d_%.17g",var.atEnrich(i).atomNum,var.atEnrich(i).isotope,var.atEnrich(i).ape);
+		key+=str;
+	}
+	return key;
+}
+
+//Reads the merCount models of one set. Returns NULL if the file ends early.
+mercuryModel* CModelLibrary::readModels(FILE* f){
+	mercuryModel* m;
+	bool ok=true;
+	int j,k;
+
+	m = new mercuryModel[merCount];
+	for(j=0;j<merCount;j++) m[j].peaks=NULL;
+
+	for(j=0;j<merCount && ok;j++){
+		ok = fread(&m[j].area,sizeof(float),1,f)==1 &&
+				 fread(&m[j].size,sizeof(int),1,f)==1 &&
+				 fread(&m[j].zeroMass,sizeof(double),1,f)==1 &&
+				 m[j].size>=0 && m[j].size<100000;
+		if(!ok || m[j].size==0) continue;
+		m[j].peaks = new Peak_T[m[j].size];
+		for(k=0;k<m[j].size && ok;k++){
+			ok = fread(&m[j].peaks[k].mz,sizeof(double),1,f)==1 &&
+					 fread(&m[j].peaks[k].intensity,sizeof(float),1,f)==1;
+		}
+	}
+
+	if(!ok){
+		deleteModels(m);
+		return NULL;
+	}
+	return m;
+}
+
+bool CModelLibrary::readString(FILE* f, string& s){
+	int n;
+	if(fread(&n,sizeof(int),1,f)!=1 || n<0 || n>4096) return false;
+	s.resize(n);
+	if(n>0 && fread(&s[0],1,n,f)!=(size_t)n) return false;
+	return true;
+}
+
+//Writes every model set to a library file, through a temporary file so that
+//an interrupted write does not leave a damaged library.
+bool CModelLibrary::saveLibrary(const char* fn, const char* dataKey){
+
+	FILE* f;
+	string tmp;
+	int n;
+	bool ok;
+	map<string,mercuryModel*>::iterator it;
+
+	tmp=fn;
+	tmp+=".tmp";
+	f=fopen(tmp.c_str(),"wb");
+	if(f==NULL) return false;
+
+	fwrite(LIBRARY_FORMAT,1,8,f);
+	fwrite(&merCount,sizeof(int),1,f);
+	writeString(f,dataKey);
+	n=modelSets.size();
+	fwrite(&n,sizeof(int),1,f);
+	for(it=modelSets.begin();it!=modelSets.end();it++){
+		writeString(f,it->first);
+		writeModels(f,it->second);
+	}
+
+	ok=(ferror(f)==0);
+	if(fclose(f)!=0) ok=false;
+	if(ok){
+		remove(fn);
+		ok=(rename(tmp.c_str(),fn)==0);
+	}
+	if(!ok) {
+		remove(tmp.c_str());
+		return false;
+	}
+
+	bChanged=false;
+	return true;
+
+}
+
+void CModelLibrary::writeModels(FILE* f, mercuryModel* m){
+	int j,k;
+	for(j=0;j<merCount;j++){
+		fwrite(&m[j].area,sizeof(float),1,f);
+		fwrite(&m[j].size,sizeof(int),1,f);
+		fwrite(&m[j].zeroMass,sizeof(double),1,f);
+		for(k=0;k<m[j].size;k++){
+			fwrite(&m[j].peaks[k].mz,sizeof(double),1,f);
+			fwrite(&m[j].peaks[k].intensity,sizeof(float),1,f);
+		}
+	}
+}
+
+void CModelLibrary::writeString(FILE* f, const string& s){
+	int n=s.size();
+	fwrite(&n,sizeof(int),1,f);
+	if(n>0) fwrite(s.data(),1,n,f);
 }
\ No newline at end of file
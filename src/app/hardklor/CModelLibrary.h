@@ -5,10 +5,17 @@
 #include "CAveragine.h"
 #include "CMercury8.h"
 #include "CHardklorVariant.h"
+#include <cstdio>
+#include <map>
+#include <string>
 #include <vector>
 
 using namespace std;
 
+//The models of each charge state and variant are built once and kept until
+//the library is destroyed, so that later buildLibrary calls with the same
+//variants reuse them. They can also be saved to a file and read back by
+//later runs that use the same isotope data.
 class CModelLibrary {
 public:
 
@@ -20,20 +27,34 @@ public:
 	bool buildLibrary(int lowCharge, int highCharge, vector<CHardklorVariant>& pepVariants);
 	void eraseLibrary();
 	mercuryModel* getModel(int charge, int var, double mz);
+	bool isChanged();
+	bool loadLibrary(const char* fn, const char* dataKey);
+	bool saveLibrary(const char* fn, const char* dataKey);
 
 protected:
 
 private:
 
+	//Functions
+	mercuryModel* buildModels(int charge, CHardklorVariant& var);
+	void deleteModels(mercuryModel* m);
+	string modelKey(int charge, CHardklorVariant& var);
+	mercuryModel* readModels(FILE* f);
+	bool readString(FILE* f, string& s);
+	void writeModels(FILE* f, mercuryModel* m);
+	void writeString(FILE* f, const string& s);
+
 	//Data Members
 	int chargeMin;
 	int chargeCount;
 	int varCount;
 	int merCount;
+	bool bChanged;	//models were built since the library was read or saved
 
 	CAveragine* averagine;
 	CMercury8* mercury;
-	mercuryModel*** libModel;
+	mercuryModel*** libModel;	//points into modelSets
+	map<string,mercuryModel*> modelSets;	//merCount models for each charge and variant
 
 };
 
@@ -3,19 +3,29 @@
 CNoiseReduction::CNoiseReduction(){
   pos=0;
   posA=0;
-  strcpy(lastFile,"");
+  sb=NULL;
 }
 
+//Neighbouring scans are read through a buffer of decoded scans, which reads
+//ahead on its own thread, rather than with msr.
 CNoiseReduction::CNoiseReduction(MSReader* msr, CHardklorSetting& hs){
   r=msr;
   cs=hs;
   pos=0;
   posA=0;
-  strcpy(lastFile,"");
+  sb=new CScanBuffer(cs,cs.boxcar*2+4);
 }
 
 CNoiseReduction::~CNoiseReduction(){
   r=NULL;
+  delete sb;
+}
+
+//Percent of the input file read up to the last scan returned. With boxcar
+//averaging, scans come from the buffer rather than from msr.
+int CNoiseReduction::getPercent(){
+  if(sb==NULL) return 0;
+  return sb->getPercent();
 }
 
 //Calculates the resolution (FWHM) of a peak
@@ -56,9 +66,11 @@ bool CNoiseReduction::DeNoise(Spectrum& sp){
   if(pos==0){
     if((cs.scan.iLower>0)) {
       k=cs.scan.iLower; 
-      r->readFile(&cs.inFile[0],tmpSpec,cs.scan.iLower);
+      sb->open(&cs.inFile[0],cs.scan.iLower);
+      sb->next(tmpSpec);
     } else {
-      r->readFile(&cs.inFile[0],tmpSpec);
+      sb->open(&cs.inFile[0]);
+      sb->next(tmpSpec);
       k=tmpSpec.getScanNumber();
     }
     if(tmpSpec.getScanNumber()==0) return false;
@@ -68,7 +80,7 @@ bool CNoiseReduction::DeNoise(Spectrum& sp){
     i=1;
     j=0;
     while( k-i > 0){
-      r->readFile(&cs.inFile[0],tmpSpec,cs.scan.iLower-i);
+      sb->find(cs.scan.iLower-i,tmpSpec);
       if(tmpSpec.getScanNumber()==0) {
         i++;
         continue;
@@ -91,8 +103,8 @@ bool CNoiseReduction::DeNoise(Spectrum& sp){
 
     //cout << "Done left " << s.size() << " " << cs.rawAvgWidth << endl;
 
-    //Get our position again
-    r->readFile(&cs.inFile[0],tmpSpec,k);
+    //Get our target scan again
+    sb->find(k,tmpSpec);
 
     //Assume High resolution data at all times
     if(!cs.centroid) {
@@ -108,7 +120,7 @@ bool CNoiseReduction::DeNoise(Spectrum& sp){
     i=1;
     j=0;
     while(true){
-      r->readFile(NULL,tmpSpec);
+      sb->next(tmpSpec);
       if(tmpSpec.getScanNumber()==0) break;
       tmpSpec.getRawFilter(cFilter2,256);
 
@@ -169,7 +181,7 @@ bool CNoiseReduction::DeNoise(Spectrum& sp){
 
   //extend right side if needed
   while(j<(int)(cs.boxcar/2)){
-    r->readFile(NULL,tmpSpec);
+    sb->next(tmpSpec);
     if(tmpSpec.getScanNumber()==0) break;    
     tmpSpec.getRawFilter(cFilter2,256);
 
@@ -416,105 +428,6 @@ int CNoiseReduction::NearestPeak(Spectrum& sp, double mz){
   return best;
 }
 
-bool CNoiseReduction::ScanAverage(Spectrum& sp, char* file, int width, float cutoff){
-  
-  Spectrum ts;
-  Spectrum ps=sp;
-  MSReader r;
- 
-  int i;
-  int j;
-  int k;
-  int widthCount=0;
-  int numScans=1;
-  double dif;
-  double prec;
-  double dt;
-  double c=CParam(ps,3);
-
-  bool bLeft=true;
-  int posLeft=ps.getScanNumber()-1;
-  int posRight=ps.getScanNumber()+1;
-  char cFilter1[256];
-  char cFilter2[256];
-
-  ps.getRawFilter(cFilter1,256);
-
-  while(widthCount<(width*2)){
-
-    //Alternate looking left and right
-    if(bLeft){
-      bLeft=false;
-      widthCount++;
-      while(posLeft>0){
-        r.readFile(file,ts,posLeft);
-        if(ts.getScanNumber()==0) break;
-        ts.getRawFilter(cFilter2,256);
-        if(strcmp(cFilter1,cFilter2)==0) break;
-        posLeft--;
-      }
-    } else {
-      bLeft=true;
-      widthCount++;
-      while(true){
-        r.readFile(file,ts,posRight);
-        if(ts.getScanNumber()==0) break;
-        ts.getRawFilter(cFilter2,256);
-        if(strcmp(cFilter1,cFilter2)==0) break;
-        posRight++;
-      }
-    }
-    if(ts.getScanNumber()==0) continue;
-
-    numScans++;
-
-    //Match peaks between pivot scan and temp scan
-    k=0;
-    for(i=0;i<ps.size();i++){
-      dif=100000.0;
-      prec = c * ps.at(i).mz * ps.at(i).mz / 2;
-
-      for(j=k;j<ts.size();j++){
-        dt=fabs(ps.at(i).mz-ts.at(j).mz);
-        if(dt<=dif) {
-          if(dt<prec) {
-            ps.at(i).intensity+=ts.at(j).intensity;
-            ts.at(j).mz=-1.0;
-            k=j+1;
-            break;
-          }
-          dif=dt;
-        } else {
-          k=j-1;
-          break;
-        }
-      }
-    }
-
-    //Add unmatched peaks from temp scan
-    for(i=0;i<ts.size();i++){
-      if(ts.at(i).mz>-1.0) ps.add(ts.at(i));
-    }
-
-    //Sort pivot scan peaks for fast traversal against next temp scan
-    ps.sortMZ();
-
-  }
-
-  //Average points and apply cutoff
-  sp.clear();
-  for(i=0;i<ps.size();i++) {
-    ps.at(i).intensity/=numScans;
-    if(ps.at(i).intensity>=cutoff) sp.add(ps.at(i));
-  }
-
-  sp.setScanNumber(ps.getScanNumber());
-  sp.setScanNumber(ps.getScanNumber(true),true);
-  sp.setRTime(ps.getRTime());
-
-  return true;
-}
-
 bool CNoiseReduction::NewScanAverage(Spectrum& sp, char* file, int width, float cutoff, int scanNum){
   
   Spectrum ts;
@@ -548,10 +461,9 @@ bool CNoiseReduction::NewScanAverage(Spectrum& sp, char* file, int width, float
 
   //if file is not null, create new buffer
   if(file!=NULL){
-    strcpy(lastFile,file);
     bs.clear();
-    if(scanNum>0) r->readFile(file,ts,scanNum);
-    else r->readFile(file,ts);
+    sb->open(file,scanNum);
+    sb->next(ts);
     if(ts.getScanNumber()==0) {
       delete [] specs;
       return false;
@@ -590,8 +502,7 @@ bool CNoiseReduction::NewScanAverage(Spectrum& sp, char* file, int width, float
           while(true){
             i--;
             if(i==0) break;
-            r->readFile(lastFile,ts,i);
-            if(ts.getScanNumber()==0) continue;
+            if(!sb->find(i,ts)) continue;
             else break;
           }
           if(i==0) break;
@@ -620,9 +531,7 @@ bool CNoiseReduction::NewScanAverage(Spectrum& sp, char* file, int width, float
       while(true){
         posRight++;
         if(posRight>=(int)bs.size()) { //buffer is too short on right, add spectra
-          r->readFile(lastFile,ts,bs[bs.size()-1].getScanNumber());
-          r->readFile(NULL,ts);
-          if(ts.getScanNumber()==0) {
+          if(!sb->next(ts)) {
             posRight--;
             break;
           }
@@ -1145,10 +1054,9 @@ bool CNoiseReduction::ScanAveragePlusDeNoise(Spectrum& sp, char* file, int width
 
   //if file is not null, create new buffer
   if(file!=NULL){
-    strcpy(lastFile,file);
     bs.clear();
-    if(scanNum>0) r->readFile(file,ts,scanNum);
-    else r->readFile(file,ts);
+    sb->open(file,scanNum);
+    sb->next(ts);
     if(ts.getScanNumber()==0) return false;
     bs.push_back(ts);
     ps=bs[0];
@@ -1187,8 +1095,7 @@ bool CNoiseReduction::ScanAveragePlusDeNoise(Spectrum& sp, char* file, int width
             i--;
             //cout << "I: " << i << endl;
             if(i==0) break;
-            r->readFile(lastFile,ts,i);
-            if(ts.getScanNumber()==0) continue;
+            if(!sb->find(i,ts)) continue;
             else break;
           }
           if(i==0) break;
@@ -1218,9 +1125,7 @@ bool CNoiseReduction::ScanAveragePlusDeNoise(Spectrum& sp, char* file, int width
       while(true){
         posRight++;
         if(posRight>=(int)bs.size()) { //buffer is too short on right, add spectra
-          r->readFile(lastFile,ts,bs[bs.size()-1].getScanNumber());
-          r->readFile(NULL,ts);
-          if(ts.getScanNumber()==0) {
+          if(!sb->next(ts)) {
             posRight--;
             break;
           }
@@ -1442,10 +1347,9 @@ bool CNoiseReduction::NewScanAveragePlusDeNoise(Spectrum& sp, char* file, int wi
 
   //if file is not null, create new buffer
   if(file!=NULL){
-    strcpy(lastFile,file);
     bs.clear();
-    if(scanNum>0) r->readFile(file,ts,scanNum);
-    else r->readFile(file,ts);
+    sb->open(file,scanNum);
+    sb->next(ts);
     if(ts.getScanNumber()==0) {
       delete [] specs;
       return false;
@@ -1485,8 +1389,7 @@ bool CNoiseReduction::NewScanAveragePlusDeNoise(Spectrum& sp, char* file, int wi
           while(true){
             i--;
             if(i==0) break;
-            r->readFile(lastFile,ts,i);
-            if(ts.getScanNumber()==0) continue;
+            if(!sb->find(i,ts)) continue;
             else break;
           }
           if(i==0) break;
@@ -1515,9 +1418,7 @@ bool CNoiseReduction::NewScanAveragePlusDeNoise(Spectrum& sp, char* file, int wi
       while(true){
         posRight++;
         if(posRight>=(int)bs.size()) { //buffer is too short on right, add spectra
-          r->readFile(lastFile,ts,bs[bs.size()-1].getScanNumber());
-          r->readFile(NULL,ts);
-          if(ts.getScanNumber()==0) {
+          if(!sb->next(ts)) {
             posRight--;
             break;
           }
@@ -4,6 +4,7 @@
 #include "MSReader.h"
 #include "Spectrum.h"
 #include "CHardklorSetting.h"
+#include "CScanBuffer.h"
 #include <cmath>
 #include <iostream>
 #include <deque>
@@ -30,7 +31,7 @@ public:
   bool DeNoiseC(Spectrum& sp);
   bool DeNoiseD(Spectrum& sp);
   int NearestPeak(Spectrum& sp, double mz);
-  bool ScanAverage(Spectrum& sp, char* file, int width, float cutoff);
+  int getPercent();
   bool NewScanAverage(Spectrum& sp, char* file, int width, float cutoff, int scanNum=0);
   //bool ScanAverage(Spectrum& sp, vector<Spectrum>& vs, int pivot, float cutoff, double cp=0.0);
   //bool ScanAverage(Spectrum& sp, deque<Spectrum>& vs, int pivot, float cutoff);
@@ -41,15 +42,19 @@ public:
   int pos;
 
 private:
+  //Not copyable, since sb is owned
+  CNoiseReduction(const CNoiseReduction&);
+  CNoiseReduction& operator=(const CNoiseReduction&);
+
   //Functions
   
   
   //Data Members
   //int pos;
   int posA;
-  char lastFile[256];
   CHardklorSetting cs;
   MSReader* r;
+  CScanBuffer* sb;
   deque<Spectrum> s;
   deque<Spectrum> bs;
 
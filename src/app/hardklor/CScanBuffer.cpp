@@ -0,0 +1,140 @@
+#include "CScanBuffer.h"
+#include <boost/bind.hpp>
+
+CScanBuffer::CScanBuffer(CHardklorSetting& hs, int sz){
+  cs=hs;
+  size=sz;
+  if(size<1) size=1;
+  strcpy(file,"");
+  firstScan=0;
+  thread=NULL;
+  done=true;
+  stopping=false;
+  pos=0;
+  percent=0;
+
+  //read the same spectra as the main reader would
+  seqReader.setFilter(cs.mzXMLFilter);
+  seqReader.setRawFilter(cs.rawFilter);
+  findReader.setFilter(cs.mzXMLFilter);
+  findReader.setRawFilter(cs.rawFilter);
+}
+
+CScanBuffer::~CScanBuffer(){
+  stop();
+}
+
+//Starts reading a file at scanNum, or at the first scan if scanNum is 0.
+bool CScanBuffer::open(char* fn, int scanNum){
+  stop();
+  strcpy(file,fn);
+  firstScan=scanNum;
+  scans.clear();
+  percents.clear();
+  pos=0;
+  percent=0;
+  done=false;
+  stopping=false;
+  thread = new boost::thread(boost::bind(&CScanBuffer::prefetch,this));
+  return true;
+}
+
+void CScanBuffer::close(){
+  stop();
+  scans.clear();
+  percents.clear();
+  pos=0;
+  percent=0;
+  strcpy(file,"");
+}
+
+char* CScanBuffer::getFile(){
+  return file;
+}
+
+//Percent of the file read up to the scan last taken with next(), as
+//MSReader::getPercent() would report after reading it.
+int CScanBuffer::getPercent(){
+  boost::mutex::scoped_lock lock(mutex);
+  return percent;
+}
+
+//Gets the next scan in the file, as MSReader::readFile(NULL,sp) would. Returns
+//false, with a scan number of 0 in sp, at the end of the file.
+bool CScanBuffer::next(Spectrum& sp){
+  boost::mutex::scoped_lock lock(mutex);
+  while(pos>=(int)scans.size() && !done) changed.wait(lock);
+  if(pos>=(int)scans.size()) {
+    sp.clear();
+    sp.setScanNumber(0);
+    return false;
+  }
+  percent=percents[pos];
+  sp=scans[pos++];
+
+  //keep at most size scans behind the current one
+  while(pos>size){
+    scans.pop_front();
+    percents.pop_front();
+    pos--;
+  }
+  changed.notify_all();
+  return true;
+}
+
+//Gets a scan by number, from the buffer if it is there, otherwise from the
+//file. Returns false, with a scan number of 0 in sp, if there is no such scan.
+bool CScanBuffer::find(int scanNum, Spectrum& sp){
+  {
+    boost::mutex::scoped_lock lock(mutex);
+    if(scans.size()>0 && scanNum>=scans.front().getScanNumber() && scanNum<=scans.back().getScanNumber()){
+      for(int i=0;i<(int)scans.size();i++){
+        if(scans[i].getScanNumber()==scanNum) {
+          sp=scans[i];
+          return true;
+        }
+      }
+      //skipped by the filter when the file was read
+      sp.clear();
+      sp.setScanNumber(0);
+      return false;
+    }
+  }
+  findReader.readFile(file,sp,scanNum);
+  return sp.getScanNumber()!=0;
+}
+
+void CScanBuffer::prefetch(){
+  Spectrum ts;
+
+  if(firstScan>0) seqReader.readFile(file,ts,firstScan);
+  else seqReader.readFile(file,ts);
+
+  while(true){
+    boost::mutex::scoped_lock lock(mutex);
+    if(ts.getScanNumber()==0 || stopping) break;
+    scans.push_back(ts);
+    percents.push_back(seqReader.getPercent());
+    changed.notify_all();
+    while(!stopping && (int)scans.size()-pos>=size) changed.wait(lock);
+    if(stopping) break;
+    lock.unlock();
+    seqReader.readFile(NULL,ts);
+  }
+
+  boost::mutex::scoped_lock lock(mutex);
+  done=true;
+  changed.notify_all();
+}
+
+void CScanBuffer::stop(){
+  if(thread==NULL) return;
+  {
+    boost::mutex::scoped_lock lock(mutex);
+    stopping=true;
+    changed.notify_all();
+  }
+  thread->join();
+  delete thread;
+  thread=NULL;
+}
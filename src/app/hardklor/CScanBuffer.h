@@ -0,0 +1,59 @@
+#ifndef _CSCANBUFFER_H
+#define _CSCANBUFFER_H
+
+#include "MSReader.h"
+#include "Spectrum.h"
+#include "CHardklorSetting.h"
+#include <boost/thread.hpp>
+#include <deque>
+
+using namespace std;
+
+//A bounded ring of decoded scans, read in file order on a background thread
+//so that scan averaging and noise reduction parse each scan only once. Up to
+//size scans are read ahead of the last one taken with next(), and up to size
+//scans already taken are kept so that they can be found again by number.
+class CScanBuffer {
+ public:
+  //Constructors & Destructors
+  CScanBuffer(CHardklorSetting& hs, int size);
+  ~CScanBuffer();
+
+  //Functions
+  bool open(char* fn, int scanNum=0);
+  void close();
+  bool next(Spectrum& sp);
+  bool find(int scanNum, Spectrum& sp);
+  char* getFile();
+  int getPercent();
+
+ private:
+  //Not copyable, since it owns a running thread
+  CScanBuffer(const CScanBuffer&);
+  CScanBuffer& operator=(const CScanBuffer&);
+
+  //Functions
+  void prefetch();
+  void stop();
+
+  //Data Members
+  CHardklorSetting cs;
+  char file[256];
+  int firstScan;
+  int size;
+
+  MSReader seqReader;   //reads ahead, on the prefetch thread
+  MSReader findReader;  //reads scans that are not in the buffer
+  boost::thread* thread;
+  boost::mutex mutex;
+  boost::condition_variable changed;
+  bool done;
+  bool stopping;
+
+  deque<Spectrum> scans;  //scans in file order
+  deque<int> percents;    //percent of the file read up to each of scans
+  int pos;                //index in scans of the next scan to take
+  int percent;            //percents entry of the scan last taken
+};
+
+#endif
@@ -15,6 +15,8 @@
 #include "util/StringUtils.h"
 #include "io/DelimitedFileWriter.h"
 
+#include <boost/thread.hpp>
+
 using namespace std;
 
 CruxHardklorApplication::CruxHardklorApplication() {
@@ -46,6 +48,16 @@ int CruxHardklorApplication::main(const string& ms1) {
     cdm = "senko";
   }
   bool xmlOutput = Params::GetBool("hardklor-xml-output");
+  int numThreads = Params::GetInt("num-threads");
+  if (numThreads < 1) {
+    numThreads = boost::thread::hardware_concurrency();
+  }
+  numThreads = max(numThreads, 1);
+  if (Params::GetInt("num-threads") > 1 &&
+      Params::GetString("hardklor-algorithm") != "version2") {
+    carp(CARP_INFO, "Hardklor analyzes scans on several threads only with "
+         "hardklor-algorithm=version2; num-threads has no effect.");
+  }
 
   vector<char*> hardklorArgs;
   addArg(&hardklorArgs, "hardklor");
@@ -78,6 +90,7 @@ int CruxHardklorApplication::main(const string& ms1) {
   addArg(&hardklorArgs, "smooth", Params::GetString("smooth"));
   addArg(&hardklorArgs, "sn_window", Params::GetString("sn-window"));
   addArg(&hardklorArgs, "static_sn", Params::GetBool("static-sn"));
+  addArg(&hardklorArgs, "threads", StringUtils::ToString(numThreads));
   addArg(&hardklorArgs, "xml", xmlOutput);
 
   addArg(&hardklorArgs, ms1);
@@ -116,6 +129,18 @@ int CruxHardklorApplication::main(const string& ms1) {
   CMercury8* mercury = new CMercury8(hp.queue(0).MercuryFile);
   CModelLibrary* models = new CModelLibrary(averagine, mercury);
 
+  // Reuse the isotope models built by earlier runs with the same data files
+  string modelLibrary = Params::GetString("hardklor-model-library");
+  string isotopeData;
+  if (!modelLibrary.empty()) {
+    isotopeData = dataFileKey(hp.queue(0).MercuryFile) + "\t" +
+      dataFileKey(hp.queue(0).HardklorFile);
+  }
+  if (!modelLibrary.empty() &&
+      models->loadLibrary(modelLibrary.c_str(), isotopeData.c_str())) {
+    carp(CARP_INFO, "Read isotope models from %s", modelLibrary.c_str());
+  }
+
   CHardklor h(averagine, mercury);
   CHardklor2 h2(averagine, mercury, models);
   vector<CHardklorVariant> pepVariants;
@@ -142,6 +167,14 @@ int CruxHardklorApplication::main(const string& ms1) {
   cout.rdbuf(oldCout);
   cerr.rdbuf(oldCerr);
 
+  if (!modelLibrary.empty() && models->isChanged()) {
+    if (models->saveLibrary(modelLibrary.c_str(), isotopeData.c_str())) {
+      carp(CARP_INFO, "Saved isotope models to %s", modelLibrary.c_str());
+    } else {
+      carp(CARP_WARNING, "Could not write isotope models to %s", modelLibrary.c_str());
+    }
+  }
+
   delete models;
   delete averagine;
   delete mercury;
@@ -235,6 +268,7 @@ vector<string> CruxHardklorApplication::getOptions() const {
     "depth",
     "distribution-area",
     "hardklor-data-file",
+    "hardklor-model-library",
     "instrument",
     "isotope-data-file",
     "max-features",
@@ -250,6 +284,7 @@ vector<string> CruxHardklorApplication::getOptions() const {
     "smooth",
     "sn-window",
     "static-sn",
+    "num-threads",
     "parameter-file",
     "verbosity"
   };
@@ -300,6 +335,31 @@ bool CruxHardklorApplication::needsOutputDirectory() const {
   return true;
 }
 
+string CruxHardklorApplication::dataFileKey(
+  const string& path
+) {
+  if (path.empty()) {
+    return "built-in";
+  }
+  // The size and a 64-bit FNV-1a hash of the contents, so that a file
+  // edited in place, or another file at the same path, does not match.
+  ifstream file(path.c_str(), ios::in | ios::binary);
+  if (!file.good()) {
+    return path;
+  }
+  uint64_t hash = 14695981039346656037ULL;
+  uint64_t size = 0;
+  char buffer[4096];
+  while (file.read(buffer, sizeof(buffer)) || file.gcount() > 0) {
+    streamsize n = file.gcount();
+    for (streamsize i = 0; i < n; i++) {
+      hash = (hash ^ (unsigned char)buffer[i]) * 1099511628211ULL;
+    }
+    size += n;
+  }
+  return StringUtils::ToString(size) + ":" + StringUtils::ToString(hash);
+}
+
 /*
  * Local Variables:
  * mode: c
@@ -75,6 +75,14 @@ class CruxHardklorApplication: public CruxApplication {
     const std::string& name,
     bool value
   );
+
+  /**
+   * \returns a key identifying the contents of an isotope data file, or
+   * the built-in data if the path is empty, for matching saved models
+   */
+  static std::string dataFileKey(
+    const std::string& path
+  );
 };
 
 
@@ -271,12 +271,15 @@ double Barista :: check_gradients_hinge_clones(int protind, int label)
 /**********************************************************/
 int Barista :: getOverFDRPSM(PSMScores &s, NeuralNet &n,double fdr)
 {
-  double* featVec;
-  for(int i = 0; i < s.size(); i++)
+  if(s.size() > 0)
     {
-      featVec = d.psmind2features(s[i].psmind);
-      double *r = n.fprop(featVec);
-      s[i].score = r[0];
+      vector<int> rows(s.size());
+      vector<double> scores(s.size());
+      for(int i = 0; i < s.size(); i++)
+	rows[i] = s[i].psmind;
+      n.fprop_batch(d.psmind2features(0), &rows[0], s.size(), &scores[0]);
+      for(int i = 0; i < s.size(); i++)
+	s[i].score = scores[i];
     }
 
   int overFDR = s.calcOverFDR(fdr);
@@ -1,6 +1,8 @@
 #include "NeuralNet.h"
 #include "util/utils.h"
 
+#include <algorithm>
+
 /*****************Sigmoid**********************/
 
 void Sigmoid :: resize(int m)
@@ -308,6 +310,72 @@ double* NeuralNet :: fprop(double *x)
 }
 
 
+void NeuralNet :: fprop_batch(const double *features, const int *rows, int num_rows, double *scores)
+{
+  const int block = 64;
+  int num_features = lin1.get_num_features();
+  int num_hu = lin1.get_num_neurons();
+  const double *w1 = lin1.get_weights();
+  const double *b1 = lin1.get_bias();
+  const double *w2 = is_linear ? 0 : lin2.get_weights();
+  const double *b2 = is_linear ? 0 : lin2.get_bias();
+
+  vector<double> x(num_features*block);
+  vector<double> h(block);
+  for(int first = 0; first < num_rows; first += block)
+    {
+      int n = min(block, num_rows-first);
+      //transpose the block, so x[j*block+b] is feature j of example b
+      for(int b = 0; b < n; b++)
+	{
+	  const double *row = features+(long)rows[first+b]*num_features;
+	  for(int j = 0; j < num_features; j++)
+	    x[j*block+b] = row[j];
+	}
+      double *out = scores+first;
+      //the sums are taken in the same order as Linear::fprop
+      if(is_linear)
+	{
+	  for(int b = 0; b < n; b++)
+	    out[b] = 0.0;
+	  for(int j = 0; j < num_features; j++)
+	    {
+	      double w = w1[j];
+	      const double *xj = &x[j*block];
+	      for(int b = 0; b < n; b++)
+		out[b] += w*xj[b];
+	    }
+	  if(lin1.get_has_bias())
+	    for(int b = 0; b < n; b++)
+	      out[b] += b1[0];
+	  continue;
+	}
+      for(int b = 0; b < n; b++)
+	out[b] = 0.0;
+      for(int k = 0; k < num_hu; k++)
+	{
+	  for(int b = 0; b < n; b++)
+	    h[b] = 0.0;
+	  for(int j = 0; j < num_features; j++)
+	    {
+	      double w = w1[k*num_features+j];
+	      const double *xj = &x[j*block];
+	      for(int b = 0; b < n; b++)
+		h[b] += w*xj[b];
+	    }
+	  if(lin1.get_has_bias())
+	    for(int b = 0; b < n; b++)
+	      h[b] += b1[k];
+	  for(int b = 0; b < n; b++)
+	    out[b] += w2[k]*(1.0/(1.0+exp(-h[b])));
+	}
+      if(lin2.get_has_bias())
+	for(int b = 0; b < n; b++)
+	  out[b] += b2[0];
+    }
+}
+
+
 void NeuralNet :: clear_gradients()
 {
   lin1.clear_gradients();
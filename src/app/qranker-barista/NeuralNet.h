@@ -86,6 +86,7 @@ class Linear
   inline double* get_dweights() {return dw;}
   inline double* get_bias() {return bias;}
   inline double* get_dbias() {return dbias;}
+  inline int get_has_bias() const {return has_bias;}
 
   void write_to_file(ofstream &outfile);
   void read_from_file(ifstream &infile);
@@ -123,6 +124,14 @@ class NeuralNet {
   void make_random();
 
   double* fprop(double *down);
+  /*
+   * Scores num_rows examples, summing in the same order as fprop. Example i
+   * is the num_features values at features+rows[i]*num_features. The
+   * examples are processed in blocks, with the features of a block
+   * transposed so that the inner loops run across examples and can be
+   * vectorized.
+   */
+  void fprop_batch(const double *features, const int *rows, int num_rows, double *scores);
   void clear_gradients();
   double* bprop(double *up);
   void update(double mu, double weight_decay=0.0);
@@ -4,6 +4,60 @@
 #include "util/Params.h"
 #include "app/ComputeQValues.h"
 
+#include <boost/bind.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+#include <boost/thread.hpp>
+
+/*
+ * Draws from the global random number generator, for training on the
+ * main thread.
+ */
+struct GlobalRandom
+{
+  int operator()(int max) {return myrandom_limit(max);}
+};
+
+/*
+ * Draws integers in [0, max) the way myrandom_limit does, but from a
+ * generator of its own, so that nets can be trained on several threads.
+ */
+class RunRandom
+{
+public:
+  RunRandom() : dist(0, UNIFORM_INT_DISTRIBUTION_MAX) {}
+  void seed(unsigned s) {rng.seed(s);}
+  int operator()(int max) {return dist(rng) % max;}
+private:
+  boost::random::mt19937 rng;
+  boost::random::uniform_int_distribution<> dist;
+};
+
+/*
+ * One run of train_many_target_nets, which continues training from the
+ * best general net at one q-value threshold. Each run has its own nets,
+ * copies of the training and test sets (which are sorted as they are
+ * scored) and best nets, so that the runs can be trained in parallel.
+ */
+struct QRanker::TargetRun
+{
+  int thr_count;
+  int interval;
+  NeuralNet net;
+  NeuralNet nets[2];
+  PSMScores trainset;
+  PSMScores testset;
+  vector<int> overFDRmulti;
+  vector<int> max_overFDR;
+  NeuralNet* max_net_targ;
+  RunRandom random;
+
+  TargetRun() : max_net_targ(NULL) {}
+  ~TargetRun() {delete[] max_net_targ;}
+};
+
+static boost::mutex log_mutex;
+
 QRanker::QRanker() :  
   seed(0),
   selectionfdr(0.01),
@@ -30,37 +84,42 @@ QRanker::~QRanker()
   delete [] nets;
 }
 
-int QRanker :: getOverFDR(PSMScores &set, NeuralNet &n, double fdr)
+/*
+ * Sets the score of every PSM in the set to the output of the net. The
+ * PSMs are scored in batches by NeuralNet::fprop_batch.
+ */
+void QRanker :: score_set(PSMScores &set, NeuralNet &n)
 {
-  double *r;
-  double* featVec;
-
-  for(int i = 0; i < set.size(); i++)
-    {
-      featVec = d.psmind2features(set[i].psmind);
-      r = n.fprop(featVec);
-      set[i].score = r[0];
+  int size = set.size();
+  if(size == 0)
+    return;
+  vector<int> rows(size);
+  vector<double> scores(size);
+  for(int i = 0; i < size; i++)
+    rows[i] = set[i].psmind;
+  n.fprop_batch(d.psmind2features(0), &rows[0], size, &scores[0]);
+  for(int i = 0; i < size; i++)
+    set[i].score = scores[i];
+}
 
-    }
+int QRanker :: getOverFDR(PSMScores &set, NeuralNet &n, double fdr)
+{
+  score_set(set, n);
   return set.calcOverFDR(fdr);
 }
 
 
 void QRanker :: getMultiFDR(PSMScores &set, NeuralNet &n, vector<double> &qvalues)
 {
-  double *r;
-  double* featVec;
-   
-  for(int i = 0; i < set.size(); i++)
-    {
-      featVec = d.psmind2features(set[i].psmind);
-      r = n.fprop(featVec);
-      set[i].score = r[0];
-    }
- 
+  getMultiFDR(set, n, qvalues, overFDRmulti);
+}
+
+void QRanker :: getMultiFDR(PSMScores &set, NeuralNet &n, vector<double> &qvalues, vector<int> &overFDR)
+{
+  score_set(set, n);
   for(unsigned int ct = 0; ct < qvalues.size(); ct++)
-    overFDRmulti[ct] = 0;
-  set.calcMultiOverFDR(qvalues, overFDRmulti);
+    overFDR[ct] = 0;
+  set.calcMultiOverFDR(qvalues, overFDR);
 }
 
 void QRanker :: getMultiFDRXCorr(PSMScores &set, vector<double> &qvalues)
@@ -553,7 +612,9 @@ void QRanker :: train_net_hinge(PSMScores &set, int interval)
 }
 
 
-void QRanker :: train_net_ranking(PSMScores &set, int interval)
+template<class Random>
+void QRanker :: train_net_ranking(PSMScores &set, int interval, NeuralNet &n,
+				 NeuralNet *pair_nets, Random &random)
 {
   double *r1;
   double *r2;
@@ -570,7 +631,7 @@ void QRanker :: train_net_ranking(PSMScores &set, int interval)
       if(interval == 0)
 	ind1 = 0;
       else
-	ind1 = myrandom_limit(interval);
+	ind1 = random(interval);
       if(ind1>set.size()-1) continue;
       if(set[ind1].label == 1)
 	label_flag = -1;
@@ -580,20 +641,20 @@ void QRanker :: train_net_ranking(PSMScores &set, int interval)
       int cn = 0;
       while(1)
 	{
-	  ind2 = myrandom_limit(interval);
+	  ind2 = random(interval);
 	  if(ind2>set.size()-1) continue;
 	  if(set[ind2].label == label_flag) break;
 	  if(cn > 1000)
 	    {
-	      ind2 = myrandom_limit(set.size());
+	      ind2 = random(set.size());
 	      break;
 	    }
 	  cn++;
 	}
       
       //pass both through the net
-      r1 = nets[0].fprop(d.psmind2features(set[ind1].psmind));
-      r2 = nets[1].fprop(d.psmind2features(set[ind2].psmind));
+      r1 = pair_nets[0].fprop(d.psmind2features(set[ind1].psmind));
+      r2 = pair_nets[1].fprop(d.psmind2features(set[ind2].psmind));
       diff = r1[0]-r2[0];
       
 
@@ -607,12 +668,12 @@ void QRanker :: train_net_ranking(PSMScores &set, int interval)
 	{
 	  if(label*diff<1)
 	    {
-	      net.clear_gradients();
+	      n.clear_gradients();
 	      gc[0] = -1.0*label;
-	      nets[0].bprop(gc);
+	      pair_nets[0].bprop(gc);
 	      gc[0] = 1.0*label;
-	      nets[1].bprop(gc);
-	      net.update(mu,weightDecay);
+	      pair_nets[1].bprop(gc);
+	      n.update(mu,weightDecay);
 	    }
 	  
 	}
@@ -621,6 +682,12 @@ void QRanker :: train_net_ranking(PSMScores &set, int interval)
   
 }
 
+void QRanker :: train_net_ranking(PSMScores &set, int interval)
+{
+  GlobalRandom random;
+  train_net_ranking(set, interval, net, nets, random);
+}
+
 
 void QRanker :: count_pairs(PSMScores &set, int interval)
 {
@@ -728,7 +795,61 @@ void QRanker :: train_many_general_nets()
 
 }
 
-void QRanker :: train_many_target_nets()
+void QRanker :: train_target_net(TargetRun *run)
+{
+  for(int i=switch_iter;i<niter;i++) {
+
+    //sorts the examples in the training set according to the current net scores
+    getMultiFDR(run->trainset,run->net,qvals,run->overFDRmulti);
+    train_net_ranking(run->trainset, run->interval, run->net, run->nets, run->random);
+
+    for(int count = 0; count < num_qvals;count++)
+      {
+	if(run->overFDRmulti[count] > run->max_overFDR[count])
+	  {
+	    run->max_overFDR[count] = run->overFDRmulti[count];
+	    run->max_net_targ[count].copy(run->net);
+	  }
+      }
+
+    if((i % 3) == 0)
+      {
+	vector<int>& fdr = run->overFDRmulti;
+	getMultiFDR(run->trainset,run->net,qvals,fdr);
+	boost::mutex::scoped_lock lock(log_mutex);
+	carp(CARP_INFO, "Threshold %d iteration %d :", run->thr_count, i);
+	carp(CARP_INFO, "trainset %.2f:%d %.2f:%d %.2f:%d  %.2f:%d %.2f:%d %.2f:%d %.2f:%d %.2f:%d %.2f:%d  %.2f:%d %.2f:%d %.2f:%d %.2f:%d %.2f:%d ", 
+	     qvals[0], fdr[0], qvals[1], fdr[1], qvals[2], fdr[2],
+	     qvals[3], fdr[3], qvals[4], fdr[4], qvals[5], fdr[5],
+	     qvals[6], fdr[6], qvals[7], fdr[7], qvals[8], fdr[8],
+	     qvals[9], fdr[9], qvals[10], fdr[10], qvals[11], fdr[11],
+	     qvals[12], fdr[12], qvals[13], fdr[13]);
+	lock.unlock();
+	getMultiFDR(run->testset,run->net,qvals,fdr);
+	lock.lock();
+	carp(CARP_INFO, "testset %.2f:%d %.2f:%d %.2f:%d  %.2f:%d %.2f:%d %.2f:%d %.2f:%d %.2f:%d %.2f:%d  %.2f:%d %.2f:%d %.2f:%d %.2f:%d %.2f:%d\n ", 
+	     qvals[0], fdr[0], qvals[1], fdr[1], qvals[2], fdr[2],
+	     qvals[3], fdr[3], qvals[4], fdr[4], qvals[5], fdr[5],
+	     qvals[6], fdr[6], qvals[7], fdr[7], qvals[8], fdr[8],
+	     qvals[9], fdr[9], qvals[10], fdr[10], qvals[11], fdr[11],
+	     qvals[12], fdr[12], qvals[13], fdr[13]);
+      }
+  }
+}
+
+void QRanker :: train_target_nets(vector<TargetRun*> *runs, int first, int stride)
+{
+  for(unsigned int r = first; r < runs->size(); r += stride)
+    train_target_net((*runs)[r]);
+}
+
+/*
+ * Continues training from the best general nets at several q-value
+ * thresholds, one after another. Each run starts from the state the
+ * previous runs left behind and draws from the global random number
+ * generator, so seeded results do not change.
+ */
+void QRanker :: train_target_nets_sequential()
 {
 
   int  thr_count = num_qvals-1;
@@ -772,14 +893,6 @@ void QRanker :: train_many_target_nets()
 		 qvals[6], overFDRmulti[6], qvals[7], overFDRmulti[7], qvals[8], overFDRmulti[8],
 		 qvals[9], overFDRmulti[9], qvals[10], overFDRmulti[10], qvals[11], overFDRmulti[11],
 		 qvals[12], overFDRmulti[12], qvals[13], overFDRmulti[13]);
-	    
-	    /*
-	    cout << "Iteration " << i << " : \n";
-	    getMultiFDR(testset,net,qvals);
-	    cout << "testset: ";
-	    printNetResults(overFDRmulti);
-	    cout << "\n";
-	    */
 	  }
 
       }
@@ -787,6 +900,71 @@ void QRanker :: train_many_target_nets()
     }
 }
 
+/*
+ * Continues training from the best general nets at several q-value
+ * thresholds. With num-threads set above one, the runs all start from the
+ * general nets, each with its own random number generator, and are
+ * trained in parallel. The best net at each q-value is then taken over
+ * all of them; of runs that tie, the first is kept. Otherwise the runs
+ * are trained one after another as before.
+ */
+void QRanker :: train_many_target_nets()
+{
+  int num_runs = 0;
+  for(int thr_count = num_qvals-1; thr_count > 0; thr_count -= 3)
+    num_runs++;
+  //0 keeps the sequential runs here, since the parallel runs give
+  //different nets than the sequential ones
+  int num_threads = min(Params::GetInt("num-threads"), num_runs);
+  if(num_threads <= 1)
+    {
+      train_target_nets_sequential();
+      return;
+    }
+
+  vector<TargetRun*> runs;
+  for(int thr_count = num_qvals-1; thr_count > 0; thr_count -= 3)
+    {
+      TargetRun *run = new TargetRun();
+      run->thr_count = thr_count;
+      run->interval = max_overFDR[thr_count];
+      //nets are allocated here, since NeuralNet::operator= draws from
+      //the global random number generator
+      run->net = max_net_gen[thr_count];
+      run->nets[0].clone(run->net);
+      run->nets[1].clone(run->net);
+      run->trainset = trainset;
+      run->testset = testset;
+      run->overFDRmulti.resize(num_qvals,0);
+      run->max_overFDR = max_overFDR;
+      run->max_net_targ = new NeuralNet[num_qvals];
+      for(int count = 0; count < num_qvals; count++)
+	run->max_net_targ[count] = max_net_targ[count];
+      run->random.seed(myrandom());
+      runs.push_back(run);
+      carp(CARP_INFO, "training threshold %d", thr_count);
+    }
+
+  boost::thread_group threads;
+  for(int t = 0; t < num_threads; t++)
+    threads.create_thread(boost::bind(&QRanker::train_target_nets, this, &runs, t, num_threads));
+  threads.join_all();
+
+  for(unsigned int r = 0; r < runs.size(); r++)
+    {
+      TargetRun *run = runs[r];
+      for(int count = 0; count < num_qvals; count++)
+	{
+	  if(run->max_overFDR[count] > max_overFDR[count])
+	    {
+	      max_overFDR[count] = run->max_overFDR[count];
+	      max_net_targ[count].copy(run->max_net_targ[count]);
+	    }
+	}
+      delete run;
+    }
+}
+
 
 
 void QRanker::train_many_nets()
@@ -1188,7 +1366,8 @@ vector<string> QRanker::getOptions() const {
     "verbosity",
      "list-of-files",
     "feature-file-out",
-    "spectrum-parser"
+    "spectrum-parser",
+    "num-threads"
   };
   return vector<string>(arr, arr + sizeof(arr) / sizeof(string));
 }
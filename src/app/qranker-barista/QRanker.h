@@ -45,14 +45,23 @@ public:
   int run();
   void train_net_sigmoid(PSMScores &set, int interval);
   void train_net_ranking(PSMScores &set, int interval);
+  template<class Random>
+  void train_net_ranking(PSMScores &set, int interval, NeuralNet &n,
+                         NeuralNet *pair_nets, Random &random);
   void train_net_hinge(PSMScores &set, int interval);
   void count_pairs(PSMScores &set, int interval);
   void train_many_general_nets();
   void train_many_target_nets();
+  void train_target_nets_sequential();
+  struct TargetRun;
+  void train_target_net(TargetRun *run);
+  void train_target_nets(vector<TargetRun*> *runs, int first, int stride);
   void train_many_nets();
     
+  void score_set(PSMScores &set, NeuralNet &n);
   int getOverFDR(PSMScores &set, NeuralNet &n, double fdr);
   void getMultiFDR(PSMScores &set, NeuralNet &n, vector<double> &qval);
+  void getMultiFDR(PSMScores &set, NeuralNet &n, vector<double> &qval, vector<int> &overFDR);
   void getMultiFDRXCorr(PSMScores &set, vector<double> &qval);
   void printNetResults(vector<int> &scores);
   void write_results();
@@ -9,40 +9,63 @@
 #include "records_to_vector-inl.h"
 #include "theoretical_peak_set.h"
 #include "compiler.h"
+#include "score_engine.h"
+#include "peptide_stream.h"
+#include "telemetry.h"
 #include "app/TideMatchSet.h"
 #include <map> //Added by Andy Lin
 #define CHECK(x) GOOGLE_CHECK((x))
 
 DEFINE_int32(fifo_page_size, 1, "Page size for FIFO allocator, in megs");
 
-ActivePeptideQueue::ActivePeptideQueue(RecordReader* reader,
+ActivePeptideQueue::ActivePeptideQueue(PeptideReader* reader,
                                        const vector<const pb::Protein*>&
                                        proteins)
   : reader_(reader),
+    stream_(NULL), consumer_(0), front_seq_(0), next_seq_(0),
     proteins_(proteins),
     theoretical_peak_set_(2000),   // probably overkill, but no harm
     theoretical_b_peak_set_(200),  // probably overkill, but no harm
-    active_targets_(0), active_decoys_(0),
-    fifo_alloc_peptides_(FLAGS_fifo_page_size << 20),
-    fifo_alloc_prog1_(FLAGS_fifo_page_size << 20),
-    fifo_alloc_prog2_(FLAGS_fifo_page_size << 20) {
+    fifo_alloc_peptides_(new FifoAllocator(FLAGS_fifo_page_size << 20)),
+    fifo_alloc_prog1_(new FifoAllocator(FLAGS_fifo_page_size << 20,
+                                        ScoreEngine::Compiled())),
+    fifo_alloc_prog2_(new FifoAllocator(FLAGS_fifo_page_size << 20,
+                                        ScoreEngine::Compiled())),
+    compiler_prog1_(new TheoreticalPeakCompiler(fifo_alloc_prog1_)),
+    compiler_prog2_(new TheoreticalPeakCompiler(fifo_alloc_prog2_)),
+    active_targets_(0), active_decoys_(0) {
   CHECK(reader_->OK());
-  compiler_prog1_ = new TheoreticalPeakCompiler(&fifo_alloc_prog1_);
-  compiler_prog2_ = new TheoreticalPeakCompiler(&fifo_alloc_prog2_);
+  peptide_centric_ = false;
+  elution_window_ = 0;
+}
+
+ActivePeptideQueue::ActivePeptideQueue(PeptideStream* stream, int consumer,
+                                       const vector<const pb::Protein*>&
+                                       proteins)
+  : reader_(NULL),
+    stream_(stream), consumer_(consumer), front_seq_(0), next_seq_(0),
+    proteins_(proteins),
+    theoretical_peak_set_(1),      // peaks are computed by the stream
+    theoretical_b_peak_set_(200),
+    fifo_alloc_peptides_(NULL), fifo_alloc_prog1_(NULL),
+    fifo_alloc_prog2_(NULL),
+    compiler_prog1_(NULL), compiler_prog2_(NULL),
+    active_targets_(0), active_decoys_(0) {
+  CHECK(stream_ != NULL);
   peptide_centric_ = false;
   elution_window_ = 0;
 }
 
 ActivePeptideQueue::~ActivePeptideQueue() {
+  DetachStream();
   deque<Peptide*>::iterator i = queue_.begin();
   // for (; i != queue_.end(); ++i)
   //   delete (*i)->PB();
-  fifo_alloc_peptides_.ReleaseAll();
-  fifo_alloc_prog1_.ReleaseAll();
-  fifo_alloc_prog2_.ReleaseAll();
-
   delete compiler_prog1_;
   delete compiler_prog2_;
+  delete fifo_alloc_peptides_;
+  delete fifo_alloc_prog1_;
+  delete fifo_alloc_prog2_;
 }
 
 // Compute the theoretical peaks of the peptide in the "back" of the queue
@@ -50,8 +73,12 @@ ActivePeptideQueue::~ActivePeptideQueue() {
 void ActivePeptideQueue::ComputeTheoreticalPeaksBack() {
   theoretical_peak_set_.Clear();
   Peptide* peptide = queue_.back();
-  peptide->ComputeTheoreticalPeaks(&theoretical_peak_set_, current_pb_peptide_,
-                                   compiler_prog1_, compiler_prog2_);
+  if (ScoreEngine::Compiled()) {
+    peptide->ComputeTheoreticalPeaks(&theoretical_peak_set_, current_pb_peptide_,
+                                     compiler_prog1_, compiler_prog2_);
+  } else {
+    peptide->ComputeTheoreticalPeaks(&theoretical_peak_set_, fifo_alloc_peptides_);
+  }
 }
 
 bool ActivePeptideQueue::isWithinIsotope(vector<double>* min_mass, vector<double>* max_mass, double mass, int* isotope_idx) {
@@ -74,6 +101,14 @@ int ActivePeptideQueue::SetActiveRange(vector<double>* min_mass, vector<double>*
 
   // queue front() is lightest; back() is heaviest
 
+  Telemetry::Scope scope(Telemetry::ACTIVE_RANGE);
+  if (stream_ != NULL) {
+    // The shared stream does the reading, peak computation and releasing.
+    stream_->Advance(consumer_, min_range, max_range,
+                     &queue_, &front_seq_, &next_seq_);
+    return SetActiveIterators(min_mass, max_mass, candidatePeptideStatus);
+  }
+
   // delete anything already loaded that falls below min_range
   while (!queue_.empty() && queue_.front()->Mass() < min_range) {
     Peptide* peptide = queue_.front();
@@ -87,18 +122,18 @@ int ActivePeptideQueue::SetActiveRange(vector<double>* min_mass, vector<double>*
   }
   if (queue_.empty()) {
     //cerr << "Releasing All\n";
-    fifo_alloc_peptides_.ReleaseAll();
-    fifo_alloc_prog1_.ReleaseAll();
-    fifo_alloc_prog2_.ReleaseAll();
+    fifo_alloc_peptides_->ReleaseAll();
+    fifo_alloc_prog1_->ReleaseAll();
+    fifo_alloc_prog2_->ReleaseAll();
     //cerr << "Prog1: ";
-    //fifo_alloc_prog1_.Show();
+    //fifo_alloc_prog1_->Show();
     //cerr << "Prog2: ";
-    //fifo_alloc_prog2_.Show();
+    //fifo_alloc_prog2_->Show();
   } else {
     Peptide* peptide = queue_.front();
     // Free all peptides up to, but not including peptide.
-    fifo_alloc_peptides_.Release(peptide);
-    peptide->ReleaseFifo(&fifo_alloc_prog1_, &fifo_alloc_prog2_);
+    fifo_alloc_peptides_->Release(peptide);
+    peptide->ReleaseFifo(fifo_alloc_prog1_, fifo_alloc_prog2_);
   }
 
   // Enqueue all peptides that are not yet queued but are lighter than
@@ -109,16 +144,23 @@ int ActivePeptideQueue::SetActiveRange(vector<double>* min_mass, vector<double>*
   if (queue_.empty() || queue_.back()->Mass() <= max_range) {
     if (!queue_.empty()) {
       ComputeTheoreticalPeaksBack();
+    } else {
+      reader_->SkipTo(min_range);
     }
     while (!(done = reader_->Done())) {
       // read all peptides lighter than max_range
-      reader_->Read(&current_pb_peptide_);
-      if (current_pb_peptide_.mass() < min_range) {
-        // we would delete current_pb_peptide_;
-        continue; // skip peptides that fall below min_range
+      Peptide* peptide;
+      {
+        Telemetry::Scope decode_scope(Telemetry::PEPTIDE_DECODE);
+        reader_->Read(&current_pb_peptide_);
+        if (current_pb_peptide_.mass() < min_range) {
+          // we would delete current_pb_peptide_;
+          continue; // skip peptides that fall below min_range
+        }
+        peptide = new(fifo_alloc_peptides_)
+          Peptide(current_pb_peptide_, proteins_, fifo_alloc_peptides_);
       }
-      Peptide* peptide = new(&fifo_alloc_peptides_)
-        Peptide(current_pb_peptide_, proteins_, &fifo_alloc_peptides_);
+      Telemetry::Count(Telemetry::PEPTIDES, 1);
       queue_.push_back(peptide);
       if (peptide->Mass() > max_range) {
         break;
@@ -130,8 +172,13 @@ int ActivePeptideQueue::SetActiveRange(vector<double>* min_mass, vector<double>*
   // peptide is too heavy
   assert(!queue_.empty() || done);
 
-  // Set up iterator for use with HasNext(),
-  // GetPeptide(), and NextPeptide(). Return the number of enqueued peptides.
+  return SetActiveIterators(min_mass, max_mass, candidatePeptideStatus);
+}
+
+// Set up iterator for use with HasNext(), GetPeptide(), and NextPeptide()
+// over the peptides of queue_ that fall within the isotope windows. Return
+// the number of active peptides.
+int ActivePeptideQueue::SetActiveIterators(vector<double>* min_mass, vector<double>* max_mass, vector<bool>* candidatePeptideStatus) {
   if (queue_.empty()) {
     return 0;
   }
@@ -168,6 +215,31 @@ int ActivePeptideQueue::SetActiveRange(vector<double>* min_mass, vector<double>*
 
 }
 
+ActivePeptideQueue::ActiveWindow ActivePeptideQueue::GetActiveWindow() const {
+  ActiveWindow window;
+  window.iter = iter_;
+  window.end = end_;
+  window.offset = queue_.empty() ? 0 : iter_ - queue_.begin();
+  window.active_targets = active_targets_;
+  window.active_decoys = active_decoys_;
+  return window;
+}
+
+void ActivePeptideQueue::RestoreActiveWindow(const ActiveWindow& window) {
+  iter_ = window.iter;
+  end_ = window.end;
+  active_targets_ = window.active_targets;
+  active_decoys_ = window.active_decoys;
+}
+
+void ActivePeptideQueue::DetachStream() {
+  if (stream_ != NULL) {
+    queue_.clear();
+    stream_->Detach(consumer_);
+    stream_ = NULL;
+  }
+}
+
 // Compute the b ion only theoretical peaks of the peptide in the "back" of the queue
 // (i.e. the one most recently read from disk -- the heaviest).
 void ActivePeptideQueue::ComputeBTheoreticalPeaksBack() {
@@ -181,6 +253,8 @@ int ActivePeptideQueue::SetActiveRangeBIons(vector<double>* min_mass, vector<dou
     exact_pval_search_ = true;
   // queue front() is lightest; back() is heaviest
 
+  Telemetry::Scope scope(Telemetry::ACTIVE_RANGE);
+
   // delete anything already loaded that falls below min_range
   while (!queue_.empty() && queue_.front()->Mass() < min_range) {
     Peptide* peptide = queue_.front();
@@ -193,11 +267,11 @@ int ActivePeptideQueue::SetActiveRangeBIons(vector<double>* min_mass, vector<dou
 //    delete peptide;
   }
   if (queue_.empty()) {
-    fifo_alloc_peptides_.ReleaseAll();
+    fifo_alloc_peptides_->ReleaseAll();
   } else {
     Peptide* peptide = queue_.front();
     // Free all peptides up to, but not including peptide.
-    fifo_alloc_peptides_.Release(peptide);
+    fifo_alloc_peptides_->Release(peptide);
   }
 
   // Enqueue all peptides that are not yet queued but are lighter than
@@ -206,15 +280,23 @@ int ActivePeptideQueue::SetActiveRangeBIons(vector<double>* min_mass, vector<dou
   // fifo_alloc_peptides_.
   bool done;
   if (queue_.empty() || queue_.back()->Mass() <= max_range) {
+    if (queue_.empty()) {
+      reader_->SkipTo(min_range);
+    }
     while (!(done = reader_->Done())) {
       // read all peptides lighter than max_range
-      reader_->Read(&current_pb_peptide_);
-      if (current_pb_peptide_.mass() < min_range) {
-        // we would delete current_pb_peptide_;
-        continue; // skip peptides that fall below min_range
+      Peptide* peptide;
+      {
+        Telemetry::Scope decode_scope(Telemetry::PEPTIDE_DECODE);
+        reader_->Read(&current_pb_peptide_);
+        if (current_pb_peptide_.mass() < min_range) {
+          // we would delete current_pb_peptide_;
+          continue; // skip peptides that fall below min_range
+        }
+        peptide = new(fifo_alloc_peptides_)
+          Peptide(current_pb_peptide_, proteins_, fifo_alloc_peptides_);
       }
-      Peptide* peptide = new(&fifo_alloc_peptides_)
-        Peptide(current_pb_peptide_, proteins_, &fifo_alloc_peptides_);
+      Telemetry::Count(Telemetry::PEPTIDES, 1);
       queue_.push_back(peptide);
       ComputeBTheoreticalPeaksBack();
       if (peptide->Mass() > max_range) {
@@ -283,7 +365,7 @@ int ActivePeptideQueue::CountAAFrequency(
 
     while (!(reader_->Done())) { // read all peptides in index
       reader_->Read(&current_pb_peptide_);
-      Peptide* peptide = new(&fifo_alloc_peptides_) Peptide(current_pb_peptide_, proteins_, &fifo_alloc_peptides_);
+      Peptide* peptide = new(fifo_alloc_peptides_) Peptide(current_pb_peptide_, proteins_, fifo_alloc_peptides_);
 
       double* dAAResidueMass = peptide->getAAMasses(); //retrieves the amino acid masses, modifications included
 
@@ -297,7 +379,7 @@ int ActivePeptideQueue::CountAAFrequency(
       ++cntTerm;
 
       delete[] dAAResidueMass;
-      fifo_alloc_peptides_.ReleaseAll();
+      fifo_alloc_peptides_->ReleaseAll();
     }
 
   //calculate the unique masses
@@ -353,7 +435,7 @@ int ActivePeptideQueue::CountAAFrequencyRes(
 
   while (!(reader_->Done())) { //read all peptides in index
     reader_->Read(&current_pb_peptide_);
-    Peptide* peptide = new(&fifo_alloc_peptides_) Peptide(current_pb_peptide_, proteins_, &fifo_alloc_peptides_);
+    Peptide* peptide = new(fifo_alloc_peptides_) Peptide(current_pb_peptide_, proteins_, fifo_alloc_peptides_);
 
     double* dAAResidueMass = peptide->getAAMasses(); //retrieves the amino acid massses, modifications included
 
@@ -407,13 +489,21 @@ int ActivePeptideQueue::CountAAFrequencyRes(
 }
 
 
+void ActivePeptideQueue::ReportRemainingHits() {
+  for (deque<Peptide*>::iterator i = queue_.begin(); i != queue_.end(); ++i) {
+    ReportPeptideHits(*i);
+    (*i)->spectrum_matches_array.clear();
+    vector<Peptide::spectrum_matches>().swap((*i)->spectrum_matches_array);
+  }
+}
+
 void ActivePeptideQueue::ReportPeptideHits(Peptide* peptide) {
     if (!peptide_centric_) {
       return;
     }
 
     current_peptide_ = peptide;
-    TideMatchSet matches(peptide, highest_mz_);
+    TideMatchSet matches(peptide, highest_mz_, *config_);
     matches.exact_pval_search_ = exact_pval_search_;
     matches.elution_window_ = elution_window_;
 
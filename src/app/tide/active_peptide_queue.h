@@ -13,12 +13,18 @@
 // SetActiveRange() the client may use the iterator interface HasNext() and
 // NextPeptide() to iterate over the window. The client may also use
 // GetPeptide() to get a specific peptide in the window.
+//
+// Several ActivePeptideQueues, one per search thread, may share a single
+// PeptideStream (see peptide_stream.h) instead of each reading the file on its
+// own. In that case the peptides and their compiled programs are decoded once
+// and owned by the stream, and each queue only holds pointers to them.
 
 #include <deque>
 #include "peptides.pb.h"
 #include "peptide.h"
 #include "theoretical_peak_set.h"
 #include "fifo_alloc.h"
+#include "peptide_reader.h"
 #include "spectrum_collection.h"
 #include "io/OutputFiles.h"
 
@@ -27,10 +33,18 @@
 #define ACTIVE_PEPTIDE_QUEUE_H
 
 class TheoreticalPeakCompiler;
+class PeptideStream;
+class SearchConfig;
 
 class ActivePeptideQueue {
  public:
-  ActivePeptideQueue(RecordReader* reader,
+  ActivePeptideQueue(PeptideReader* reader,
+            const vector<const pb::Protein*>& proteins);
+
+  // Draw peptides from a stream shared with other queues. consumer identifies
+  // this queue to the stream and must be unique among the stream's consumers.
+  // Only SetActiveRange() is supported on such a queue.
+  ActivePeptideQueue(PeptideStream* stream, int consumer,
             const vector<const pb::Protein*>& proteins);
 
   ~ActivePeptideQueue();
@@ -64,8 +78,12 @@ class ActivePeptideQueue {
   int ActiveDecoys() const { return active_decoys_; }
 
   void ReportPeptideHits(Peptide* peptide);
+  // Report the hits of every peptide still queued, as if they had all been
+  // dropped, for a peptide-centric search that is done.
+  void ReportRemainingHits();
   void SetOutputs(OutputFiles* output_files, const vector<const pb::AuxLocation*>* locations, int top_matches,
-                  bool compute_sp, ofstream* target_file, ofstream* decoy_file, double highest_mz) {
+                  bool compute_sp, ostream* target_file, ostream* decoy_file, double highest_mz,
+                  const SearchConfig* config) {
       locations_ = locations;
       output_files_ = output_files;
       top_matches_ = top_matches;
@@ -73,6 +91,7 @@ class ActivePeptideQueue {
       target_file_ = target_file;
       decoy_file_ = decoy_file;
       highest_mz_ = highest_mz;
+      config_ = config;
   }
   void setPeptideCentric(bool peptide_centric) {
     peptide_centric_ = peptide_centric;
@@ -81,6 +100,31 @@ class ActivePeptideQueue {
   void setElutionWindow(int elution_window) {
     elution_window_ = elution_window;
   }
+
+  // Tell the shared stream, if any, that this queue is done searching, so
+  // that the peptides it holds can be released. No-op for unshared queues.
+  void DetachStream();
+  bool SharesStream() const { return stream_ != NULL; }
+
+  // Several spectra with overlapping precursor windows may be scored against
+  // a single range loaded by SetActiveRange(). SetActiveWindow() selects the
+  // active peptides for one of them among those already loaded, without
+  // reading or releasing anything; min_mass and max_mass must lie within the
+  // min_range and max_range of the last call to SetActiveRange().
+  // GetActiveWindow() and RestoreActiveWindow() save and restore the
+  // selection, so the client can switch back to a spectrum's window when
+  // reporting its matches.
+  struct ActiveWindow {
+    deque<Peptide*>::const_iterator iter, end;
+    int offset; // position of iter among the loaded peptides
+    int active_targets, active_decoys;
+  };
+  int SetActiveWindow(vector<double>* min_mass, vector<double>* max_mass, vector<bool>* candidatePeptideStatus) {
+    return SetActiveIterators(min_mass, max_mass, candidatePeptideStatus);
+  }
+  ActiveWindow GetActiveWindow() const;
+  void RestoreActiveWindow(const ActiveWindow& window);
+
   // iter_ points to the current peptide. Client access is by HasNext(),
   // GetPeptide(), and NextPeptide(). end_ points just beyond the last active
   // peptide.
@@ -92,9 +136,10 @@ class ActivePeptideQueue {
   OutputFiles* output_files_;
   int top_matches_;
   bool compute_sp_;
-  ofstream* target_file_;
-  ofstream* decoy_file_;
+  ostream* target_file_;
+  ostream* decoy_file_;
   double highest_mz_;
+  const SearchConfig* config_;
   Peptide* current_peptide_;
   bool exact_pval_search_;
   bool peptide_centric_;
@@ -107,10 +152,18 @@ class ActivePeptideQueue {
   // See .cc file.
   void ComputeTheoreticalPeaksBack();
   void ComputeBTheoreticalPeaksBack();
+  int SetActiveIterators(vector<double>* min_mass, vector<double>* max_mass, vector<bool>* candidatePeptideStatus);
 
-  RecordReader* reader_;
+  PeptideReader* reader_;
   pb::Peptide current_pb_peptide_;
 
+  // Set if peptides come from a shared stream rather than from reader_.
+  // front_seq_ and next_seq_ are the stream sequence numbers of queue_.front()
+  // and of the peptide just past queue_.back().
+  PeptideStream* stream_;
+  int consumer_;
+  uint64_t front_seq_, next_seq_;
+
   // All amino acid sequences from which the peptides are drawn.
   const vector<const pb::Protein*>& proteins_; 
 
@@ -136,10 +189,11 @@ class ActivePeptideQueue {
   // FifoAllocators allow us to execute the code thus generated,
   // since they set the proper permissions. The set of theoretical peaks for 
   // "dotting" with charge 1 and charge 2 spectra, have different
-  // FifoAllocators and TheoreticalPeakCompilers.
-  FifoAllocator fifo_alloc_peptides_;
-  FifoAllocator fifo_alloc_prog1_;
-  FifoAllocator fifo_alloc_prog2_;
+  // FifoAllocators and TheoreticalPeakCompilers. A queue fed by a shared
+  // PeptideStream leaves all of this to the stream, and has none of them.
+  FifoAllocator* fifo_alloc_peptides_;
+  FifoAllocator* fifo_alloc_prog1_;
+  FifoAllocator* fifo_alloc_prog2_;
   TheoreticalPeakCompiler* compiler_prog1_;
   TheoreticalPeakCompiler* compiler_prog2_;
 
@@ -0,0 +1,303 @@
+// See columnar_peptides.h for a description of the format.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _MSC_VER
+#include <io.h>
+#include "mman.h"
+#else
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+#include <algorithm>
+#include "columnar_peptides.h"
+#include "io/carp.h"
+
+static const size_t COPY_BUFFER_SIZE = 1 << 20;
+
+static uint64_t Align8(uint64_t offset) {
+  return (offset + 7) & ~(uint64_t)7;
+}
+
+ColumnarPeptideWriter::ColumnarPeptideWriter(const string& filename,
+                                             const pb::Header& header)
+  : filename_(filename), header_(header),
+    section_filenames_(ColumnarPeptides::NUM_SECTIONS),
+    sections_(ColumnarPeptides::NUM_SECTIONS, (FILE*)NULL),
+    section_sizes_(ColumnarPeptides::NUM_SECTIONS, 0),
+    num_peptides_(0), num_mods_(0), ok_(true), closed_(false) {
+  for (int i = 0; i < ColumnarPeptides::NUM_SECTIONS; ++i) {
+    char suffix[32];
+    sprintf(suffix, ".section%d.tmp", i);
+    section_filenames_[i] = filename + suffix;
+    if ((sections_[i] = fopen(section_filenames_[i].c_str(), "wb")) == NULL) {
+      carp(CARP_FATAL, "Couldn't open file %s for write (errno %d: %s).",
+           section_filenames_[i].c_str(), errno, strerror(errno));
+      ok_ = false;
+      return;
+    }
+  }
+  uint64_t first_mod_offset = 0;
+  ok_ = WriteSection(ColumnarPeptides::MOD_OFFSETS, &first_mod_offset,
+                     sizeof(first_mod_offset));
+}
+
+ColumnarPeptideWriter::~ColumnarPeptideWriter() {
+  Close();
+}
+
+bool ColumnarPeptideWriter::WriteSection(int section, const void* data,
+                                         size_t size) {
+  if (size > 0 && fwrite(data, size, 1, sections_[section]) != 1) {
+    return false;
+  }
+  section_sizes_[section] += size;
+  return true;
+}
+
+bool ColumnarPeptideWriter::Write(const pb::Peptide& peptide) {
+  if (!ok_ || closed_) {
+    return false;
+  }
+  double mass = peptide.mass();
+  int64_t id = peptide.id();
+  int32_t protein_id = peptide.first_location().protein_id();
+  int32_t pos = peptide.first_location().pos();
+  int32_t length = peptide.length();
+  int32_t aux_loc = peptide.has_aux_locations_index() ?
+    peptide.aux_locations_index() : -1;
+  uint8_t decoy = peptide.has_is_decoy() ? (peptide.is_decoy() ? 1 : 0) : 2;
+  num_mods_ += peptide.modifications_size();
+
+  ok_ = WriteSection(ColumnarPeptides::MASS, &mass, sizeof(mass))
+    && WriteSection(ColumnarPeptides::ID, &id, sizeof(id))
+    && WriteSection(ColumnarPeptides::PROTEIN_ID, &protein_id,
+                    sizeof(protein_id))
+    && WriteSection(ColumnarPeptides::POS, &pos, sizeof(pos))
+    && WriteSection(ColumnarPeptides::LENGTH, &length, sizeof(length))
+    && WriteSection(ColumnarPeptides::AUX_LOC, &aux_loc, sizeof(aux_loc))
+    && WriteSection(ColumnarPeptides::DECOY, &decoy, sizeof(decoy))
+    && WriteSection(ColumnarPeptides::MOD_OFFSETS, &num_mods_,
+                    sizeof(num_mods_));
+  for (int i = 0; ok_ && i < peptide.modifications_size(); ++i) {
+    int32_t mod = peptide.modifications(i);
+    ok_ = WriteSection(ColumnarPeptides::MODS, &mod, sizeof(mod));
+  }
+  ++num_peptides_;
+  return ok_;
+}
+
+bool ColumnarPeptideWriter::Close() {
+  if (closed_) {
+    return ok_;
+  }
+  closed_ = true;
+  for (int i = 0; i < ColumnarPeptides::NUM_SECTIONS; ++i) {
+    if (sections_[i] != NULL && fclose(sections_[i]) != 0) {
+      ok_ = false;
+    }
+    sections_[i] = NULL;
+  }
+
+  FILE* out = NULL;
+  if (ok_ && (out = fopen(filename_.c_str(), "wb")) == NULL) {
+    carp(CARP_FATAL, "Couldn't open file %s for write (errno %d: %s).",
+         filename_.c_str(), errno, strerror(errno));
+    ok_ = false;
+  }
+
+  if (ok_) {
+    string header_bytes;
+    header_.SerializeToString(&header_bytes);
+    uint32_t magic = COLUMNAR_MAGIC_NUMBER;
+    uint32_t version = COLUMNAR_VERSION;
+    uint64_t header_size = header_bytes.size();
+    uint64_t offsets[ColumnarPeptides::NUM_SECTIONS];
+    uint64_t offset = Align8(ColumnarPeptides::PreambleSize() + header_size);
+    for (int i = 0; i < ColumnarPeptides::NUM_SECTIONS; ++i) {
+      offsets[i] = offset;
+      offset = Align8(offset + section_sizes_[i]);
+    }
+    ok_ = fwrite(&magic, sizeof(magic), 1, out) == 1
+      && fwrite(&version, sizeof(version), 1, out) == 1
+      && fwrite(&num_peptides_, sizeof(num_peptides_), 1, out) == 1
+      && fwrite(&header_size, sizeof(header_size), 1, out) == 1
+      && fwrite(offsets, sizeof(offsets), 1, out) == 1
+      && (header_size == 0 ||
+          fwrite(header_bytes.data(), header_size, 1, out) == 1);
+
+    vector<char> buffer(COPY_BUFFER_SIZE);
+    const char zeros[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    uint64_t position = ColumnarPeptides::PreambleSize() + header_size;
+    for (int i = 0; ok_ && i < ColumnarPeptides::NUM_SECTIONS; ++i) {
+      size_t pad = offsets[i] - position;
+      if (pad > 0 && fwrite(zeros, pad, 1, out) != 1) {
+        ok_ = false;
+        break;
+      }
+      FILE* in = fopen(section_filenames_[i].c_str(), "rb");
+      if (in == NULL) {
+        ok_ = false;
+        break;
+      }
+      size_t n;
+      while ((n = fread(&buffer[0], 1, buffer.size(), in)) > 0) {
+        if (fwrite(&buffer[0], n, 1, out) != 1) {
+          ok_ = false;
+          break;
+        }
+      }
+      fclose(in);
+      position = offsets[i] + section_sizes_[i];
+    }
+    if (fclose(out) != 0) {
+      ok_ = false;
+    }
+  }
+
+  for (int i = 0; i < ColumnarPeptides::NUM_SECTIONS; ++i) {
+    remove(section_filenames_[i].c_str());
+  }
+  if (!ok_) {
+    carp(CARP_FATAL, "Error writing peptides to %s.", filename_.c_str());
+  }
+  return ok_;
+}
+
+ColumnarPeptideReader::ColumnarPeptideReader(const string& filename,
+                                             pb::Header* header)
+  : filename_(filename), base_(NULL), size_(0), num_peptides_(0),
+    num_mods_(0), next_(0) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < ColumnarPeptides::PreambleSize()) {
+    close(fd);
+    return;
+  }
+  size_ = st.st_size;
+  void* base = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    return;
+  }
+  base_ = (const char*)base;
+
+  const char* p = base_;
+  uint32_t magic, version;
+  uint64_t header_size;
+  memcpy(&magic, p, sizeof(magic));
+  p += sizeof(magic);
+  memcpy(&version, p, sizeof(version));
+  p += sizeof(version);
+  memcpy(&num_peptides_, p, sizeof(num_peptides_));
+  p += sizeof(num_peptides_);
+  memcpy(&header_size, p, sizeof(header_size));
+  p += sizeof(header_size);
+  memcpy(offsets_, p, sizeof(offsets_));
+  p += sizeof(offsets_);
+
+  // Every section must lie between its own offset and the next one (or the
+  // end of the file), so that Read never goes past the mapping.
+  bool valid = magic == COLUMNAR_MAGIC_NUMBER && version == COLUMNAR_VERSION
+    && header_size <= size_ - ColumnarPeptides::PreambleSize()
+    && offsets_[0] >= ColumnarPeptides::PreambleSize() + header_size;
+  for (int i = 0; valid && i < ColumnarPeptides::NUM_SECTIONS; ++i) {
+    uint64_t end = i + 1 < ColumnarPeptides::NUM_SECTIONS ?
+      offsets_[i + 1] : size_;
+    valid = offsets_[i] % 8 == 0 && offsets_[i] <= end && end <= size_;
+  }
+  // MOD_OFFSETS holds num_peptides_ + 1 entries.
+  valid = valid
+    && SectionFits(ColumnarPeptides::MASS, sizeof(double))
+    && SectionFits(ColumnarPeptides::ID, sizeof(int64_t))
+    && SectionFits(ColumnarPeptides::PROTEIN_ID, sizeof(int32_t))
+    && SectionFits(ColumnarPeptides::POS, sizeof(int32_t))
+    && SectionFits(ColumnarPeptides::LENGTH, sizeof(int32_t))
+    && SectionFits(ColumnarPeptides::AUX_LOC, sizeof(int32_t))
+    && SectionFits(ColumnarPeptides::DECOY, sizeof(uint8_t))
+    && num_peptides_ < SectionCapacity(ColumnarPeptides::MOD_OFFSETS,
+                                       sizeof(uint64_t));
+  // Only the ends of MOD_OFFSETS are checked here, since the file is opened
+  // several times per search; Read() checks each peptide's own range.
+  if (valid) {
+    mod_offsets_ = Section<uint64_t>(ColumnarPeptides::MOD_OFFSETS);
+    num_mods_ = SectionCapacity(ColumnarPeptides::MODS, sizeof(int32_t));
+    valid = mod_offsets_[0] == 0 && mod_offsets_[num_peptides_] <= num_mods_;
+  }
+  if (valid && header != NULL) {
+    valid = header->ParseFromArray(p, header_size);
+  }
+  if (!valid) {
+    munmap((void*)base_, size_);
+    base_ = NULL;
+    return;
+  }
+
+  mass_ = Section<double>(ColumnarPeptides::MASS);
+  id_ = Section<int64_t>(ColumnarPeptides::ID);
+  protein_id_ = Section<int32_t>(ColumnarPeptides::PROTEIN_ID);
+  pos_ = Section<int32_t>(ColumnarPeptides::POS);
+  length_ = Section<int32_t>(ColumnarPeptides::LENGTH);
+  aux_loc_ = Section<int32_t>(ColumnarPeptides::AUX_LOC);
+  decoy_ = Section<uint8_t>(ColumnarPeptides::DECOY);
+  mods_ = Section<int32_t>(ColumnarPeptides::MODS);
+}
+
+uint64_t ColumnarPeptideReader::SectionCapacity(int section,
+                                                size_t width) const {
+  uint64_t end = section + 1 < ColumnarPeptides::NUM_SECTIONS ?
+    offsets_[section + 1] : size_;
+  return (end - offsets_[section]) / width;
+}
+
+bool ColumnarPeptideReader::SectionFits(int section, size_t width) const {
+  return num_peptides_ <= SectionCapacity(section, width);
+}
+
+ColumnarPeptideReader::~ColumnarPeptideReader() {
+  if (base_ != NULL) {
+    munmap((void*)base_, size_);
+  }
+}
+
+bool ColumnarPeptideReader::Read(pb::Peptide* peptide) {
+  if (Done()) {
+    return false;
+  }
+  uint64_t i = next_++;
+  uint64_t mods_begin = mod_offsets_[i], mods_end = mod_offsets_[i + 1];
+  if (mods_begin > mods_end || mods_end > num_mods_) {
+    carp(CARP_FATAL, "Invalid modifications for peptide %llu in %s.",
+         (unsigned long long)i, filename_.c_str());
+  }
+  peptide->Clear();
+  peptide->set_id(id_[i]);
+  peptide->set_mass(mass_[i]);
+  peptide->set_length(length_[i]);
+  pb::Location* location = peptide->mutable_first_location();
+  location->set_protein_id(protein_id_[i]);
+  location->set_pos(pos_[i]);
+  for (uint64_t j = mods_begin; j < mods_end; ++j) {
+    peptide->add_modifications(mods_[j]);
+  }
+  if (aux_loc_[i] >= 0) {
+    peptide->set_aux_locations_index(aux_loc_[i]);
+  }
+  if (decoy_[i] != 2) {
+    peptide->set_is_decoy(decoy_[i] == 1);
+  }
+  return true;
+}
+
+void ColumnarPeptideReader::SkipTo(double min_mass) {
+  if (Done() || mass_[next_] >= min_mass) {
+    return;
+  }
+  next_ = lower_bound(mass_ + next_, mass_ + num_peptides_, min_mass) - mass_;
+}
@@ -0,0 +1,142 @@
+// Columnar peptide index format.
+//
+// The original pepix file is a stream of protocol buffer records, which must
+// be parsed one by one even when most of the peptides are lighter than any
+// spectrum being searched. The columnar format instead stores each field of
+// the peptides as a fixed-width array, so that the file can be memory-mapped
+// and the first peptide of a given mass found by binary search of the mass
+// array. Peptide records are then built only for peptides that are read.
+//
+// Layout (all integers little-endian, every section aligned to 8 bytes):
+//
+//   uint32  COLUMNAR_MAGIC_NUMBER
+//   uint32  COLUMNAR_VERSION
+//   uint64  number of peptides, N
+//   uint64  size of the serialized pb::Header, H
+//   uint64  offset of each of the NUM_SECTIONS sections, from file start
+//   H bytes pb::Header, as in the records format
+//   sections:
+//     MASS         double[N]
+//     ID           int64[N]
+//     PROTEIN_ID   int32[N]
+//     POS          int32[N]   position of the peptide in that protein
+//     LENGTH       int32[N]
+//     AUX_LOC      int32[N]   aux_locations_index, or -1 if there is none
+//     DECOY        uint8[N]   is_decoy: 0, 1, or 2 if not set
+//     MOD_OFFSETS  uint64[N+1]  peptide i owns MODS[MOD_OFFSETS[i]..[i+1])
+//     MODS         int32[]
+//
+// Peaks are not stored: the records format never carries them either, and
+// tide-search computes them as peptides enter the active queue.
+
+#ifndef COLUMNAR_PEPTIDES_H
+#define COLUMNAR_PEPTIDES_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "header.pb.h"
+#include "peptides.pb.h"
+#include "peptide_reader.h"
+
+using namespace std;
+
+#define COLUMNAR_MAGIC_NUMBER  0xfead1235ul
+#define COLUMNAR_VERSION       1
+
+class ColumnarPeptides {
+ public:
+  enum Section {
+    MASS,
+    ID,
+    PROTEIN_ID,
+    POS,
+    LENGTH,
+    AUX_LOC,
+    DECOY,
+    MOD_OFFSETS,
+    MODS,
+    NUM_SECTIONS
+  };
+
+  static size_t PreambleSize() {
+    return 2 * sizeof(uint32_t) + (2 + NUM_SECTIONS) * sizeof(uint64_t);
+  }
+};
+
+// Writes peptides, which must arrive in order of non-decreasing mass, into a
+// columnar file. Each section is spooled into its own temporary file beside
+// the output, so memory use does not grow with the number of peptides; Close()
+// concatenates them.
+class ColumnarPeptideWriter {
+ public:
+  ColumnarPeptideWriter(const string& filename, const pb::Header& header);
+  ~ColumnarPeptideWriter();
+
+  // client should check once after construction
+  bool OK() const { return ok_; }
+
+  bool Write(const pb::Peptide& peptide);
+
+  // Assemble the output file and remove the temporary files. Called by the
+  // destructor if the client does not.
+  bool Close();
+
+ private:
+  bool WriteSection(int section, const void* data, size_t size);
+
+  string filename_;
+  pb::Header header_;
+  vector<string> section_filenames_;
+  vector<FILE*> sections_;
+  vector<uint64_t> section_sizes_;
+  uint64_t num_peptides_;
+  uint64_t num_mods_;
+  bool ok_;
+  bool closed_;
+};
+
+// Memory-maps a columnar file.
+class ColumnarPeptideReader : public PeptideReader {
+ public:
+  ColumnarPeptideReader(const string& filename, pb::Header* header);
+  ~ColumnarPeptideReader();
+
+  bool OK() const { return base_ != NULL; }
+  bool Done() { return next_ >= num_peptides_; }
+  bool Read(pb::Peptide* peptide);
+  void SkipTo(double min_mass);
+
+ private:
+  template<class T> const T* Section(int section) const {
+    return (const T*)(base_ + offsets_[section]);
+  }
+
+  // Number of values of the given width that fit between the start of the
+  // section and the start of the next one, or the end of the file. Only
+  // valid once the offsets are known to be in order and within the file.
+  uint64_t SectionCapacity(int section, size_t width) const;
+  // Whether the section has room for one value per peptide.
+  bool SectionFits(int section, size_t width) const;
+
+  string filename_;
+  const char* base_;
+  size_t size_;
+  uint64_t num_peptides_;
+  uint64_t num_mods_;
+  uint64_t offsets_[ColumnarPeptides::NUM_SECTIONS];
+  uint64_t next_;
+
+  const double* mass_;
+  const int64_t* id_;
+  const int32_t* protein_id_;
+  const int32_t* pos_;
+  const int32_t* length_;
+  const int32_t* aux_loc_;
+  const uint8_t* decoy_;
+  const uint64_t* mod_offsets_;
+  const int32_t* mods_;
+};
+
+#endif // COLUMNAR_PEPTIDES_H
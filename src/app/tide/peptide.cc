@@ -10,6 +10,7 @@
 #include "theoretical_peak_set.h"
 #include "peptide.h"
 #include "compiler.h"
+#include "telemetry.h"
 
 #ifdef DEBUG
 DEFINE_int32(debug_peptide_id, -1, "Peptide id to debug.");
@@ -205,6 +206,7 @@ void Peptide::Compile(const TheoreticalPeakArr* peaks,
 }
 
 void Peptide::ComputeTheoreticalPeaks(TheoreticalPeakSet* workspace) const {
+  Telemetry::Scope scope(Telemetry::PEAK_COMPUTE);
   AddIons<TheoreticalPeakSet>(workspace);   // Generic workspace
 #ifdef DEBUG
   Show();
@@ -212,6 +214,7 @@ void Peptide::ComputeTheoreticalPeaks(TheoreticalPeakSet* workspace) const {
 }
 
 void Peptide::ComputeBTheoreticalPeaks(TheoreticalPeakSetBIons* workspace) const {
+  Telemetry::Scope scope(Telemetry::PEAK_COMPUTE);
   AddBIonsOnly<TheoreticalPeakSetBIons>(workspace);   // workspace for b ion only peak set
 #ifdef DEBUG
   Show();
@@ -223,7 +226,10 @@ void Peptide::ComputeTheoreticalPeaks(ST_TheoreticalPeakSet* workspace,
                                       TheoreticalPeakCompiler* compiler_prog1,
                                       TheoreticalPeakCompiler* compiler_prog2) {
   // Search-time fast workspace
-  AddIons<ST_TheoreticalPeakSet>(workspace);
+  {
+    Telemetry::Scope scope(Telemetry::PEAK_COMPUTE);
+    AddIons<ST_TheoreticalPeakSet>(workspace);
+  }
 
 #if 0
   TheoreticalPeakArr peaks[2];
@@ -233,7 +239,10 @@ void Peptide::ComputeTheoreticalPeaks(ST_TheoreticalPeakSet* workspace,
   Compile(peaks, pb_peptide, compiler_prog1, compiler_prog2);
 #endif
 
-  Compile(workspace->GetPeaks(), pb_peptide, compiler_prog1, compiler_prog2);
+  {
+    Telemetry::Scope scope(Telemetry::PROGRAM_COMPILE);
+    Compile(workspace->GetPeaks(), pb_peptide, compiler_prog1, compiler_prog2);
+  }
 #ifdef DEBUG
   if (Id() == FLAGS_debug_peptide_id) {
     cout << "Prog1:" << endl;
@@ -244,6 +253,31 @@ void Peptide::ComputeTheoreticalPeaks(ST_TheoreticalPeakSet* workspace,
 #endif
 }
 
+void Peptide::ComputeTheoreticalPeaks(ST_TheoreticalPeakSet* workspace,
+                                      FifoAllocator* fifo_alloc) {
+  Telemetry::Scope scope(Telemetry::PEAK_COMPUTE);
+  AddIons<ST_TheoreticalPeakSet>(workspace);
+
+  // As in TheoreticalPeakCompiler::AddPositive(), peaks past the end of the
+  // cache are dropped.
+  const TheoreticalPeakArr* peaks = workspace->GetPeaks();
+  int end = MaxBin::Global().CacheBinEnd() * NUM_PEAK_TYPES;
+  peaks_ = (int*) fifo_alloc->New(sizeof(int) * (peaks[0].size() + peaks[1].size()));
+  int n = 0;
+  for (int i = 0; i < peaks[0].size(); ++i) {
+    if (peaks[0][i].Code() < end) {
+      peaks_[n++] = peaks[0][i].Code();
+    }
+  }
+  num_peaks1_ = n;
+  for (int i = 0; i < peaks[1].size(); ++i) {
+    if (peaks[1][i].Code() < end) {
+      peaks_[n++] = peaks[1][i].Code();
+    }
+  }
+  num_peaks2_ = n;
+}
+
 // return the amino acid masses in the current peptide
 double* Peptide::getAAMasses(){
   double* masses_charge = new double[Len()];
@@ -18,7 +18,9 @@
 // product of its theoretical peaks with a given observed spectrum.
 // Specifically, ComputeTheoreticalPeaks() generates a compiled program for
 // doing so.  A different version of the generated program exists for charge 1
-// and  charge 2.
+// and  charge 2. When a score engine other than the compiled one is in use
+// (see score_engine.h), the theoretical peaks are instead kept as an array of
+// cache indices.
 
 #ifndef PEPTIDE_H
 #define PEPTIDE_H
@@ -76,7 +78,8 @@ class Peptide {
     has_aux_locations_index_(peptide.has_aux_locations_index()),
     aux_locations_index_(peptide.aux_locations_index()),
     mods_(NULL), num_mods_(0), decoy_(peptide.is_decoy()),
-    prog1_(NULL), prog2_(NULL) {
+    prog1_(NULL), prog2_(NULL),
+    peaks_(NULL), num_peaks1_(0), num_peaks2_(0) {
     // Set residues_ by pointing to the first occurrence in proteins.
     residues_ = proteins[first_loc_protein_id_]->residues().data() 
                     + first_loc_pos_;
@@ -176,6 +179,11 @@ class Peptide {
                                TheoreticalPeakCompiler* compiler_prog1,
                                TheoreticalPeakCompiler* compiler_prog2);
   void ComputeBTheoreticalPeaks(TheoreticalPeakSetBIons* workspace) const;
+  // Alternative to the second version above for engines that do not compile
+  // programs: the codes of the theoretical peaks are stored in an array
+  // allocated by fifo_alloc, which should be the allocator of the peptide.
+  void ComputeTheoreticalPeaks(ST_TheoreticalPeakSet* workspace,
+                               FifoAllocator* fifo_alloc);
 
   // Return the appropriate program depending on the precursor charge.
   // TODO 257: fix the unfortunate use of max_charge.
@@ -183,6 +191,14 @@ class Peptide {
     return max_charge <= 2 ? prog1_ : prog2_;
   }
 
+  // Set *codes to the cache indices of the theoretical peaks for the given
+  // precursor charge, as stored by ComputeTheoreticalPeaks(workspace,
+  // fifo_alloc), and return their number.
+  int Peaks(int max_charge, const int** codes) const {
+    *codes = peaks_;
+    return max_charge <= 2 ? num_peaks1_ : num_peaks2_;
+  }
+
   void ReleaseFifo(FifoAllocator* fifo_alloc_prog1,
        FifoAllocator* fifo_alloc_prog2) {
     // TODO 258: this code should probably move to ActivePeptideQueue
@@ -239,6 +255,11 @@ class Peptide {
 
   void* prog1_;
   void* prog2_;
+
+  // Codes of the charge 1 peaks, followed by those of the charge 2 peaks.
+  int* peaks_;
+  int num_peaks1_;
+  int num_peaks2_;
 };
 
 #endif // PEPTIDE_H
@@ -13,6 +13,9 @@
 // values are stored as varint. The peak locations then have to be restored
 // at search time.
 //
+// With columnar set, the output is written in the memory-mappable format of
+// columnar_peptides.h rather than as records.
+//
 // TODO 248: We're only doing this to guarantee the exact same results as Crux
 // used to return, but perhaps the diffs don't really add useful info, in which 
 // case we could eliminate them.
@@ -22,6 +25,7 @@
 #include <string>
 #include <vector>
 #include "records.h"
+#include "columnar_peptides.h"
 #include "peptide.h"
 #include "theoretical_peak_set.h"
 #include "abspath.h"
@@ -56,7 +60,8 @@ static void AddPeaksToPB(pb::Peptide* peptide, const TheoreticalPeakArr* peaks,
 
 void AddTheoreticalPeaks(const vector<const pb::Protein*>& proteins,
 			 const string& input_filename,
-			 const string& output_filename) {
+			 const string& output_filename,
+			 bool columnar) {
   pb::Header orig_header, new_header;
   HeadedRecordReader reader(input_filename, &orig_header);
   CHECK(orig_header.file_type() == pb::Header::PEPTIDES);
@@ -69,9 +74,16 @@ void AddTheoreticalPeaks(const vector<const pb::Protein*>& proteins,
   pb::Header_Source* source = new_header.add_source();
   source->mutable_header()->CopyFrom(orig_header);
   source->set_filename(AbsPath(input_filename));
-  HeadedRecordWriter writer(output_filename, new_header);
+  HeadedRecordWriter* writer = NULL;
+  ColumnarPeptideWriter* columnar_writer = NULL;
+  if (columnar) {
+    columnar_writer = new ColumnarPeptideWriter(output_filename, new_header);
+    CHECK(columnar_writer->OK());
+  } else {
+    writer = new HeadedRecordWriter(output_filename, new_header);
+    CHECK(writer->OK());
+  }
   CHECK(reader.OK());
-  CHECK(writer.OK());
 
   pb::Peptide pb_peptide;
 //  const int workspace_size = 2000; // More than sufficient for theor. peaks.
@@ -91,7 +103,16 @@ void AddTheoreticalPeaks(const vector<const pb::Protein*>& proteins,
     AddPeaksToPB(&pb_peptide, &peaks_charge_2, 2, false);
     AddPeaksToPB(&pb_peptide, &negs_charge_1, 1, true);
     AddPeaksToPB(&pb_peptide, &negs_charge_2, 2, true);
-*/    CHECK(writer.Write(&pb_peptide));
+*/    if (columnar_writer) {
+      CHECK(columnar_writer->Write(pb_peptide));
+    } else {
+      CHECK(writer->Write(&pb_peptide));
+    }
   }
   CHECK(reader.OK());
+  if (columnar_writer) {
+    CHECK(columnar_writer->Close());
+  }
+  delete columnar_writer;
+  delete writer;
 }
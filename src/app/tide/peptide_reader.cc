@@ -0,0 +1,34 @@
+// See peptide_reader.h for a description of this class.
+
+#include <stdio.h>
+#include <stdint.h>
+#include "peptide_reader.h"
+#include "columnar_peptides.h"
+
+PeptideReader* PeptideReader::Open(const string& filename, pb::Header* header) {
+  FILE* f = fopen(filename.c_str(), "rb");
+  if (f == NULL) {
+    return NULL;
+  }
+  unsigned char bytes[4];
+  bool have_magic = fread(bytes, sizeof(bytes), 1, f) == 1;
+  fclose(f);
+  if (!have_magic) {
+    return NULL;
+  }
+  // Both formats begin with a little-endian 32-bit magic number.
+  uint32_t magic = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) |
+    ((uint32_t)bytes[3] << 24);
+
+  PeptideReader* reader = NULL;
+  if (magic == COLUMNAR_MAGIC_NUMBER) {
+    reader = new ColumnarPeptideReader(filename, header);
+  } else if (magic == MAGIC_NUMBER) {
+    reader = new RecordPeptideReader(filename, header);
+  }
+  if (reader != NULL && !reader->OK()) {
+    delete reader;
+    reader = NULL;
+  }
+  return reader;
+}
@@ -0,0 +1,60 @@
+// A PeptideReader reads the peptides of a tide index (the pepix file) in
+// order of non-decreasing mass. Two on-disk formats exist:
+//
+//   records:  the original stream of varint-delimited pb::Peptide messages
+//             following a pb::Header (see records.h). Every peptide must be
+//             parsed in turn.
+//
+//   columnar: fixed-width arrays of masses, locations, etc., memory-mapped at
+//             search time (see columnar_peptides.h). The reader can jump
+//             straight to the first peptide of a given mass.
+//
+// PeptideReader::Open() detects the format of a file from its magic number,
+// so clients such as ActivePeptideQueue need not care which one they read.
+
+#ifndef PEPTIDE_READER_H
+#define PEPTIDE_READER_H
+
+#include <string>
+#include "header.pb.h"
+#include "peptides.pb.h"
+#include "records.h"
+
+using namespace std;
+
+class PeptideReader {
+ public:
+  virtual ~PeptideReader() {}
+
+  // Open a file of peptides in either format and fill in *header (if not
+  // NULL) with its header. Returns NULL if the file cannot be opened or is in
+  // neither format.
+  static PeptideReader* Open(const string& filename, pb::Header* header = NULL);
+
+  virtual bool OK() const = 0;
+  virtual bool Done() = 0;
+  virtual bool Read(pb::Peptide* peptide) = 0;
+
+  // Advance past peptides lighter than min_mass, so that the next call to
+  // Read() returns the first remaining peptide at least as heavy. Never moves
+  // backward. Readers that cannot seek may leave the skipping to the client,
+  // who must discard light peptides anyway.
+  virtual void SkipTo(double min_mass) {}
+};
+
+// Reader of the original records format.
+class RecordPeptideReader : public PeptideReader {
+ public:
+  RecordPeptideReader(const string& filename, pb::Header* header)
+    : reader_(filename, header) {
+  }
+
+  bool OK() const { return reader_.OK(); }
+  bool Done() { return reader_.Done(); }
+  bool Read(pb::Peptide* peptide) { return reader_.Read(peptide); }
+
+ private:
+  HeadedRecordReader reader_;
+};
+
+#endif // PEPTIDE_READER_H
@@ -0,0 +1,145 @@
+// See peptide_stream.h for a description of this class.
+
+#include <algorithm>
+#include <limits>
+#include <gflags/gflags.h>
+#include "peptide_stream.h"
+#include "compiler.h"
+#include "score_engine.h"
+#include "telemetry.h"
+
+DECLARE_int32(fifo_page_size);
+
+PeptideStream::PeptideStream(PeptideReader* reader,
+                             const vector<const pb::Protein*>& proteins,
+                             int num_consumers)
+  : reader_(reader),
+    done_(false),
+    proteins_(proteins),
+    theoretical_peak_set_(2000),   // probably overkill, but no harm
+    begin_seq_(0), end_seq_(0),
+    consumer_front_(num_consumers, 0),
+    consumer_min_range_(num_consumers, -numeric_limits<double>::infinity()),
+    consumer_detached_(num_consumers, false),
+    fifo_alloc_peptides_(FLAGS_fifo_page_size << 20),
+    fifo_alloc_prog1_(FLAGS_fifo_page_size << 20, ScoreEngine::Compiled()),
+    fifo_alloc_prog2_(FLAGS_fifo_page_size << 20, ScoreEngine::Compiled()) {
+  assert(reader_->OK());
+  compiler_prog1_ = new TheoreticalPeakCompiler(&fifo_alloc_prog1_);
+  compiler_prog2_ = new TheoreticalPeakCompiler(&fifo_alloc_prog2_);
+}
+
+PeptideStream::~PeptideStream() {
+  fifo_alloc_peptides_.ReleaseAll();
+  fifo_alloc_prog1_.ReleaseAll();
+  fifo_alloc_prog2_.ReleaseAll();
+
+  delete compiler_prog1_;
+  delete compiler_prog2_;
+}
+
+bool PeptideStream::DecodeNext() {
+  if (done_ || (done_ = reader_->Done())) {
+    return false;
+  }
+  Peptide* peptide;
+  {
+    Telemetry::Scope scope(Telemetry::PEPTIDE_DECODE);
+    reader_->Read(&current_pb_peptide_);
+    peptide = new(&fifo_alloc_peptides_)
+      Peptide(current_pb_peptide_, proteins_, &fifo_alloc_peptides_);
+  }
+  Telemetry::Count(Telemetry::PEPTIDES, 1);
+  // Unlike ActivePeptideQueue, which defers the work for the one peptide it
+  // reads beyond max_range, we compute the peaks of every peptide right away:
+  // the next consumer to come along may well need them.
+  theoretical_peak_set_.Clear();
+  if (ScoreEngine::Compiled()) {
+    peptide->ComputeTheoreticalPeaks(&theoretical_peak_set_, current_pb_peptide_,
+                                     compiler_prog1_, compiler_prog2_);
+  } else {
+    peptide->ComputeTheoreticalPeaks(&theoretical_peak_set_, &fifo_alloc_peptides_);
+  }
+  peptides_.push_back(peptide);
+  ++end_seq_;
+  return true;
+}
+
+void PeptideStream::Advance(int consumer, double min_range, double max_range,
+                            deque<Peptide*>* queue, uint64_t* front_seq,
+                            uint64_t* next_seq) {
+  Telemetry::Lock(&mutex_);
+  boost::mutex::scoped_lock lock(mutex_, boost::adopt_lock);
+
+  // delete anything already held that falls below min_range
+  while (!queue->empty() && queue->front()->Mass() < min_range) {
+    queue->pop_front();
+    ++(*front_seq);
+  }
+
+  // No consumer's min_range ever decreases, so peptides that are lighter than
+  // every consumer's current one need not even be decoded.
+  consumer_min_range_[consumer] = min_range;
+  double min_needed = numeric_limits<double>::infinity();
+  for (size_t i = 0; i < consumer_min_range_.size(); ++i) {
+    if (!consumer_detached_[i]) {
+      min_needed = min(min_needed, consumer_min_range_[i]);
+    }
+  }
+  reader_->SkipTo(min_needed);
+
+  // Make sure all peptides up to the first one heavier than max_range
+  // have been decoded.
+  while ((peptides_.empty() || peptides_.back()->Mass() <= max_range) &&
+         DecodeNext()) {
+  }
+
+  // Hand the consumer what it hasn't seen yet, skipping peptides that fall
+  // below min_range, and stopping after the first one heavier than max_range.
+  assert(*next_seq >= begin_seq_);
+  while (*next_seq < end_seq_ &&
+         (queue->empty() || queue->back()->Mass() <= max_range)) {
+    Peptide* peptide = peptides_[*next_seq - begin_seq_];
+    ++(*next_seq);
+    if (queue->empty() && peptide->Mass() < min_range) {
+      *front_seq = *next_seq;
+      continue;
+    }
+    queue->push_back(peptide);
+  }
+
+  consumer_front_[consumer] = *front_seq;
+  ReleaseUnused();
+}
+
+void PeptideStream::Detach(int consumer) {
+  boost::mutex::scoped_lock lock(mutex_);
+  consumer_detached_[consumer] = true;
+  ReleaseUnused();
+}
+
+void PeptideStream::ReleaseUnused() {
+  uint64_t min_front = end_seq_;
+  for (size_t i = 0; i < consumer_front_.size(); ++i) {
+    if (!consumer_detached_[i]) {
+      min_front = min(min_front, consumer_front_[i]);
+    }
+  }
+  if (min_front <= begin_seq_) {
+    return;
+  }
+  while (begin_seq_ < min_front && !peptides_.empty()) {
+    peptides_.pop_front();
+    ++begin_seq_;
+  }
+  if (peptides_.empty()) {
+    fifo_alloc_peptides_.ReleaseAll();
+    fifo_alloc_prog1_.ReleaseAll();
+    fifo_alloc_prog2_.ReleaseAll();
+  } else {
+    Peptide* peptide = peptides_.front();
+    // Free all peptides up to, but not including peptide.
+    fifo_alloc_peptides_.Release(peptide);
+    peptide->ReleaseFifo(&fifo_alloc_prog1_, &fifo_alloc_prog2_);
+  }
+}
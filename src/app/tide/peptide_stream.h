@@ -0,0 +1,106 @@
+// A PeptideStream is a single reader over a file of peptides of
+// non-decreasing neutral mass that is shared by several ActivePeptideQueues,
+// one per search thread.
+//
+// Without it, every search thread opens its own PeptideReader on the pepix
+// file and each ActivePeptideQueue decodes every pb::Peptide, computes its
+// theoretical peaks and compiles its dot-product programs on its own. With N
+// threads all of that work is done N times over. A PeptideStream does it once:
+// peptides are decoded, their theoretical peaks computed and their programs
+// compiled by whichever consumer first needs them, and the resulting Peptide
+// objects are handed to every consumer.
+//
+// Each consumer (see ActivePeptideQueue::SetActiveRange()) keeps its own deque
+// of pointers into the stream. The stream tracks, for every consumer, the
+// sequence number of the lightest peptide that consumer still holds. Memory
+// for peptides and programs is released only once every consumer has moved
+// past it, so the stream behaves as a reference-counted ring over the
+// FifoAllocators that back the peptides.
+//
+// All calls into the stream are serialized by an internal mutex. The compiled
+// programs are never modified once written, so consumers may execute them
+// concurrently without holding the lock.
+
+#ifndef PEPTIDE_STREAM_H
+#define PEPTIDE_STREAM_H
+
+#include <stdint.h>
+#include <deque>
+#include <vector>
+#include <boost/thread.hpp>
+#include "peptides.pb.h"
+#include "peptide_reader.h"
+#include "peptide.h"
+#include "fifo_alloc.h"
+#include "theoretical_peak_set.h"
+
+class TheoreticalPeakCompiler;
+
+class PeptideStream {
+ public:
+  PeptideStream(PeptideReader* reader,
+                const vector<const pb::Protein*>& proteins,
+                int num_consumers);
+
+  ~PeptideStream();
+
+  // Called by ActivePeptideQueue::SetActiveRange() on behalf of the given
+  // consumer. Drops peptides lighter than min_range from the front of queue,
+  // makes sure that every peptide up to (and including) the first one heavier
+  // than max_range has been decoded, and appends the ones not yet in queue to
+  // its back. *front_seq and *next_seq give the stream sequence numbers of
+  // queue.front() and of the peptide just past queue.back(); they are updated
+  // accordingly. Storage no longer held by any consumer is then released.
+  void Advance(int consumer, double min_range, double max_range,
+               deque<Peptide*>* queue, uint64_t* front_seq,
+               uint64_t* next_seq);
+
+  // Called once a consumer will make no further calls to Advance(), so that
+  // it no longer holds back the release of storage.
+  void Detach(int consumer);
+
+  // Number of peptides decoded so far.
+  uint64_t NumDecoded() const { return end_seq_; }
+
+ private:
+  // Read the next peptide from disk and compute its theoretical peaks and
+  // programs. Returns false at end of file.
+  bool DecodeNext();
+
+  // Release all peptides that are no longer held by any consumer.
+  void ReleaseUnused();
+
+  PeptideReader* reader_;
+  pb::Peptide current_pb_peptide_;
+  bool done_;
+
+  // All amino acid sequences from which the peptides are drawn.
+  const vector<const pb::Protein*>& proteins_;
+
+  // Workspace for computing theoretical peaks for a single peptide.
+  ST_TheoreticalPeakSet theoretical_peak_set_;
+
+  // Decoded peptides still held by at least one consumer. The peptide at
+  // peptides_[i] has sequence number begin_seq_ + i.
+  deque<Peptide*> peptides_;
+  uint64_t begin_seq_;
+  uint64_t end_seq_;
+
+  // Sequence number of the lightest peptide held by each consumer.
+  vector<uint64_t> consumer_front_;
+  // min_range of the latest call to Advance() by each consumer. Peptides
+  // lighter than all of these will never be needed.
+  vector<double> consumer_min_range_;
+  vector<bool> consumer_detached_;
+
+  // See ActivePeptideQueue for a description of these members.
+  FifoAllocator fifo_alloc_peptides_;
+  FifoAllocator fifo_alloc_prog1_;
+  FifoAllocator fifo_alloc_prog2_;
+  TheoreticalPeakCompiler* compiler_prog1_;
+  TheoreticalPeakCompiler* compiler_prog2_;
+
+  boost::mutex mutex_;
+};
+
+#endif // PEPTIDE_STREAM_H
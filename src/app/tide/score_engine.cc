@@ -0,0 +1,102 @@
+// See score_engine.h for a description of this class.
+//
+// The vectorized kernels are compiled with per-function target attributes so
+// that the rest of the program need not be built for AVX2 or AVX-512; which
+// kernel to call is decided by querying the CPU at run time.
+
+#include "score_engine.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define SCORE_ENGINE_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+static int DotProdScalar(const int* cache, const int* codes, int num_codes) {
+  int total = 0;
+  for (int i = 0; i < num_codes; ++i) {
+    total += cache[codes[i]];
+  }
+  return total;
+}
+
+#ifdef SCORE_ENGINE_X86_DISPATCH
+__attribute__((target("avx2")))
+static int DotProdAvx2(const int* cache, const int* codes, int num_codes) {
+  __m256i sum = _mm256_setzero_si256();
+  int i = 0;
+  for (; i + 8 <= num_codes; i += 8) {
+    __m256i index = _mm256_loadu_si256((const __m256i*) (codes + i));
+    sum = _mm256_add_epi32(sum, _mm256_i32gather_epi32(cache, index, 4));
+  }
+  __m128i sum4 = _mm_add_epi32(_mm256_castsi256_si128(sum),
+                               _mm256_extracti128_si256(sum, 1));
+  sum4 = _mm_add_epi32(sum4, _mm_shuffle_epi32(sum4, _MM_SHUFFLE(1, 0, 3, 2)));
+  sum4 = _mm_add_epi32(sum4, _mm_shuffle_epi32(sum4, _MM_SHUFFLE(2, 3, 0, 1)));
+  int total = _mm_cvtsi128_si32(sum4);
+  for (; i < num_codes; ++i) {
+    total += cache[codes[i]];
+  }
+  return total;
+}
+
+__attribute__((target("avx512f")))
+static int DotProdAvx512(const int* cache, const int* codes, int num_codes) {
+  __m512i sum = _mm512_setzero_si512();
+  int i = 0;
+  for (; i + 16 <= num_codes; i += 16) {
+    __m512i index = _mm512_loadu_si512((const void*) (codes + i));
+    sum = _mm512_add_epi32(sum, _mm512_i32gather_epi32(index, cache, 4));
+  }
+  if (i < num_codes) {
+    // Gather the remaining entries under a mask rather than one at a time.
+    __mmask16 mask = (__mmask16) ((1u << (num_codes - i)) - 1);
+    __m512i index = _mm512_maskz_loadu_epi32(mask, codes + i);
+    sum = _mm512_add_epi32(sum, _mm512_mask_i32gather_epi32(
+      _mm512_setzero_si512(), mask, index, cache, 4));
+  }
+  return _mm512_reduce_add_epi32(sum);
+}
+#endif // SCORE_ENGINE_X86_DISPATCH
+
+ScoreEngine::Type ScoreEngine::type_ = ScoreEngine::JIT;
+ScoreEngine::DotProdFunction ScoreEngine::dot_prod_ = DotProdScalar;
+const char* ScoreEngine::kernel_ = "";
+
+bool ScoreEngine::Select(const string& name) {
+  dot_prod_ = DotProdScalar;
+  kernel_ = "";
+  if (name == "jit") {
+    type_ = JIT;
+  } else if (name == "scalar") {
+    type_ = SCALAR;
+  } else if (name == "simd") {
+    type_ = SIMD;
+    kernel_ = "scalar";
+#ifdef SCORE_ENGINE_X86_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+      dot_prod_ = DotProdAvx512;
+      kernel_ = "avx512";
+    } else if (__builtin_cpu_supports("avx2")) {
+      dot_prod_ = DotProdAvx2;
+      kernel_ = "avx2";
+    }
+#endif
+  } else {
+    return false;
+  }
+  return true;
+}
+
+string ScoreEngine::Description() {
+  switch (type_) {
+  case JIT:
+    return "jit";
+  case SCALAR:
+    return "scalar";
+  case SIMD:
+  default:
+    return string("simd (") + kernel_ + ")";
+  }
+}
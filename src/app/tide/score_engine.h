@@ -0,0 +1,62 @@
+// ScoreEngine selects how tide-search takes the dot product between a
+// candidate peptide's theoretical peaks and the cache of an observed spectrum
+// (see spectrum_preprocess.h).
+//
+// jit:    The default. Each peptide's peaks are compiled into x86 machine code
+//         (see compiler.h), and the programs for all candidates are run one
+//         after another. Requires executable memory.
+//
+// simd:   Each peptide keeps its peaks as an array of int32 cache indices
+//         (the codes of its TheoreticalPeakArr). The cache entries are
+//         fetched with AVX-512 or AVX2 gather instructions and summed in
+//         vector registers. The widest instruction set supported by the CPU
+//         is chosen at run time; without AVX2 the scalar kernel is used.
+//
+// scalar: As simd, but the dot product is a plain loop. Portable.
+//
+// All engines produce identical scores. Select() is called once, before any
+// peptides are read, and the choice is global.
+
+#ifndef SCORE_ENGINE_H
+#define SCORE_ENGINE_H
+
+#include <string>
+
+using namespace std;
+
+class ScoreEngine {
+ public:
+  enum Type {
+    JIT,
+    SIMD,
+    SCALAR
+  };
+
+  // Select the engine by name ("jit", "simd" or "scalar"). Returns false if
+  // the name is not recognized.
+  static bool Select(const string& name);
+
+  static Type Selected() { return type_; }
+
+  // True if peptides should be compiled to programs rather than keep their
+  // peaks as arrays of cache indices.
+  static bool Compiled() { return type_ == JIT; }
+
+  // Name of the engine and kernel in use, for logging, e.g. "simd (avx2)".
+  static string Description();
+
+  // Return the sum of cache[codes[i]] for 0 <= i < num_codes.
+  static int DotProd(const int* cache, const int* codes, int num_codes) {
+    return dot_prod_(cache, codes, num_codes);
+  }
+
+ private:
+  typedef int (*DotProdFunction)(const int* cache, const int* codes,
+                                 int num_codes);
+
+  static Type type_;
+  static DotProdFunction dot_prod_;
+  static const char* kernel_;
+};
+
+#endif // SCORE_ENGINE_H
@@ -0,0 +1,20 @@
+// See search_config.h for a description of this class.
+
+#include "search_config.h"
+#include "util/Params.h"
+
+SearchConfig::SearchConfig()
+  : skip_preprocessing(Params::GetBool("skip-preprocessing")),
+    remove_precursor_peak(Params::GetBool("remove-precursor-peak")),
+    remove_precursor_tolerance(Params::GetDouble("remove-precursor-tolerance")),
+    deisotope(Params::GetDouble("deisotope")),
+    use_flanking_peaks(Params::GetBool("use-flanking-peaks")),
+    use_neutral_loss_peaks(Params::GetBool("use-neutral-loss-peaks")),
+    fragment_tolerance(Params::GetDouble("fragment-tolerance")),
+    evidence_granularity(Params::GetInt("evidence-granularity")),
+    concat(Params::GetBool("concat")),
+    file_column(Params::GetBool("file-column")),
+    exact_p_value(Params::GetBool("exact-p-value")),
+    precision(Params::GetInt("precision")),
+    mass_precision(Params::GetInt("mass-precision")) {
+}
@@ -0,0 +1,36 @@
+// SearchConfig holds the parameters that tide-search consults for every
+// spectrum or every match, looked up once from Params when the search starts
+// rather than by name in the inner loops. It is immutable, and the search
+// passes it by reference to the code that preprocesses spectra and reports
+// matches.
+//
+// Parameters that are only read once per run are still read from Params
+// where they are used.
+
+#ifndef SEARCH_CONFIG_H
+#define SEARCH_CONFIG_H
+
+class SearchConfig {
+ public:
+  // The current values of the parameters in Params.
+  SearchConfig();
+
+  // Spectrum preprocessing and evidence vectors
+  const bool skip_preprocessing;
+  const bool remove_precursor_peak;
+  const double remove_precursor_tolerance;
+  const double deisotope;
+  const bool use_flanking_peaks;
+  const bool use_neutral_loss_peaks;
+  const double fragment_tolerance;
+  const int evidence_granularity;
+
+  // Reporting
+  const bool concat;
+  const bool file_column;
+  const bool exact_p_value;
+  const int precision;
+  const int mass_precision;
+};
+
+#endif // SEARCH_CONFIG_H
@@ -13,8 +13,9 @@
 #include "max_mz.h"
 #include "records.h"
 #include "records_to_vector-inl.h"
+#include "search_config.h"
+#include "telemetry.h"
 #include "util/mass.h"
-#include "util/Params.h"
 
 using namespace std;
 using google::protobuf::uint64;
@@ -177,6 +178,7 @@ vector<double> Spectrum::CreateEvidenceVector(
   int charge,
   double pepMassMonoMean,
   int maxPrecurMass,
+  const SearchConfig& config,
   long int* num_range_skipped,
   long int* num_precursors_skipped,
   long int* num_isotopes_skipped,
@@ -196,10 +198,10 @@ vector<double> Spectrum::CreateEvidenceVector(
   double maxIonIntens = 0.0;
 
   // Find max ion mass and max ion intensity
-  bool skipPreprocess = Params::GetBool("skip-preprocessing");
-  bool remove_precursor = !skipPreprocess && Params::GetBool("remove-precursor-peak");
-  double precursorMZExclude = Params::GetDouble("remove-precursor-tolerance");
-  double deisotope_threshold = Params::GetDouble("deisotope");
+  bool skipPreprocess = config.skip_preprocessing;
+  bool remove_precursor = !skipPreprocess && config.remove_precursor_peak;
+  double precursorMZExclude = config.remove_precursor_tolerance;
+  double deisotope_threshold = config.deisotope;
   set<int> peakSkip;
   for (int ion = 0; ion < numPeaks; ion++) {
     double ionMass = M_Z(ion);
@@ -295,8 +297,8 @@ vector<double> Spectrum::CreateEvidenceVector(
     intensObs[i] -= multiplier * (partial_sums[right] - partial_sums[left]);
   }
 
-  bool flankingPeaks = Params::GetBool("use-flanking-peaks");
-  bool nlPeaks = Params::GetBool("use-neutral-loss-peaks");
+  bool flankingPeaks = config.use_flanking_peaks;
+  bool nlPeaks = config.use_neutral_loss_peaks;
   int binFirst = MassConstants::mass2bin(30);
   int binLast = MassConstants::mass2bin(pepMassMonoMean - 47);
   vector<double> evidence(maxPrecurMass, 0);
@@ -374,13 +376,15 @@ vector<int> Spectrum::CreateEvidenceVectorDiscretized(
   int charge,
   double pepMassMonoMean,
   int maxPrecurMass,
+  const SearchConfig& config,
   long int* num_range_skipped,
   long int* num_precursors_skipped,
   long int* num_isotopes_skipped,
   long int* num_retained
 ) const {
+  Telemetry::Scope scope(Telemetry::PREPROCESS);
   vector<double> evidence =
-    CreateEvidenceVector(binWidth, binOffset, charge, pepMassMonoMean, maxPrecurMass,
+    CreateEvidenceVector(binWidth, binOffset, charge, pepMassMonoMean, maxPrecurMass, config,
                          num_range_skipped, num_precursors_skipped, num_isotopes_skipped, num_retained);
   vector<int> discretized;
   discretized.reserve(evidence.size());
@@ -483,6 +487,13 @@ void SpectrumCollection::MakeSpecCharges() {
   }
 }
 
+void SpectrumCollection::AddSpecCharge(Spectrum* spectrum, int charge) {
+  spectra_.push_back(spectrum);
+  double neutral_mass = (spectrum->PrecursorMZ() - MASS_PROTON) * charge;
+  spec_charges_.push_back(SpecCharge(neutral_mass, charge, spectrum,
+                                     spectra_.size() - 1));
+}
+
 double SpectrumCollection::FindHighestMZ() const {
   // Return the maximum MZ seen across all input spectra.
   double highest = 0;
@@ -27,6 +27,8 @@
 
 using namespace std;
 
+class SearchConfig;
+
 // Number of m/z regions in XCorr normalization.
 #define NUM_SPECTRUM_REGIONS 10
 
@@ -73,6 +75,7 @@ class Spectrum {
     int charge,
     double pepMassMonoMean,
     int maxPrecurMass,
+    const SearchConfig& config,
     long int* num_range_skipped = NULL,
     long int* num_precursors_skipped = NULL,
     long int* num_isotopes_skipped = NULL,
@@ -83,6 +86,7 @@ class Spectrum {
     int charge,
     double pepMassMonoMean,
     int maxPrecurMass,
+    const SearchConfig& config,
     long int* num_range_skipped = NULL,
     long int* num_precursors_skipped = NULL,
     long int* num_isotopes_skipped = NULL,
@@ -121,6 +125,11 @@ class SpectrumCollection {
 
   double FindHighestMZ() const;
 
+  // Add a spectrum, which the collection then owns, to be searched at a
+  // single charge state. Clients that add spectrum-charge pairs already in
+  // order (see spectrum_sorter.h) do not call Sort().
+  void AddSpecCharge(Spectrum* spectrum, int charge);
+
   struct SpecCharge {
     double neutral_mass;
     int charge;
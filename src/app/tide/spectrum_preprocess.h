@@ -112,6 +112,7 @@
 
 using namespace std;
 
+class SearchConfig;
 class Spectrum;
 
 class ObservedPeakSet {
@@ -139,12 +140,14 @@ class ObservedPeakSet {
   int DebugDotProd(const TheoreticalPeakArr& theoretical);
 #endif
 
-  void PreprocessSpectrum(const Spectrum& spectrum, int charge) {
+  void PreprocessSpectrum(const Spectrum& spectrum, int charge,
+                          const SearchConfig& config) {
     long int dummy1, dummy2, dummy3, dummy4;
-    PreprocessSpectrum(spectrum, charge, &dummy1, &dummy2, &dummy3, &dummy4);
+    PreprocessSpectrum(spectrum, charge, config, &dummy1, &dummy2, &dummy3, &dummy4);
   }
 
   void PreprocessSpectrum(const Spectrum& spectrum, int charge,
+                          const SearchConfig& config,
                           long int* num_range_skipped,
                           long int* num_precursors_skipped,
                           long int* num_isotopes_skipped,
@@ -154,6 +157,7 @@ class ObservedPeakSet {
   // Method for creating residue evidence matrix from Spectrum
   void CreateResidueEvidenceMatrix(const Spectrum& spectrum,
                                    int charge,
+                                   const SearchConfig& config,
                                    int maxPrecurMassBin,
                                    double precursorMass,
                                    int nAA,
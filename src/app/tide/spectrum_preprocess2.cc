@@ -22,8 +22,9 @@
 #include "spectrum_preprocess.h"
 #include "mass_constants.h" //added by Andy Lin
 #include "max_mz.h"
+#include "search_config.h"
+#include "telemetry.h"
 #include "util/mass.h"
-#include "util/Params.h"
 #include <cmath>
 
 using namespace std;
@@ -58,10 +59,12 @@ static void SubtractBackground(double* observed, int end) {
 }
 
 void ObservedPeakSet::PreprocessSpectrum(const Spectrum& spectrum, int charge,
+                                         const SearchConfig& config,
                                          long int* num_range_skipped,
                                          long int* num_precursors_skipped,
                                          long int* num_isotopes_skipped,
                                          long int* num_retained) {
+  Telemetry::Scope scope(Telemetry::PREPROCESS);
 #ifdef DEBUG
   bool debug = (FLAGS_debug_spectrum_id == spectrum.SpectrumNumber()
                 && (FLAGS_debug_charge == 0 || FLAGS_debug_charge == charge));
@@ -79,7 +82,7 @@ void ObservedPeakSet::PreprocessSpectrum(const Spectrum& spectrum, int charge,
 
   memset(peaks_, 0, sizeof(double) * MaxBin::Global().BackgroundBinEnd());
 
-  if (Params::GetBool("skip-preprocessing")) {
+  if (config.skip_preprocessing) {
     for (int i = 0; i < spectrum.Size(); ++i) {
       double peak_location = spectrum.M_Z(i);
       if (peak_location >= experimental_mass_cut_off) {
@@ -93,9 +96,9 @@ void ObservedPeakSet::PreprocessSpectrum(const Spectrum& spectrum, int charge,
       }
     }
   } else {
-    bool remove_precursor = Params::GetBool("remove-precursor-peak");
-    double precursor_tolerance = Params::GetDouble("remove-precursor-tolerance");
-    double deisotope_threshold = Params::GetDouble("deisotope");
+    bool remove_precursor = config.remove_precursor_peak;
+    double precursor_tolerance = config.remove_precursor_tolerance;
+    double deisotope_threshold = config.deisotope;
     int max_charge = spectrum.MaxCharge();
 
     // Fill peaks
@@ -353,6 +356,7 @@ void ObservedPeakSet::addEvidToResEvMatrix(
 void ObservedPeakSet::CreateResidueEvidenceMatrix(
   const Spectrum& spectrum,
   int charge,
+  const SearchConfig& config,
   int maxPrecurMassBin,
   double precursorMass, // neutral mass
   int nAA, //TODO different than one used in CreateEvidenceVector
@@ -367,6 +371,7 @@ void ObservedPeakSet::CreateResidueEvidenceMatrix(
   long int* num_retained,
   vector<vector<double> >& residueEvidenceMatrix
   ) {
+  Telemetry::Scope scope(Telemetry::PREPROCESS);
 
   assert(MaxBin::Global().MaxBinEnd() > 0);
 
@@ -388,10 +393,10 @@ void ObservedPeakSet::CreateResidueEvidenceMatrix(
   const double maxIntensPerRegion = 50.0;
 
   // Determining max ion mass and max ion intensity
-  bool skipPreprocess = Params::GetBool("skip-preprocessing");
-  bool remove_precursor = !skipPreprocess && Params::GetBool("remove-precursor-peak");
-  double precursorMZExclude = Params::GetDouble("remove-precursor-tolerance");
-  double deisotope_threshold = Params::GetDouble("deisotope");
+  bool skipPreprocess = config.skip_preprocessing;
+  bool remove_precursor = !skipPreprocess && config.remove_precursor_peak;
+  double precursorMZExclude = config.remove_precursor_tolerance;
+  double deisotope_threshold = config.deisotope;
   double maxIonIntens = 0.0;
   double maxIonMass = 0.0;
   set<int> peakSkip;
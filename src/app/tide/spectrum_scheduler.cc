@@ -0,0 +1,67 @@
+// See spectrum_scheduler.h for a description of this class.
+
+#include <stdint.h>
+#include <algorithm>
+#include "spectrum_scheduler.h"
+
+// Largest number of spectrum-charge pairs per chunk, and the number of
+// chunks each thread should get, at least, when there are few pairs.
+static const int MAX_CHUNK_SIZE = 256;
+static const int MIN_CHUNKS_PER_THREAD = 16;
+
+SpectrumScheduler::SpectrumScheduler(int num_items, int num_threads,
+                                     bool interleave)
+  : chunks_(num_threads), position_(num_threads, 0) {
+  int max_chunk = num_items / (num_threads * MIN_CHUNKS_PER_THREAD);
+  max_chunk = max(1, min(MAX_CHUNK_SIZE, max_chunk));
+
+  vector<Chunk> chunks;
+  if (interleave) {
+    MakeChunks(0, num_items, max_chunk, &chunks);
+    for (size_t i = 0; i < chunks.size(); ++i) {
+      chunks_[i % num_threads].push_back(chunks[i]);
+    }
+  } else {
+    for (int t = 0; t < num_threads; ++t) {
+      chunks.clear();
+      MakeChunks((int64_t)num_items * t / num_threads,
+                 (int64_t)num_items * (t + 1) / num_threads, max_chunk, &chunks);
+      chunks_[t].insert(chunks_[t].end(), chunks.begin(), chunks.end());
+    }
+  }
+}
+
+void SpectrumScheduler::MakeChunks(int begin, int end, int max_chunk,
+                                   vector<Chunk>* chunks) {
+  while (begin < end) {
+    int size = max(1, min(max_chunk, (end - begin + 3) / 4));
+    chunks->push_back(Chunk(begin, begin + size));
+    begin += size;
+  }
+}
+
+bool SpectrumScheduler::Next(int thread, int* begin, int* end) {
+  boost::mutex::scoped_lock lock(mutex_);
+
+  deque<Chunk>* source = &chunks_[thread];
+  if (source->empty()) {
+    // Steal the lightest chunk that does not take this thread backward.
+    source = NULL;
+    for (size_t t = 0; t < chunks_.size(); ++t) {
+      if (!chunks_[t].empty() &&
+          chunks_[t].front().first >= position_[thread] &&
+          (source == NULL || chunks_[t].front().first < source->front().first)) {
+        source = &chunks_[t];
+      }
+    }
+    if (source == NULL) {
+      return false;
+    }
+  }
+
+  *begin = source->front().first;
+  *end = source->front().second;
+  source->pop_front();
+  position_[thread] = *end;
+  return true;
+}
@@ -0,0 +1,62 @@
+// A SpectrumScheduler hands out the spectrum-charge pairs of a search, sorted
+// by neutral mass, to the search threads.
+//
+// The pairs are split into contiguous chunks, and each thread is given a
+// deque of chunks in increasing mass order. A thread works through its own
+// deque from the front. Once it is empty the thread steals from the others:
+// it takes the lightest chunk at the front of another thread's deque that is
+// no lighter than the last chunk it searched, so that every thread still
+// visits masses in non-decreasing order, as ActivePeptideQueue requires.
+//
+// Chunks are dealt out in one of two ways:
+//
+//   banded:      thread t is given the t-th of num_threads contiguous bands
+//                of chunks. Each thread's peptide window slides forward over
+//                a band of its own. Suited to threads with their own
+//                ActivePeptideQueue reading the index independently.
+//
+//   interleaved: chunks are dealt round-robin, so all threads advance
+//                together over a narrow band of masses. Suited to threads
+//                sharing a PeptideStream, which holds every peptide between
+//                the lightest and the heaviest window in use.
+//
+// Chunks shrink toward the end of each thread's deque so that threads run
+// out of work at about the same time.
+//
+// Next() is called once per chunk, so a single mutex guards all deques.
+
+#ifndef SPECTRUM_SCHEDULER_H
+#define SPECTRUM_SCHEDULER_H
+
+#include <deque>
+#include <utility>
+#include <vector>
+#include <boost/thread.hpp>
+
+using namespace std;
+
+class SpectrumScheduler {
+ public:
+  SpectrumScheduler(int num_items, int num_threads, bool interleave);
+
+  // Sets [*begin, *end) to the next range of items, by index, for the given
+  // thread to search. Returns false once no work that the thread can take
+  // remains.
+  bool Next(int thread, int* begin, int* end);
+
+ private:
+  typedef pair<int, int> Chunk;
+
+  // Split [begin, end) into chunks of at most max_chunk items, shrinking
+  // toward the end, and append them to chunks.
+  static void MakeChunks(int begin, int end, int max_chunk,
+                         vector<Chunk>* chunks);
+
+  vector< deque<Chunk> > chunks_;
+  // End of the last chunk handed out to each thread.
+  vector<int> position_;
+
+  boost::mutex mutex_;
+};
+
+#endif // SPECTRUM_SCHEDULER_H
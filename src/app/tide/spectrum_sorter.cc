@@ -0,0 +1,225 @@
+// See spectrum_sorter.h for a description of this class.
+
+#include <stdio.h>
+#include <algorithm>
+#include "spectrum_sorter.h"
+#include "util/mass.h"
+#include "io/carp.h"
+
+// Most runs merged at once. Beyond that, groups of runs are first merged into
+// longer runs, so as not to run out of file handles.
+static const int MAX_MERGE_RUNS = 128;
+
+SpectrumSorter::SpectrumSorter(const string& temp_prefix, size_t max_bytes,
+                               double key_window)
+  : temp_prefix_(temp_prefix), max_bytes_(max_bytes), key_window_(key_window),
+    buffer_bytes_(0), run_count_(0), num_spectra_(0), num_spec_charges_(0),
+    highest_mz_(0), last_neutral_mass_(0) {
+}
+
+SpectrumSorter::~SpectrumSorter() {
+  FinishMerge();
+  for (vector<int>::const_iterator i = run_ids_.begin(); i != run_ids_.end(); ++i) {
+    remove(RunFilename(*i).c_str());
+  }
+  for (vector<pb::Spectrum*>::iterator i = buffer_spectra_.begin();
+       i != buffer_spectra_.end();
+       ++i) {
+    delete *i;
+  }
+}
+
+string SpectrumSorter::RunFilename(int run_id) const {
+  char suffix[32];
+  sprintf(suffix, ".run%d.tmp", run_id);
+  return temp_prefix_ + suffix;
+}
+
+SpectrumSorter::Entry SpectrumSorter::MakeEntry(pb::Spectrum* spectrum,
+                                                int charge) const {
+  Entry entry;
+  entry.key = (spectrum->precursor_m_z() - MASS_PROTON - key_window_) * charge;
+  entry.spectrum_number = spectrum->spectrum_number();
+  entry.charge = charge;
+  entry.spectrum = spectrum;
+  return entry;
+}
+
+double SpectrumSorter::LastPeak(const pb::Spectrum& spectrum) {
+  // m/z numerators are stored as deltas; see spectrum.proto.
+  google::protobuf::int64 total = 0;
+  for (int i = 0; i < spectrum.peak_m_z_size(); ++i) {
+    total += spectrum.peak_m_z(i);
+  }
+  return total / (double)spectrum.peak_m_z_denominator();
+}
+
+bool SpectrumSorter::Sort(const string& filename) {
+  HeadedRecordReader reader(filename, &header_);
+  if (!reader.OK() || header_.file_type() != pb::Header::SPECTRA) {
+    return false;
+  }
+  while (!reader.Done()) {
+    pb::Spectrum* spectrum = new pb::Spectrum;
+    buffer_spectra_.push_back(spectrum);
+    if (!reader.Read(spectrum)) {
+      break;
+    }
+    ++num_spectra_;
+    if (spectrum->peak_m_z_size() == 0) {
+      carp(CARP_FATAL, "Spectrum %d has no peaks.", spectrum->spectrum_number());
+    }
+    highest_mz_ = max(highest_mz_, LastPeak(*spectrum));
+
+    for (int i = 0; i < spectrum->charge_state_size(); ++i) {
+      Entry entry = MakeEntry(spectrum, spectrum->charge_state(i));
+      if (num_spec_charges_++ == 0 || last_ < entry) {
+        last_ = entry;
+        last_neutral_mass_ =
+          (spectrum->precursor_m_z() - MASS_PROTON) * entry.charge;
+      }
+      buffer_.push_back(entry);
+    }
+    buffer_bytes_ += sizeof(pb::Spectrum) +
+      sizeof(google::protobuf::int64) *
+      (spectrum->peak_m_z_size() + spectrum->peak_intensity_size()) +
+      (sizeof(Entry) + sizeof(int)) * spectrum->charge_state_size();
+    if (buffer_bytes_ >= max_bytes_) {
+      Spill();
+    }
+  }
+  if (!reader.OK()) {
+    return false;
+  }
+  Spill();
+  CollapseRuns();
+  StartMerge(run_ids_);
+  run_ids_.clear();
+  return true;
+}
+
+void SpectrumSorter::Spill() {
+  if (buffer_.empty()) {
+    return;
+  }
+  std::sort(buffer_.begin(), buffer_.end());
+  int run_id = run_count_++;
+  string filename = RunFilename(run_id);
+  {
+    HeadedRecordWriter writer(filename, header_);
+    for (vector<Entry>::iterator i = buffer_.begin(); i != buffer_.end(); ++i) {
+      Write(&writer, filename, i->spectrum, i->charge);
+    }
+  }
+  run_ids_.push_back(run_id);
+
+  for (vector<pb::Spectrum*>::iterator i = buffer_spectra_.begin();
+       i != buffer_spectra_.end();
+       ++i) {
+    delete *i;
+  }
+  buffer_spectra_.clear();
+  buffer_.clear();
+  buffer_bytes_ = 0;
+}
+
+void SpectrumSorter::Write(HeadedRecordWriter* writer, const string& filename,
+                           pb::Spectrum* spectrum, int charge) {
+  // Each record of a run is a single spectrum-charge pair.
+  spectrum->clear_charge_state();
+  spectrum->add_charge_state(charge);
+  if (!writer->Write(spectrum)) {
+    carp(CARP_FATAL, "Error writing spectra to %s.", filename.c_str());
+  }
+}
+
+void SpectrumSorter::CollapseRuns() {
+  while (run_ids_.size() > MAX_MERGE_RUNS) {
+    vector<int> group(run_ids_.begin(), run_ids_.begin() + MAX_MERGE_RUNS);
+    run_ids_.erase(run_ids_.begin(), run_ids_.begin() + MAX_MERGE_RUNS);
+    int run_id = run_count_++;
+    string filename = RunFilename(run_id);
+    StartMerge(group);
+    {
+      HeadedRecordWriter writer(filename, header_);
+      while (!heap_.empty()) {
+        int run = PopRun();
+        pb::Spectrum* spectrum = &merging_[run]->spectrum;
+        Write(&writer, filename, spectrum, spectrum->charge_state(0));
+        AdvanceRun(run);
+      }
+    }
+    FinishMerge();
+    run_ids_.push_back(run_id);
+  }
+}
+
+void SpectrumSorter::StartMerge(const vector<int>& run_ids) {
+  merging_ids_ = run_ids;
+  for (size_t i = 0; i < run_ids.size(); ++i) {
+    Run* run = new Run;
+    run->reader = new HeadedRecordReader(RunFilename(run_ids[i]));
+    if (!run->reader->OK()) {
+      carp(CARP_FATAL, "Error reading spectra from %s.",
+           RunFilename(run_ids[i]).c_str());
+    }
+    merging_.push_back(run);
+    AdvanceRun(i);
+  }
+}
+
+void SpectrumSorter::AdvanceRun(int run) {
+  HeadedRecordReader* reader = merging_[run]->reader;
+  if (reader->Done()) {
+    if (!reader->OK()) {
+      carp(CARP_FATAL, "Error reading spectra from %s.",
+           RunFilename(merging_ids_[run]).c_str());
+    }
+    return;
+  }
+  pb::Spectrum* spectrum = &merging_[run]->spectrum;
+  if (!reader->Read(spectrum) || spectrum->charge_state_size() != 1) {
+    carp(CARP_FATAL, "Error reading spectra from %s.",
+         RunFilename(merging_ids_[run]).c_str());
+  }
+  heap_.push_back(MergeItem(MakeEntry(spectrum, spectrum->charge_state(0)), run));
+  push_heap(heap_.begin(), heap_.end(), MergeGreater());
+}
+
+int SpectrumSorter::PopRun() {
+  pop_heap(heap_.begin(), heap_.end(), MergeGreater());
+  int run = heap_.back().second;
+  heap_.pop_back();
+  return run;
+}
+
+void SpectrumSorter::FinishMerge() {
+  for (size_t i = 0; i < merging_.size(); ++i) {
+    delete merging_[i]->reader;
+    delete merging_[i];
+    remove(RunFilename(merging_ids_[i]).c_str());
+  }
+  merging_.clear();
+  merging_ids_.clear();
+  heap_.clear();
+}
+
+bool SpectrumSorter::NextSegment(SpectrumCollection* segment) {
+  if (heap_.empty()) {
+    return false;
+  }
+  size_t bytes = 0;
+  do {
+    int run = PopRun();
+    const pb::Spectrum& spectrum = merging_[run]->spectrum;
+    Spectrum* spec = new Spectrum(spectrum);
+    segment->AddSpecCharge(spec, spectrum.charge_state(0));
+    bytes += sizeof(Spectrum) + sizeof(SpectrumCollection::SpecCharge) +
+      2 * sizeof(double) * spec->Size();
+    AdvanceRun(run);
+  } while (!heap_.empty() && bytes < max_bytes_);
+  if (heap_.empty()) {
+    FinishMerge();
+  }
+  return true;
+}
@@ -0,0 +1,128 @@
+// The SpectrumSorter class sorts the spectrum-charge pairs of a file of
+// spectrum records (see spectrum_collection.h) in bounded memory, for inputs
+// too large to hold in a SpectrumCollection all at once.
+//
+// Sort() reads the file once. Spectra are buffered until the memory limit is
+// reached; each buffer is then sorted and written to a temporary file of
+// records (a "run") holding one record per spectrum-charge pair, i.e. a
+// spectrum with several candidate charges is written once for each of them.
+// NextSegment() then merges the runs, filling a SpectrumCollection with the
+// next spectrum-charge pairs in order, again up to the memory limit.
+//
+// The pairs are ordered as tide-search orders them in memory: by neutral
+// mass, or for m/z precursor windows by the low end of the window (see
+// TideSearchApplication::ScSortByMz). Since successive segments continue that
+// order, the rolling-window join against the peptides (see
+// active_peptide_queue.{h,cc}) can carry on from one segment to the next.
+
+#ifndef SPECTRUM_SORTER_H
+#define SPECTRUM_SORTER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "header.pb.h"
+#include "spectrum.pb.h"
+#include "records.h"
+#include "spectrum_collection.h"
+
+using namespace std;
+
+class SpectrumSorter {
+ public:
+  // Runs are written to files named temp_prefix.run<N>.tmp. Spectrum-charge
+  // pairs are ordered by (precursor m/z - proton - key_window) * charge, so
+  // key_window is the m/z precursor window, or 0 to order by neutral mass.
+  SpectrumSorter(const string& temp_prefix, size_t max_bytes,
+                 double key_window);
+  ~SpectrumSorter();
+
+  // Read and sort the spectra of filename. Returns false if it is not a file
+  // of spectrum records.
+  bool Sort(const string& filename);
+
+  int NumSpectra() const { return num_spectra_; }
+  int64_t NumSpecCharges() const { return num_spec_charges_; }
+
+  // Maximum m/z of any peak, as SpectrumCollection::FindHighestMZ().
+  double HighestMZ() const { return highest_mz_; }
+
+  // Neutral mass of the last spectrum-charge pair in order.
+  double LastNeutralMass() const { return last_neutral_mass_; }
+
+  // Add the next spectrum-charge pairs to segment, which should be empty, in
+  // order. Returns false if there were none left.
+  bool NextSegment(SpectrumCollection* segment);
+
+  // True when every spectrum-charge pair has been handed out.
+  bool Done() const { return heap_.empty(); }
+
+ private:
+  struct Entry {
+    double key;
+    int spectrum_number;
+    int charge;
+    pb::Spectrum* spectrum;
+
+    bool operator<(const Entry& other) const {
+      if (key != other.key) {
+        return key < other.key;
+      }
+      if (spectrum_number != other.spectrum_number) {
+        return spectrum_number < other.spectrum_number;
+      }
+      return charge < other.charge;
+    }
+  };
+
+  // A run being merged, with its next spectrum-charge pair.
+  struct Run {
+    HeadedRecordReader* reader;
+    pb::Spectrum spectrum;
+  };
+
+  // Heap item: an entry and the index of the run it came from.
+  typedef pair<Entry, int> MergeItem;
+  struct MergeGreater {
+    bool operator()(const MergeItem& x, const MergeItem& y) const {
+      return y.first < x.first;
+    }
+  };
+
+  Entry MakeEntry(pb::Spectrum* spectrum, int charge) const;
+  static double LastPeak(const pb::Spectrum& spectrum);
+
+  void Spill();
+  void Write(HeadedRecordWriter* writer, const string& filename,
+             pb::Spectrum* spectrum, int charge);
+  void CollapseRuns();
+  void StartMerge(const vector<int>& run_ids);
+  void AdvanceRun(int run);
+  int PopRun();
+  void FinishMerge();
+  string RunFilename(int run_id) const;
+
+  string temp_prefix_;
+  size_t max_bytes_;
+  double key_window_;
+  pb::Header header_;
+
+  vector<pb::Spectrum*> buffer_spectra_;
+  vector<Entry> buffer_;
+  size_t buffer_bytes_;
+
+  vector<int> run_ids_;   // runs not yet merged
+  int run_count_;         // runs created so far, to number their files
+
+  vector<Run*> merging_;  // open runs, indexed as in heap_
+  vector<int> merging_ids_;
+  vector<MergeItem> heap_;
+
+  int num_spectra_;
+  int64_t num_spec_charges_;
+  double highest_mz_;
+  Entry last_;
+  double last_neutral_mass_;
+};
+
+#endif // SPECTRUM_SORTER_H
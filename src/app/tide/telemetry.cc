@@ -0,0 +1,210 @@
+// See telemetry.h for a description of this class.
+
+#include <stdio.h>
+#ifdef _MSC_VER
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+#include "telemetry.h"
+
+// Nesting of phases beyond this is charged to the phase at this depth.
+static const int MAX_DEPTH = 16;
+
+static const char* PHASE_NAMES[Telemetry::NUM_PHASES] = {
+  "other", "spectrum-read", "preprocess", "active-range", "peptide-decode",
+  "peak-compute", "program-compile", "scoring", "p-value", "result-format",
+  "result-write", "lock-wait", "digest", "peptide-sort", "index-write"
+};
+
+static const char* COUNTER_NAMES[Telemetry::NUM_COUNTERS] = {
+  "spectra", "candidates", "peptides"
+};
+
+struct Telemetry::Stats {
+  string name;
+  double seconds[NUM_PHASES];
+  int64_t calls[NUM_PHASES];
+  int64_t counts[NUM_COUNTERS];
+  Phase stack[MAX_DEPTH];
+  int depth;
+  double mark;  // when time was last charged
+};
+
+bool Telemetry::enabled_ = false;
+
+static boost::mutex registry_mutex;
+static vector<Telemetry::Stats*> registry;
+
+// The stats are owned by the registry, not by the thread.
+static void NoCleanup(Telemetry::Stats*) {}
+static boost::thread_specific_ptr<Telemetry::Stats> current_stats(NoCleanup);
+
+static double Now() {
+#ifdef _MSC_VER
+  static LARGE_INTEGER frequency;
+  LARGE_INTEGER count;
+  if (frequency.QuadPart == 0) {
+    QueryPerformanceFrequency(&frequency);
+  }
+  QueryPerformanceCounter(&count);
+  return (double)count.QuadPart / frequency.QuadPart;
+#else
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+#endif
+}
+
+// Charge the time since the last charge to the innermost phase.
+static void Charge(Telemetry::Stats* stats, double now) {
+  int top = (stats->depth < MAX_DEPTH ? stats->depth : MAX_DEPTH) - 1;
+  stats->seconds[stats->stack[top]] += now - stats->mark;
+  stats->mark = now;
+}
+
+Telemetry::Thread::Thread(const string& name) : previous_(NULL), active_(enabled_) {
+  if (!active_) {
+    return;
+  }
+  double now = Now();
+  previous_ = current_stats.get();
+  if (previous_ != NULL) {
+    Charge(previous_, now);
+  }
+  Stats* stats = NULL;
+  {
+    boost::mutex::scoped_lock lock(registry_mutex);
+    for (vector<Stats*>::iterator i = registry.begin(); i != registry.end(); ++i) {
+      if ((*i)->name == name) {
+        stats = *i;
+        break;
+      }
+    }
+    if (stats == NULL) {
+      stats = new Stats;
+      stats->name = name;
+      for (int i = 0; i < NUM_PHASES; i++) {
+        stats->seconds[i] = 0;
+        stats->calls[i] = 0;
+      }
+      for (int i = 0; i < NUM_COUNTERS; i++) {
+        stats->counts[i] = 0;
+      }
+      registry.push_back(stats);
+    }
+  }
+  if (stats == previous_) {
+    // Already measured under this name, e.g. tide-index run by tide-search.
+    active_ = false;
+    return;
+  }
+  stats->stack[0] = OTHER;
+  stats->depth = 1;
+  stats->mark = now;
+  current_stats.reset(stats);
+}
+
+Telemetry::Thread::~Thread() {
+  if (!active_) {
+    return;
+  }
+  double now = Now();
+  Stats* stats = current_stats.get();
+  if (stats != NULL) {
+    Charge(stats, now);
+  }
+  if (previous_ != NULL) {
+    previous_->mark = now;
+  }
+  current_stats.reset(previous_);
+}
+
+Telemetry::Stats* Telemetry::Current() {
+  return current_stats.get();
+}
+
+void Telemetry::Enter(Stats* stats, Phase phase) {
+  Charge(stats, Now());
+  if (stats->depth < MAX_DEPTH) {
+    stats->stack[stats->depth] = phase;
+  }
+  ++stats->depth;
+  ++stats->calls[phase];
+}
+
+void Telemetry::Exit(Stats* stats) {
+  Charge(stats, Now());
+  --stats->depth;
+}
+
+void Telemetry::AddCount(Counter counter, int64_t n) {
+  Stats* stats = Current();
+  if (stats != NULL) {
+    stats->counts[counter] += n;
+  }
+}
+
+bool Telemetry::WriteReport(const string& filename) {
+  FILE* f = fopen(filename.c_str(), "w");
+  if (f == NULL) {
+    return false;
+  }
+  fprintf(f, "thread\ttotal-seconds");
+  for (int i = 0; i < NUM_PHASES; i++) {
+    fprintf(f, "\t%s-seconds", PHASE_NAMES[i]);
+  }
+  for (int i = 0; i < NUM_PHASES; i++) {
+    fprintf(f, "\t%s-calls", PHASE_NAMES[i]);
+  }
+  for (int i = 0; i < NUM_COUNTERS; i++) {
+    fprintf(f, "\t%s", COUNTER_NAMES[i]);
+  }
+  fprintf(f, "\n");
+
+  // The calling thread is still being measured; bring it up to date.
+  Stats* current = Current();
+  if (current != NULL) {
+    Charge(current, Now());
+  }
+
+  boost::mutex::scoped_lock lock(registry_mutex);
+  Stats all;
+  all.name = "all";
+  for (int i = 0; i < NUM_PHASES; i++) {
+    all.seconds[i] = 0;
+    all.calls[i] = 0;
+  }
+  for (int i = 0; i < NUM_COUNTERS; i++) {
+    all.counts[i] = 0;
+  }
+  for (size_t r = 0; r <= registry.size(); r++) {
+    const Stats* stats = (r < registry.size()) ? registry[r] : &all;
+    double total = 0;
+    for (int i = 0; i < NUM_PHASES; i++) {
+      total += stats->seconds[i];
+    }
+    fprintf(f, "%s\t%.6f", stats->name.c_str(), total);
+    for (int i = 0; i < NUM_PHASES; i++) {
+      fprintf(f, "\t%.6f", stats->seconds[i]);
+    }
+    for (int i = 0; i < NUM_PHASES; i++) {
+      fprintf(f, "\t%lld", (long long)stats->calls[i]);
+    }
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+      fprintf(f, "\t%lld", (long long)stats->counts[i]);
+    }
+    fprintf(f, "\n");
+    if (stats != &all) {
+      for (int i = 0; i < NUM_PHASES; i++) {
+        all.seconds[i] += stats->seconds[i];
+        all.calls[i] += stats->calls[i];
+      }
+      for (int i = 0; i < NUM_COUNTERS; i++) {
+        all.counts[i] += stats->counts[i];
+      }
+    }
+  }
+  return fclose(f) == 0;
+}
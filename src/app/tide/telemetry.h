@@ -0,0 +1,126 @@
+// Telemetry measures, for each thread of a run, the time spent in each phase
+// of the work (reading spectra, preprocessing them, decoding peptides, ...)
+// along with counts of the work done. While it is not enabled, each
+// measurement costs the test of a flag.
+//
+// Time is charged to the innermost open phase only, so the phases of a
+// thread add up to the time the thread was measured. Time outside of any
+// phase is charged to OTHER.
+//
+// Usage:
+//   Telemetry::Enable();                   // once, before threads start
+//   Telemetry::Thread thread("search-3");  // in each thread to measure
+//   {
+//     Telemetry::Scope scope(Telemetry::SCORING);
+//     ...
+//   }
+//   Telemetry::Count(Telemetry::SPECTRA, 1);
+//   Telemetry::WriteReport(filename);      // once all threads are done
+//
+// Threads are identified by name, so a thread started again under the same
+// name (e.g. for the next spectrum file) adds to the same totals. Threads
+// running at the same time must have different names.
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <boost/thread.hpp>
+
+using namespace std;
+
+class Telemetry {
+ public:
+  enum Phase {
+    OTHER,
+    SPECTRUM_READ,    // reading and sorting spectrum files
+    PREPROCESS,       // spectrum preprocessing and evidence vectors
+    ACTIVE_RANGE,     // SetActiveRange() apart from the next three
+    PEPTIDE_DECODE,
+    PEAK_COMPUTE,
+    PROGRAM_COMPILE,
+    SCORING,
+    PVALUE,           // exact p-value and residue evidence count programs
+    RESULT_FORMAT,
+    RESULT_WRITE,
+    LOCK_WAIT,
+    DIGEST,           // tide-index
+    PEPTIDE_SORT,
+    INDEX_WRITE,
+    NUM_PHASES
+  };
+
+  enum Counter {
+    SPECTRA,      // spectrum-charge pairs searched
+    CANDIDATES,   // candidate peptides scored
+    PEPTIDES,     // peptides decoded or digested
+    NUM_COUNTERS
+  };
+
+  static void Enable() { enabled_ = true; }
+  static bool Enabled() { return enabled_; }
+
+  // Per-thread totals. For the implementation only.
+  struct Stats;
+
+  // Measures the calling thread under name for its lifetime. Whatever the
+  // thread was measured as before resumes afterwards.
+  class Thread {
+   public:
+    explicit Thread(const string& name);
+    ~Thread();
+   private:
+    Stats* previous_;
+    bool active_;
+  };
+
+  // Charges the time until it is destroyed to phase.
+  class Scope {
+   public:
+    explicit Scope(Phase phase) : stats_(enabled_ ? Current() : NULL) {
+      if (stats_ != NULL) {
+        Enter(stats_, phase);
+      }
+    }
+    ~Scope() {
+      if (stats_ != NULL) {
+        Exit(stats_);
+      }
+    }
+   private:
+    Stats* stats_;
+  };
+
+  static void Count(Counter counter, int64_t n) {
+    if (enabled_) {
+      AddCount(counter, n);
+    }
+  }
+
+  // Lock mutex, charging any wait to LOCK_WAIT.
+  static void Lock(boost::mutex* mutex) {
+    if (!enabled_) {
+      mutex->lock();
+      return;
+    }
+    Scope scope(LOCK_WAIT);
+    mutex->lock();
+  }
+
+  // Write one tab-delimited row per thread, and a row of totals: the time
+  // in each phase, the number of times each phase was entered, and the
+  // counters. Returns false if filename cannot be written.
+  static bool WriteReport(const string& filename);
+
+ private:
+  static Stats* Current();
+  static void Enter(Stats* stats, Phase phase);
+  static void Exit(Stats* stats);
+  static void AddCount(Counter counter, int64_t n);
+
+  static bool enabled_;
+};
+
+#endif // TELEMETRY_H
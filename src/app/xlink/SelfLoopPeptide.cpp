@@ -82,8 +82,7 @@ void SelfLoopPeptide::addCandidates(
     vector<SelfLoopPeptide>::iterator eiter = XLinkDatabase::getSelfLoopEnd(is_decoy);
 
     while (biter != eiter && biter->getMass(GlobalParams::getIsotopicMass()) <= max_mass) {
-      biter->incrementPointerCount();
-      candidates.add(&(*biter));
+      candidates.add(new SelfLoopPeptide(*biter));
       ++biter;
     }
   }
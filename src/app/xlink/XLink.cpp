@@ -9,11 +9,26 @@
 
 #include <sstream>
 #include <iostream>
+
+#include <boost/thread/tss.hpp>
 using namespace std;
 
 namespace XLink {
 
-set<Crux::Peptide*> allocated_peptides_; ///< tracker for allocated peptides
+/**
+ * tracker for allocated peptides, one for each thread that searches
+ */
+static boost::thread_specific_ptr<set<Crux::Peptide*> > allocated_peptides_;
+
+/**
+ * \returns the calling thread's allocated peptides
+ */
+static set<Crux::Peptide*>& getAllocatedPeptides() {
+  if (allocated_peptides_.get() == NULL) {
+    allocated_peptides_.reset(new set<Crux::Peptide*>());
+  }
+  return *allocated_peptides_;
+}
 
 bool testInterIntraKeep(
   Crux::Peptide *pep1,
@@ -143,23 +158,43 @@ void addAllocatedPeptide(
   Crux::Peptide* peptide ///< peptide to add
   ) {
 
-  allocated_peptides_.insert(peptide);
+  getAllocatedPeptides().insert(peptide);
 }
 
 /**
  * delete all peptides that are allocated
  */
 void deleteAllocatedPeptides() {
-  carp(CARP_DEBUG, "deleting %d peptides", allocated_peptides_.size());
+  deletePeptides(getAllocatedPeptides());
+}
+
+/**
+ * moves the peptides allocated by this thread into peptides
+ */
+void takeAllocatedPeptides(
+  set<Crux::Peptide*>& peptides ///< receives the peptides
+  ) {
+  set<Crux::Peptide*>& allocated = getAllocatedPeptides();
+  peptides.insert(allocated.begin(), allocated.end());
+  allocated.clear();
+}
+
+/**
+ * delete the peptides in a set, and clear it
+ */
+void deletePeptides(
+  set<Crux::Peptide*>& peptides ///< peptides to delete
+  ) {
+  carp(CARP_DEBUG, "deleting %d peptides", peptides.size());
   for (set<Crux::Peptide*>::iterator iter =
-    allocated_peptides_.begin();
-    iter != allocated_peptides_.end();
+    peptides.begin();
+    iter != peptides.end();
     ++iter) {
   
   delete *iter;
 
   }
-  allocated_peptides_.clear();
+  peptides.clear();
 }
 
 
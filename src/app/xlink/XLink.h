@@ -10,6 +10,7 @@
 #include "XLinkBondMap.h"
 #include "XLinkablePeptide.h"
 
+#include <set>
 #include <vector>
 #include <string>
 
@@ -90,10 +91,27 @@ void addAllocatedPeptide(
   );
 
 /**
- * delete all peptides that are allocated
+ * delete all peptides that are allocated.  Peptides are tracked
+ * separately for each thread, so this only deletes those allocated
+ * by the calling thread.
  */
 void deleteAllocatedPeptides();
 
+/**
+ * moves the peptides allocated by this thread into peptides, so
+ * that another thread can delete them once it is done with them
+ */
+void takeAllocatedPeptides(
+  std::set<Crux::Peptide*>& peptides ///< receives the peptides
+  );
+
+/**
+ * delete the peptides in a set, and clear it
+ */
+void deletePeptides(
+  std::set<Crux::Peptide*>& peptides ///< peptides to delete
+  );
+
 } // namespace XLink
 
 #endif
@@ -32,6 +32,9 @@ std::vector<XLinkablePeptide> XLinkDatabase::target_xlinkable_peptides2_;
 std::vector<XLinkablePeptide> XLinkDatabase::target_xlinkable_peptides_flatten_;
 std::vector<XLinkablePeptide> XLinkDatabase::decoy_xlinkable_peptides_flatten_;
 
+XLinkableFragmentStore XLinkDatabase::target_xlinkable_fragments_;
+XLinkableFragmentStore XLinkDatabase::decoy_xlinkable_fragments_;
+
 bool XLinkDatabase::addPeptideToDatabase(Crux::Peptide* peptide) {
   
   bool added = false;
@@ -212,6 +215,8 @@ void XLinkDatabase::initialize() {
     carp(CARP_INFO, "  The database contains %d cross-linkable peptides.", target_xlinkable_peptides_.size());
     sort(target_xlinkable_peptides_.begin(), target_xlinkable_peptides_.end(), compareXLinkablePeptideMass);
     flattenLinkablePeptides(target_xlinkable_peptides_, target_xlinkable_peptides_flatten_);
+    target_xlinkable_fragments_.build(target_xlinkable_peptides_flatten_);
+    decoy_xlinkable_fragments_.build(decoy_xlinkable_peptides_flatten_);
   }
 
   carp(CARP_INFO, "Done initializing database");
@@ -225,6 +230,8 @@ void XLinkDatabase::finalize() {
   decoy_selfloop_peptides_.clear();
   target_xlinkable_peptides_.clear();
   decoy_xlinkable_peptides_.clear();
+  target_xlinkable_fragments_.clear();
+  decoy_xlinkable_fragments_.clear();
   target_xlinkable_peptides_flatten_.clear();
   for (size_t idx1=0;idx1<target_peptides_.size();idx1++) {
     for (size_t idx2=0;idx2<target_peptides_[idx1].size();idx2++) {
@@ -689,6 +696,16 @@ vector<XLinkablePeptide>::iterator XLinkDatabase::getXLinkableFlattenEnd(
 }
 
 
+XLinkableFragmentStore& XLinkDatabase::getXLinkableFragments(
+  bool decoy
+  ) {
+  if (decoy) {
+    return decoy_xlinkable_fragments_;
+  } else {
+    return target_xlinkable_fragments_;
+  }
+}
+
 int XLinkDatabase::getNLinkable() {
   return(target_xlinkable_peptides_.size());
 }
@@ -4,12 +4,19 @@
 #include "model/Peptide.h"
 #include "model/Database.h"
 #include "XLinkablePeptide.h"
+#include "XLinkableFragmentStore.h"
 #include "SelfLoopPeptide.h"
 #include "LinearPeptide.h"
 #include "MonoLinkPeptide.h"
 
 #include <vector>
 
+/**
+ * The candidates of a cross-link search.  They are only changed by
+ * initialize and finalize, so the search threads can read them without
+ * locking.  Matches are scored and ranked in place, so each spectrum's
+ * collection holds its own copies of the candidates, never these objects.
+ */
 class XLinkDatabase {
 
  protected:
@@ -40,6 +47,9 @@ class XLinkDatabase {
 
   static std::vector<XLinkablePeptide> decoy_xlinkable_peptides_flatten_;
 
+  static XLinkableFragmentStore target_xlinkable_fragments_; ///< fragment masses of the flattened targets
+  static XLinkableFragmentStore decoy_xlinkable_fragments_; ///< fragment masses of the flattened decoys
+
   static void findLinearPeptides(
     vector<Crux::Peptide*>& peptides, 
     vector<LinearPeptide>& linears
@@ -100,6 +110,13 @@ class XLinkDatabase {
     FLOAT_T max_mass
   );
 
+  /**
+   * \returns the fragment masses of the flattened xlinkable peptides
+   */
+  static XLinkableFragmentStore& getXLinkableFragments(
+    bool decoy
+  );
+
   static std::vector<SelfLoopPeptide>::iterator getSelfLoopBegin(
     bool decoy
   );
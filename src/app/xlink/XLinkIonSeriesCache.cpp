@@ -1,7 +1,15 @@
 #include "XLinkIonSeriesCache.h"
 
+#include <boost/thread/mutex.hpp>
+
 using namespace std;
 
+/**
+ * Guard the caches, which are filled in by searches on several threads.
+ */
+static boost::mutex ion_series_mutex;
+static boost::mutex ion_constraint_mutex;
+
 vector<vector<IonSeries*> > XLinkIonSeriesCache::target_xlinkable_ion_series_;
 
 vector<vector<IonSeries*> > XLinkIonSeriesCache::decoy_xlinkable_ion_series_;
@@ -21,6 +29,7 @@ IonSeries* XLinkIonSeriesCache::getXLinkablePeptideIonSeries(
     return NULL;
   } else {
 
+    boost::mutex::scoped_lock lock(ion_series_mutex);
     bool decoy = xpep.isDecoy();
     //carp(CARP_INFO, "decoy %i pep_idx %i charge %i", decoy, xpep_idx, charge);
     vector<vector<IonSeries*> >* ion_cache = &target_xlinkable_ion_series_;
@@ -104,6 +113,7 @@ IonConstraint* XLinkIonSeriesCache::getXCorrIonConstraint(
 
   int charge_idx = charge - 1;
 
+  boost::mutex::scoped_lock lock(ion_constraint_mutex);
   while(xcorr_ion_constraint_.size() <= charge_idx) {
     xcorr_ion_constraint_.push_back(IonConstraint::newIonConstraintSmart(XCORR, (xcorr_ion_constraint_.size()+1)));
   }
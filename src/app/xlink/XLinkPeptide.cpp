@@ -17,12 +17,15 @@
 #include <iostream>
 #include <sstream>
 
+#include <boost/thread/mutex.hpp>
+
 using namespace std;
 
 FLOAT_T XLinkPeptide::linker_mass_ = 0;
 set<Crux::Peptide*> XLinkPeptide::allocated_peptides_;
 FLOAT_T XLinkPeptide::pmin_ = 0;
 bool XLinkPeptide::pmin_set_ = false;
+static boost::mutex pmin_mutex;
 
 XLinkPeptide::XLinkPeptide() : XLinkMatch() {
   mass_calculated_[MONO] = false;
@@ -198,12 +201,17 @@ int XLinkPeptide::addCandidates(
   carp(CARP_DEBUG, "XLinkPeptide::addCandidates - min:%g", min_mass);
   carp(CARP_DEBUG, "XLinkPeptide::addCandidates - max:%g", max_mass);
 
-  if (!pmin_set_) {
-    pmin_ = XLinkDatabase::getXLinkableBegin()->getMass(GlobalParams::getIsotopicMass());
-    pmin_set_ = true;
+  FLOAT_T pmin;
+  {
+    boost::mutex::scoped_lock lock(pmin_mutex);
+    if (!pmin_set_) {
+      pmin_ = XLinkDatabase::getXLinkableBegin()->getMass(GlobalParams::getIsotopicMass());
+      pmin_set_ = true;
+    }
+    pmin = pmin_;
   }
-  FLOAT_T peptide1_min_mass = pmin_;
-  FLOAT_T peptide1_max_mass = max_mass-pmin_-linker_mass_;
+  FLOAT_T peptide1_min_mass = pmin;
+  FLOAT_T peptide1_max_mass = max_mass-pmin-linker_mass_;
 
   carp(CARP_DEBUG, "peptide1_min:%g", peptide1_min_mass);
   carp(CARP_DEBUG, "peptide1_max:%g", peptide1_max_mass);
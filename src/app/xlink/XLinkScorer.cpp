@@ -14,6 +14,7 @@
 #include "util/GlobalParams.h"
 
 
+#include <algorithm>
 #include <iostream>
 
 using namespace std;
@@ -33,6 +34,7 @@ void XLinkScorer::init(
   spectrum_ = spectrum;
   charge_ = charge;
   compute_sp_ = compute_sp;
+  xcorr_array_ready_ = false;
 
   if ((spectrum_ != NULL) && (charge_ > 0)) {
 
@@ -201,6 +203,31 @@ FLOAT_T XLinkScorer::scoreXLinkablePeptide(
 
 }
 
+/**
+ * Scores the peptide with ions from the fragment store rather than an
+ * IonSeries.  The spectrum is preprocessed once, on the first call.
+ */
+FLOAT_T XLinkScorer::scoreXLinkablePeptide(
+  const XLinkableFragmentStore& fragments,
+  size_t idx,
+  FLOAT_T mod_mass) {
+
+  if (!xcorr_array_ready_) {
+    if (!scorer_xcorr_->createIntensityArrayXcorr(spectrum_, charge_)) {
+      carp(CARP_FATAL, "failed to produce XCORR");
+    }
+    xcorr_array_ready_ = true;
+  }
+  int max_charge = min(charge_, ion_constraint_xcorr_->getMaxCharge());
+  int num_ions = fragments.predictIons(idx, max_charge, mod_mass,
+    ion_types_, ion_charges_, ion_mass_zs_);
+  if (num_ions == 0) {
+    return 0;
+  }
+  return scorer_xcorr_->scoreIntensityIons(
+    &ion_types_[0], &ion_charges_[0], &ion_mass_zs_[0], num_ions);
+}
+
 /*                                                                                                                                                                                                                          
  * Local Variables:                                                                                                                                                                                                         
  * mode: c                                                                                                                                                                                                                  
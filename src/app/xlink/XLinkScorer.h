@@ -9,6 +9,9 @@
 #define XLINKSCORER_H_
 #include "model/objects.h"
 #include "XLinkMatch.h"
+#include "XLinkableFragmentStore.h"
+
+#include <vector>
 
 class XLinkScorer {
  protected:
@@ -22,6 +25,10 @@ class XLinkScorer {
   IonSeries* ion_series_xcorr_; ///< current ion series xcorr
   IonSeries* ion_series_sp_; ///< current ion series sp
   bool compute_sp_; ///< calculate sp score
+  bool xcorr_array_ready_; ///< has the spectrum been preprocessed for xcorr
+  std::vector<ION_TYPE_T> ion_types_; ///< types of the ions being scored
+  std::vector<int> ion_charges_; ///< charges of the ions being scored
+  std::vector<FLOAT_T> ion_mass_zs_; ///< m/z of the ions being scored
  
   /**
    * initializes the object with the spectrum
@@ -71,6 +78,16 @@ class XLinkScorer {
     int link_idx, 
     FLOAT_T mod_mass
   );
+
+  /**
+   * \returns the xcorr score of a flattened xlinkable peptide, from its
+   * fragment masses in the store, with mod_mass at its link site
+   */
+  FLOAT_T scoreXLinkablePeptide(
+    const XLinkableFragmentStore& fragments, ///< the fragment store
+    size_t idx, ///< index of the peptide in the store
+    FLOAT_T mod_mass ///< mass added at the link site
+  );
   
   IonConstraint* getIonConstraintXCorr();
   
@@ -0,0 +1,172 @@
+/**
+ * \file XLinkableFragmentStore.cpp
+ * \brief Fragment masses of the flattened xlinkable peptides, for scoring
+ * them without building ion series.
+ *****************************************************************************/
+
+#include "XLinkableFragmentStore.h"
+#include "util/GlobalParams.h"
+#include "util/mass.h"
+#include "util/modifications.h"
+
+#include <algorithm>
+
+using namespace std;
+
+/**
+ * Creates an empty store
+ */
+XLinkableFragmentStore::XLinkableFragmentStore() {
+  xpeptides_ = NULL;
+}
+
+/**
+ * Computes the fragment masses of flattened xlinkable peptides.  The b ion
+ * of cleavage i is the sum of the first i residues and the y ion is the sum
+ * of the last i residues plus water, as in IonSeries; a ions are b ions
+ * less CO.
+ */
+void XLinkableFragmentStore::build(
+  vector<XLinkablePeptide>& xpeptides ///< flattened peptides
+  ) {
+
+  clear();
+  xpeptides_ = &xpeptides;
+
+  size_t num_peptides = xpeptides.size();
+  masses_.reserve(num_peptides);
+  mono_masses_.reserve(num_peptides);
+  link_sites_.reserve(num_peptides);
+  lengths_.reserve(num_peptides);
+  fragment_begins_.reserve(num_peptides);
+
+  vector<FLOAT_T> mass_matrix;
+  for (size_t idx = 0; idx < num_peptides; idx++) {
+    XLinkablePeptide& xpeptide = xpeptides[idx];
+    masses_.push_back(xpeptide.getMassConst(GlobalParams::getIsotopicMass()));
+    mono_masses_.push_back(xpeptide.getMass(MONO));
+    link_sites_.push_back(xpeptide.getLinkSite(0));
+
+    // Flattening puts the link sites of a peptide next to each other.
+    Crux::Peptide* peptide = xpeptide.getPeptide();
+    if (idx > 0 && peptide != NULL && peptide == xpeptides[idx-1].getPeptide()) {
+      lengths_.push_back(lengths_.back());
+      fragment_begins_.push_back(fragment_begins_.back());
+      continue;
+    }
+
+    int length = (peptide != NULL) ? peptide->getLength() : strlen(xpeptide.getSequence());
+    lengths_.push_back(length);
+    fragment_begins_.push_back(b_masses_.size());
+
+    MODIFIED_AA_T* mod_seq = xpeptide.getModifiedSequence();
+    mass_matrix.resize(length + 1);
+    mass_matrix[0] = 0;
+    for (int aa_idx = 1; aa_idx <= length; aa_idx++) {
+      mass_matrix[aa_idx] = mass_matrix[aa_idx-1] +
+        get_mass_mod_amino_acid(mod_seq[aa_idx-1], MONO);
+    }
+    freeModSeq(mod_seq);
+
+    for (int cleavage_idx = 1; cleavage_idx < length; cleavage_idx++) {
+      b_masses_.push_back(mass_matrix[cleavage_idx]);
+      y_masses_.push_back(mass_matrix[length] - mass_matrix[length - cleavage_idx] + MASS_H2O_MONO);
+    }
+  }
+  carp(CARP_DEBUG, "Stored %d fragment masses for %d xlinkable peptides",
+       b_masses_.size(), num_peptides);
+}
+
+/**
+ * Frees the fragment masses
+ */
+void XLinkableFragmentStore::clear() {
+  xpeptides_ = NULL;
+  vector<FLOAT_T>().swap(masses_);
+  vector<FLOAT_T>().swap(mono_masses_);
+  vector<int>().swap(link_sites_);
+  vector<int>().swap(lengths_);
+  vector<size_t>().swap(fragment_begins_);
+  vector<FLOAT_T>().swap(b_masses_);
+  vector<FLOAT_T>().swap(y_masses_);
+}
+
+size_t XLinkableFragmentStore::size() const {
+  return masses_.size();
+}
+
+size_t XLinkableFragmentStore::lowerBound(FLOAT_T min_mass) const {
+  return lower_bound(masses_.begin(), masses_.end(), min_mass) - masses_.begin();
+}
+
+size_t XLinkableFragmentStore::upperBound(FLOAT_T max_mass) const {
+  return upper_bound(masses_.begin(), masses_.end(), max_mass) - masses_.begin();
+}
+
+FLOAT_T XLinkableFragmentStore::getMonoMass(size_t idx) const {
+  return mono_masses_[idx];
+}
+
+XLinkablePeptide& XLinkableFragmentStore::getXLinkablePeptide(size_t idx) const {
+  return (*xpeptides_)[idx];
+}
+
+/**
+ * Fills the xcorr ions of a peptide: for each cleavage, the a, b and y ions
+ * at each charge.  Forward ions past the link site and reverse ions that
+ * contain it carry mod_mass, as in XLinkablePeptide::predictIons.
+ * \returns the number of ions
+ */
+int XLinkableFragmentStore::predictIons(
+  size_t idx, ///< index of the peptide
+  int max_charge, ///< highest ion charge
+  FLOAT_T mod_mass, ///< mass added at the link site
+  vector<ION_TYPE_T>& ion_types, ///< type of each ion -out
+  vector<int>& ion_charges, ///< charge of each ion -out
+  vector<FLOAT_T>& ion_mass_zs ///< m/z of each ion -out
+  ) const {
+
+  int length = lengths_[idx];
+  int link_site = link_sites_[idx];
+  size_t begin = fragment_begins_[idx];
+  size_t num_ions = 3 * (length - 1) * max_charge;
+  ion_types.resize(num_ions);
+  ion_charges.resize(num_ions);
+  ion_mass_zs.resize(num_ions);
+
+  size_t ion_idx = 0;
+  for (int cleavage_idx = 1; cleavage_idx < length; cleavage_idx++) {
+    FLOAT_T b_mass = b_masses_[begin + cleavage_idx - 1];
+    FLOAT_T y_mass = y_masses_[begin + cleavage_idx - 1];
+    if (cleavage_idx > link_site) {
+      b_mass += mod_mass;
+    }
+    if (cleavage_idx >= length - link_site) {
+      y_mass += mod_mass;
+    }
+    FLOAT_T a_mass = b_mass - MASS_CO_MONO;
+    for (int charge = 1; charge <= max_charge; charge++, ion_idx++) {
+      ion_types[ion_idx] = A_ION;
+      ion_charges[ion_idx] = charge;
+      ion_mass_zs[ion_idx] = (a_mass + MASS_H_MONO * charge) / charge;
+    }
+    for (int charge = 1; charge <= max_charge; charge++, ion_idx++) {
+      ion_types[ion_idx] = B_ION;
+      ion_charges[ion_idx] = charge;
+      ion_mass_zs[ion_idx] = (b_mass + MASS_H_MONO * charge) / charge;
+    }
+    for (int charge = 1; charge <= max_charge; charge++, ion_idx++) {
+      ion_types[ion_idx] = Y_ION;
+      ion_charges[ion_idx] = charge;
+      ion_mass_zs[ion_idx] = (y_mass + MASS_H_MONO * charge) / charge;
+    }
+  }
+  return ion_idx;
+}
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 2
+ * End:
+ */
@@ -0,0 +1,100 @@
+/**
+ * \file XLinkableFragmentStore.h
+ * \brief Fragment masses of the flattened xlinkable peptides, for scoring
+ * them without building ion series.
+ *
+ * The top-n search scores every xlinkable peptide in a precursor window
+ * against each spectrum. Rather than predicting an IonSeries of Ion objects
+ * for each of them, the store computes the neutral b and y fragment masses
+ * of every peptide once, when the database is built, and keeps them in flat
+ * arrays in the mass order of the flattened peptides. Peptides that differ
+ * only in their link site share their fragment masses.
+ *****************************************************************************/
+
+#ifndef XLINKABLEFRAGMENTSTORE_H_
+#define XLINKABLEFRAGMENTSTORE_H_
+
+#include "model/objects.h"
+#include "XLinkablePeptide.h"
+
+#include <vector>
+
+class XLinkableFragmentStore {
+ protected:
+  std::vector<XLinkablePeptide>* xpeptides_; ///< the flattened peptides
+  std::vector<FLOAT_T> masses_; ///< mass of each peptide, as used to find candidates
+  std::vector<FLOAT_T> mono_masses_; ///< monoisotopic mass of each peptide
+  std::vector<int> link_sites_; ///< sequence index of each peptide's link site
+  std::vector<int> lengths_; ///< length of each peptide
+  std::vector<size_t> fragment_begins_; ///< index of each peptide's first fragment
+  std::vector<FLOAT_T> b_masses_; ///< neutral b ion mass of each cleavage
+  std::vector<FLOAT_T> y_masses_; ///< neutral y ion mass of each cleavage
+
+ public:
+  /**
+   * Creates an empty store
+   */
+  XLinkableFragmentStore();
+
+  /**
+   * Computes the fragment masses of flattened xlinkable peptides, which
+   * must be sorted by mass and must outlive the store
+   */
+  void build(
+    std::vector<XLinkablePeptide>& xpeptides ///< flattened peptides
+  );
+
+  /**
+   * Frees the fragment masses
+   */
+  void clear();
+
+  /**
+   * \returns the number of peptides in the store
+   */
+  size_t size() const;
+
+  /**
+   * \returns the index of the first peptide whose mass is not below min_mass
+   */
+  size_t lowerBound(FLOAT_T min_mass) const;
+
+  /**
+   * \returns the index of the first peptide whose mass is above max_mass
+   */
+  size_t upperBound(FLOAT_T max_mass) const;
+
+  /**
+   * \returns the monoisotopic mass of a peptide
+   */
+  FLOAT_T getMonoMass(size_t idx) const;
+
+  /**
+   * \returns the flattened peptide at an index
+   */
+  XLinkablePeptide& getXLinkablePeptide(size_t idx) const;
+
+  /**
+   * Fills the type, charge and m/z of the xcorr ions of a peptide, in the
+   * order that IonSeries predicts them. Ions that contain the link site
+   * are shifted by mod_mass.
+   * \returns the number of ions
+   */
+  int predictIons(
+    size_t idx, ///< index of the peptide
+    int max_charge, ///< highest ion charge
+    FLOAT_T mod_mass, ///< mass added at the link site
+    std::vector<ION_TYPE_T>& ion_types, ///< type of each ion -out
+    std::vector<int>& ion_charges, ///< charge of each ion -out
+    std::vector<FLOAT_T>& ion_mass_zs ///< m/z of each ion -out
+  ) const;
+};
+
+#endif
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 2
+ * End:
+ */
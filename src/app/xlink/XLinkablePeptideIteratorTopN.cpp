@@ -12,6 +12,7 @@
 #include "XLinkScorer.h"
 #include "XLinkDatabase.h"
 #include "util/GlobalParams.h"
+#include <algorithm>
 #include <iostream>
 
 
@@ -39,15 +40,11 @@ XLinkablePeptideIteratorTopN::XLinkablePeptideIteratorTopN(
   //carp(CARP_DEBUG, "precursor:%g", precursor_mass); 
   //carp(CARP_INFO, "min:%g", min_mass);
   //carp(CARP_INFO, "max:%g", max_mass);
-  vector<XLinkablePeptide>::iterator xlp_biter = XLinkDatabase::getXLinkableFlattenBegin(is_decoy, min_mass);
-  vector<XLinkablePeptide>::iterator xlp_eiter = XLinkDatabase::getXLinkableFlattenEnd(is_decoy, max_mass);
- 
-  int nscore = xlp_eiter - xlp_biter;
-//  if (nscore > top_n_) {
-    scorePeptides(scorer, precursor_mass, xlp_biter, xlp_eiter);
-//  } else {
-//    scored_xlp_.insert(scored_xlp_.begin(), xlp_biter, xlp_eiter);
-//  }
+  XLinkableFragmentStore& fragments = XLinkDatabase::getXLinkableFragments(is_decoy);
+  size_t begin_idx = fragments.lowerBound(min_mass);
+  size_t end_idx = fragments.upperBound(max_mass);
+
+  scorePeptides(scorer, precursor_mass, fragments, begin_idx, end_idx);
   
   //find the begin and end iterators for the given mass range.
   /*
@@ -73,31 +70,50 @@ XLinkablePeptideIteratorTopN::XLinkablePeptideIteratorTopN(
 
 }
 
+/**
+ * orders scored peptides by highest XCorr score
+ */
+static bool compareXCorrScores(
+  const pair<FLOAT_T, size_t>& score1,
+  const pair<FLOAT_T, size_t>& score2
+  ) {
+  return score1.first > score2.first;
+}
+
 void XLinkablePeptideIteratorTopN::scorePeptides(
   XLinkScorer& scorer, 
   FLOAT_T precursor_mass, 
-  vector<XLinkablePeptide>::iterator& biter, 
-  vector<XLinkablePeptide>::iterator& eiter
+  XLinkableFragmentStore& fragments,
+  size_t begin_idx,
+  size_t end_idx
   ) {
 
-  scored_xlp_.clear();
-  while(biter != eiter) {
-    XLinkablePeptide& pep1 = *biter;
-    FLOAT_T delta_mass = precursor_mass - pep1.getMass(MONO);// - XLinkPeptide::getLinkerMass();
-    FLOAT_T xcorr = scorer.scoreXLinkablePeptide(pep1, 0, delta_mass);
-    pep1.setXCorr(0, xcorr);
-    //pep1.getXCorr();
-    scored_xlp_.push_back(&pep1);
-    biter++;
+  // The peptides belong to the database, which other searches may be
+  // reading, so their scores are kept here and only the top n copies
+  // are given them.  Candidates are scored from their precomputed
+  // fragment masses, so no ion series is built for them.
+  vector<pair<FLOAT_T, size_t> > scores;
+  scores.reserve(max(end_idx, begin_idx) - begin_idx);
+  for (size_t idx = begin_idx; idx < end_idx; idx++) {
+    FLOAT_T delta_mass = precursor_mass - fragments.getMonoMass(idx);// - XLinkPeptide::getLinkerMass();
+    FLOAT_T xcorr = scorer.scoreXLinkablePeptide(fragments, idx, delta_mass);
+    scores.push_back(make_pair(xcorr, idx));
   }
-  if (scored_xlp_.size() > 0) {
-    sort(scored_xlp_.begin(), scored_xlp_.end(), compareXLinkableXCorrPtr);
+  size_t num_top = min((size_t)max(top_n_, 0), scores.size());
+  partial_sort(scores.begin(), scores.begin() + num_top, scores.end(),
+               compareXCorrScores);
+
+  scored_xlp_.clear();
+  scored_xlp_.reserve(num_top);
+  for (size_t idx = 0;idx < num_top;idx++) {
+    scored_xlp_.push_back(fragments.getXLinkablePeptide(scores[idx].second));
+    scored_xlp_.back().setXCorr(0, scores[idx].first);
   }
  
   IF_CARP(CARP_DETAILED_DEBUG,
-    for (size_t idx = 0;idx < min((size_t)top_n_,scored_xlp_.size());idx++) {
-      string seq = scored_xlp_[idx]->getModifiedSequenceString();
-      carp(CARP_INFO,"%d %g %s", idx, scored_xlp_[idx]->getXCorr(), seq.c_str());
+    for (size_t idx = 0;idx < scored_xlp_.size();idx++) {
+      string seq = scored_xlp_[idx].getModifiedSequenceString();
+      carp(CARP_INFO,"%d %g %s", idx, scored_xlp_[idx].getXCorr(), seq.c_str());
     }
   );
 }
@@ -141,7 +157,7 @@ XLinkablePeptide& XLinkablePeptideIteratorTopN::next() {
     carp(CARP_FATAL, "next called on empty iterator!");
   }
 
-  XLinkablePeptide& ans = *scored_xlp_[current_count_-1];
+  XLinkablePeptide& ans = scored_xlp_[current_count_-1];
   //carp(CARP_INFO, "next peptide:%s %g", ans.getSequence(), ans.getXCorr());
   queueNextPeptide();
   //carp(CARP_INFO, "XLinkablePeptideIteratorTopN: returning reference");
@@ -153,7 +169,7 @@ XLinkablePeptide* XLinkablePeptideIteratorTopN::nextPtr() {
     carp(CARP_FATAL, "next called on empty iterator!");
   }
   
-  XLinkablePeptide* ans = scored_xlp_[current_count_-1];
+  XLinkablePeptide* ans = &scored_xlp_[current_count_-1];
   queueNextPeptide();
   return ans;
   
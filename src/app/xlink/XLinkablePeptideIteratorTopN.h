@@ -12,6 +12,7 @@
 #include "XLinkablePeptide.h"
 #include "XLinkBondMap.h"
 #include "XLinkScorer.h"
+#include "XLinkableFragmentStore.h"
 #include <queue>
 #include <vector>
 
@@ -21,7 +22,7 @@ class XLinkablePeptideIteratorTopN: public XLinkablePeptideIterator {
  protected:
 
   //std::priority_queue<XLinkablePeptide, std::vector<XLinkablePeptide>, CompareXCorr> scored_xlp_;  
-  std::vector<XLinkablePeptide*> scored_xlp_; ///< sorted by highest XCorr score.
+  std::vector<XLinkablePeptide> scored_xlp_; ///< copies of the top n, sorted by highest XCorr score.
   int current_count_;
   int top_n_; ///<set by kojak-top-n
   bool has_next_; ///< is there a next candidate
@@ -35,8 +36,9 @@ class XLinkablePeptideIteratorTopN: public XLinkablePeptideIterator {
   void scorePeptides(
     XLinkScorer& scorer,
     FLOAT_T precursor_mass,
-    std::vector<XLinkablePeptide>::iterator& biter,
-    std::vector<XLinkablePeptide>::iterator& eiter
+    XLinkableFragmentStore& fragments,
+    size_t begin_idx,
+    size_t end_idx
   );
 
  public:
@@ -29,9 +29,13 @@
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <map>
 
 #include <ctime>
 
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
 
 
 using namespace std;
@@ -100,7 +104,321 @@ void writeTrainingCandidates(XLinkMatchCollection* training_candidates, int scan
 
 
 /**
- * main method for SearchForXLinks that implements the refactored code
+ * Weibull training candidates shared by the spectra of one charge whose
+ * precursor masses fall in the same weibull-mass-bin. The first of those
+ * spectra in the file generates them.
+ */
+struct XLinkWeibullBin {
+  size_t owner; ///< the item that generates the candidates
+  XLinkMatchCollection* training_candidates; ///< unscored, NULL if there were none
+  Weibull weibull; ///< fit to the owner's scores, if reuse-weibull-fits
+  bool fit_success;
+  set<Crux::Peptide*> peptides; ///< peptides allocated for the decoys
+  bool ready; ///< has the owner generated the candidates
+};
+
+/**
+ * A spectrum and charge state to search and, once it has been searched,
+ * the matches waiting to be written.
+ */
+struct XLinkSearchItem {
+  Crux::Spectrum* spectrum;
+  SpectrumZState zstate;
+  XLinkWeibullBin* weibull_bin; ///< NULL unless weibull-mass-bin is set
+  XLinkMatchCollection* target_candidates; ///< NULL if there were none
+  XLinkMatchCollection* decoy_candidates;
+  set<Crux::Peptide*> peptides; ///< peptides allocated for the decoys
+  bool searched;
+};
+
+/**
+ * The spectrum-charge pairs of one ms2 file, shared by the threads that
+ * search them and the thread that writes their matches in order.
+ */
+struct XLinkSearchQueue {
+  vector<XLinkSearchItem> items;
+  size_t next_item; ///< next item to search
+  size_t num_written; ///< items written so far
+  size_t max_ahead; ///< most items searched ahead of the writer
+  unsigned seed; ///< decoys of item i are shuffled with seed + i
+  string ms2_file;
+  FLOAT_T min_pvalue;
+  vector<XLinkWeibullBin*> weibull_bins;
+  boost::mutex mutex;
+  boost::condition_variable changed;
+};
+
+/**
+ * \returns unscored candidates for fitting the Weibull distribution of a
+ * spectrum-charge pair: the targets in the precursor-window-weibull and
+ * enough shuffled decoys of them to reach min-weibull-points.
+ */
+static XLinkMatchCollection* createTrainingCandidates(
+  Crux::Spectrum* spectrum, ///< the spectrum
+  SpectrumZState& zstate, ///< its charge state
+  int min_weibull_points ///< fewest candidates to return
+  ) {
+
+  XLinkMatchCollection *target_train_candidates =
+    new XLinkMatchCollection(
+      spectrum,
+      zstate,
+      false,
+      true);
+  XLinkMatchCollection *train_candidates =
+    new XLinkMatchCollection(
+      spectrum,
+      zstate,
+      true,
+      true
+      );
+
+  for (size_t idx=0;idx < target_train_candidates->getMatchTotal();idx++) {
+    train_candidates->add(target_train_candidates->at(idx), true);
+  }
+  while(train_candidates->getMatchTotal() < min_weibull_points &&
+        target_train_candidates->getMatchTotal() > 0) {
+    target_train_candidates->shuffle(*train_candidates);
+  }
+  carp(CARP_DEBUG, "Delete target train candidates.");
+  delete target_train_candidates;
+  return train_candidates;
+}
+
+/**
+ * Generates the training candidates of a Weibull bin for its owner and,
+ * if reuse-weibull-fits is set, fits the bin's Weibull to their scores
+ * against the owner's spectrum. Wakes the items waiting for the bin.
+ */
+static void createWeibullBin(
+  XLinkSearchQueue* queue, ///< the file being searched
+  XLinkSearchItem& item, ///< the bin's owner
+  int min_weibull_points ///< fewest training candidates
+  ) {
+
+  XLinkWeibullBin* bin = item.weibull_bin;
+  XLinkMatchCollection* training_candidates =
+    createTrainingCandidates(item.spectrum, item.zstate, min_weibull_points);
+  // The decoys are shared, so they live until the whole file is written.
+  XLink::takeAllocatedPeptides(bin->peptides);
+
+  if (training_candidates->getMatchTotal() == 0) {
+    delete training_candidates;
+    training_candidates = NULL;
+  } else if (Params::GetBool("reuse-weibull-fits")) {
+    XLinkMatchCollection scored_candidates(*training_candidates);
+    scored_candidates.scoreSpectrum(item.spectrum);
+    for (int idx = 0;idx < scored_candidates.getMatchTotal();idx++) {
+      const string& sequence = scored_candidates[idx]->getSequenceStringConst();
+      FLOAT_T score = scored_candidates[idx]->getScore(XCORR);
+      bin->weibull.addPoint(sequence, score);
+    }
+    bin->fit_success = bin->weibull.fit();
+    if (!bin->fit_success || Params::GetBool("write-weibull-points")) {
+      writeTrainingCandidates(&scored_candidates, item.spectrum->getFirstScan(), bin->weibull);
+    }
+  }
+
+  boost::mutex::scoped_lock lock(queue->mutex);
+  bin->training_candidates = training_candidates;
+  bin->ready = true;
+  queue->changed.notify_all();
+}
+
+/**
+ * Scores the candidates and decoys of one spectrum-charge pair, computes
+ * their p-values if requested, and ranks them for writing.
+ */
+static void searchSpectrumCharge(
+  XLinkSearchQueue* queue, ///< the file being searched
+  size_t item_idx ///< the item to search
+  ) {
+
+  XLinkSearchItem& item = queue->items[item_idx];
+  Crux::Spectrum* spectrum = item.spectrum;
+  SpectrumZState& zstate = item.zstate;
+  int scan_num = spectrum->getFirstScan();
+  int top_match = Params::GetInt("top-match");
+  int min_weibull_points = Params::GetInt("min-weibull-points");
+
+  // Decoys are the same whichever thread searches the item.
+  mysrandom_thread(queue->seed + item_idx);
+
+  bool compute_pvalues = Params::GetBool("compute-p-values");
+  XLinkWeibullBin* bin = item.weibull_bin;
+  if (compute_pvalues && bin != NULL && bin->owner == item_idx) {
+    createWeibullBin(queue, item, min_weibull_points);
+  }
+
+  XLinkMatchCollection* target_candidates =
+    new XLinkMatchCollection(
+      spectrum,
+      zstate,
+      false,
+      false
+      );
+
+  if (target_candidates->getMatchTotal() < 0) {
+    carp(CARP_ERROR, "Scan %d has %d candidates.", scan_num, 
+         target_candidates->getMatchTotal());
+  } else if (target_candidates->getMatchTotal() == 0) {
+    carp(CARP_DETAILED_INFO, "Skipping scan %d charge %d mass %lg", 
+         scan_num, 
+         zstate.getCharge(),
+         zstate.getNeutralMass()
+         );
+    delete target_candidates;
+    XLink::takeAllocatedPeptides(item.peptides);
+    return;
+  }
+
+  carp(CARP_DETAILED_INFO, "Scan=%d charge=%d mass=%lg candidates=%d", 
+       scan_num, 
+       zstate.getCharge(), 
+       zstate.getNeutralMass(), 
+       target_candidates->getMatchTotal());   
+
+  // Score targets.
+  target_candidates->scoreSpectrum(spectrum);
+
+  // Score decoys.
+  carp(CARP_DEBUG, "Getting decoy candidates.");
+  XLinkMatchCollection* decoy_candidates = new XLinkMatchCollection();
+  target_candidates->shuffle(*decoy_candidates);
+  carp(CARP_DEBUG, "Scoring decoys.");
+  decoy_candidates->scoreSpectrum(spectrum);
+  
+  if (compute_pvalues) {
+    // Spectra in a Weibull bin wait for its owner, which was searched
+    // before them, to generate the training candidates.
+    if (bin != NULL) {
+      boost::mutex::scoped_lock lock(queue->mutex);
+      while (!bin->ready) {
+        queue->changed.wait(lock);
+      }
+    }
+
+    //class for estimating pvalues.
+    Weibull local_weibull;
+    Weibull* weibull = &local_weibull;
+    XLinkMatchCollection* train_candidates = NULL;
+    bool write_weibull_points;
+    if (bin != NULL && bin->training_candidates != NULL &&
+        Params::GetBool("reuse-weibull-fits")) {
+      weibull = &bin->weibull;
+      write_weibull_points = !bin->fit_success;
+    } else {
+      if (bin != NULL && bin->training_candidates != NULL) {
+        train_candidates = new XLinkMatchCollection(*bin->training_candidates);
+      } else {
+        train_candidates = createTrainingCandidates(spectrum, zstate, min_weibull_points);
+      }
+      train_candidates->scoreSpectrum(spectrum);
+      for (int idx = 0;idx < train_candidates->getMatchTotal();idx++) {
+        const string& sequence = (*train_candidates)[idx]->getSequenceStringConst();
+        FLOAT_T score = (*train_candidates)[idx]->getScore(XCORR);
+        weibull->addPoint(sequence, score);
+      }
+      write_weibull_points = !weibull->fit();
+    }
+    
+    target_candidates->sort(XCORR);
+    
+    
+    // Calculate pvalues.
+    int nprint = min(top_match,target_candidates->getMatchTotal());
+    carp(CARP_DEBUG, "Calculating %d target p-values.", nprint);
+    for (int idx=0;idx < nprint;idx++) {
+      FLOAT_T score = (*target_candidates)[idx]->getScore(XCORR);
+      (*target_candidates)[idx]->setPValue(weibull->getPValue(score));
+    }
+    
+    nprint = min(top_match, (int)decoy_candidates->getMatchTotal());
+    carp(CARP_DEBUG, "Calculating %d decoy p-values.", nprint);
+    decoy_candidates->sort(XCORR);
+    for (int idx=0;idx < nprint;idx++) {
+      FLOAT_T score = (*decoy_candidates)[idx]->getScore(XCORR);
+      (*decoy_candidates)[idx]->setPValue(weibull->getPValue(score));
+      FLOAT_T wpvalue = weibull->getWeibullPValue(score);
+      FLOAT_T bpvalue = bonferroni_correction(wpvalue, decoy_candidates->getMatchTotal()) * 2.0;
+      if ((wpvalue == 0) || (wpvalue != wpvalue) || (bpvalue  < queue->min_pvalue)) {
+        //If we have a bad fit, 0 or too low pvalue, print out the points.
+        write_weibull_points = true;
+      }
+    
+    }
+  
+  
+    if (train_candidates != NULL &&
+        (write_weibull_points || Params::GetBool("write-weibull-points"))) {
+      writeTrainingCandidates(train_candidates, scan_num, *weibull);
+    }
+    carp(CARP_DEBUG, "Delete train candidates.");
+    delete train_candidates;
+    
+  } // if (compute_p_values)
+  
+  target_candidates->setFilePath(queue->ms2_file);
+  decoy_candidates->setFilePath(queue->ms2_file);
+
+  if (Params::GetBool("concat")) {
+    for (size_t idx=0;idx < decoy_candidates->getMatchTotal();idx++) {
+      target_candidates->add(decoy_candidates->at(idx), true);
+    }
+  } else {
+    if (decoy_candidates->getScoredType(SP) == true) {
+      decoy_candidates->populateMatchRank(SP);
+    }
+    decoy_candidates->populateMatchRank(XCORR);
+    decoy_candidates->sort(XCORR);
+  }
+  
+  carp(CARP_DEBUG, "Ranking.");
+  
+  if (target_candidates->getScoredType(SP) == true) {
+    target_candidates->populateMatchRank(SP);
+  }
+  target_candidates->populateMatchRank(XCORR);
+  target_candidates->sort(XCORR);
+
+  item.target_candidates = target_candidates;
+  item.decoy_candidates = decoy_candidates;
+  // The decoys' peptides are deleted once they have been written.
+  XLink::takeAllocatedPeptides(item.peptides);
+}
+
+/**
+ * Searches the items of the queue in turn until there are none left,
+ * staying no more than max_ahead items ahead of the writer.
+ */
+static void searchSpectrumCharges(
+  XLinkSearchQueue* queue ///< the file being searched
+  ) {
+
+  while (true) {
+    size_t item_idx;
+    {
+      boost::mutex::scoped_lock lock(queue->mutex);
+      while (queue->next_item < queue->items.size() &&
+             queue->next_item >= queue->num_written + queue->max_ahead) {
+        queue->changed.wait(lock);
+      }
+      if (queue->next_item >= queue->items.size()) {
+        return;
+      }
+      item_idx = queue->next_item++;
+    }
+    searchSpectrumCharge(queue, item_idx);
+    boost::mutex::scoped_lock lock(queue->mutex);
+    queue->items[item_idx].searched = true;
+    queue->changed.notify_all();
+  }
+}
+
+/**
+ * main method for SearchForXLinks that implements the refactored code.
+ * The spectrum-charge pairs of each file are searched on num-threads
+ * threads, and their matches are written in the order of the file.
  */
 int SearchForXLinks::xlinkSearchMain() {
   
@@ -113,10 +431,17 @@ int SearchForXLinks::xlinkSearchMain() {
 
   string input_file = Params::GetString("protein fasta file");
   string output_directory = Params::GetString("output-dir");
-  int top_match = Params::GetInt("top-match");
   XLinkPeptide::setLinkerMass(Params::GetDouble("link mass"));
-  int min_weibull_points = Params::GetInt("min-weibull-points");
   bool compute_pvalues = Params::GetBool("compute-p-values");
+  FLOAT_T weibull_mass_bin = Params::GetDouble("weibull-mass-bin");
+  if (Params::GetBool("reuse-weibull-fits") && weibull_mass_bin <= 0) {
+    carp(CARP_FATAL, "reuse-weibull-fits requires weibull-mass-bin to be greater than 0.");
+  }
+  int num_threads = Params::GetInt("num-threads");
+  if (num_threads < 1) {
+    num_threads = boost::thread::hardware_concurrency();
+  }
+  num_threads = max(num_threads, 1);
 
   /* Prepare input fasta  */
   carp(CARP_INFO, "Preparing database.");
@@ -145,7 +470,6 @@ int SearchForXLinks::xlinkSearchMain() {
     string ms2_file = *ms2_file_iter;
     
     carp(CARP_INFO, "Loading spectra %s.", ms2_file.c_str());
-    Crux::Spectrum* spectrum = NULL;
     Crux::SpectrumCollection* spectra =
       SpectrumCollectionFactory::create(ms2_file);
     spectra->parse();
@@ -153,196 +477,120 @@ int SearchForXLinks::xlinkSearchMain() {
     FilteredSpectrumChargeIterator* spectrum_iterator =
       new FilteredSpectrumChargeIterator(spectra);
 
+    XLinkSearchQueue queue;
+    map<pair<int, long long>, XLinkWeibullBin*> weibull_bins;
+    while (spectrum_iterator->hasNext()) {
+      XLinkSearchItem item;
+      item.spectrum = spectrum_iterator->next(zstate);
+      item.zstate = zstate;
+      item.weibull_bin = NULL;
+      if (compute_pvalues && weibull_mass_bin > 0) {
+        pair<int, long long> bin_key(zstate.getCharge(),
+          (long long)floor(zstate.getNeutralMass() / weibull_mass_bin));
+        XLinkWeibullBin*& bin = weibull_bins[bin_key];
+        if (bin == NULL) {
+          bin = new XLinkWeibullBin();
+          bin->owner = queue.items.size();
+          bin->training_candidates = NULL;
+          bin->fit_success = false;
+          bin->ready = false;
+          queue.weibull_bins.push_back(bin);
+        }
+        item.weibull_bin = bin;
+      }
+      item.target_candidates = NULL;
+      item.decoy_candidates = NULL;
+      item.searched = false;
+      queue.items.push_back(item);
+    }
+    queue.next_item = 0;
+    queue.num_written = 0;
+    queue.max_ahead = 4 * num_threads;
+    queue.seed = myrandom();
+    queue.ms2_file = ms2_file;
 
-    // main loop over spectra in ms2 file
-    int scan_num = 0;
     int skipped_no_candidates = 0;
     int search_count = 0;
     FLOAT_T num_spectra = (FLOAT_T)spectra->getNumSpectra();
-    FLOAT_T min_pvalue = 1.0 / num_spectra;
-    //class for estimating pvalues.
-    Weibull weibull;
+    queue.min_pvalue = 1.0 / num_spectra;
   
     // for every observed spectrum 
-    carp(CARP_INFO, "Beginning search.");
+    carp(CARP_INFO, "Beginning search on %d threads.", num_threads);
     int print_interval = Params::GetInt("print-search-progress");
 
-    while (spectrum_iterator->hasNext()) {
+    boost::thread_group threads;
+    for (int thread_idx = 0; thread_idx < num_threads; thread_idx++) {
+      threads.create_thread(boost::bind(&searchSpectrumCharges, &queue));
+    }
 
-      spectrum = spectrum_iterator->next(zstate);
-      scan_num = spectrum->getFirstScan();
-      
-      if (print_interval > 0 && search_count > 0 && search_count % print_interval == 0) {
-	carp(CARP_INFO, 
-	     "%d spectrum-charge combinations searched, %.0f%% complete",
-	     search_count + spectrum_iterator->numSkipped(),
-	     (search_count + spectrum_iterator->numSkipped()) / num_spectra * 100);
+    // write the matches of each spectrum as soon as it and all the ones
+    // before it have been searched
+    for (size_t item_idx = 0; item_idx < queue.items.size(); item_idx++) {
+      XLinkSearchItem& item = queue.items[item_idx];
+      {
+        boost::mutex::scoped_lock lock(queue.mutex);
+        while (!item.searched) {
+          queue.changed.wait(lock);
+        }
       }
-      search_count++;
 
-      FLOAT_T precursor_mz = spectrum->getPrecursorMz();
-
-      XLinkMatchCollection* target_candidates =
-	new XLinkMatchCollection(
-				 spectrum,
-				 zstate,
-				 false,
-				 false
-				 );
-
-      if (target_candidates->getMatchTotal() < 0) {
-	carp(CARP_ERROR, "Scan %d has %d candidates.", scan_num, 
-	     target_candidates->getMatchTotal());
-      } else if (target_candidates->getMatchTotal() == 0) {
-	skipped_no_candidates++;
-	carp(CARP_DETAILED_INFO, "Skipping scan %d charge %d mass %lg", 
-	     scan_num, 
-	     zstate.getCharge(),
-	     zstate.getNeutralMass()
-	     );
-	delete target_candidates;
-	//XLink::deleteAllocatedPeptides();
-	continue;
+      if (print_interval > 0 && search_count > 0 && search_count % print_interval == 0) {
+        carp(CARP_INFO, 
+             "%d spectrum-charge combinations searched, %.0f%% complete",
+             search_count + spectrum_iterator->numSkipped(),
+             (search_count + spectrum_iterator->numSkipped()) / num_spectra * 100);
       }
+      search_count++;
 
-      carp(CARP_DETAILED_INFO, "Scan=%d charge=%d mass=%lg candidates=%d", 
-	   scan_num, 
-	   zstate.getCharge(), 
-	   zstate.getNeutralMass(), 
-	   target_candidates->getMatchTotal());   
-
-      // Score targets.
-      target_candidates->scoreSpectrum(spectrum);
-
-      // Score decoys.
-      carp(CARP_DEBUG, "Getting decoy candidates.");
-      XLinkMatchCollection* decoy_candidates = new XLinkMatchCollection();
-      target_candidates->shuffle(*decoy_candidates);
-      carp(CARP_DEBUG, "Scoring decoys.");
-      decoy_candidates->scoreSpectrum(spectrum);
-      
-      if (compute_pvalues) {
-	weibull.reset();
-	XLinkMatchCollection *target_train_candidates =
-	  new XLinkMatchCollection(
-				   spectrum,
-				   zstate,
-				   false,
-				   true);
-	XLinkMatchCollection *train_candidates =
-	  new XLinkMatchCollection(
-				   spectrum,
-				   zstate,
-				   true,
-				   true
-				   );
-      
-	for (size_t idx=0;idx < target_train_candidates->getMatchTotal();idx++) {
-	  train_candidates->add(target_train_candidates->at(idx), true);
-	}
-	while(train_candidates->getMatchTotal() < min_weibull_points) {
-	  target_train_candidates->shuffle(*train_candidates);
-	}
-	train_candidates->scoreSpectrum(spectrum);
-	for (int idx = 0;idx < train_candidates->getMatchTotal();idx++) {
-	  const string& sequence = (*train_candidates)[idx]->getSequenceStringConst();
-	  FLOAT_T score = (*train_candidates)[idx]->getScore(XCORR);
-	  weibull.addPoint(sequence, score);
-	}
-	bool write_weibull_points = !weibull.fit();
-	
-	target_candidates->sort(XCORR);
-	
-	
-	// Calculate pvalues.
-	int nprint = min(top_match,target_candidates->getMatchTotal());
-	carp(CARP_DEBUG, "Calculating %d target p-values.", nprint);
-	for (int idx=0;idx < nprint;idx++) {
-	  FLOAT_T score = (*target_candidates)[idx]->getScore(XCORR);
-	  (*target_candidates)[idx]->setPValue(weibull.getPValue(score));
-	}
-	
-	nprint = min(top_match, (int)decoy_candidates->getMatchTotal());
-	carp(CARP_DEBUG, "Calculating %d decoy p-values.", nprint);
-	decoy_candidates->sort(XCORR);
-	for (int idx=0;idx < nprint;idx++) {
-	  FLOAT_T score = (*decoy_candidates)[idx]->getScore(XCORR);
-	  (*decoy_candidates)[idx]->setPValue(weibull.getPValue(score));
-	  FLOAT_T wpvalue = weibull.getWeibullPValue(score);
-	  FLOAT_T bpvalue = bonferroni_correction(wpvalue, decoy_candidates->getMatchTotal()) * 2.0;
-	  if ((wpvalue == 0) || (wpvalue != wpvalue) || (bpvalue  < min_pvalue)) {
-	    //If we have a bad fit, 0 or too low pvalue, print out the points.
-	    write_weibull_points = true;
-	  }
-        
-	}
-      
-      
-	if (write_weibull_points || Params::GetBool("write-weibull-points")) {
-	  writeTrainingCandidates(train_candidates, scan_num, weibull);
-	}
-	carp(CARP_DEBUG, "Delete train candidates.");
-	delete train_candidates;
-	carp(CARP_DEBUG, "Delete target train candidates.");
-	delete target_train_candidates;
-	
-      } // if (compute_p_values)
-      
-      //print out
-      target_candidates->setFilePath(ms2_file);
-      decoy_candidates->setFilePath(ms2_file);
-      vector<MatchCollection*> decoy_vec;
-    
-      if (Params::GetBool("concat")) {
-	for (size_t idx=0;idx < decoy_candidates->getMatchTotal();idx++) {
-	  target_candidates->add(decoy_candidates->at(idx), true);
-	}
+      if (item.target_candidates == NULL) {
+        skipped_no_candidates++;
       } else {
-	
-	decoy_vec.push_back(decoy_candidates);
-
-	if (decoy_candidates->getScoredType(SP) == true) {
-	  decoy_candidates->populateMatchRank(SP);
-	}
-	decoy_candidates->populateMatchRank(XCORR);
-	decoy_candidates->sort(XCORR);
-      }
-      
-      carp(CARP_DEBUG, "Ranking.");
-      
-      if (target_candidates->getScoredType(SP) == true) {
-	target_candidates->populateMatchRank(SP);
+        vector<MatchCollection*> decoy_vec;
+        if (!Params::GetBool("concat")) {
+          decoy_vec.push_back(item.decoy_candidates);
+        }
+        carp(CARP_DEBUG, "Writing results.");
+        output_files.writeMatches(
+          (MatchCollection*)item.target_candidates, 
+          decoy_vec,
+          XCORR,
+          item.spectrum);
+
+        /* Clean up */
+        carp(CARP_DEBUG, "Deleting decoy candidates.");
+        delete item.decoy_candidates;
+        carp(CARP_DEBUG, "Deleting target candidates.");
+        delete item.target_candidates;
+        item.target_candidates = NULL;
+        item.decoy_candidates = NULL;
+        carp(CARP_DEBUG, "Done with spectrum %d.", item.spectrum->getFirstScan());
+        carp(CARP_DEBUG, "=====================================");
       }
-      target_candidates->populateMatchRank(XCORR);
-      target_candidates->sort(XCORR);
-      
-    
-      carp(CARP_DEBUG, "Writing results.");
-      output_files.writeMatches(
-				(MatchCollection*)target_candidates, 
-				decoy_vec,
-				XCORR,
-				spectrum);
-
-      /* Clean up */
-      carp(CARP_DEBUG, "Deleting decoy candidates.");
-      delete decoy_candidates;
-      carp(CARP_DEBUG, "Deleting target candidates.");
-      delete target_candidates;
-      XLink::deleteAllocatedPeptides();
-    
-      //free_spectrum(spectrum);
-      
-      carp(CARP_DEBUG, "Done with spectrum %d.", scan_num);
-      carp(CARP_DEBUG, "=====================================");
+      XLink::deletePeptides(item.peptides);
+
+      boost::mutex::scoped_lock lock(queue.mutex);
+      queue.num_written++;
+      queue.changed.notify_all();
     } // get next spectrum
+    threads.join_all();
+
+    for (size_t bin_idx = 0; bin_idx < queue.weibull_bins.size(); bin_idx++) {
+      XLinkWeibullBin* bin = queue.weibull_bins[bin_idx];
+      delete bin->training_candidates;
+      XLink::deletePeptides(bin->peptides);
+      delete bin;
+    }
+    if (!queue.weibull_bins.empty()) {
+      carp(CARP_INFO, "Shared Weibull training candidates among %d bins.",
+           queue.weibull_bins.size());
+    }
 
     carp(CARP_INFO, "Skipped %d (%g%%) spectra with 0 candidates.", 
-	 skipped_no_candidates, skipped_no_candidates / num_spectra * 100);
+         skipped_no_candidates, skipped_no_candidates / num_spectra * 100);
     
     carp(CARP_INFO, "Skipped %d (%g%%) spectra with too few peaks.", 
-	 spectrum_iterator->numSkipped(), 
-	 spectrum_iterator->numSkipped() / num_spectra * 100);
+         spectrum_iterator->numSkipped(), 
+         spectrum_iterator->numSkipped() / num_spectra * 100);
 
     output_files.writeFooters();
 
@@ -5,22 +5,33 @@
 
 #include "DelimitedFileReader.h"
 
+#include <cstring>
 #include <fstream>
 
 #include <iostream>
 #include <string>
 
+#include <boost/iostreams/device/mapped_file.hpp>
+
 #include "carp.h"
 #include "DelimitedFile.h"
 #include "util/StringUtils.h"
 
 using namespace std;
 
+/**
+ * \returns whether a character is whitespace, as trimmed from the first line
+ */
+static bool isTrimmedSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
 /**
  * \returns a DelimitedFileReader object
  */  
 DelimitedFileReader::DelimitedFileReader():
-  num_rows_valid_(false), istream_ptr_(NULL), delimiter_('\t'), owns_stream_(false) {
+  delimiter_('\t'), has_next_(false), has_current_(false), owns_stream_(false),
+  istream_ptr_(NULL), num_rows_valid_(false), mapped_file_(NULL) {
 }
 
 /**
@@ -31,7 +42,8 @@ DelimitedFileReader::DelimitedFileReader(
   const char *file_name, ///< the path of the file to read
   bool has_header, ///< indicates whether the header exists (default true).
   char delimiter ///< the delimiter to use (default tab).
-): istream_ptr_(NULL), num_rows_valid_(false), delimiter_(delimiter) {
+): delimiter_(delimiter), owns_stream_(false), istream_ptr_(NULL), num_rows_valid_(false),
+  mapped_file_(NULL) {
   loadData(file_name, has_header);
 }
 
@@ -43,7 +55,8 @@ DelimitedFileReader::DelimitedFileReader(
   const std::string& file_name, ///< the path of the file  to read
   bool has_header, ///< indicates whether the header exists (default true).
   char delimiter ///< the delimiter to use (default tab)
-): istream_ptr_(NULL), delimiter_(delimiter) {
+): delimiter_(delimiter), owns_stream_(false), istream_ptr_(NULL), num_rows_valid_(false),
+  mapped_file_(NULL) {
   loadData(file_name, has_header);
 }
 
@@ -55,8 +68,8 @@ DelimitedFileReader::DelimitedFileReader(
   std::istream* istream_ptr, ///< the stream to be read
   bool has_header, ///<indicates whether header exists
   char delimiter ///< the delimiter to use (default tab)
-): istream_ptr_(istream_ptr), istream_begin_(istream_ptr->tellg()), delimiter_(delimiter),
-has_header_(has_header), owns_stream_(false) {
+): delimiter_(delimiter), has_header_(has_header), owns_stream_(false),
+istream_ptr_(istream_ptr), istream_begin_(istream_ptr->tellg()), mapped_file_(NULL) {
   loadData();
 }
 
@@ -65,16 +78,45 @@ has_header_(has_header), owns_stream_(false) {
  * Destructor
  */
 DelimitedFileReader::~DelimitedFileReader() {
+  close();
+}
+
+/**
+ * Closes the file or stream, if this object opened it.
+ */
+void DelimitedFileReader::close() {
+  if (mapped_file_ != NULL) {
+    delete mapped_file_;
+    mapped_file_ = NULL;
+  }
   if (istream_ptr_ != NULL && owns_stream_) {
     delete istream_ptr_;
   }
+  istream_ptr_ = NULL;
+  owns_stream_ = false;
 }
 
 /**
  * \returns the number of rows, assuming a square matrix
  */
 unsigned int DelimitedFileReader::numRows() {
-  if (!num_rows_valid_) {
+  if (!num_rows_valid_ && mapped_file_ != NULL) {
+    num_rows_ = 0;
+    const char* line = mapped_file_->data();
+    const char* end = line + mapped_file_->size();
+    while (line < end) {
+      num_rows_++;
+      const char* newline = (const char*)memchr(line, '\n', end - line);
+      if (newline == NULL) {
+        break;
+      }
+      line = newline + 1;
+    }
+    if (has_header_ && num_rows_ > 0) {
+      num_rows_--;
+    }
+    num_rows_valid_ = true;
+  } else if (!num_rows_valid_) {
     num_rows_ = 0;
 
     streampos last_pos = istream_ptr_->tellg();
@@ -88,7 +130,7 @@ unsigned int DelimitedFileReader::numRows() {
       num_rows_++;
     }
     
-    if (has_header_) {
+    if (has_header_ && num_rows_ > 0) {
       num_rows_--;
     }
     num_rows_valid_ = true;
@@ -140,7 +182,7 @@ string DelimitedFileReader::getHeaderString() {
 
 
 void DelimitedFileReader::loadData() {
-  if (!istream_ptr_->good()) {
+  if (mapped_file_ == NULL && !istream_ptr_->good()) {
     carp(CARP_ERROR, "Stream is not good!");
     carp(CARP_ERROR, "Filename:%s", file_name_.c_str());
     carp(CARP_ERROR, "EOF:%i", istream_ptr_ -> eof());
@@ -152,14 +194,25 @@ void DelimitedFileReader::loadData() {
   num_rows_valid_ = false;
   has_current_ = false;
   column_mismatch_warned_ = false;
-  istream_begin_ = istream_ptr_->tellg(); 
+  if (mapped_file_ != NULL) {
+    map_next_ = mapped_file_->data();
+  } else {
+    istream_begin_ = istream_ptr_->tellg(); 
+  }
 
-  has_next_ = !getline(*istream_ptr_, next_data_string_).fail();
-  next_data_string_ = StringUtils::Trim(next_data_string_);
+  has_next_ = readNextLine();
+  if (has_next_) {
+    while (next_begin_ < next_end_ && isTrimmedSpace(*next_begin_)) {
+      next_begin_++;
+    }
+    while (next_end_ > next_begin_ && isTrimmedSpace(*(next_end_ - 1))) {
+      next_end_--;
+    }
+  }
   if (has_header_) {
     if (has_next_) {
-      column_names_ = StringUtils::Split(next_data_string_, delimiter_);
-      has_next_ = !getline(*istream_ptr_, next_data_string_).fail();
+      column_names_ = StringUtils::Split(string(next_begin_, next_end_), delimiter_);
+      has_next_ = readNextLine();
     } else {
       carp(CARP_WARNING, "No data/headers found!");
       return;
@@ -183,6 +236,7 @@ void DelimitedFileReader::loadData(
   bool has_header ///< header indicator
   ) {
 
+  close();
   file_name_ = string(file_name);
   has_header_ = has_header;
 
@@ -191,8 +245,16 @@ void DelimitedFileReader::loadData(
     istream_ptr_ = &cin;
     owns_stream_ = false;
   } else {
-    istream_ptr_ = new ifstream(file_name, ios::in);
-    owns_stream_ = true;
+    // Map the file if possible; empty and special files are streamed.
+    try {
+      mapped_file_ = new boost::iostreams::mapped_file_source(file_name_);
+    } catch (const std::exception&) {
+      mapped_file_ = NULL;
+    }
+    if (mapped_file_ == NULL) {
+      istream_ptr_ = new ifstream(file_name, ios::in);
+      owns_stream_ = true;
+    }
   }
   loadData();
 
@@ -264,6 +326,10 @@ const string& DelimitedFileReader::getString() {
   if (!has_current_) {
     carp(CARP_FATAL, "End of file!");
   }
+  if (!current_data_valid_) {
+    current_data_string_.assign(row_begin_, row_end_);
+    current_data_valid_ = true;
+  }
   return current_data_string_;
 }
 
@@ -273,11 +339,28 @@ const string& DelimitedFileReader::getString() {
 const string& DelimitedFileReader::getString(
   unsigned int col_idx ///< the column index
   ) {
-  if (col_idx >= data_.size()) {
+  if (col_idx >= cell_begin_.size()) {
+    carp(CARP_FATAL, "col idx:%i is out of bounds! (0,%i,%i)",
+         col_idx, (column_names_.size()-1), (cell_begin_.size()-1));
+  }
+  if (!data_valid_[col_idx]) {
+    data_[col_idx].assign(cell_begin_[col_idx], cell_end_[col_idx]);
+    data_valid_[col_idx] = true;
+  }
+  return data_[col_idx];
+}
+
+/**
+ * \returns the number of characters in the cell
+ */
+unsigned int DelimitedFileReader::getLength(
+  unsigned int col_idx ///< the column index
+  ) {
+  if (col_idx >= cell_begin_.size()) {
     carp(CARP_FATAL, "col idx:%i is out of bounds! (0,%i,%i)",
-         col_idx, (column_names_.size()-1), (data_.size()-1));
+         col_idx, (column_names_.size()-1), (cell_begin_.size()-1));
   }
-  return data_.at(col_idx);
+  return cell_end_[col_idx] - cell_begin_[col_idx];
 }
 
 /** 
@@ -311,6 +394,11 @@ TValue DelimitedFileReader::getValue(
 FLOAT_T DelimitedFileReader::getFloat(
   unsigned int col_idx ///< the column index
   ) {
+  double value;
+  if (col_idx < cell_begin_.size() &&
+      StringUtils::TryParseDouble(cell_begin_[col_idx], cell_end_[col_idx], &value)) {
+    return value;
+  }
   const string& string_ans = getString(col_idx);
   if (string_ans == "Inf") {
     return numeric_limits<FLOAT_T>::infinity();
@@ -344,6 +432,11 @@ FLOAT_T DelimitedFileReader::getFloat(
 double DelimitedFileReader::getDouble(
   unsigned int col_idx ///< the column index 
   ) {
+  double value;
+  if (col_idx < cell_begin_.size() &&
+      StringUtils::TryParseDouble(cell_begin_[col_idx], cell_end_[col_idx], &value)) {
+    return value;
+  }
   const string& string_ans = getString(col_idx);
   if (string_ans == "") {
     return 0.0;
@@ -378,7 +471,11 @@ double DelimitedFileReader::getDouble(
 int DelimitedFileReader::getInteger(
   unsigned int col_idx ///< the column index 
   ) {
-  //TODO : check the string for a valid integer.
+  int value;
+  if (col_idx < cell_begin_.size() &&
+      StringUtils::TryParseInt(cell_begin_[col_idx], cell_end_[col_idx], &value)) {
+    return value;
+  }
   return getValue<int>(col_idx);
 }
 
@@ -453,13 +550,58 @@ void DelimitedFileReader::getDoubleVectorFromCell(
   }
 }
 
+/**
+ * Reads the following line of the file as the next row.
+ * \returns false if there are no more rows.
+ */
+bool DelimitedFileReader::readNextLine() {
+  if (mapped_file_ == NULL) {
+    if (getline(*istream_ptr_, next_data_string_).fail()) {
+      return false;
+    }
+    next_begin_ = next_data_string_.data();
+    next_end_ = next_begin_ + next_data_string_.length();
+    return true;
+  }
+  const char* end = mapped_file_->data() + mapped_file_->size();
+  if (map_next_ >= end) {
+    return false;
+  }
+  const char* newline = (const char*)memchr(map_next_, '\n', end - map_next_);
+  next_begin_ = map_next_;
+  next_end_ = newline == NULL ? end : newline;
+  map_next_ = newline == NULL ? end : newline + 1;
+  return true;
+}
+
+/**
+ * Finds the cells of the current row.
+ */
+void DelimitedFileReader::splitRow() {
+  cell_begin_.clear();
+  cell_end_.clear();
+  const char* cell = row_begin_;
+  while (true) {
+    const char* delimiter = (const char*)memchr(cell, delimiter_, row_end_ - cell);
+    cell_begin_.push_back(cell);
+    if (delimiter == NULL) {
+      cell_end_.push_back(row_end_);
+      break;
+    }
+    cell_end_.push_back(delimiter);
+    cell = delimiter + 1;
+  }
+}
+
 /*Iterator functions.*/
 /**
  * resets the file pointer to the beginning of the file.
  */
 void DelimitedFileReader::reset() {
-  istream_ptr_->clear();
-  istream_ptr_->seekg(istream_begin_, ios::beg);
+  if (mapped_file_ == NULL) {
+    istream_ptr_->clear();
+    istream_ptr_->seekg(istream_begin_, ios::beg);
+  }
   loadData();
 }
 
@@ -469,25 +611,38 @@ void DelimitedFileReader::reset() {
 void DelimitedFileReader::next() {
   if (has_next_) {
     current_row_++;
-    current_data_string_ = next_data_string_;
-    //parse next_data_string_ into data_
-    data_ = StringUtils::Split(current_data_string_, delimiter_);
+    //a mapped row stays in place; a streamed row is copied out of the line buffer
+    if (mapped_file_ != NULL) {
+      row_begin_ = next_begin_;
+      row_end_ = next_end_;
+      current_data_valid_ = false;
+    } else {
+      current_data_string_.assign(next_begin_, next_end_);
+      row_begin_ = current_data_string_.data();
+      row_end_ = row_begin_ + current_data_string_.length();
+      current_data_valid_ = true;
+    }
+    //find the cells of the row; they are copied into data_ only on request
+    splitRow();
     //make sure data has the right number of columns for the header.
-    if (data_.size() < column_names_.size()) {
+    if (cell_begin_.size() < column_names_.size()) {
       if (!column_mismatch_warned_) {
         carp(CARP_WARNING, "Column count %d for line %d is less than header %d",
-             data_.size(), current_row_, column_names_.size());
-        carp(CARP_WARNING, "%s", current_data_string_.c_str());
+             cell_begin_.size(), current_row_, column_names_.size());
+        carp(CARP_WARNING, "%s", string(row_begin_, row_end_).c_str());
         carp(CARP_WARNING, "Suppressing warnings, other mismatches may exist!");
         column_mismatch_warned_ = true;
       }
-      while (data_.size() < column_names_.size()) {
-        data_.push_back("");
+      while (cell_begin_.size() < column_names_.size()) {
+        cell_begin_.push_back(row_end_);
+        cell_end_.push_back(row_end_);
       }
     }
+    data_.resize(cell_begin_.size());
+    data_valid_.assign(cell_begin_.size(), false);
 
     //read next line
-    has_next_ = !getline(*istream_ptr_, next_data_string_).fail();
+    has_next_ = readNextLine();
     has_current_ = true;
   } else {
     has_current_ = false;
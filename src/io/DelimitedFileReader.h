@@ -9,7 +9,9 @@
  * Types from each cell of the table.  This class also provides function
  * for reading a list of integers or string from a cell using a delimiter
  * that is different from the column delimiter (default is comma ',').
- * This class reads the data in line by line
+ * This class reads the data in line by line.  Files named by path are
+ * memory-mapped, and the cells of each row are located in place and
+ * only copied into strings when requested as strings.
  ****************************************************************************/
 #ifndef DELIMITEDFILEREADER_H
 #define DELIMITEDFILEREADER_H
@@ -26,6 +28,12 @@
 #include "parameter.h"
 #include "util/Params.h"
 
+namespace boost {
+namespace iostreams {
+class mapped_file_source;
+}
+}
+
 class DelimitedFileReader {
 
  protected:
@@ -36,7 +44,7 @@ class DelimitedFileReader {
 
   std::string next_data_string_; ///<the next data string.
   std::string current_data_string_; ///<the current data string.
-  std::vector<std::string> data_; ///<the current vectorized data.
+  std::vector<std::string> data_; ///<the cells of the current row that have been requested as strings.
   std::vector<std::string> column_names_; ///<the column names.
 
   char delimiter_; ///<the delimiter to use.
@@ -59,6 +67,34 @@ class DelimitedFileReader {
 
   bool column_mismatch_warned_; ///<indicator of whether the column mismatch warning has been issued
 
+  boost::iostreams::mapped_file_source* mapped_file_; ///<the file, if it is memory-mapped rather than streamed
+  const char* map_next_; ///<start of the line after the next row in the mapped file
+
+  const char* next_begin_; ///<start of the next row
+  const char* next_end_; ///<end of the next row
+  const char* row_begin_; ///<start of the current row
+  const char* row_end_; ///<end of the current row
+  std::vector<const char*> cell_begin_; ///<start of each cell in the current row
+  std::vector<const char*> cell_end_; ///<end of each cell in the current row
+  std::vector<bool> data_valid_; ///<whether each cell has been copied into data_
+  bool current_data_valid_; ///<whether current_data_string_ holds the current row
+
+  /**
+   * Reads the following line of the file as the next row.
+   * \returns false if there are no more rows.
+   */
+  bool readNextLine();
+
+  /**
+   * Finds the cells of the current row.
+   */
+  void splitRow();
+
+  /**
+   * Closes the file or stream, if this object opened it.
+   */
+  void close();
+
   /**
    * clears the current data and column names,
    * parses the header if it exists,
@@ -190,6 +226,14 @@ class DelimitedFileReader {
     unsigned int col_idx ///< the column index
   );
 
+  /**
+   * \returns the number of characters in the cell
+   * using the current row
+   */
+  unsigned int getLength(
+    unsigned int col_idx ///< the column index
+  );
+
   /**
    * \returns the value of the cell
    * using the current row
@@ -0,0 +1,370 @@
+/**
+ * \file DelimitedFileSorter.cpp
+ * \brief Sorts the rows of delimited files by the value of one column,
+ * within a memory budget.
+ *****************************************************************************/
+#include "DelimitedFileSorter.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <boost/bind.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/thread.hpp>
+
+#include "carp.h"
+#include "DelimitedFileReader.h"
+#include "util/WinCrux.h"
+
+using namespace std;
+
+/**
+ * Rows sorted by each thread before the sorted slices are merged.
+ */
+static const size_t MIN_SORT_SLICE = 4096;
+
+/**
+ * Most runs open at once; more are first merged into fewer runs.
+ */
+static const size_t MAX_MERGE_RUNS = 128;
+
+DelimitedFileSorter::DelimitedFileSorter(
+  COLTYPE_T columnType,
+  bool ascending,
+  const string& tempPrefix,
+  size_t maxBytes,
+  int numThreads
+) : columnType_(columnType), numeric_(columnType != COLTYPE_STRING), ascending_(ascending),
+    tempPrefix_(tempPrefix), maxBytes_(maxBytes), numThreads_(max(numThreads, 1)),
+    size_(0), bufferBytes_(0), bufferPos_(0), merging_(false) {
+  if (columnType != COLTYPE_INT && columnType != COLTYPE_REAL &&
+      columnType != COLTYPE_STRING) {
+    carp(CARP_FATAL, "Unknown column type");
+  }
+}
+
+DelimitedFileSorter::~DelimitedFileSorter() {
+  for (size_t i = 0; i < runs_.size(); i++) {
+    if (runs_[i]) {
+      fclose(runs_[i]);
+    }
+  }
+  for (size_t i = 0; i < runFiles_.size(); i++) {
+    remove(runFiles_[i].c_str());
+  }
+}
+
+void DelimitedFileSorter::push(DelimitedFileReader& reader, unsigned int colIdx) {
+  switch (columnType_) {
+    case COLTYPE_STRING:
+      push(reader.getString(), reader.getString(colIdx));
+      break;
+    case COLTYPE_INT:
+      // compared as doubles, which hold every int exactly
+      push(reader.getString(), (double)reader.getInteger(colIdx));
+      break;
+    default:
+      push(reader.getString(), reader.getDouble(colIdx));
+      break;
+  }
+}
+
+void DelimitedFileSorter::push(const string& row, double key) {
+  add(row, key, string());
+}
+
+void DelimitedFileSorter::push(const string& row, const string& key) {
+  add(row, 0, key);
+}
+
+void DelimitedFileSorter::add(const string& row, double number, const string& text) {
+  if (merging_) {
+    carp(CARP_FATAL, "Row added after sorting began");
+  }
+  buffer_.push_back(Record());
+  Record& record = buffer_.back();
+  record.number = number;
+  record.text = text;
+  record.row = row;
+  ++size_;
+  bufferBytes_ += sizeof(Record) + sizeof(size_t) + text.size() + row.size();
+  if (maxBytes_ > 0 && bufferBytes_ >= maxBytes_) {
+    spill();
+  }
+}
+
+unsigned long long DelimitedFileSorter::size() const {
+  return size_;
+}
+
+bool DelimitedFileSorter::less(const Record& x, const Record& y) const {
+  if (numeric_) {
+    return ascending_ ? x.number < y.number : y.number < x.number;
+  }
+  return ascending_ ? x.text < y.text : y.text < x.text;
+}
+
+void DelimitedFileSorter::sortRange(Iter begin, Iter end) {
+  stable_sort(begin, end, CompareRecords(this));
+}
+
+void DelimitedFileSorter::mergeRanges(Iter begin, Iter middle, Iter end) {
+  inplace_merge(begin, middle, end, CompareRecords(this));
+}
+
+/**
+ * Sort order_ with numThreads_ threads: each sorts a slice, and then the
+ * slices are merged pairwise, again in parallel, until one remains.
+ */
+void DelimitedFileSorter::sortBuffer() {
+  size_t n = buffer_.size();
+  order_.resize(n);
+  for (size_t i = 0; i < n; i++) {
+    order_[i] = i;
+  }
+  size_t slices = min((size_t)numThreads_, max(n / MIN_SORT_SLICE, (size_t)1));
+  if (slices <= 1) {
+    sortRange(order_.begin(), order_.end());
+    return;
+  }
+  vector<Iter> bounds;
+  for (size_t i = 0; i <= slices; i++) {
+    bounds.push_back(order_.begin() + n * i / slices);
+  }
+  boost::thread_group sorters;
+  for (size_t i = 0; i < slices; i++) {
+    sorters.create_thread(boost::bind(&DelimitedFileSorter::sortRange, this,
+                                      bounds[i], bounds[i + 1]));
+  }
+  sorters.join_all();
+  while (bounds.size() > 2) {
+    vector<Iter> merged;
+    boost::thread_group mergers;
+    size_t i = 0;
+    for (; i + 2 < bounds.size(); i += 2) {
+      mergers.create_thread(boost::bind(&DelimitedFileSorter::mergeRanges, this,
+                                        bounds[i], bounds[i + 1], bounds[i + 2]));
+      merged.push_back(bounds[i]);
+    }
+    mergers.join_all();
+    for (; i < bounds.size(); i++) {
+      merged.push_back(bounds[i]);
+    }
+    bounds.swap(merged);
+  }
+}
+
+FILE* DelimitedFileSorter::createRun(string* outFile) {
+  string pattern = tempPrefix_ + "_XXXXXX";
+  vector<char> name(pattern.begin(), pattern.end());
+  name.push_back('\0');
+  int fd = mkstemp(&name[0]);
+  if (fd == -1) {
+    carp(CARP_FATAL, "Error creating temp file %s: %s", pattern.c_str(), strerror(errno));
+  }
+  *outFile = &name[0];
+  runFiles_.push_back(*outFile);
+  FILE* file = fdopen(fd, "wb");
+  if (file == NULL) {
+    carp(CARP_FATAL, "Could not open %s for writing", outFile->c_str());
+  }
+  return file;
+}
+
+/**
+ * Runs hold each record as its numeric key, then the lengths and bytes of
+ * the string key and of the row.
+ */
+void DelimitedFileSorter::writeRecord(FILE* file, const string& runFile, const Record& record) {
+  boost::uint32_t textLength = record.text.size();
+  boost::uint32_t rowLength = record.row.size();
+  if (fwrite(&record.number, sizeof(record.number), 1, file) != 1 ||
+      fwrite(&textLength, sizeof(textLength), 1, file) != 1 ||
+      fwrite(record.text.data(), 1, textLength, file) != textLength ||
+      fwrite(&rowLength, sizeof(rowLength), 1, file) != 1 ||
+      fwrite(record.row.data(), 1, rowLength, file) != rowLength) {
+    carp(CARP_FATAL, "Error writing to %s", runFile.c_str());
+  }
+}
+
+bool DelimitedFileSorter::readRecord(FILE* file, Record* outRecord) {
+  if (fread(&outRecord->number, sizeof(outRecord->number), 1, file) != 1) {
+    return false;
+  }
+  boost::uint32_t textLength, rowLength;
+  bool ok = fread(&textLength, sizeof(textLength), 1, file) == 1;
+  if (ok) {
+    outRecord->text.resize(textLength);
+    ok = textLength == 0 || fread(&outRecord->text[0], 1, textLength, file) == textLength;
+  }
+  ok = ok && fread(&rowLength, sizeof(rowLength), 1, file) == 1;
+  if (ok) {
+    outRecord->row.resize(rowLength);
+    ok = rowLength == 0 || fread(&outRecord->row[0], 1, rowLength, file) == rowLength;
+  }
+  if (!ok) {
+    carp(CARP_FATAL, "Error reading a sorted run of rows");
+  }
+  return true;
+}
+
+/**
+ * Write the rows in memory to a new sorted run.
+ */
+void DelimitedFileSorter::spill() {
+  sortBuffer();
+  string runFile;
+  FILE* file = createRun(&runFile);
+  for (size_t i = 0; i < order_.size(); i++) {
+    writeRecord(file, runFile, buffer_[order_[i]]);
+  }
+  if (fclose(file) != 0) {
+    carp(CARP_FATAL, "Error writing to %s", runFile.c_str());
+  }
+  carp(CARP_DEBUG, "Wrote %d rows to sorted run %s", (int)buffer_.size(), runFile.c_str());
+  buffer_.clear();
+  order_.clear();
+  bufferBytes_ = 0;
+}
+
+/**
+ * Open runs as merge sources 0 to runFiles.size() - 1, and start the heap
+ * with their first records.
+ */
+void DelimitedFileSorter::openRuns(const vector<string>& runFiles) {
+  runs_.resize(runFiles.size());
+  heads_.resize(runFiles.size() + 1);
+  mergeHeap_.clear();
+  for (size_t i = 0; i < runs_.size(); i++) {
+    runs_[i] = fopen(runFiles[i].c_str(), "rb");
+    if (runs_[i] == NULL) {
+      carp(CARP_FATAL, "Could not open %s for reading", runFiles[i].c_str());
+    }
+    if (readNext(i, &heads_[i])) {
+      mergeHeap_.push_back(i);
+    }
+  }
+  make_heap(mergeHeap_.begin(), mergeHeap_.end(), CompareSources(this));
+}
+
+/**
+ * Merge each group of up to MAX_MERGE_RUNS consecutive sorted runs into a
+ * single new run, keeping the runs in order. Repeated, this merges the runs
+ * in a tree, so that every row is rewritten only once per level and no
+ * more than MAX_MERGE_RUNS files need be open at once.
+ */
+void DelimitedFileSorter::collapseRuns() {
+  vector<string> allInputs;
+  allInputs.swap(runFiles_);
+  for (size_t begin = 0; begin < allInputs.size(); begin += MAX_MERGE_RUNS) {
+    size_t end = min(begin + MAX_MERGE_RUNS, allInputs.size());
+    if (end - begin == 1) {
+      runFiles_.push_back(allInputs[begin]);
+      continue;
+    }
+    vector<string> inputs(allInputs.begin() + begin, allInputs.begin() + end);
+    openRuns(inputs);
+    string runFile;
+    FILE* file = createRun(&runFile);
+    Record record;
+    while (popNext(&record)) {
+      writeRecord(file, runFile, record);
+    }
+    if (fclose(file) != 0) {
+      carp(CARP_FATAL, "Error writing to %s", runFile.c_str());
+    }
+    runs_.clear();
+    for (size_t i = 0; i < inputs.size(); i++) {
+      remove(inputs[i].c_str());
+    }
+  }
+}
+
+void DelimitedFileSorter::startMerge() {
+  merging_ = true;
+  sortBuffer();
+  bufferPos_ = 0;
+  if (!runFiles_.empty()) {
+    carp(CARP_INFO, "Merging %d sorted runs of rows", (int)runFiles_.size() + 1);
+  }
+  while (runFiles_.size() > MAX_MERGE_RUNS) {
+    collapseRuns();
+  }
+  openRuns(runFiles_);
+  // The buffer holds the latest rows, so it is the last source.
+  int source = runs_.size();
+  if (readNext(source, &heads_[source])) {
+    mergeHeap_.push_back(source);
+    push_heap(mergeHeap_.begin(), mergeHeap_.end(), CompareSources(this));
+  }
+}
+
+/**
+ * Read the next record of a source: runs_[source], or the buffer in memory
+ * if source is past the runs.
+ */
+bool DelimitedFileSorter::readNext(int source, Record* outRecord) {
+  if (source >= (int)runs_.size()) {
+    if (bufferPos_ >= order_.size()) {
+      vector<Record>().swap(buffer_);
+      vector<size_t>().swap(order_);
+      return false;
+    }
+    Record& record = buffer_[order_[bufferPos_++]];
+    outRecord->number = record.number;
+    outRecord->text.swap(record.text);
+    outRecord->row.swap(record.row);
+    return true;
+  }
+  FILE*& run = runs_[source];
+  if (run == NULL) {
+    return false;
+  }
+  if (!readRecord(run, outRecord)) {
+    fclose(run);
+    run = NULL;
+    return false;
+  }
+  return true;
+}
+
+bool DelimitedFileSorter::popNext(Record* outRecord) {
+  if (mergeHeap_.empty()) {
+    return false;
+  }
+  pop_heap(mergeHeap_.begin(), mergeHeap_.end(), CompareSources(this));
+  int source = mergeHeap_.back();
+  Record& head = heads_[source];
+  outRecord->number = head.number;
+  outRecord->text.swap(head.text);
+  outRecord->row.swap(head.row);
+  if (readNext(source, &head)) {
+    push_heap(mergeHeap_.begin(), mergeHeap_.end(), CompareSources(this));
+  } else {
+    mergeHeap_.pop_back();
+  }
+  return true;
+}
+
+bool DelimitedFileSorter::next(string* outRow, double* outKey) {
+  if (!merging_) {
+    startMerge();
+  }
+  Record record;
+  if (!popNext(&record)) {
+    return false;
+  }
+  outRow->swap(record.row);
+  if (outKey != NULL) {
+    *outKey = record.number;
+  }
+  return true;
+}
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 2
+ * End:
+ */
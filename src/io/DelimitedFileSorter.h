@@ -0,0 +1,160 @@
+/**
+ * \file DelimitedFileSorter.h
+ * \brief Sorts the rows of delimited files by the value of one column,
+ * within a memory budget.
+ *
+ * Rows are kept in memory, each with its sort key parsed once, until the
+ * budget is reached. They are then sorted on several threads and written
+ * as a sorted run to a temporary file. When the rows are read back, the
+ * runs and the rows still in memory are merged through a heap. Rows with
+ * equal keys stay in the order in which they were added.
+ *****************************************************************************/
+#ifndef DELIMITEDFILESORTER_H
+#define DELIMITEDFILESORTER_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "model/objects.h"
+
+class DelimitedFileReader;
+
+class DelimitedFileSorter {
+ public:
+  /**
+   * \returns a sorter for keys of the given column type. Runs are written
+   * to files whose names start with tempPrefix.
+   */
+  DelimitedFileSorter(
+    COLTYPE_T columnType, ///< how keys are compared
+    bool ascending, ///< ascending or descending order
+    const std::string& tempPrefix, ///< path prefix for the sorted runs
+    size_t maxBytes, ///< memory budget for rows, 0 for no limit
+    int numThreads ///< threads used to sort each run
+  );
+
+  /**
+   * Destructor; removes the temporary files.
+   */
+  ~DelimitedFileSorter();
+
+  /**
+   * Adds the current row of a reader, keyed by one of its cells.
+   */
+  void push(
+    DelimitedFileReader& reader, ///< the reader
+    unsigned int colIdx ///< the column of the key
+  );
+
+  /**
+   * Adds a row with a numeric key, for int and real columns.
+   */
+  void push(const std::string& row, double key);
+
+  /**
+   * Adds a row with a string key, for string columns.
+   */
+  void push(const std::string& row, const std::string& key);
+
+  /**
+   * \returns the number of rows added.
+   */
+  unsigned long long size() const;
+
+  /**
+   * Gets the next row in sorted order, and its key if it is numeric.
+   * \returns false if there are none left. No more rows may be pushed
+   * after the first call.
+   */
+  bool next(
+    std::string* outRow, ///< the row
+    double* outKey = NULL ///< the numeric key, if not NULL
+  );
+
+ private:
+  struct Record {
+    double number; ///< key of int and real columns
+    std::string text; ///< key of string columns
+    std::string row;
+  };
+
+  /**
+   * Orders the indices of records in the buffer by key.
+   */
+  class CompareRecords {
+   public:
+    CompareRecords(const DelimitedFileSorter* sorter) : sorter_(sorter) {}
+    bool operator()(size_t x, size_t y) const {
+      return sorter_->less(sorter_->buffer_[x], sorter_->buffer_[y]);
+    }
+   private:
+    const DelimitedFileSorter* sorter_;
+  };
+
+  /**
+   * Orders merge sources so that the heap's top has the smallest key,
+   * and of equal keys, the earliest source.
+   */
+  class CompareSources {
+   public:
+    CompareSources(const DelimitedFileSorter* sorter) : sorter_(sorter) {}
+    bool operator()(int x, int y) const {
+      const Record& recordX = sorter_->heads_[x];
+      const Record& recordY = sorter_->heads_[y];
+      if (sorter_->less(recordY, recordX)) {
+        return true;
+      } else if (sorter_->less(recordX, recordY)) {
+        return false;
+      }
+      return x > y;
+    }
+   private:
+    const DelimitedFileSorter* sorter_;
+  };
+
+  typedef std::vector<size_t>::iterator Iter;
+
+  void add(const std::string& row, double number, const std::string& text);
+  bool less(const Record& x, const Record& y) const;
+  void sortRange(Iter begin, Iter end);
+  void mergeRanges(Iter begin, Iter middle, Iter end);
+  void sortBuffer();
+  void spill();
+  FILE* createRun(std::string* outFile);
+  void writeRecord(FILE* file, const std::string& runFile, const Record& record);
+  bool readRecord(FILE* file, Record* outRecord);
+  void openRuns(const std::vector<std::string>& runFiles);
+  void collapseRuns();
+  void startMerge();
+  bool popNext(Record* outRecord);
+  bool readNext(int source, Record* outRecord);
+
+  COLTYPE_T columnType_;
+  bool numeric_;
+  bool ascending_;
+  std::string tempPrefix_;
+  size_t maxBytes_;
+  int numThreads_;
+  unsigned long long size_;
+
+  std::vector<Record> buffer_; ///< rows in memory, in the order added
+  std::vector<size_t> order_; ///< indices into buffer_, sorted by sortBuffer
+  size_t bufferBytes_;
+  size_t bufferPos_;
+
+  std::vector<std::string> runFiles_; ///< sorted runs, earliest rows first
+  std::vector<FILE*> runs_; ///< open runs while merging
+  std::vector<Record> heads_; ///< current record of each merge source
+  std::vector<int> mergeHeap_;
+  bool merging_;
+};
+
+#endif
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 2
+ * End:
+ */
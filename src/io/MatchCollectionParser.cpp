@@ -170,7 +170,8 @@ Protein* MatchCollectionParser::getProtein(
  */
 MatchCollection* MatchCollectionParser::create(
   const string& match_path, ///< path to the file of matches 
-  const string& fasta_path ///< path to the protein database
+  const string& fasta_path, ///< path to the protein database
+  const vector<bool>* rows ///< PSMs of a tab-delimited file to parse, or NULL for all
   ) {
   carp(CARP_DEBUG, "match path:%s", match_path.c_str());
   if (!fasta_path.empty()) {
@@ -187,6 +188,9 @@ MatchCollection* MatchCollectionParser::create(
   
   if (FileUtils::IsDir(match_path)) {
     carp(CARP_FATAL, "Internal error");
+  } else if (rows != NULL && !isTabDelimited(match_path)) {
+    carp(CARP_FATAL, "Only PSMs of a tab-delimited file can be selected (%s).",
+         match_path.c_str());
   } else if (StringUtils::IEndsWith(match_path, ".xml")) {
     collection = PepXMLReader::parse(match_path, database_, decoy_database_);
   } else if (StringUtils::IEndsWith(match_path, ".sqt")) {
@@ -194,7 +198,7 @@ MatchCollection* MatchCollectionParser::create(
   } else if (StringUtils::IEndsWith(match_path, ".mzid")) {
     collection = MzIdentMLReader::parse(match_path, database_, decoy_database_);
   } else {
-    collection = MatchFileReader::parse(match_path, database_, decoy_database_);
+    collection = MatchFileReader::parse(match_path, database_, decoy_database_, rows);
   }
   
   //  Test if collection already has file path set, otherwise set it.
@@ -203,6 +207,14 @@ MatchCollection* MatchCollectionParser::create(
   return collection;
 }
 
+bool MatchCollectionParser::isTabDelimited(
+  const string& match_path ///< path to the file of matches
+  ) {
+  return !StringUtils::IEndsWith(match_path, ".xml") &&
+    !StringUtils::IEndsWith(match_path, ".sqt") &&
+    !StringUtils::IEndsWith(match_path, ".mzid");
+}
+
 /*
  * Local Variables:
  * mode: c
@@ -31,7 +31,16 @@ class MatchCollectionParser {
    */
   MatchCollection* create(
     const std::string& match_path, ///< path to the file of matches
-    const std::string& fasta_path  ///< path to the protein database
+    const std::string& fasta_path, ///< path to the protein database
+    const std::vector<bool>* rows = NULL ///< PSMs of a tab-delimited file to parse, as in MatchFileReader::parse, or NULL for all
+  );
+
+  /**
+   * \returns true if the file of matches is read as tab-delimited, i.e.
+   * it is not pepXML, SQT or mzIdentML.
+   */
+  static bool isTabDelimited(
+    const std::string& match_path ///< path to the file of matches
   );
 
 
@@ -151,7 +151,7 @@ bool MatchFileReader::empty(
   if (idx == -1) {
     return true;
   }
-  return DelimitedFileReader::getString(idx).empty();
+  return getLength(idx) == 0;
 }
 
 /**
@@ -178,14 +178,20 @@ void MatchFileReader::getMatchColumnsPresent(
 MatchCollection* MatchFileReader::parse(
   const string& file_path,
   Database* database,
-  Database* decoy_database) {
-  return MatchFileReader(file_path, database, decoy_database).parse();
+  Database* decoy_database,
+  const vector<bool>* rows) {
+  return MatchFileReader(file_path, database, decoy_database).parse(rows);
 }
 
 MatchCollection* MatchFileReader::parse() {
+  return parse(NULL);
+}
+
+MatchCollection* MatchFileReader::parse(const vector<bool>* rows) {
   MatchCollection* match_collection = new MatchCollection();
   match_collection->preparePostProcess();
   int maxRank = Params::GetInt("top-match-in");
+  size_t row = 0;
 
   while (hasNext()) {
     FLOAT_T ln_experiment_size = 0;
@@ -219,7 +225,12 @@ MatchCollection* MatchFileReader::parse() {
     match_collection->setScoredType(BY_IONS_TOTAL, !empty(BY_IONS_TOTAL_COL));
 
     // parse match object
-    if (maxRank == 0 || getInteger(XCORR_RANK_COL) <= maxRank) {
+    bool keep = maxRank == 0 || getInteger(XCORR_RANK_COL) <= maxRank;
+    if (keep && rows != NULL) {
+      keep = row < rows->size() && (*rows)[row];
+      row++;
+    }
+    if (keep) {
       Crux::Match* match = parseMatch();
       if (match == NULL) {
         carp(CARP_ERROR, "Failed to parse tab-delimited PSM match");
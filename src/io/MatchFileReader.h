@@ -127,13 +127,20 @@ class MatchFileReader: public DelimitedFileReader, public PSMReader {
      */
     void getMatchColumnsPresent (std::vector<bool>& col_is_present);
 
+    /**
+     * Parses the PSMs of a file. If rows is given, only the PSMs whose
+     * entry in it is true are parsed, numbering PSMs as PSMTable::load
+     * does: in file order, skipping those past top-match-in.
+     */
     static MatchCollection* parse(
       const std::string& file_path,
       Database* database,
-      Database* decoy_database
+      Database* decoy_database,
+      const std::vector<bool>* rows = NULL
     );
 
     MatchCollection* parse();
+    MatchCollection* parse(const std::vector<bool>* rows);
 };
 
 #endif //MATCHFILEREADER_H
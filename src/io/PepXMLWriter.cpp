@@ -6,6 +6,7 @@
 #include "PepXMLWriter.h"
 #include "util/AminoAcidUtil.h"
 #include "util/crux-utils.h"
+#include "util/GlobalParams.h"
 #include "util/Params.h"
 #include "util/StringUtils.h"
 #include "model/MatchCollection.h"
@@ -355,7 +356,7 @@ void PepXMLWriter::print_modifications_xml(
 ) {
   carp(CARP_DEBUG, "print_modifications_xml:%s %s", mod_seq, pep_seq);
   // variable modifications
-  int mod_precision = Params::GetInt("mod-precision");
+  int mod_precision = GlobalParams::getModPrecision();
   map<int, double> var_mods = find_variable_modifications(mod_seq);
   if (!var_mods.empty()) {
     fprintf(output_file, "<modification_info modified_peptide=\"%s\">\n", mod_seq);
@@ -34,7 +34,9 @@ PinWriter::PinWriter():
   out_(NULL),
   enzyme_(get_enzyme_type_parameter("enzyme")),
   precision_(Params::GetInt("precision")),
-  mass_precision_(Params::GetInt("mass-precision")) {
+  mass_precision_(Params::GetInt("mass-precision")),
+  mod_symbols_(Params::GetBool("mod-symbols")),
+  filestem_prefixes_(Params::GetBool("filestem-prefixes")) {
     
   features_.push_back(make_pair("SpecId", true));
   features_.push_back(make_pair("Label", true));
@@ -135,6 +137,23 @@ void PinWriter::write(
 }
 
 void PinWriter::write(MatchCollection* collection, string database) {
+  int max_charge = 0;
+  for (MatchIterator i = MatchIterator(collection); i.hasNext();) {
+    max_charge = max(i.next()->getCharge(), max_charge);
+  }
+  enableFeatures(collection, max_charge);
+
+  vector<MatchCollection*> decoyvec;
+  int top_match = Params::GetInt("top-match");
+  printHeader();
+  write(collection, decoyvec, top_match); // TODO: When top match is greater than default (5) in a given PSM File?
+}
+
+/**
+ * Enable the features for the scores of the collection, and the charge
+ * features up to max_charge.
+ */
+void PinWriter::enableFeatures(MatchCollection* collection, int max_charge) {
   bool sp = collection->getScoredType(SP);
   bool xcorr = collection->getScoredType(XCORR);
   bool exact_p = collection->getScoredType(TIDE_SEARCH_REFACTORED_XCORR);
@@ -154,19 +173,9 @@ void PinWriter::write(MatchCollection* collection, string database) {
   setEnabledStatus("NegLog10ResEvPValue", combine_p);
   setEnabledStatus("NegLog10CombinePValue", combine_p);
 
-
-  int max_charge = 0;
-  for (MatchIterator i = MatchIterator(collection); i.hasNext();) {
-    max_charge = max(i.next()->getCharge(), max_charge);
-  }
   for (int i = 1; i <= max_charge; i++) {
     setEnabledStatus("Charge" + StringUtils::ToString(i), true);
   }
-
-  vector<MatchCollection*> decoyvec;
-  int top_match = Params::GetInt("top-match");
-  printHeader();
-  write(collection, decoyvec, top_match); // TODO: When top match is greater than default (5) in a given PSM File?
 }
 
 bool PinWriter::isInfinite(FLOAT_T x) {
@@ -285,7 +294,7 @@ void PinWriter::printPSM(
 string PinWriter::getPeptide(Peptide* pep) {
   stringstream sequence;
   sequence << pep->getNTermFlankingAA() << '.'
-           << (Params::GetBool("mod-symbols")
+           << (mod_symbols_
                 ? pep->getModifiedSequenceWithSymbols()
                 : pep->getModifiedSequenceWithMasses())
            << '.' << pep->getCTermFlankingAA();
@@ -293,7 +302,7 @@ string PinWriter::getPeptide(Peptide* pep) {
 }
 
 string PinWriter::getId(Match* match, int scan_number) {
-  string prefix = Params::GetBool("filestem-prefixes")
+  string prefix = filestem_prefixes_
     ? FileUtils::Stem(match->getFilePath())
     : "";
 
@@ -36,6 +36,8 @@ class PinWriter : public PSMWriter {
     std::string database
   );
 
+  void enableFeatures(MatchCollection* collection, int max_charge);
+
   void printHeader();
 
   void closeFile();
@@ -62,6 +64,8 @@ class PinWriter : public PSMWriter {
   ENZYME_T enzyme_; 
   int precision_;
   int mass_precision_;
+  bool mod_symbols_;
+  bool filestem_prefixes_;
 
   void printPSM(Crux::Match* match);
 
@@ -22,6 +22,9 @@
 #endif
 
 #include <stack>
+#include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/once.hpp>
 
 using namespace Crux;
 using namespace std;
@@ -30,6 +33,7 @@ using namespace std;
 class IonCache {
  protected:
   stack<Ion*> cache_;
+  boost::mutex mutex_;
   #ifdef DEBUG
   int ncheckin;
   int ncheckout;
@@ -54,6 +58,7 @@ class IonCache {
   }
 
   Ion* checkout() {
+    boost::mutex::scoped_lock lock(mutex_);
     #ifdef DEBUG
     ncheckout++;
     #endif
@@ -66,6 +71,7 @@ class IonCache {
     }
   }
   void checkin(Ion* ion) {
+    boost::mutex::scoped_lock lock(mutex_);
     #ifdef DEBUG
     ncheckin++;
     #endif
@@ -89,7 +95,7 @@ IonCache ion_cache_;
   /**
    * Have we initialized the modification_masses?
    */
-  static bool initialized_modification_masses = false;
+  static boost::once_flag initialized_modification_masses = BOOST_ONCE_INIT;
 
   static const int DETECTABLE_MZ_MIN = 200;
   static const int DETECTABLE_MZ_MAX = 2400;
@@ -115,8 +121,6 @@ void Ion::initializeModificationMasses(
     modification_masses[ISOTOPE] = 1; // FIXME check this!!!
     modification_masses[FLANK] = 1; // FIXME check this!!!
   }
-
-  initialized_modification_masses = true;
 }
 
 /**
@@ -761,9 +765,8 @@ FLOAT_T Ion::modifyMassZ(
   )
 {
   // initalize the modified masses(average|mono);
-  if(!initialized_modification_masses){
-    initializeModificationMasses(mass_type);
-  }
+  boost::call_once(initialized_modification_masses,
+                   boost::bind(&Ion::initializeModificationMasses, mass_type));
   
   return  mass_z + (modification_masses[(int)ion_modification]/(float)charge) * modification_count;  
 }
@@ -850,9 +853,8 @@ FLOAT_T Ion::modifyMass(
   )
 {
   // initalize the modified masses(average|mono);
-  if(!initialized_modification_masses){
-    initializeModificationMasses(mass_type);
-  }
+  boost::call_once(initialized_modification_masses,
+                   boost::bind(&Ion::initializeModificationMasses, mass_type));
   
   return  mass + modification_masses[(int)ion_modification] * modification_count;
 }
@@ -23,6 +23,8 @@
 #include "Spectrum.h"
 
 #include <stack>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
 
 using namespace Crux;
 
@@ -30,7 +32,10 @@ static const int BINARY_GMTK = 1;
 static const int PRINT_NULL_IONS = 1;
 static const int MIN_FRAMES = 3;
 
-FLOAT_T* IonSeries::mass_matrix_ = NULL;
+/**
+ * Pre-allocated mass matrix of each thread that predicts ions
+ */
+static boost::thread_specific_ptr<std::vector<FLOAT_T> > mass_matrix_;
 
 
 /**
@@ -52,6 +57,7 @@ struct loss_limit{
 class LossLimitCache {
  protected:
   stack<LOSS_LIMIT_T*> cache_;
+  boost::mutex mutex_;
  public:
   LossLimitCache() {
   }
@@ -65,6 +71,7 @@ class LossLimitCache {
   }
 
   LOSS_LIMIT_T* checkout() {
+    boost::mutex::scoped_lock lock(mutex_);
     LOSS_LIMIT_T* new_element;
     if (cache_.empty()) {
       new_element = new LOSS_LIMIT_T[GlobalParams::getMaxLength()];
@@ -75,6 +82,7 @@ class LossLimitCache {
     return (new_element);
   }
   void checkin(LOSS_LIMIT_T* array) {
+    boost::mutex::scoped_lock lock(mutex_);
     cache_.push(array);
   }
 
@@ -259,7 +267,7 @@ IonSeries::~IonSeries()
 }
 
 void IonSeries::finalize() {
-  delete []mass_matrix_;
+  mass_matrix_.reset();
 
 }
 
@@ -449,12 +457,12 @@ FLOAT_T* IonSeries::createIonMassMatrix(
     return NULL;
   }
 
-  if (mass_matrix_ == NULL) {
-    //Allocate the static mass_matrix_
-    mass_matrix_ = new FLOAT_T[sizeof(FLOAT_T)*(GlobalParams::getMaxLength()+1)];
+  if (mass_matrix_.get() == NULL) {
+    //Allocate this thread's mass_matrix_
+    mass_matrix_.reset(new std::vector<FLOAT_T>(GlobalParams::getMaxLength()+1));
   }
 
-  FLOAT_T* mass_matrix = mass_matrix_;
+  FLOAT_T* mass_matrix = &(*mass_matrix_)[0];
   
   // at index 0, the length of the peptide is stored
   mass_matrix[0] = peptide_length;
@@ -0,0 +1,295 @@
+/**
+ * \file PSMTable.cpp
+ * \brief A compact, column-oriented store of peptide-spectrum matches
+ * read from tab-delimited result files.
+ */
+#include "PSMTable.h"
+#include "Match.h"
+#include "MatchCollection.h"
+#include "MatchIterator.h"
+#include "Modification.h"
+#include "Peptide.h"
+#include "io/carp.h"
+#include "io/MatchFileReader.h"
+#include "util/Params.h"
+#include "util/StringUtils.h"
+
+#include <limits>
+
+using namespace std;
+
+/**
+ * The score and rank columns of a result file, and the score type each
+ * is stored as.
+ */
+struct ScoreColumn {
+  MATCH_COLUMNS_T column;
+  SCORER_TYPE_T type;
+};
+
+static const ScoreColumn SCORE_COLUMNS[] = {
+  {SP_SCORE_COL, SP},
+  {XCORR_SCORE_COL, XCORR},
+  {DELTA_CN_COL, DELTA_CN},
+  {DELTA_LCN_COL, DELTA_LCN},
+  {EXACT_PVALUE_COL, TIDE_SEARCH_EXACT_PVAL},
+  {REFACTORED_SCORE_COL, TIDE_SEARCH_REFACTORED_XCORR},
+  {RESIDUE_EVIDENCE_COL, RESIDUE_EVIDENCE_SCORE},
+  {RESIDUE_PVALUE_COL, RESIDUE_EVIDENCE_PVAL},
+  {BOTH_PVALUE_COL, BOTH_PVALUE},
+  {DECOY_XCORR_QVALUE_COL, DECOY_XCORR_QVALUE},
+  {PVALUE_COL, LOGP_BONF_WEIBULL_XCORR},
+  {EVALUE_COL, EVALUE},
+  {PERCOLATOR_QVALUE_COL, PERCOLATOR_QVALUE},
+  {PERCOLATOR_SCORE_COL, PERCOLATOR_SCORE},
+  {WEIBULL_QVALUE_COL, LOGP_QVALUE_WEIBULL_XCORR},
+  {QRANKER_SCORE_COL, QRANKER_SCORE},
+  {QRANKER_QVALUE_COL, QRANKER_QVALUE},
+  {BARISTA_SCORE_COL, BARISTA_SCORE},
+  {BARISTA_QVALUE_COL, BARISTA_QVALUE},
+  {BY_IONS_MATCHED_COL, BY_IONS_MATCHED},
+  {BY_IONS_TOTAL_COL, BY_IONS_TOTAL}
+};
+
+static const ScoreColumn RANK_COLUMNS[] = {
+  {SP_RANK_COL, SP},
+  {XCORR_RANK_COL, XCORR},
+  {RESIDUE_RANK_COL, RESIDUE_EVIDENCE_PVAL},
+  {BOTH_PVALUE_RANK, BOTH_PVALUE},
+  {PERCOLATOR_RANK_COL, PERCOLATOR_SCORE}
+};
+
+static const int NUM_SCORE_COLUMNS = sizeof(SCORE_COLUMNS) / sizeof(ScoreColumn);
+static const int NUM_RANK_COLUMNS = sizeof(RANK_COLUMNS) / sizeof(ScoreColumn);
+
+PSMTable::PSMTable() : distinct_matches_(false) {
+  for (int i = 0; i < NUMBER_SCORER_TYPES; i++) {
+    has_score_[i] = false;
+    has_rank_[i] = false;
+  }
+}
+
+void PSMTable::load(const string& path) {
+  MatchFileReader reader(path);
+  vector<bool> columns;
+  reader.getMatchColumnsPresent(columns);
+  if (columns.empty()) {
+    carp(CARP_FATAL, "Could not read the header of %s.", path.c_str());
+  }
+
+  // Start a column for each score in this file that earlier files did not
+  // have, with no score for the rows already loaded.
+  for (int i = 0; i < NUM_SCORE_COLUMNS; i++) {
+    SCORER_TYPE_T type = SCORE_COLUMNS[i].type;
+    if (columns[SCORE_COLUMNS[i].column] && !has_score_[type]) {
+      scores_[type].assign(size(), NOT_SCORED);
+      has_score_[type] = true;
+    }
+  }
+  for (int i = 0; i < NUM_RANK_COLUMNS; i++) {
+    SCORER_TYPE_T type = RANK_COLUMNS[i].type;
+    if (columns[RANK_COLUMNS[i].column] && !has_rank_[type]) {
+      ranks_[type].assign(size(), 0);
+      has_rank_[type] = true;
+    }
+  }
+
+  int maxRank = Params::GetInt("top-match-in");
+  while (reader.hasNext()) {
+    if (maxRank == 0 || reader.getInteger(XCORR_RANK_COL) <= maxRank) {
+      addRow(reader, columns);
+    }
+    reader.next();
+  }
+}
+
+void PSMTable::addRow(MatchFileReader& reader, const vector<bool>& columns) {
+  file_.push_back(intern(reader.getString(FILE_COL)));
+  scan_.push_back(reader.getInteger(SCAN_COL));
+  charge_.push_back(reader.getInteger(CHARGE_COL));
+
+  // Peptide, as read by MatchFileReader::parsePeptide
+  string seq = reader.getString(SEQUENCE_COL);
+  if (seq.empty()) {
+    carp(CARP_FATAL, "No peptide sequence (%s).", seq.c_str());
+  }
+  if (seq.length() > 4 && seq[1] == '.' && seq[seq.length() - 2] == '.') {
+    seq = seq.substr(2, seq.length() - 4);
+  }
+  string unmodSeq = Crux::Peptide::unmodifySequence(seq);
+  vector<Crux::Modification> mods;
+  string modsString = reader.getString(MODIFICATIONS_COL);
+  if (!modsString.empty()) {
+    mods = Crux::Modification::Parse(modsString, &unmodSeq);
+  } else {
+    Crux::Modification::FromSeq(seq, NULL, &mods);
+  }
+  Crux::Peptide peptide;
+  peptide.setUnmodifiedSequence(unmodSeq);
+  peptide.setMods(mods);
+  sequence_.push_back(intern(unmodSeq));
+  modified_sequence_.push_back(intern(peptide.getModifiedSequenceWithMasses()));
+
+  string proteinIds = reader.getString(PROTEIN_ID_COL);
+  decoy_.push_back(!proteinIds.empty() &&
+                   StringUtils::StartsWith(proteinIds, Params::GetString("decoy-prefix")));
+
+  int experimentSize = 0;
+  if (!reader.empty(DISTINCT_MATCHES_SPECTRUM_COL)) {
+    distinct_matches_ = true;
+    experimentSize = reader.getInteger(DISTINCT_MATCHES_SPECTRUM_COL);
+  } else if (!reader.empty(MATCHES_SPECTRUM_COL)) {
+    experimentSize = reader.getInteger(MATCHES_SPECTRUM_COL);
+  }
+  experiment_size_.push_back(experimentSize);
+
+  // Scores in the columns this file has, and no score in the others.
+  vector<bool> scored(NUMBER_SCORER_TYPES, false);
+  for (int i = 0; i < NUM_SCORE_COLUMNS; i++) {
+    MATCH_COLUMNS_T column = SCORE_COLUMNS[i].column;
+    SCORER_TYPE_T type = SCORE_COLUMNS[i].type;
+    if (!columns[column] || reader.empty(column)) {
+      continue;
+    }
+    FLOAT_T score = reader.getFloat(column);
+    if (type == LOGP_BONF_WEIBULL_XCORR) {
+      score = score > 0 ? -log(score) : numeric_limits<FLOAT_T>::infinity();
+    }
+    scores_[type].push_back(score);
+    scored[type] = true;
+  }
+  for (int type = 0; type < NUMBER_SCORER_TYPES; type++) {
+    if (has_score_[type] && !scored[type]) {
+      scores_[type].push_back(NOT_SCORED);
+    }
+  }
+  vector<bool> ranked(NUMBER_SCORER_TYPES, false);
+  for (int i = 0; i < NUM_RANK_COLUMNS; i++) {
+    MATCH_COLUMNS_T column = RANK_COLUMNS[i].column;
+    SCORER_TYPE_T type = RANK_COLUMNS[i].type;
+    if (!columns[column] || reader.empty(column)) {
+      continue;
+    }
+    ranks_[type].push_back(reader.getInteger(column));
+    ranked[type] = true;
+  }
+  for (int type = 0; type < NUMBER_SCORER_TYPES; type++) {
+    if (has_rank_[type] && !ranked[type]) {
+      ranks_[type].push_back(0);
+    }
+  }
+}
+
+void PSMTable::load(MatchCollection* matches) {
+  // Scores the collection was parsed with, as in load(path), and ranks,
+  // which a Match reports as 0 when it has none.
+  for (int i = 0; i < NUM_SCORE_COLUMNS; i++) {
+    SCORER_TYPE_T type = SCORE_COLUMNS[i].type;
+    if (matches->getScoredType(type) && !has_score_[type]) {
+      scores_[type].assign(size(), NOT_SCORED);
+      has_score_[type] = true;
+    }
+  }
+  for (int i = 0; i < NUM_RANK_COLUMNS; i++) {
+    SCORER_TYPE_T type = RANK_COLUMNS[i].type;
+    if (!has_rank_[type]) {
+      ranks_[type].assign(size(), 0);
+      has_rank_[type] = true;
+    }
+  }
+  distinct_matches_ = distinct_matches_ || matches->getHasDistinctMatches();
+
+  MatchIterator iter(matches);
+  while (iter.hasNext()) {
+    Crux::Match* match = iter.next();
+    file_.push_back(intern(match->getSpectrum()->getFullFilename()));
+    scan_.push_back(match->getSpectrum()->getFirstScan());
+    charge_.push_back(match->getCharge());
+
+    Crux::Peptide* peptide = match->getPeptide();
+    char* seq = peptide->getSequence();
+    sequence_.push_back(intern(seq != NULL ? seq : ""));
+    free(seq);
+    modified_sequence_.push_back(intern(peptide->getModifiedSequenceWithMasses()));
+    decoy_.push_back(match->getNullPeptide());
+    experiment_size_.push_back(match->getTargetExperimentSize());
+
+    for (int type = 0; type < NUMBER_SCORER_TYPES; type++) {
+      if (has_score_[type]) {
+        scores_[type].push_back(matches->getScoredType((SCORER_TYPE_T)type) ?
+                                match->getScore((SCORER_TYPE_T)type) : NOT_SCORED);
+      }
+      if (has_rank_[type]) {
+        ranks_[type].push_back(match->getRank((SCORER_TYPE_T)type));
+      }
+    }
+  }
+}
+
+int PSMTable::intern(const string& str) {
+  pair<map<string, int>::iterator, bool> inserted =
+    string_index_.insert(make_pair(str, (int)strings_.size()));
+  if (inserted.second) {
+    strings_.push_back(&inserted.first->first);
+  }
+  return inserted.first->second;
+}
+
+int PSMTable::size() const {
+  return (int)scan_.size();
+}
+
+bool PSMTable::hasScore(SCORER_TYPE_T type) const {
+  return has_score_[type];
+}
+
+bool PSMTable::hasDistinctMatches() const {
+  return distinct_matches_;
+}
+
+FLOAT_T PSMTable::getScore(SCORER_TYPE_T type, int row) const {
+  return has_score_[type] ? scores_[type][row] : NOT_SCORED;
+}
+
+int PSMTable::getRank(SCORER_TYPE_T type, int row) const {
+  return has_rank_[type] ? ranks_[type][row] : 0;
+}
+
+const string& PSMTable::getFile(int row) const {
+  return *strings_[file_[row]];
+}
+
+int PSMTable::getScan(int row) const {
+  return scan_[row];
+}
+
+int PSMTable::getCharge(int row) const {
+  return charge_[row];
+}
+
+const string& PSMTable::getSequence(int row) const {
+  return *strings_[sequence_[row]];
+}
+
+const string& PSMTable::getModifiedSequence(int row) const {
+  return *strings_[modified_sequence_[row]];
+}
+
+bool PSMTable::isDecoy(int row) const {
+  return decoy_[row];
+}
+
+int PSMTable::getExperimentSize(int row) const {
+  return experiment_size_[row];
+}
+
+void PSMTable::setExperimentSize(int row, int size) {
+  experiment_size_[row] = size;
+}
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 2
+ * End:
+ */
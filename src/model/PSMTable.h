@@ -0,0 +1,136 @@
+/**
+ * \file PSMTable.h
+ * \brief A compact, column-oriented store of peptide-spectrum matches
+ * read from tab-delimited result files.
+ *
+ * Post-processing tools that only need the scores and a few identifying
+ * fields of each PSM can load them into a PSMTable rather than building
+ * a Crux::Match (with its Peptide, Spectrum and full score array) per
+ * row. Each score that is present in the input is kept in its own
+ * column, and strings such as file names and sequences are stored once
+ * and referred to by index.
+ */
+#ifndef PSM_TABLE_H
+#define PSM_TABLE_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include "model/objects.h"
+#include "util/utils.h"
+
+class MatchCollection;
+class MatchFileReader;
+
+class PSMTable {
+ public:
+  /**
+   * Creates an empty table.
+   */
+  PSMTable();
+
+  /**
+   * Appends the PSMs in a tab-delimited result file to the table. As
+   * when parsing matches, PSMs with an xcorr rank above top-match-in are
+   * skipped.
+   */
+  void load(const std::string& path);
+
+  /**
+   * Appends the PSMs of a collection parsed from a file in another
+   * format, in the order of the collection.
+   */
+  void load(MatchCollection* matches);
+
+  /**
+   * \returns the number of PSMs in the table.
+   */
+  int size() const;
+
+  /**
+   * \returns true if any loaded file had a column for the score type, or
+   * any collection was scored with it.
+   */
+  bool hasScore(SCORER_TYPE_T type) const;
+
+  /**
+   * \returns true if any PSM had a distinct matches/spectrum count.
+   */
+  bool hasDistinctMatches() const;
+
+  /**
+   * \returns the score of a PSM, or NOT_SCORED if it has none. As in
+   * Crux::Match, the Weibull p-value column is stored as a negative log
+   * p-value.
+   */
+  FLOAT_T getScore(SCORER_TYPE_T type, int row) const;
+
+  /**
+   * \returns the rank of a PSM by the score type, or 0 if it has none.
+   */
+  int getRank(SCORER_TYPE_T type, int row) const;
+
+  const std::string& getFile(int row) const;
+  int getScan(int row) const;
+  int getCharge(int row) const;
+
+  /**
+   * \returns the unmodified peptide sequence of a PSM.
+   */
+  const std::string& getSequence(int row) const;
+
+  /**
+   * \returns the peptide sequence of a PSM with modification masses, in
+   * the form of Peptide::getModifiedSequenceWithMasses().
+   */
+  const std::string& getModifiedSequence(int row) const;
+
+  /**
+   * \returns true if the PSM is to a decoy protein, as judged by
+   * decoy-prefix for tab-delimited files.
+   */
+  bool isDecoy(int row) const;
+
+  /**
+   * The number of candidate peptides the spectrum was compared to.
+   */
+  int getExperimentSize(int row) const;
+  void setExperimentSize(int row, int size);
+
+ private:
+  // Not copyable, since strings_ points into string_index_.
+  PSMTable(const PSMTable&);
+  PSMTable& operator=(const PSMTable&);
+
+  int intern(const std::string& str);
+  void addRow(MatchFileReader& reader, const std::vector<bool>& columns);
+
+  std::map<std::string, int> string_index_;   ///< Each distinct string once
+  std::vector<const std::string*> strings_;   ///< The strings, by index
+
+  std::vector<int> file_;
+  std::vector<int> scan_;
+  std::vector<int> charge_;
+  std::vector<int> sequence_;
+  std::vector<int> modified_sequence_;
+  std::vector<bool> decoy_;
+  std::vector<int> experiment_size_;
+  bool distinct_matches_;
+
+  /**
+   * One column per score type, allocated only if some file had that score.
+   */
+  std::vector<FLOAT_T> scores_[NUMBER_SCORER_TYPES];
+  std::vector<int> ranks_[NUMBER_SCORER_TYPES];
+  bool has_score_[NUMBER_SCORER_TYPES];
+  bool has_rank_[NUMBER_SCORER_TYPES];
+};
+
+#endif
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 2
+ * End:
+ */
@@ -18,6 +18,8 @@
 #include <stdlib.h>
 #include "util/utils.h"
 #include <vector>
+#include <iterator>
+#include <cstddef>
 #include "model/objects.h"
 
 class Peak {
@@ -84,20 +86,51 @@ private:
 };
 
 /**
- * Return a vector of allocated Peak pointers
+ * \class PeakIterator
+ * \brief Iterates over the peaks of a Spectrum, which are stored
+ * contiguously. Dereferencing yields a pointer to the peak, so callers
+ * written against a container of Peak pointers keep working.
  */
-std::vector<Peak*> allocate_peak_vector(unsigned int num_peaks);
+class PeakIterator {
+public:
+    typedef std::random_access_iterator_tag iterator_category;
+    typedef Peak* value_type;
+    typedef ptrdiff_t difference_type;
+    typedef Peak** pointer;
+    typedef Peak* reference;
+
+    PeakIterator() : peak_(NULL) {}
+    explicit PeakIterator(Peak* peak) : peak_(peak) {}
+
+    Peak* operator*() const { return peak_; }
+    Peak* operator[](ptrdiff_t n) const { return peak_ + n; }
+
+    PeakIterator& operator++() { ++peak_; return *this; }
+    PeakIterator operator++(int) { PeakIterator old(*this); ++peak_; return old; }
+    PeakIterator& operator--() { --peak_; return *this; }
+    PeakIterator operator--(int) { PeakIterator old(*this); --peak_; return old; }
+    PeakIterator& operator+=(ptrdiff_t n) { peak_ += n; return *this; }
+    PeakIterator& operator-=(ptrdiff_t n) { peak_ -= n; return *this; }
+    PeakIterator operator+(ptrdiff_t n) const { return PeakIterator(peak_ + n); }
+    PeakIterator operator-(ptrdiff_t n) const { return PeakIterator(peak_ - n); }
+    ptrdiff_t operator-(const PeakIterator& other) const { return peak_ - other.peak_; }
+
+    bool operator==(const PeakIterator& other) const { return peak_ == other.peak_; }
+    bool operator!=(const PeakIterator& other) const { return peak_ != other.peak_; }
+    bool operator<(const PeakIterator& other) const { return peak_ < other.peak_; }
+    bool operator>(const PeakIterator& other) const { return peak_ > other.peak_; }
+    bool operator<=(const PeakIterator& other) const { return peak_ <= other.peak_; }
+    bool operator>=(const PeakIterator& other) const { return peak_ >= other.peak_; }
 
-/**
- * Free a Peak pointer array
- */
-void free_peak_vector(std::vector<Peak*> &peaks);
+private:
+    Peak* peak_;
+};
 
 /**
  * Sort peaks by their intensity or location
  * Use the lib function sort()
  */
-void sort_peaks(std::vector<Peak*> &peak_array, PEAK_SORT_TYPE_T sort_type);
+void sort_peaks(std::vector<Peak> &peak_array, PEAK_SORT_TYPE_T sort_type);
 
 /*
  * Local Variables:
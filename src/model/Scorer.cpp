@@ -956,6 +956,72 @@ void Scorer::getProcessedPeaks(
 
 
 
+/**
+ * Adds the observed intensities matched by one B, Y or A ion to the
+ * sums of an XCORR score.
+ * \returns false if the ion is of any other type
+ */
+inline bool Scorer::addIonIntensity(
+  ION_TYPE_T ion_type, ///< the ion type
+  int ion_charge, ///< the ion charge
+  FLOAT_T ion_mass_z, ///< the ion mass/z
+  int max_bin, ///< the max bin index of the observed array
+  FLOAT_T& B_Y_sum, ///< sum of intensities at B and Y ions -in/out
+  FLOAT_T& FLANK_sum, ///< sum of intensities flanking them -in/out
+  FLOAT_T& LOSS_sum ///< sum of intensities at losses and A ions -in/out
+  ) {
+
+  FLOAT_T bin_width = bin_width_;
+  FLOAT_T bin_offset = bin_offset_;
+  int intensity_array_idx 
+    = INTEGERIZE(ion_mass_z, bin_width, bin_offset);
+
+  // skip ions that are located beyond max mz limit
+  if(intensity_array_idx >= max_bin){
+    return true;
+  }
+
+  // is it B, Y ion?
+  if(ion_type == B_ION || 
+     ion_type == Y_ION){
+
+    //      if (!ion->isModified()){
+    // Add peaks of intensity 50.0 for B, Y type ions. 
+    // In addition, add peaks of intensity of 25.0 to +/- 1 m/z flanking each B, Y ion if requested.
+    // Skip ions that are located beyond max mz limit
+    B_Y_sum += observed_[intensity_array_idx];
+    if (use_flanks_) {
+      FLANK_sum += observed_[intensity_array_idx-1];
+      if ((intensity_array_idx + 1) < max_bin) {
+        FLANK_sum += observed_[intensity_array_idx+1];
+      }
+    }
+      
+    // add neutral loss of water and NH3
+    if(ion_type == B_ION){
+      int h2o_array_idx = 
+        INTEGERIZE((ion_mass_z - (MASS_H2O_MONO/ion_charge)),
+                     bin_width, bin_offset);  
+      LOSS_sum += observed_[h2o_array_idx];
+    }
+
+    int nh3_array_idx 
+      = INTEGERIZE((ion_mass_z -  (MASS_NH3_MONO/ion_charge)),
+                     bin_width, bin_offset);
+    LOSS_sum += observed_[nh3_array_idx];
+
+  }// is it A ion?
+  else if(ion_type == A_ION){
+    // Add peaks of intensity 10.0 for A type ions.
+    LOSS_sum += observed_[intensity_array_idx];
+  }
+  else{// ERROR!, only should create B, Y, A type ions for xcorr theoreical 
+    carp(CARP_ERROR, "only should create B, Y, A type ions for xcorr theoretical spectrum");
+    return false;
+  }
+  return true;
+}
+
 /**
  * Score the ion series directly.
  * \returns the calculated XCORR score.
@@ -968,12 +1034,6 @@ FLOAT_T Scorer::scoreIntensityIonSeries(
   FLOAT_T ans = 0.0;
   
   Ion* ion = NULL;
-  int intensity_array_idx = 0;
-  int ion_charge = 0;
-  ION_TYPE_T ion_type;
-  FLOAT_T ion_mass_z = 0;
-  FLOAT_T bin_width = bin_width_;
-  FLOAT_T bin_offset = bin_offset_;
   int max_bin = getMaxBin();
   FLOAT_T B_Y_sum = 0.0;
   FLOAT_T FLANK_sum = 0.0;
@@ -988,59 +1048,41 @@ FLOAT_T Scorer::scoreIntensityIonSeries(
     ++ion_iterator) {
     
     ion = *ion_iterator;
-    
-    ion_mass_z = ion->getMassZ();
-    intensity_array_idx 
-      = INTEGERIZE(ion_mass_z, bin_width, bin_offset);
-
-    // skip ions that are located beyond max mz limit
-    if(intensity_array_idx >= max_bin){
-      continue;
+    if (!addIonIntensity(ion->getType(), ion->getCharge(), ion->getMassZ(),
+                         max_bin, B_Y_sum, FLANK_sum, LOSS_sum)) {
+      return 0;
     }
-    ion_type = ion->getType();
-
-    // is it B, Y ion?
-    if(ion_type == B_ION || 
-       ion_type == Y_ION){
-
-      //      if (!ion->isModified()){
-      // Add peaks of intensity 50.0 for B, Y type ions. 
-      // In addition, add peaks of intensity of 25.0 to +/- 1 m/z flanking each B, Y ion if requested.
-      // Skip ions that are located beyond max mz limit
-      B_Y_sum += observed_[intensity_array_idx];
-      if (use_flanks_) {
-        FLANK_sum += observed_[intensity_array_idx-1];
-        if ((intensity_array_idx + 1) < max_bin) {
-          FLANK_sum += observed_[intensity_array_idx+1];
-	      }
-      }
-        
-      // add neutral loss of water and NH3
-      ion_charge = ion->getCharge();
-      if(ion_type == B_ION){
-        int h2o_array_idx = 
-          INTEGERIZE((ion_mass_z - (MASS_H2O_MONO/ion_charge)),
-                       bin_width, bin_offset);  
-        LOSS_sum += observed_[h2o_array_idx];
-      }
+  }
 
-      int nh3_array_idx 
-        = INTEGERIZE((ion_mass_z -  (MASS_NH3_MONO/ion_charge)),
-                       bin_width, bin_offset);
-      LOSS_sum += observed_[nh3_array_idx];
+  ans = B_Y_sum * B_Y_HEIGHT + FLANK_sum * FLANK_HEIGHT + LOSS_sum * LOSS_HEIGHT;
+  return ans / 10000.0;
+}
 
-    }// is it A ion?
-    else if(ion_type == A_ION){
-      // Add peaks of intensity 10.0 for A type ions.
-      LOSS_sum += observed_[intensity_array_idx];
-    }
-    else{// ERROR!, only should create B, Y, A type ions for xcorr theoreical 
-      carp(CARP_ERROR, "only should create B, Y, A type ions for xcorr theoretical spectrum");
+/**
+ * Scores ions given by their type, charge and mass/z against the
+ * observed array, without needing Ion objects.
+ * \returns the calculated XCORR score.
+ */
+FLOAT_T Scorer::scoreIntensityIons(
+  const ION_TYPE_T* ion_types, ///< type of each ion, B, Y or A -in
+  const int* ion_charges, ///< charge of each ion -in
+  const FLOAT_T* ion_mass_zs, ///< mass/z of each ion -in
+  int num_ions ///< the number of ions -in
+  ) {
+
+  int max_bin = getMaxBin();
+  FLOAT_T B_Y_sum = 0.0;
+  FLOAT_T FLANK_sum = 0.0;
+  FLOAT_T LOSS_sum = 0.0;
+
+  for (int ion_idx = 0; ion_idx < num_ions; ++ion_idx) {
+    if (!addIonIntensity(ion_types[ion_idx], ion_charges[ion_idx], ion_mass_zs[ion_idx],
+                         max_bin, B_Y_sum, FLANK_sum, LOSS_sum)) {
       return 0;
     }
   }
 
-  ans = B_Y_sum * B_Y_HEIGHT + FLANK_sum * FLANK_HEIGHT + LOSS_sum * LOSS_HEIGHT;
+  FLOAT_T ans = B_Y_sum * B_Y_HEIGHT + FLANK_sum * FLANK_HEIGHT + LOSS_sum * LOSS_HEIGHT;
   return ans / 10000.0;
 }
 
@@ -163,6 +163,21 @@ class Scorer {
     IonSeries* ion_series
   );
 
+  /**
+   * Adds the observed intensities matched by one B, Y or A ion to the
+   * sums of an XCORR score.
+   * \returns false if the ion is of any other type
+   */
+  inline bool addIonIntensity(
+    ION_TYPE_T ion_type, ///< the ion type
+    int ion_charge, ///< the ion charge
+    FLOAT_T ion_mass_z, ///< the ion mass/z
+    int max_bin, ///< the max bin index of the observed array
+    FLOAT_T& B_Y_sum, ///< sum of intensities at B and Y ions -in/out
+    FLOAT_T& FLANK_sum, ///< sum of intensities flanking them -in/out
+    FLOAT_T& LOSS_sum ///< sum of intensities at losses and A ions -in/out
+  );
+
   /*****************************************************
    * General purpose functions
    * 
@@ -377,6 +392,20 @@ class Scorer {
     int charge               ///< the peptide charge -in 
     );
 
+  /**
+   * Scores ions given by their type, charge and mass/z against the
+   * observed array, as scoreIntensityIonSeries scores the ions of an
+   * ion series, but without needing Ion objects.  The scorer must
+   * already have its observed array from createIntensityArrayXcorr.
+   * \returns the calculated XCORR score.
+   */
+  FLOAT_T scoreIntensityIons(
+    const ION_TYPE_T* ion_types, ///< type of each ion, B, Y or A -in
+    const int* ion_charges, ///< charge of each ion -in
+    const FLOAT_T* ion_mass_zs, ///< mass/z of each ion -in
+    int num_ions ///< the number of ions -in
+    );
+
   /**
    * Uses an iterative cross correlation
    *
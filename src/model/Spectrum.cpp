@@ -20,6 +20,8 @@
 #include "io/carp.h"
 #include <vector>
 #include <string>
+#include <algorithm>
+#include <utility>
 #include "io/DelimitedFile.h"
 #include "io/MatchFileReader.h"
 #include "MSToolkit/Spectrum.h"
@@ -46,9 +48,8 @@ Spectrum::Spectrum() :
    has_peaks_(false),
    sorted_by_mz_(false),
    sorted_by_intensity_(false),
-   has_mz_peak_array_(false)
+   has_mz_index_(false)
 {
-  mz_peak_array_ = NULL;
 }
 
 /**
@@ -74,10 +75,8 @@ Spectrum::Spectrum (
    has_peaks_(false),
    sorted_by_mz_(false),
    sorted_by_intensity_(false),
-   has_mz_peak_array_(false)
+   has_mz_index_(false)
  {
-  mz_peak_array_ = NULL;
-
   for (unsigned int idx=0;idx<possible_z.size();idx++) {
     SpectrumZState zstate;
     zstate.setMZ(precursor_mz, possible_z.at(idx));
@@ -90,11 +89,6 @@ Spectrum::Spectrum (
  */
 Spectrum::~Spectrum()
 {
-  free_peak_vector(peaks_);
-  
-  if(has_mz_peak_array_){
-    delete [] mz_peak_array_;
-  }
 }
 
 /**
@@ -102,7 +96,7 @@ Spectrum::~Spectrum()
  * in the spectrum
  */
 PeakIterator Spectrum::begin() const {
-  return peaks_.begin();
+  return PeakIterator(peaks_.empty() ? NULL : const_cast<Peak*>(&peaks_[0]));
 }
 
 /**
@@ -110,7 +104,7 @@ PeakIterator Spectrum::begin() const {
  * in the spectrum
  */
 PeakIterator Spectrum::end() const {
-  return peaks_.end();
+  return begin() + peaks_.size();
 }
 
 /**
@@ -159,8 +153,8 @@ void Spectrum::print(FILE* file) ///< output file to print at -out
   for(int peak_idx = 0; peak_idx < (int)peaks_.size(); ++peak_idx){
     fprintf(file, "%.*f %.4f\n",
             mass_precision,
-            peaks_[peak_idx]->getLocation(),
-            peaks_[peak_idx]->getIntensity());
+            peaks_[peak_idx].getLocation(),
+            peaks_[peak_idx].getIntensity());
   }
 }
 
@@ -269,20 +263,17 @@ void Spectrum::printSqt(
  has_peaks_(old_spectrum.has_peaks_),
  sorted_by_mz_(old_spectrum.sorted_by_mz_),
  sorted_by_intensity_(old_spectrum.sorted_by_intensity_),
- has_mz_peak_array_(old_spectrum.has_mz_peak_array_)
+ has_mz_index_(false)
 {
 
   // copy each peak
+  peaks_.reserve(old_spectrum.peaks_.size());
   for(int peak_idx=0; peak_idx < (int)old_spectrum.peaks_.size(); ++peak_idx){
-    this->addPeak(old_spectrum.peaks_[peak_idx]->getIntensity(),
-                  old_spectrum.peaks_[peak_idx]->getLocation());
-  }
-
-  /*  Should we do this??
-  if( old_spectrum.mz_peak_array ){
-    populateMzPeakArray();
+    this->addPeak(old_spectrum.peaks_[peak_idx].getIntensity(),
+                  old_spectrum.peaks_[peak_idx].getLocation());
   }
-  */
+  sorted_by_mz_ = old_spectrum.sorted_by_mz_;
+  sorted_by_intensity_ = old_spectrum.sorted_by_intensity_;
 }
 
 void Spectrum::copyFrom(Spectrum *src) {
@@ -297,20 +288,18 @@ void Spectrum::copyFrom(Spectrum *src) {
  i_lines_v_  = src->i_lines_v_;
  d_lines_v_ = src-> d_lines_v_;
  has_peaks_ = src-> has_peaks_;
- sorted_by_mz_ = src->sorted_by_mz_;
- sorted_by_intensity_ = src->sorted_by_intensity_;
- has_mz_peak_array_ = src->has_mz_peak_array_;
- // copy each peak
+ has_mz_index_ = false;
+ // replace any peaks this spectrum already has with copies of src's
+ peaks_.clear();
+ total_energy_ = 0;
+ peaks_.reserve(src->peaks_.size());
  for(int peak_idx=0; peak_idx < (int)src->peaks_.size(); ++peak_idx){
-   this->addPeak(src->peaks_[peak_idx]->getIntensity(),
-                  src->peaks_[peak_idx]->getLocation());
-  }
-
-  /*  Should we do this??
-  if( old_spectrum.mz_peak_array ){
-    populateMzPeakArray();
+   this->addPeak(src->peaks_[peak_idx].getIntensity(),
+                  src->peaks_[peak_idx].getLocation());
   }
-  */
+ // addPeak clears the sort flags, and the copies are in src's order
+ sorted_by_mz_ = src->sorted_by_mz_;
+ sorted_by_intensity_ = src->sorted_by_intensity_;
 
 }
 
@@ -326,10 +315,10 @@ bool Spectrum::parseMstoolkitSpectrum
   // clear any existing values
   zstates_.clear();
 
-  free_peak_vector(peaks_);
+  peaks_.clear();
   i_lines_v_.clear();
   d_lines_v_.clear();
-  if( mz_peak_array_ ){ delete [] mz_peak_array_; }
+  has_mz_index_ = false;
 
   MSToolkit::Spectrum* mst_real_spectrum = (MSToolkit::Spectrum*)mst_spectrum;
 
@@ -342,6 +331,7 @@ bool Spectrum::parseMstoolkitSpectrum
   filename_ = filename;
 
   //add all peaks.
+  peaks_.reserve(mst_real_spectrum->size());
   for(int peak_idx = 0; peak_idx < (int)mst_real_spectrum->size(); peak_idx++){
     this->addPeak(mst_real_spectrum->at(peak_idx).intensity,
                    mst_real_spectrum->at(peak_idx).mz);
@@ -377,10 +367,10 @@ bool Spectrum::parsePwizSpecInfo(
   // clear any existing values
   zstates_.clear();
   ezstates_.clear();
-  free_peak_vector(peaks_);
+  peaks_.clear();
   i_lines_v_.clear();
   d_lines_v_.clear();
-  if( mz_peak_array_ ){ free(mz_peak_array_); }
+  has_mz_index_ = false;
 
   // assign new values
   first_scan_ = firstScan;
@@ -390,6 +380,7 @@ bool Spectrum::parsePwizSpecInfo(
   int num_peaks = pwiz_spectrum->defaultArrayLength;
   vector<double>& mzs = pwiz_spectrum->getMZArray()->data;
   vector<double>& intensities = pwiz_spectrum->getIntensityArray()->data;
+  peaks_.reserve(num_peaks);
   for(int peak_idx = 0; peak_idx < num_peaks; peak_idx++){
     addPeak(intensities[peak_idx], mzs[peak_idx]);
   }
@@ -504,10 +495,11 @@ void Spectrum::addPeak
   FLOAT_T location_mz ///< the location of peak to add -in
   )
 {
-  Peak *peak = new Peak(intensity, location_mz);
-  peaks_.push_back(peak);
+  peaks_.push_back(Peak(intensity, location_mz));
   updateFields(intensity, location_mz);
   has_peaks_ = true;
+  has_mz_index_ = false;
+  sorted_by_mz_ = sorted_by_intensity_ = false;
 }
 
 void Spectrum::truncatePeaks(int count) {
@@ -519,10 +511,9 @@ void Spectrum::truncatePeaks(int count) {
   }
   min_peak_mz_ = count > 0 ? numeric_limits<FLOAT_T>::max() : 0;
   max_peak_mz_ = 0;
-  vector<Peak*>::const_iterator removePoint = peaks_.begin() + count;
-  for (vector<Peak*>::const_iterator i = peaks_.begin(); i != peaks_.end(); i++) {
-    if (i < removePoint) {
-      FLOAT_T mz = (*i)->getLocation();
+  for (int peak_idx = 0; peak_idx < (int)peaks_.size(); peak_idx++) {
+    if (peak_idx < count) {
+      FLOAT_T mz = peaks_[peak_idx].getLocation();
       if (mz < min_peak_mz_) {
         min_peak_mz_ = mz;
       }
@@ -530,43 +521,64 @@ void Spectrum::truncatePeaks(int count) {
         max_peak_mz_ = mz;
       }
     } else {
-      total_energy_ -= (*i)->getIntensity();
-      delete *i;
+      total_energy_ -= peaks_[peak_idx].getIntensity();
     }
   }
-  peaks_.resize(count);
+  peaks_.erase(peaks_.begin() + count, peaks_.end());
+  has_mz_index_ = false;
 }
 
 /**
- * Creates and fills mz_peak_array_, the array of pointers to peaks
- * in the Spectrum's vector of peaks.  Peaks in the array are
- * indexed by ???
+ * Creates and fills the m/z index, the peak m/z values in ascending
+ * order along with the position of each peak in the Spectrum's
+ * vector of peaks, so that peaks can be looked up by binary search.
  */
-void Spectrum::populateMzPeakArray()
+void Spectrum::populateMzIndex()
 {
-  if (has_mz_peak_array_ == true){
+  if (has_mz_index_) {
     return;
   }
-  
-  int array_length = MZ_TO_PEAK_ARRAY_RESOLUTION * MAX_PEAK_MZ;
-  mz_peak_array_ = new Peak * [array_length];
-  for (int peak_idx = 0; peak_idx < array_length; peak_idx++){
-    mz_peak_array_[peak_idx] = NULL;
+
+  int num_peaks = (int)peaks_.size();
+  vector< pair<FLOAT_T, int> > order;
+  order.reserve(num_peaks);
+  for (int peak_idx = 0; peak_idx < num_peaks; peak_idx++) {
+    order.push_back(make_pair(peaks_[peak_idx].getLocation(), peak_idx));
   }
-  for(int peak_idx = 0; peak_idx < (int)peaks_.size(); peak_idx++){
-    Peak * peak = peaks_[peak_idx];
-    FLOAT_T peak_mz = peak->getLocation();
-    int mz_idx = (int) (peak_mz * MZ_TO_PEAK_ARRAY_RESOLUTION);
-    if (mz_peak_array_[mz_idx] != NULL){
-      carp(CARP_INFO, "Peak collision at mz %.3f = %i", peak_mz, mz_idx);
-      if (mz_peak_array_[mz_idx]->getIntensity() < peak->getIntensity()) {
-        mz_peak_array_[mz_idx] = peak;
-      }
-    } else {
-      mz_peak_array_[mz_idx] = peak; 
-    }
+  if (!sorted_by_mz_) {
+    sort(order.begin(), order.end());
   }
-  has_mz_peak_array_ = true;
+  mz_index_mz_.resize(num_peaks);
+  mz_index_peak_.resize(num_peaks);
+  for (int i = 0; i < num_peaks; i++) {
+    mz_index_mz_[i] = order[i].first;
+    mz_index_peak_[i] = order[i].second;
+  }
+  has_mz_index_ = true;
+}
+
+/**
+ * Finds the positions in mz_index_mz_ of the peaks within 'max' of
+ * 'mz', building the index if needed.
+ * \returns false if there are no such peaks.
+ */
+bool Spectrum::findPeakRange(
+  FLOAT_T mz, ///< the m/z to look around -in
+  FLOAT_T max, ///< the maximum distance from mz -in
+  int* first, ///< the first peak in range -out
+  int* last ///< one past the last peak in range -out
+  )
+{
+  populateMzIndex(); // for rapid peak lookup by mz
+
+  vector<FLOAT_T>::const_iterator begin = mz_index_mz_.begin();
+  vector<FLOAT_T>::const_iterator low =
+    lower_bound(begin, mz_index_mz_.end(), mz - max);
+  vector<FLOAT_T>::const_iterator high =
+    upper_bound(low, mz_index_mz_.end(), mz + max);
+  *first = (int)(low - begin);
+  *last = (int)(high - begin);
+  return *first < *last;
 }
 
 /**
@@ -574,40 +586,27 @@ void Spectrum::populateMzPeakArray()
  * NULL if no peak.
  * This should lazily create the data structures within the
  * spectrum object that it needs.
- * TODO: reimplement with faster peak lookup
  */
 Peak * Spectrum::getNearestPeak(
   FLOAT_T mz, ///< the mz of the peak around which to sum intensities -in
   FLOAT_T max ///< the maximum distance to get intensity -in
   )
 {
-  this->populateMzPeakArray(); // for rapid peak lookup by mz
+  int first, last;
+  if (!findPeakRange(mz, max, &first, &last)) {
+    return NULL;
+  }
 
   FLOAT_T min_distance = BILLION;
-  int min_mz_idx = (int)((mz - max) * MZ_TO_PEAK_ARRAY_RESOLUTION + 0.5);
-  min_mz_idx = min_mz_idx < 0 ? 0 : min_mz_idx;
-  int max_mz_idx = (int)((mz + max) * MZ_TO_PEAK_ARRAY_RESOLUTION + 0.5);
-  int absolute_max_mz_idx = MAX_PEAK_MZ * MZ_TO_PEAK_ARRAY_RESOLUTION - 1;
-  max_mz_idx = max_mz_idx > absolute_max_mz_idx 
-    ? absolute_max_mz_idx : max_mz_idx;
-  Peak * peak = NULL;
-  Peak * nearest_peak = NULL;
-  int peak_idx;
-  for (peak_idx=min_mz_idx; peak_idx < max_mz_idx + 1; peak_idx++){
-    if ((peak = mz_peak_array_[peak_idx]) == NULL){
-      continue;
-    }
-    FLOAT_T peak_mz = peak->getLocation();
-    FLOAT_T distance = fabs(mz - peak_mz);
-    if (distance > max){
-      continue;
-    }
-    if (distance < min_distance){
-      nearest_peak = peak;
+  int nearest_idx = -1;
+  for (int i = first; i < last; i++) {
+    FLOAT_T distance = fabs(mz - mz_index_mz_[i]);
+    if (distance < min_distance) {
+      nearest_idx = mz_index_peak_[i];
       min_distance = distance;
     }
   }
-  return nearest_peak;
+  return nearest_idx < 0 ? NULL : &peaks_[nearest_idx];
 }
 
 /**
@@ -622,18 +621,17 @@ Peak* Spectrum::getMaxIntensityPeak(
   FLOAT_T max ///< the maximum distance to get intensity -in
   ) {
 
+  int first, last;
+  if (!findPeakRange(mz, max, &first, &last)) {
+    return NULL;
+  }
+
   FLOAT_T max_intensity = -BILLION;
   Peak* max_intensity_peak = NULL;
-
-  for (PeakIterator peak_iter = begin();
-    peak_iter != end();
-    ++peak_iter) {
-
-    Peak* peak = *peak_iter;
-    FLOAT_T peak_mz = peak->getLocation();
-    FLOAT_T distance = fabs(mz - peak_mz);
+  for (int i = first; i < last; i++) {
+    Peak* peak = &peaks_[mz_index_peak_[i]];
     FLOAT_T intensity = peak->getIntensity();
-    if ((distance <= max) && (intensity > max_intensity)){
+    if (intensity > max_intensity) {
       max_intensity_peak = peak;
       max_intensity = intensity;
     }
@@ -841,8 +839,8 @@ FLOAT_T Spectrum::getMaxPeakIntensity()
   FLOAT_T max_intensity = -1;
 
   for(int peak_idx = 0; peak_idx < (int)peaks_.size(); ++peak_idx){
-    if (max_intensity <= peaks_[peak_idx]->getIntensity()) {
-      max_intensity = peaks_[peak_idx]->getIntensity();
+    if (max_intensity <= peaks_[peak_idx].getIntensity()) {
+      max_intensity = peaks_[peak_idx].getIntensity();
     }
   }
   return max_intensity; 
@@ -854,9 +852,9 @@ FLOAT_T Spectrum::getMaxPeakIntensity()
 void Spectrum::sumNormalize()
 {
   for(int peak_idx = 0; peak_idx < (int)peaks_.size(); peak_idx++){
-    Peak * peak = peaks_[peak_idx];
-    FLOAT_T new_intensity = peak->getIntensity() / total_energy_;
-    peak->setIntensity(new_intensity);
+    Peak& peak = peaks_[peak_idx];
+    FLOAT_T new_intensity = peak.getIntensity() / total_energy_;
+    peak.setIntensity(new_intensity);
   }
 }
 
@@ -870,6 +868,7 @@ void Spectrum::sortPeaks(PEAK_SORT_TYPE_T type)
     return;
   }
   sort_peaks(peaks_, type);
+  has_mz_index_ = false;
   sorted_by_mz_ = (type == _PEAK_LOCATION);
   sorted_by_intensity_ = (type == _PEAK_INTENSITY);
 }
@@ -879,15 +878,12 @@ void Spectrum::sortPeaks(PEAK_SORT_TYPE_T type)
  */
 void Spectrum::rankPeaks()
 {
-  sort_peaks(peaks_, _PEAK_INTENSITY);
-  sorted_by_intensity_ = true;
-  sorted_by_mz_ = false;
+  sortPeaks(_PEAK_INTENSITY);
   int rank = (int)peaks_.size();
   for(int peak_idx = 0; peak_idx < (int) peaks_.size(); peak_idx++){
-    Peak * peak = peaks_[peak_idx];
     FLOAT_T new_rank = rank/(float)peaks_.size();
     rank--;
-    peak->setIntensityRank(new_rank);
+    peaks_[peak_idx].setIntensityRank(new_rank);
   }
 
 }
@@ -917,19 +913,19 @@ bool Spectrum::assignZState() {
   // sum peaks below and above the precursor m/z window separately
   FLOAT_T left_sum = 0.00001;
   FLOAT_T right_sum = 0.00001;
-  for (vector<Peak*>::const_iterator i = peaks_.begin(); i != peaks_.end(); i++) {
-    FLOAT_T location = (*i)->getLocation();
+  for (vector<Peak>::const_iterator i = peaks_.begin(); i != peaks_.end(); i++) {
+    FLOAT_T location = i->getLocation();
     if (location < precursor_mz_ - 20) {
-      left_sum += (*i)->getIntensity();
+      left_sum += i->getIntensity();
     } else if (location > precursor_mz_ + 20) {
-      right_sum += (*i)->getIntensity();
+      right_sum += i->getIntensity();
     } // else, skip peaks around precursor
   }
 
   // What is the justification for this? Ask Mike MacCoss
   FLOAT_T FractionWindow = 0;
   FLOAT_T CorrectionFactor = 1;
-  FLOAT_T max_peak_mz = peaks_.back()->getLocation();
+  FLOAT_T max_peak_mz = peaks_.back().getLocation();
   if ((precursor_mz_ * 2) >= max_peak_mz) {
     FractionWindow = (precursor_mz_ * 2) - max_peak_mz;
     CorrectionFactor = fabs((precursor_mz_ - FractionWindow)) / precursor_mz_;
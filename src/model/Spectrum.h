@@ -49,7 +49,7 @@ class Spectrum{
   FLOAT_T          precursor_mz_;  ///< The m/z of precursor (MS-MS spectra)
   std::vector<SpectrumZState> zstates_;
   std::vector<SpectrumZState> ezstates_;
-  std::vector<Peak*>  peaks_;         ///< The spectrum peaks
+  std::vector<Peak> peaks_;        ///< The spectrum peaks, stored contiguously
   FLOAT_T          min_peak_mz_;   ///< The minimum m/z of all peaks
   FLOAT_T          max_peak_mz_;   ///< The maximum m/z of all peaks
   double           total_energy_;  ///< The sum of intensities in all peaks
@@ -62,15 +62,11 @@ class Spectrum{
   bool             has_peaks_;  ///< Does the spectrum contain peak information
   bool             sorted_by_mz_; ///< Are the spectrum peaks sorted by m/z...
   bool             sorted_by_intensity_; ///< ... or by intensity?
-  bool             has_mz_peak_array_; ///< Is the mz_peak_array populated.
-  Peak         **mz_peak_array_;  ///< Allows rapid peak retrieval by mz.
+  bool             has_mz_index_; ///< Are mz_index_mz_/mz_index_peak_ current?
+  std::vector<FLOAT_T> mz_index_mz_; ///< Peak m/z values in ascending order...
+  std::vector<int> mz_index_peak_;   ///< ...and the index of each in peaks_.
 
   // constants
-  /**
-   * m/z resolution.  I.e., 5 == 0.2 m/z units
-   */
-  static const int MZ_TO_PEAK_ARRAY_RESOLUTION = 5;
-  static const int MAX_PEAK_MZ = 5000; ///< Maximum possible m/z value.
   static const int MAX_CHARGE = 6;     ///< Maximum allowed charge.
   
   // private methods
@@ -82,6 +78,18 @@ class Spectrum{
      FLOAT_T location  ///< the location of the peak that has been added -in
      );
 
+  /**
+   * Finds the positions in mz_index_mz_ of the peaks within 'max' of
+   * 'mz', building the index if needed.
+   * \returns false if there are no such peaks.
+   */
+  bool findPeakRange
+    (FLOAT_T mz,  ///< the m/z to look around -in
+     FLOAT_T max, ///< the maximum distance from mz -in
+     int* first,  ///< the first peak in range -out
+     int* last    ///< one past the last peak in range -out
+     );
+
  public:
   /**
    * Default constructor.
@@ -337,11 +345,11 @@ class Spectrum{
   void truncatePeaks(int count);
 
   /**
-   * Creates and fills mz_peak_array_, the array of pointers to peaks
-   * in the Spectrum's vector of peaks.  Peaks in the array are
-   * indexed by ???
+   * Creates and fills the m/z index, the peak m/z values in ascending
+   * order along with the position of each peak in the Spectrum's
+   * vector of peaks, so that peaks can be looked up by binary search.
    */
-  void populateMzPeakArray();
+  void populateMzIndex();
 
   /**
    *if ms2 file dose not have any Z line then assignZState will create it  
@@ -74,10 +74,10 @@ typedef enum _peak_sort_type PEAK_SORT_TYPE_T;
 namespace Crux { class Spectrum; }
 
 /**
- * \typedef PeakIterator
+ * \class PeakIterator
  * \brief An object to iterate over the peaks in a spectrum
  */
-typedef std::vector<Peak*>::const_iterator PeakIterator;
+class PeakIterator;
 
 /**
  * \class SpectrumCollection
@@ -287,12 +287,35 @@ Params::Params() : finalized_(false) {
     "\"PMAEK\"; setting it to \"N\" will yield \"EKPMA\"; and setting it to \"none\" will "
     "yield \"KPMAE\".",
     "Available for tide-index.", true);
+  InitStringParam("peptide-index-format", "records", "records|columnar",
+    "Layout of the peptides in the index. 'records' stores each peptide as a "
+    "compressed record, giving the smallest index. 'columnar' stores the "
+    "peptides as fixed-width arrays that tide-search memory-maps, so that it "
+    "can skip directly to the peptides within the precursor window of the "
+    "lightest spectrum instead of reading every lighter peptide. tide-search "
+    "and other commands that read the index detect the format automatically.",
+    "Available for tide-index.", true);
   InitBoolParam("peptide-list", false,
     "Create in the output directory a text file listing of all the peptides in the "
     "database, along with their neutral masses, one per line. If decoys are generated, "
     "then a second file will be created containing the decoy peptides. Decoys that also "
     "appear in the target database are marked with an asterisk in a third column.",
     "Available for tide-index.", true);
+  InitIntParam("max-memory", 0, 0, BILLION,
+    "Approximate limit, in megabytes, on the memory used to hold unmodified "
+    "peptides (tide-index) or spectra (tide-search) while they are sorted by "
+    "mass. When the limit is reached, they are sorted and written to a "
+    "temporary file in temp-dir (or in the index or output directory if "
+    "temp-dir is blank), and all such files are merged at the end. tide-search "
+    "then searches the spectra in mass-ordered batches of about this size "
+    "instead of loading them all. For tide-index the limit covers only the "
+    "unmodified peptides being sorted: the distinct target sequences kept to "
+    "generate decoys and remove duplicates still grow with the database, and "
+    "modified peptides are bounded by modsoutputter-threshold instead. "
+    "sort-by-column holds the rows it sorts "
+    "within this limit in the same way, and stat-column only spills its "
+    "values once they exceed it. 0 means no limit for every tool.",
+    "Available for tide-index, tide-search, sort-by-column and stat-column.", true);
   InitIntParam("modsoutputter-threshold", 1000, 0, BILLION,
     "Maximum number of temporary files that would be opened by ModsOutputter "
     "before switching to ModsOutputterAlt.",
@@ -400,7 +423,7 @@ Params::Params() : finalized_(false) {
   InitStringParam("temp-dir", "",
     "The name of the directory where temporary files will be created. If this "
     "parameter is blank, then the system temporary directory will be used",
-    "Available for tide-index.", true);
+    "Available for tide-index, tide-search, sort-by-column and stat-column.", true);
   // coder options regarding decoys
   InitIntParam("num-decoy-files", 1, 0, 10,
     "Replaces number-decoy-set.  Determined by decoy-location"
@@ -876,6 +899,13 @@ Params::Params() : finalized_(false) {
     "'residue-evidence' is designed to score high-resolution MS2 spectra; and 'both' calculates "
     "both scores. The latter requires that exact-p-value=T.",
     "Available for tide-search.", true);
+  InitStringParam("score-engine", "jit", "jit|simd|scalar",
+    "How XCorr scores are computed when exact-p-value=F. 'jit' compiles each "
+    "candidate peptide into machine code, and requires executable memory; "
+    "'simd' uses AVX-512 or AVX2 instructions, whichever the processor "
+    "supports, falling back to 'scalar' otherwise; 'scalar' uses plain "
+    "portable code. All three give identical scores.",
+    "Available for tide-search.", true);
   InitDoubleParam("fragment-tolerance", .02, 0, 2,
     "Mass tolerance (in Da) for scoring pairs of peaks when creating the residue evidence matrix. "
     "This parameter only makes sense when score-function is 'residue-evidence' or 'both'.",
@@ -891,9 +921,38 @@ Params::Params() : finalized_(false) {
                   "Specify a comma-separated list of isotope errors of the form: "
                   "1,2,3,..."
                   "Available for tide-search", true);
+  InitIntParam("spectrum-batch-size", 1, 1, 256,
+    "Number of spectra, consecutive in precursor mass and with overlapping "
+    "precursor windows, to score together against their candidate peptides. "
+    "Each compiled peptide is then scored against the whole batch at once, "
+    "which makes better use of the processor cache. A value of 1 scores one "
+    "spectrum at a time. Only used with score-function=xcorr when "
+    "exact-p-value=F and peptide-centric-search=F.",
+    "Available for tide-search.", true);
+  InitBoolParam("deterministic-output", false,
+    "Write the tab-delimited search results in the order the spectrum-charge "
+    "pairs are searched, whatever the number of threads, so that repeated runs "
+    "give identical files. Results found ahead of that order are held in "
+    "memory until they can be written. When F, each thread's results are "
+    "written as soon as they are complete. Peptide-centric search results "
+    "are always written as they are complete.",
+    "Available for tide-search.", true);
+  InitBoolParam("telemetry", false,
+    "Measure the time each thread spends reading and preprocessing spectra, "
+    "decoding peptides, computing their peaks, scoring, computing p-values, "
+    "writing results and waiting for locks, and write it to "
+    "tide-search.telemetry.txt or tide-index.telemetry.txt, one tab-delimited "
+    "row per thread.",
+    "Available for tide-search and tide-index.", true);
   InitIntParam("num-threads", 0, 0, 64,
-               "0=poll CPU to set num threads; else specify num threads directly.",
-               "Available for tide-search tab-delimited files only.", true);
+               "0=poll CPU to set num threads; else specify num threads directly. "
+               "q-ranker trains its target nets in parallel only when this is "
+               "set above 1, since the parallel runs give different nets than "
+               "the sequential ones. hardklor uses several threads only with "
+               "hardklor-algorithm=version2.",
+               "Available for tide-search tab-delimited files only, and for "
+               "tide-index, sort-by-column, stat-column, q-ranker, search-for-xlinks and "
+               "hardklor.", true);
   /*
    * Comet parameters
    */
@@ -1521,6 +1580,17 @@ Params::Params() : finalized_(false) {
     "Keep shuffling and collecting XCorr scores until the minimum number of points for "
     "weibull fitting (using targets and decoys) is achieved.",
     "Available for crux search-for-xlinks", true);
+  InitDoubleParam("weibull-mass-bin", 0, 0, 1e6,
+    "Share one set of Weibull training candidates among the spectra of each charge "
+    "whose precursor masses fall in the same bin of this width (in Da). The "
+    "candidates and their shuffled decoys are generated once per bin and scored "
+    "against each spectrum. A value of 0 generates them for every spectrum.",
+    "Available for crux search-for-xlinks", true);
+  InitBoolParam("reuse-weibull-fits", false,
+    "Fit the Weibull distribution once per weibull-mass-bin, to the scores of the "
+    "first spectrum in the bin, and use it for the p-values of the other spectra "
+    "in the bin rather than scoring the training candidates against each of them.",
+    "Available for crux search-for-xlinks. Requires weibull-mass-bin greater than 0.", true);
   InitArgParam("link sites",
     "Specification of the the two sets of amino acids that the cross-linker can "
     "connect. These are specified as two comma-separated sets of amino acids, "
@@ -1618,6 +1688,13 @@ Params::Params() : finalized_(false) {
   InitStringParam("hardklor-data-file", "",
     "Specifies an ASCII text file that defines symbols for the periodic table.",
     "Available for crux hardklor", true);
+  InitStringParam("hardklor-model-library", "",
+    "Specifies a binary file in which the isotope distribution models built for each "
+    "averagine variant and charge state are saved, so that later runs read them instead "
+    "of building them again. Models built from hardklor-data-file or "
+    "isotope-data-file contents other than the current ones are not reused. Leave empty to build the models on "
+    "every run.",
+    "Available for crux hardklor", true);
   InitStringParam("instrument", "fticr", "fticr|orbitrap|tof|qit",
     "Indicates the type of instrument used to collect data. This parameter, combined with "
     "the resolution parameter, define how spectra will be centroided (if you provide "
@@ -1970,12 +2047,14 @@ void Params::Categorize() {
   items.insert("remove-precursor-tolerance");
   items.insert("scan-number");
   items.insert("skip-preprocessing");
+  items.insert("spectrum-batch-size");
   items.insert("spectrum-charge");
   items.insert("spectrum-max-mz");
   items.insert("spectrum-min-mz");
   items.insert("use-flanking-peaks");
   items.insert("use-neutral-loss-peaks");
   items.insert("score-function");
+  items.insert("score-engine");
   items.insert("fragment-tolerance");
   items.insert("evidence-granularity");
   AddCategory("Search parameters", items);
@@ -2012,7 +2091,9 @@ void Params::Categorize() {
   items.clear();
   items.insert("max-xlink-mods");
   items.insert("mono-link");
+  items.insert("reuse-weibull-fits");
   items.insert("use-old-xlink");
+  items.insert("weibull-mass-bin");
   items.insert("xlink-include-deadends");
   items.insert("xlink-include-inter");
   items.insert("xlink-include-inter-intra");
@@ -2162,6 +2243,7 @@ void Params::Categorize() {
   items.insert("decoy-prefix");
   items.insert("decoy-xml-output");
   items.insert("delimiter");
+  items.insert("deterministic-output");
   items.insert("feature-file-out");
   items.insert("file-column");
   items.insert("fileroot");
@@ -2179,6 +2261,7 @@ void Params::Categorize() {
   items.insert("output_txtfile");
   items.insert("overwrite");
   items.insert("parameter-file");
+  items.insert("peptide-index-format");
   items.insert("peptide-list");
   items.insert("pepxml-output");
   items.insert("pin-output");
@@ -2193,6 +2276,8 @@ void Params::Categorize() {
   items.insert("sqt-output");
   items.insert("store-index");
   items.insert("store-spectra");
+  items.insert("telemetry");
+  items.insert("max-memory");
   items.insert("temp-dir");
   items.insert("top-match");
   items.insert("txt-output");
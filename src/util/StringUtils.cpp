@@ -134,6 +134,106 @@ string StringUtils::LineFormat(string s, unsigned limit, unsigned indentSize) {
   return lines.str();
 }
 
+bool StringUtils::TryParseDouble(const char* begin, const char* end, double* out) {
+  // Up to 15 significant digits fit exactly in a double, as do the powers of
+  // ten up to 1e22, so one multiplication or division rounds correctly.
+  static const double POWERS_OF_TEN[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+  const int MAX_DIGITS = 15;
+  const int MAX_EXPONENT = 22;
+
+  const char* i = begin;
+  bool negative = false;
+  if (i != end && (*i == '-' || *i == '+')) {
+    negative = *i == '-';
+    ++i;
+  }
+  unsigned long long mantissa = 0;
+  int digits = 0;
+  int exponent = 0;
+  bool sawDigit = false;
+  for (; i != end && *i >= '0' && *i <= '9'; ++i) {
+    sawDigit = true;
+    if (mantissa == 0 && *i == '0') {
+      continue;
+    } else if (++digits > MAX_DIGITS) {
+      return false;
+    }
+    mantissa = mantissa * 10 + (*i - '0');
+  }
+  if (i != end && *i == '.') {
+    for (++i; i != end && *i >= '0' && *i <= '9'; ++i) {
+      sawDigit = true;
+      --exponent;
+      if (mantissa == 0 && *i == '0') {
+        continue;
+      } else if (++digits > MAX_DIGITS) {
+        return false;
+      }
+      mantissa = mantissa * 10 + (*i - '0');
+    }
+  }
+  if (!sawDigit) {
+    return false;
+  }
+  if (i != end && (*i == 'e' || *i == 'E')) {
+    ++i;
+    bool negativeExponent = false;
+    if (i != end && (*i == '-' || *i == '+')) {
+      negativeExponent = *i == '-';
+      ++i;
+    }
+    int value = 0;
+    bool sawExponentDigit = false;
+    for (; i != end && *i >= '0' && *i <= '9'; ++i) {
+      sawExponentDigit = true;
+      if (value < 10000) {
+        value = value * 10 + (*i - '0');
+      }
+    }
+    if (!sawExponentDigit) {
+      return false;
+    }
+    exponent += negativeExponent ? -value : value;
+  }
+  if (i != end) {
+    return false;
+  }
+
+  double value = (double)mantissa;
+  if (mantissa != 0) {
+    if (exponent < -MAX_EXPONENT || exponent > MAX_EXPONENT) {
+      return false;
+    }
+    value = exponent < 0 ? value / POWERS_OF_TEN[-exponent] : value * POWERS_OF_TEN[exponent];
+  }
+  *out = negative ? -value : value;
+  return true;
+}
+
+bool StringUtils::TryParseInt(const char* begin, const char* end, int* out) {
+  const char* i = begin;
+  bool negative = false;
+  if (i != end && (*i == '-' || *i == '+')) {
+    negative = *i == '-';
+    ++i;
+  }
+  if (i == end || end - i > 9) {
+    return false;
+  }
+  int value = 0;
+  for (; i != end; ++i) {
+    if (*i < '0' || *i > '9') {
+      return false;
+    }
+    value = value * 10 + (*i - '0');
+  }
+  *out = negative ? -value : value;
+  return true;
+}
+
 StringUtils::StringUtils() {}
 StringUtils::~StringUtils() {}
 
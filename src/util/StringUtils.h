@@ -158,6 +158,16 @@ class StringUtils {
   static bool IsNumeric(
     const std::string& s, bool allowNegative = true, bool allowDecimal = true);
 
+  // Parse a plain decimal number (optional sign, digits, optional fraction and
+  // exponent) from a range of characters, without a stream or the locale.
+  // Returns false, leaving out unchanged, if the range is anything else or
+  // cannot be converted exactly this way; callers then use FromString.
+  static bool TryParseDouble(const char* begin, const char* end, double* out);
+
+  // Parse an integer of at most nine digits, with an optional sign, from a
+  // range of characters. Returns false for anything else.
+  static bool TryParseInt(const char* begin, const char* end, int* out);
+
   // Break a string into lines limited by length
   static std::string LineFormat(std::string s, unsigned limit, unsigned indentSize = 0);
 
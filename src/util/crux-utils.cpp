@@ -1275,6 +1275,11 @@ void shuffle_floats(FLOAT_T* array, int size) {
  * Fits a three-parameter Weibull distribution to the input data. 
  * Implementation of Weibull distribution parameter estimation from 
  * http:// www.chinarel.com/onlincebook/LifeDataWeb/rank_regression_on_y.htm
+ *
+ * Gives the same fits as calling fit_two_parameter_weibull for each
+ * shift, with the same arithmetic in the same order, but the ranks' Y
+ * values and their running sums, which do not depend on the shift, are
+ * computed once and the X buffer is reused across shifts.
  * \returns eta, beta, c (which in this case is the amount the data should
  * be shifted by) and the best correlation coefficient
  */
@@ -1303,10 +1308,64 @@ void fit_three_parameter_weibull(
   FLOAT_T cur_correlation = 0.0;
   FLOAT_T cur_shift = 0.0;
 
+  // Y, and the sum of Y over the first idx points
+  vector<FLOAT_T> X(max(fit_data_points, 0));
+  vector<FLOAT_T> Y(X.size());
+  vector<FLOAT_T> sums_Y(Y.size() + 1, 0.0);
+  for (int idx = 0; idx < fit_data_points; idx++) {
+    int reverse_idx = total_data_points - idx;
+    FLOAT_T F_T_idx = (reverse_idx - 0.3) / (total_data_points + 0.4);
+    Y[idx] = log( -log(1.0 - F_T_idx) );
+    sums_Y[idx+1] = sums_Y[idx] + Y[idx];
+  }
+
   for (cur_shift = max_shift; cur_shift > min_shift ; cur_shift -= step) {
 
-    fit_two_parameter_weibull(data, fit_data_points, total_data_points, 
-                              cur_shift, &cur_eta, &cur_beta, &cur_correlation);
+    // shift (including only non-neg data values) and take log
+    int N = 0;
+    FLOAT_T sum_X  = 0.0;
+    FLOAT_T sum_XY = 0.0;
+    FLOAT_T sum_XX = 0.0;
+    for (; N < fit_data_points; N++) {
+      FLOAT_T score = data[N] + cur_shift;
+      if (score <= 0.0) {
+        break;
+      }
+      X[N] = log(score);
+      sum_X  += X[N];
+      sum_XX += X[N] * X[N];
+      sum_XY += X[N] * Y[N];
+    }
+    FLOAT_T sum_Y = sums_Y[N];
+
+    FLOAT_T b_num    = sum_XY - (sum_X * sum_Y / N);
+    FLOAT_T b_denom  = sum_XX - sum_X * sum_X / N;
+    cur_beta = b_num / b_denom;
+    FLOAT_T a_hat    = (sum_Y - cur_beta * sum_X) / N;
+    cur_eta  = exp( - a_hat / cur_beta );
+
+    // centered second pass, as in fit_two_parameter_weibull
+    FLOAT_T c_num   = 0.0;
+    FLOAT_T c_denom_X = 0.0;
+    FLOAT_T c_denom_Y = 0.0;
+    FLOAT_T mean_X = sum_X / N;
+    FLOAT_T mean_Y = sum_Y / N;
+    for (int idx = 0; idx < N; idx++) {
+      FLOAT_T X_delta = X[idx] - mean_X;
+      FLOAT_T Y_delta = Y[idx] - mean_Y;
+      c_num += X_delta * Y_delta;
+      c_denom_X += X_delta * X_delta;
+      c_denom_Y += Y_delta * Y_delta;
+    }
+    FLOAT_T c_denom = sqrt(c_denom_X * c_denom_Y);
+    if (c_denom == 0.0) {
+      cur_correlation = 0.0; // min value
+      cur_eta = 0;
+      cur_beta = 0;
+    } else {
+      cur_correlation = c_num / c_denom;
+    }
+
     //According to the definition of the weibull distribution,
     //https://en.wikipedia.org/wiki/Weibull_distribution
     //the eta and beta parameters both have to be >0.
@@ -27,6 +27,8 @@
 #include <stack>
 #include <iostream>
 
+#include <boost/thread/mutex.hpp>
+
 using namespace std;
 
 /**
@@ -35,6 +37,7 @@ using namespace std;
 class MODIFIED_AA_T_Cache {
  protected:
   stack<MODIFIED_AA_T*> cache_; ///< Cache itself
+  boost::mutex mutex_; ///< Guards the cache, which searches share between threads
  public:
   
   /**
@@ -59,11 +62,17 @@ class MODIFIED_AA_T_Cache {
    */
   MODIFIED_AA_T* checkout(bool clear=false) {
     MODIFIED_AA_T* new_element;
-    if (cache_.empty()) {
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      if (cache_.empty()) {
+        new_element = NULL;
+      } else {
+        new_element = cache_.top();
+        cache_.pop();
+      }
+    }
+    if (new_element == NULL) {
       new_element = new MODIFIED_AA_T[MAX_PEPTIDE_LENGTH + 1];
-    } else {
-      new_element = cache_.top();
-      cache_.pop();
     }
     if (clear) {
       memset(new_element, 0, sizeof(MODIFIED_AA_T)*(MAX_PEPTIDE_LENGTH+1));
@@ -78,6 +87,7 @@ class MODIFIED_AA_T_Cache {
   void checkin(
     MODIFIED_AA_T* array
   ) {
+    boost::mutex::scoped_lock lock(mutex_);
     cache_.push(array);
   }
   
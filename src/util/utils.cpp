@@ -18,6 +18,7 @@
 #include <errno.h>
 #include "boost/random/mersenne_twister.hpp"
 #include "boost/random/uniform_int_distribution.hpp"
+#include "boost/thread/tss.hpp"
 #include "utils.h"
 #include "io/carp.h"
 #include "WinCrux.h"
@@ -436,9 +437,15 @@ char** parse_file(
   return lines;
 }
 
+/**
+ * Generator of a thread that was given its own seed by mysrandom_thread.
+ */
+static boost::thread_specific_ptr<boost::mt19937> thread_mt19937_;
+
 boost::mt19937& get_mt19937() {
   static boost::mt19937 mt19937_;
-  return mt19937_;
+  boost::mt19937* thread_mt19937 = thread_mt19937_.get();
+  return thread_mt19937 != NULL ? *thread_mt19937 : mt19937_;
 }
 
 /**
@@ -461,6 +468,17 @@ void mysrandom(unsigned seed) {
   get_mt19937().seed(seed);
 }
 
+/**
+ * Gives the calling thread its own generator, seeded with seed, so that
+ * the numbers it draws do not depend on what other threads draw.
+ */
+void mysrandom_thread(unsigned seed) {
+  if (thread_mt19937_.get() == NULL) {
+    thread_mt19937_.reset(new boost::mt19937());
+  }
+  thread_mt19937_->seed(seed);
+}
+
 /*
  * Local Variables:
  * mode: c
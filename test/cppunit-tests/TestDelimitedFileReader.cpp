@@ -0,0 +1,133 @@
+#include <cppunit/config/SourcePrefix.h>
+#include "TestDelimitedFileReader.h"
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include "StringUtils.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION( TestDelimitedFileReader );
+
+using namespace std;
+
+void TestDelimitedFileReader::setUp(){
+  // initialize variables to use for testing
+  tinyFile = "sample-files/tiny-tab-file.txt";
+  filename = "tiny-delim-read.txt";
+  remove(filename);
+}
+
+void TestDelimitedFileReader::tearDown(){
+  remove(filename);
+}
+
+void TestDelimitedFileReader::writeFile(const string& contents){
+  ofstream file(filename, ios::binary);
+  file << contents;
+}
+
+// a file opened by path is memory-mapped; a stream is read line by line.
+// both should give the same rows.
+void TestDelimitedFileReader::mappedMatchesStreamed(){
+  DelimitedFileReader mapped(tinyFile);
+  ifstream stream(tinyFile);
+  DelimitedFileReader streamed(&stream);
+
+  CPPUNIT_ASSERT(mapped.numCols() == 5);
+  CPPUNIT_ASSERT(mapped.getColumnNames() == streamed.getColumnNames());
+  CPPUNIT_ASSERT(mapped.numRows() == streamed.numRows());
+  CPPUNIT_ASSERT(mapped.numRows() > 0);
+
+  unsigned int rows = 0;
+  while (mapped.hasNext()) {
+    CPPUNIT_ASSERT(streamed.hasNext());
+    CPPUNIT_ASSERT(mapped.getString() == streamed.getString());
+    CPPUNIT_ASSERT(mapped.getInteger("scan") == streamed.getInteger("scan"));
+    CPPUNIT_ASSERT(mapped.getInteger("charge") == streamed.getInteger("charge"));
+    CPPUNIT_ASSERT(mapped.getDouble("peptide mass") == streamed.getDouble("peptide mass"));
+    CPPUNIT_ASSERT(mapped.getString("spectrum precursor m/z") ==
+                   streamed.getString("spectrum precursor m/z"));
+    rows++;
+    mapped.next();
+    streamed.next();
+  }
+  CPPUNIT_ASSERT(!streamed.hasNext());
+  CPPUNIT_ASSERT(rows == mapped.numRows());
+}
+
+// cells that are not plain decimals fall back to the old conversions
+void TestDelimitedFileReader::cellValues(){
+  writeFile("int\treal\n"
+            "1267\t463.51001\n"
+            "-4\t1e3\n"
+            "7\tInf\n"
+            "8\t-Inf\n"
+            "9\t\n"
+            "10\t1.234567890123456789\n");
+  DelimitedFileReader reader(filename);
+
+  CPPUNIT_ASSERT(reader.getInteger("int") == 1267);
+  CPPUNIT_ASSERT(reader.getDouble("real") == 463.51001);
+  reader.next();
+  CPPUNIT_ASSERT(reader.getInteger("int") == -4);
+  CPPUNIT_ASSERT(reader.getDouble("real") == 1000.0);
+  reader.next();
+  CPPUNIT_ASSERT(reader.getDouble("real") == numeric_limits<double>::infinity());
+  reader.next();
+  CPPUNIT_ASSERT(reader.getDouble("real") == -numeric_limits<double>::infinity());
+  reader.next();
+  CPPUNIT_ASSERT(reader.getDouble("real") == 0.0);
+  CPPUNIT_ASSERT(reader.getString("real") == "");
+  reader.next();
+  CPPUNIT_ASSERT(reader.getDouble("real") ==
+                 StringUtils::FromString<double>("1.234567890123456789"));
+  reader.next();
+  CPPUNIT_ASSERT(!reader.hasNext());
+}
+
+// the last row is read even without a newline after it
+void TestDelimitedFileReader::noTrailingNewline(){
+  writeFile("a\tb\n1\t2.5\n3\t4");
+  DelimitedFileReader reader(filename);
+
+  CPPUNIT_ASSERT(reader.numCols() == 2);
+  CPPUNIT_ASSERT(reader.numRows() == 2);
+  CPPUNIT_ASSERT(reader.hasNext());
+  CPPUNIT_ASSERT(reader.getInteger("a") == 1);
+  CPPUNIT_ASSERT(reader.getDouble("b") == 2.5);
+  reader.next();
+  CPPUNIT_ASSERT(reader.hasNext());
+  CPPUNIT_ASSERT(reader.getString() == "3\t4");
+  CPPUNIT_ASSERT(reader.getInteger("a") == 3);
+  CPPUNIT_ASSERT(reader.getString("b") == "4");
+  reader.next();
+  CPPUNIT_ASSERT(!reader.hasNext());
+
+  // reading again from the start gives the same rows
+  reader.reset();
+  CPPUNIT_ASSERT(reader.hasNext());
+  CPPUNIT_ASSERT(reader.getInteger("a") == 1);
+}
+
+// an empty file cannot be mapped, so it is streamed
+void TestDelimitedFileReader::emptyFile(){
+  writeFile("");
+  DelimitedFileReader reader(filename);
+
+  CPPUNIT_ASSERT(!reader.hasNext());
+  CPPUNIT_ASSERT(reader.numCols() == 0);
+  CPPUNIT_ASSERT(reader.numRows() == 0);
+
+  DelimitedFileReader no_header(filename, false);
+  CPPUNIT_ASSERT(!no_header.hasNext());
+  CPPUNIT_ASSERT(no_header.numRows() == 0);
+}
+
+void TestDelimitedFileReader::headerOnly(){
+  writeFile("a\tb");
+  DelimitedFileReader reader(filename);
+
+  CPPUNIT_ASSERT(reader.numCols() == 2);
+  CPPUNIT_ASSERT(reader.getColumnName(1) == "b");
+  CPPUNIT_ASSERT(!reader.hasNext());
+  CPPUNIT_ASSERT(reader.numRows() == 0);
+}
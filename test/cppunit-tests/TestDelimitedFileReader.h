@@ -0,0 +1,38 @@
+#ifndef CPP_UNIT_TESTDELIMITEDFILEREADER_H
+#define CPP_UNIT_TESTDELIMITEDFILEREADER_H
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <string>
+#include "DelimitedFileReader.h"
+
+class TestDelimitedFileReader : public CPPUNIT_NS::TestFixture
+{
+  CPPUNIT_TEST_SUITE( TestDelimitedFileReader );
+  CPPUNIT_TEST( mappedMatchesStreamed );
+  CPPUNIT_TEST( cellValues );
+  CPPUNIT_TEST( noTrailingNewline );
+  CPPUNIT_TEST( emptyFile );
+  CPPUNIT_TEST( headerOnly );
+  CPPUNIT_TEST_SUITE_END();
+  
+ protected:
+  // variables to use in testing
+  const char* tinyFile;
+  const char* filename;
+
+  // replaces the contents of filename
+  void writeFile(const std::string& contents);
+
+ public:
+  void setUp();
+  void tearDown();
+
+ protected:
+  void mappedMatchesStreamed();
+  void cellValues();
+  void noTrailingNewline();
+  void emptyFile();
+  void headerOnly();
+};
+
+#endif //CPP_UNIT_TESTDELIMITEDFILEREADER_H
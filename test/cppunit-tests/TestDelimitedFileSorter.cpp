@@ -0,0 +1,152 @@
+#include <cppunit/config/SourcePrefix.h>
+#include "TestDelimitedFileSorter.h"
+#include <cstdlib>
+#include <sstream>
+
+CPPUNIT_TEST_SUITE_REGISTRATION( TestDelimitedFileSorter );
+
+using namespace std;
+
+// rows are named by the order in which they were added
+static string rowName(int i){
+  ostringstream name;
+  name << "row" << i;
+  return name.str();
+}
+
+void TestDelimitedFileSorter::setUp(){
+  tempPrefix = "sorter-test";
+}
+
+void TestDelimitedFileSorter::tearDown(){
+}
+
+void TestDelimitedFileSorter::drain(DelimitedFileSorter& sorter,
+                                    vector<string>& rows,
+                                    vector<double>& keys){
+  rows.clear();
+  keys.clear();
+  string row;
+  double key;
+  while (sorter.next(&row, &key)) {
+    rows.push_back(row);
+    keys.push_back(key);
+  }
+}
+
+// no limit: everything is sorted in memory
+void TestDelimitedFileSorter::inMemory(){
+  DelimitedFileSorter sorter(COLTYPE_REAL, true, tempPrefix, 0, 1);
+  sorter.push("c", 3.5);
+  sorter.push("a", -1.0);
+  sorter.push("b", 2.0);
+  CPPUNIT_ASSERT(sorter.size() == 3);
+
+  vector<string> rows;
+  vector<double> keys;
+  drain(sorter, rows, keys);
+  CPPUNIT_ASSERT(rows.size() == 3);
+  CPPUNIT_ASSERT(rows[0] == "a" && rows[1] == "b" && rows[2] == "c");
+  CPPUNIT_ASSERT(keys[0] == -1.0 && keys[1] == 2.0 && keys[2] == 3.5);
+
+  string row;
+  CPPUNIT_ASSERT(!sorter.next(&row));
+}
+
+// a one-byte budget writes every row to its own run
+void TestDelimitedFileSorter::severalRuns(){
+  DelimitedFileSorter sorter(COLTYPE_INT, true, tempPrefix, 1, 2);
+  const int num_rows = 50;
+  for (int i = 0; i < num_rows; i++) {
+    sorter.push(rowName(i), (double)((i * 37) % num_rows));
+  }
+
+  vector<string> rows;
+  vector<double> keys;
+  drain(sorter, rows, keys);
+  CPPUNIT_ASSERT(rows.size() == (size_t)num_rows);
+  for (int i = 0; i < num_rows; i++) {
+    CPPUNIT_ASSERT(keys[i] == (double)i);
+  }
+}
+
+// more runs than can be open at once are first merged into fewer runs
+void TestDelimitedFileSorter::collapsedRuns(){
+  DelimitedFileSorter sorter(COLTYPE_INT, true, tempPrefix, 1, 1);
+  const int num_rows = 1000;
+  for (int i = 0; i < num_rows; i++) {
+    sorter.push(rowName(i), (double)(i % 10));
+  }
+
+  vector<string> rows;
+  vector<double> keys;
+  drain(sorter, rows, keys);
+  CPPUNIT_ASSERT(rows.size() == (size_t)num_rows);
+  for (int i = 0; i < num_rows; i++) {
+    // key k holds rows k, k + 10, k + 20, ... in the order they were added
+    int key = i / (num_rows / 10);
+    int added = key + 10 * (i % (num_rows / 10));
+    CPPUNIT_ASSERT(keys[i] == (double)key);
+    CPPUNIT_ASSERT(rows[i] == rowName(added));
+  }
+}
+
+// equal keys come out in the order added, across runs and the buffer
+void TestDelimitedFileSorter::tiesKeepOrder(){
+  DelimitedFileSorter sorter(COLTYPE_STRING, true, tempPrefix, 200, 1);
+  const int num_rows = 30;
+  for (int i = 0; i < num_rows; i++) {
+    sorter.push(rowName(i), i % 2 == 0 ? string("even") : string("odd"));
+  }
+
+  vector<string> rows;
+  vector<double> keys;
+  drain(sorter, rows, keys);
+  CPPUNIT_ASSERT(rows.size() == (size_t)num_rows);
+  for (int i = 0; i < num_rows / 2; i++) {
+    CPPUNIT_ASSERT(rows[i] == rowName(2 * i));
+    CPPUNIT_ASSERT(rows[num_rows / 2 + i] == rowName(2 * i + 1));
+  }
+}
+
+// numbers compare by value, strings character by character
+void TestDelimitedFileSorter::numericVsString(){
+  const char* values[] = { "10", "9", "100", "-5" };
+  DelimitedFileSorter numbers(COLTYPE_REAL, true, tempPrefix, 1, 1);
+  DelimitedFileSorter strings(COLTYPE_STRING, true, tempPrefix, 1, 1);
+  for (int i = 0; i < 4; i++) {
+    numbers.push(values[i], atof(values[i]));
+    strings.push(values[i], values[i]);
+  }
+
+  vector<string> rows;
+  vector<double> keys;
+  drain(numbers, rows, keys);
+  CPPUNIT_ASSERT(rows.size() == 4);
+  CPPUNIT_ASSERT(rows[0] == "-5" && rows[1] == "9" &&
+                 rows[2] == "10" && rows[3] == "100");
+
+  drain(strings, rows, keys);
+  CPPUNIT_ASSERT(rows.size() == 4);
+  CPPUNIT_ASSERT(rows[0] == "-5" && rows[1] == "10" &&
+                 rows[2] == "100" && rows[3] == "9");
+}
+
+// reverse order, with ties still in the order added
+void TestDelimitedFileSorter::descending(){
+  DelimitedFileSorter sorter(COLTYPE_REAL, false, tempPrefix, 100, 1);
+  const int num_rows = 40;
+  for (int i = 0; i < num_rows; i++) {
+    sorter.push(rowName(i), (double)(i % 4));
+  }
+
+  vector<string> rows;
+  vector<double> keys;
+  drain(sorter, rows, keys);
+  CPPUNIT_ASSERT(rows.size() == (size_t)num_rows);
+  for (int i = 0; i < num_rows; i++) {
+    int key = 3 - i / (num_rows / 4);
+    CPPUNIT_ASSERT(keys[i] == (double)key);
+    CPPUNIT_ASSERT(rows[i] == rowName(key + 4 * (i % (num_rows / 4))));
+  }
+}
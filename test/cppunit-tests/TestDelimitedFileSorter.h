@@ -0,0 +1,42 @@
+#ifndef CPP_UNIT_TESTDELIMITEDFILESORTER_H
+#define CPP_UNIT_TESTDELIMITEDFILESORTER_H
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <string>
+#include <vector>
+#include "DelimitedFileSorter.h"
+
+class TestDelimitedFileSorter : public CPPUNIT_NS::TestFixture
+{
+  CPPUNIT_TEST_SUITE( TestDelimitedFileSorter );
+  CPPUNIT_TEST( inMemory );
+  CPPUNIT_TEST( severalRuns );
+  CPPUNIT_TEST( collapsedRuns );
+  CPPUNIT_TEST( tiesKeepOrder );
+  CPPUNIT_TEST( numericVsString );
+  CPPUNIT_TEST( descending );
+  CPPUNIT_TEST_SUITE_END();
+  
+ protected:
+  // variables to use in testing
+  std::string tempPrefix;
+
+  // sorted rows of a sorter, with their numeric keys
+  void drain(DelimitedFileSorter& sorter,
+             std::vector<std::string>& rows,
+             std::vector<double>& keys);
+
+ public:
+  void setUp();
+  void tearDown();
+
+ protected:
+  void inMemory();
+  void severalRuns();
+  void collapsedRuns();
+  void tiesKeepOrder();
+  void numericVsString();
+  void descending();
+};
+
+#endif //CPP_UNIT_TESTDELIMITEDFILESORTER_H
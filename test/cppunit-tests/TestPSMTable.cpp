@@ -0,0 +1,118 @@
+#include <cppunit/config/SourcePrefix.h>
+#include "TestPSMTable.h"
+#include "Match.h"
+#include "parameter.h" 
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+
+CPPUNIT_TEST_SUITE_REGISTRATION( TestPSMTable );
+
+using namespace std;
+
+void TestPSMTable::setUp(){
+  initialize_parameters();  // accessing any parameter values requires this
+
+  // initialize variables to use for testing
+  filename = "tiny-psms.txt";
+  filename2 = "tiny-psms2.txt";
+  writeFile(filename,
+    "file\tscan\tcharge\tspectrum neutral mass\txcorr score\txcorr rank\t"
+    "e-value\tp-value\tdistinct matches/spectrum\tsequence\tprotein id\n"
+    "a.ms2\t1\t2\t1000.5\t2.5\t1\t0.01\t0.1\t50\tK.PEPTIDE.R\tprot1\n"
+    "a.ms2\t1\t2\t1000.5\t1.5\t2\t0.5\t0.5\t50\tPEPTIDES\tdecoy_prot1\n"
+    "b.ms2\t7\t3\t1500.25\t3.25\t1\t0.001\t0.01\t80\tR.AACK.-\tprot2,prot3\n");
+  table = new PSMTable();
+  table->load(filename);
+}
+
+void TestPSMTable::tearDown(){
+  // delete anything you allocated
+  delete table;
+  remove(filename);
+  remove(filename2);
+}
+
+void TestPSMTable::writeFile(const char* name, const string& contents){
+  ofstream file(name, ios::binary);
+  file << contents;
+}
+
+void TestPSMTable::loadRows(){
+  CPPUNIT_ASSERT(table->size() == 3);
+
+  CPPUNIT_ASSERT(table->getFile(0) == "a.ms2");
+  CPPUNIT_ASSERT(table->getFile(2) == "b.ms2");
+  CPPUNIT_ASSERT(table->getScan(2) == 7);
+  CPPUNIT_ASSERT(table->getCharge(1) == 2);
+  CPPUNIT_ASSERT(table->getCharge(2) == 3);
+
+  // flanking residues are dropped
+  CPPUNIT_ASSERT(table->getSequence(0) == "PEPTIDE");
+  CPPUNIT_ASSERT(table->getSequence(1) == "PEPTIDES");
+  CPPUNIT_ASSERT(table->getSequence(2) == "AACK");
+  CPPUNIT_ASSERT(table->getModifiedSequence(2) == "AACK");
+
+  // decoys are found by decoy-prefix
+  CPPUNIT_ASSERT(!table->isDecoy(0));
+  CPPUNIT_ASSERT(table->isDecoy(1));
+  CPPUNIT_ASSERT(!table->isDecoy(2));
+
+  // each distinct string is stored once
+  CPPUNIT_ASSERT(&table->getFile(0) == &table->getFile(1));
+  CPPUNIT_ASSERT(&table->getFile(0) != &table->getFile(2));
+}
+
+void TestPSMTable::scoresAndRanks(){
+  CPPUNIT_ASSERT(table->hasScore(XCORR));
+  CPPUNIT_ASSERT(table->hasScore(EVALUE));
+  CPPUNIT_ASSERT(table->hasScore(LOGP_BONF_WEIBULL_XCORR));
+  CPPUNIT_ASSERT(!table->hasScore(SP));
+  CPPUNIT_ASSERT(!table->hasScore(PERCOLATOR_SCORE));
+
+  CPPUNIT_ASSERT(table->getScore(XCORR, 0) == 2.5);
+  CPPUNIT_ASSERT(table->getScore(XCORR, 1) == 1.5);
+  CPPUNIT_ASSERT(table->getScore(XCORR, 2) == 3.25);
+  CPPUNIT_ASSERT(table->getScore(EVALUE, 1) == (FLOAT_T)0.5);
+  CPPUNIT_ASSERT(table->getScore(SP, 0) == NOT_SCORED);
+
+  // the Weibull p-value is kept as a negative log p-value
+  CPPUNIT_ASSERT(fabs(table->getScore(LOGP_BONF_WEIBULL_XCORR, 0) - -log(0.1)) < 1e-5);
+
+  CPPUNIT_ASSERT(table->getRank(XCORR, 0) == 1);
+  CPPUNIT_ASSERT(table->getRank(XCORR, 1) == 2);
+  CPPUNIT_ASSERT(table->getRank(SP, 0) == 0);
+}
+
+// a later file may lack scores of an earlier one, or add new ones
+void TestPSMTable::appendFiles(){
+  writeFile(filename2,
+    "file\tscan\tcharge\tspectrum neutral mass\tsp score\tsp rank\t"
+    "xcorr score\txcorr rank\tmatches/spectrum\tsequence\tprotein id\n"
+    "a.ms2\t9\t1\t800\t120.5\t1\t0.75\t1\t12\tPEPK\tprot4\n");
+  table->load(filename2);
+
+  CPPUNIT_ASSERT(table->size() == 4);
+  CPPUNIT_ASSERT(table->hasScore(SP));
+  CPPUNIT_ASSERT(table->getScore(SP, 0) == NOT_SCORED);
+  CPPUNIT_ASSERT(table->getScore(SP, 3) == 120.5);
+  CPPUNIT_ASSERT(table->getRank(SP, 3) == 1);
+  CPPUNIT_ASSERT(table->getRank(SP, 2) == 0);
+  CPPUNIT_ASSERT(table->getScore(EVALUE, 2) == (FLOAT_T)0.001);
+  CPPUNIT_ASSERT(table->getScore(EVALUE, 3) == NOT_SCORED);
+  CPPUNIT_ASSERT(table->getScore(XCORR, 3) == 0.75);
+  CPPUNIT_ASSERT(table->getExperimentSize(3) == 12);
+
+  // file names are shared across files
+  CPPUNIT_ASSERT(&table->getFile(3) == &table->getFile(0));
+}
+
+void TestPSMTable::experimentSize(){
+  CPPUNIT_ASSERT(table->hasDistinctMatches());
+  CPPUNIT_ASSERT(table->getExperimentSize(0) == 50);
+  CPPUNIT_ASSERT(table->getExperimentSize(2) == 80);
+
+  table->setExperimentSize(0, 100);
+  CPPUNIT_ASSERT(table->getExperimentSize(0) == 100);
+  CPPUNIT_ASSERT(table->getExperimentSize(1) == 50);
+}
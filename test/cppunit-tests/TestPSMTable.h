@@ -0,0 +1,37 @@
+#ifndef CPP_UNIT_TESTPSMTABLE_H
+#define CPP_UNIT_TESTPSMTABLE_H
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <string>
+#include "PSMTable.h"
+
+class TestPSMTable : public CPPUNIT_NS::TestFixture
+{
+  CPPUNIT_TEST_SUITE( TestPSMTable );
+  CPPUNIT_TEST( loadRows );
+  CPPUNIT_TEST( scoresAndRanks );
+  CPPUNIT_TEST( appendFiles );
+  CPPUNIT_TEST( experimentSize );
+  CPPUNIT_TEST_SUITE_END();
+  
+ protected:
+  // variables to use in testing
+  const char* filename;
+  const char* filename2;
+  PSMTable* table;
+
+  // replaces the contents of a file
+  void writeFile(const char* name, const std::string& contents);
+
+ public:
+  void setUp();
+  void tearDown();
+
+ protected:
+  void loadRows();
+  void scoresAndRanks();
+  void appendFiles();
+  void experimentSize();
+};
+
+#endif //CPP_UNIT_TESTPSMTABLE_H
@@ -50,3 +50,62 @@ void TestSpectrum::defaultGetters(){
 
 
 
+
+void TestSpectrum::peakLookups(){
+  // no peaks at all
+  CPPUNIT_ASSERT(default_s->getNearestPeak(100, 1) == NULL);
+  CPPUNIT_ASSERT(default_s->getMaxIntensityPeak(100, 1) == NULL);
+
+  // added out of m/z order, so the lookups have to sort them
+  Spectrum s;
+  s.addPeak(10, 102);
+  s.addPeak(30, 200.5);
+  s.addPeak(20, 100);
+  s.addPeak(30, 200);
+
+  // out of range on either side, and between peaks
+  CPPUNIT_ASSERT(s.getNearestPeak(50, 1) == NULL);
+  CPPUNIT_ASSERT(s.getNearestPeak(500, 1) == NULL);
+  CPPUNIT_ASSERT(s.getMaxIntensityPeak(150, 1) == NULL);
+
+  // a peak exactly 'max' away is in range
+  Peak* peak = s.getNearestPeak(103, 1);
+  CPPUNIT_ASSERT(peak != NULL && peak->getLocation() == 102);
+
+  // equally near peaks: the one with the lower m/z wins
+  peak = s.getNearestPeak(101, 1);
+  CPPUNIT_ASSERT(peak != NULL && peak->getLocation() == 100);
+
+  peak = s.getMaxIntensityPeak(101, 1);
+  CPPUNIT_ASSERT(peak != NULL && peak->getIntensity() == 20);
+
+  // equally intense peaks: the one with the lower m/z wins
+  peak = s.getMaxIntensityPeak(200.25, 1);
+  CPPUNIT_ASSERT(peak != NULL && peak->getLocation() == 200);
+
+  // the lookups see peaks added after an earlier lookup
+  s.addPeak(40, 101);
+  peak = s.getNearestPeak(101, 1);
+  CPPUNIT_ASSERT(peak != NULL && peak->getLocation() == 101);
+  peak = s.getMaxIntensityPeak(101, 1);
+  CPPUNIT_ASSERT(peak != NULL && peak->getIntensity() == 40);
+}
+
+void TestSpectrum::copyReplacesPeaks(){
+  Spectrum src;
+  src.addPeak(10, 100);
+  src.addPeak(20, 200);
+  src.sortPeaks(_PEAK_LOCATION);
+
+  Spectrum dest;
+  dest.addPeak(5, 300);
+  dest.addPeak(5, 50);
+  dest.copyFrom(&src);
+
+  CPPUNIT_ASSERT(dest.getNumPeaks() == 2);
+  CPPUNIT_ASSERT(dest.getTotalEnergy() == 30);
+  CPPUNIT_ASSERT(dest.getNearestPeak(300, 1) == NULL);
+  CPPUNIT_ASSERT(dest.getNearestPeak(50, 1) == NULL);
+  Peak* peak = dest.getNearestPeak(200, 1);
+  CPPUNIT_ASSERT(peak != NULL && peak->getIntensity() == 20);
+}
@@ -20,6 +20,8 @@ class TestSpectrum : public CPPUNIT_NS::TestFixture
 {
   CPPUNIT_TEST_SUITE( TestSpectrum );
   CPPUNIT_TEST( defaultGetters );
+  CPPUNIT_TEST( peakLookups );
+  CPPUNIT_TEST( copyReplacesPeaks );
   CPPUNIT_TEST_SUITE_END();
   
  protected:
@@ -32,6 +34,8 @@ class TestSpectrum : public CPPUNIT_NS::TestFixture
 
  protected:
   void defaultGetters();
+  void peakLookups();
+  void copyReplacesPeaks();
 };
 
 #endif //CPP_UNIT_TESTSPECTRUM_H
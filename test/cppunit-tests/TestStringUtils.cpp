@@ -0,0 +1,65 @@
+#include <cppunit/config/SourcePrefix.h>
+#include "TestStringUtils.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION( TestStringUtils );
+
+using namespace std;
+
+void TestStringUtils::setUp(){
+}
+
+void TestStringUtils::tearDown(){
+}
+
+bool TestStringUtils::parseDouble(const string& s, double* out){
+  return StringUtils::TryParseDouble(s.data(), s.data() + s.length(), out);
+}
+
+bool TestStringUtils::parseInt(const string& s, int* out){
+  return StringUtils::TryParseInt(s.data(), s.data() + s.length(), out);
+}
+
+// plain decimals convert to the same double as the stream does
+void TestStringUtils::tryParseDouble(){
+  const char* values[] = {
+    "0", "-0", "42", "+7", "1.5", "-0.25", ".5", "3.", "0.1", "463.51001",
+    "1849.0024", "1e3", "2.5E-2", "-6.02e+23", "123456789012345",
+    "0.000000000000001", "1e-22", "000123.4500"
+  };
+  for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+    double value = -1;
+    CPPUNIT_ASSERT(parseDouble(values[i], &value));
+    CPPUNIT_ASSERT(value == StringUtils::FromString<double>(values[i]));
+  }
+}
+
+// anything else is left to FromString, with out unchanged
+void TestStringUtils::tryParseDoubleRejects(){
+  const char* values[] = {
+    "", "-", ".", "e5", "1e", "1e+", "abc", "1.2.3", "1,5", " 1", "1 ",
+    "Inf", "-Inf", "nan", "0x10", "1234567890123456", "1e23", "1e-23"
+  };
+  for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+    double value = -1;
+    CPPUNIT_ASSERT(!parseDouble(values[i], &value));
+    CPPUNIT_ASSERT(value == -1);
+  }
+}
+
+void TestStringUtils::tryParseInt(){
+  int value = -1;
+  CPPUNIT_ASSERT(parseInt("0", &value) && value == 0);
+  CPPUNIT_ASSERT(parseInt("1267", &value) && value == 1267);
+  CPPUNIT_ASSERT(parseInt("-4", &value) && value == -4);
+  CPPUNIT_ASSERT(parseInt("+4", &value) && value == 4);
+  CPPUNIT_ASSERT(parseInt("999999999", &value) && value == 999999999);
+
+  value = -1;
+  CPPUNIT_ASSERT(!parseInt("", &value));
+  CPPUNIT_ASSERT(!parseInt("-", &value));
+  CPPUNIT_ASSERT(!parseInt("1.0", &value));
+  CPPUNIT_ASSERT(!parseInt("12a", &value));
+  CPPUNIT_ASSERT(!parseInt(" 1", &value));
+  CPPUNIT_ASSERT(!parseInt("1000000000", &value));
+  CPPUNIT_ASSERT(value == -1);
+}
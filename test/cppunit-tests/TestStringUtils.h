@@ -0,0 +1,31 @@
+#ifndef CPP_UNIT_TESTSTRINGUTILS_H
+#define CPP_UNIT_TESTSTRINGUTILS_H
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <string>
+#include "StringUtils.h"
+
+class TestStringUtils : public CPPUNIT_NS::TestFixture
+{
+  CPPUNIT_TEST_SUITE( TestStringUtils );
+  CPPUNIT_TEST( tryParseDouble );
+  CPPUNIT_TEST( tryParseDoubleRejects );
+  CPPUNIT_TEST( tryParseInt );
+  CPPUNIT_TEST_SUITE_END();
+  
+ protected:
+  // parse all of s, as TryParseDouble and TryParseInt do with a cell
+  bool parseDouble(const std::string& s, double* out);
+  bool parseInt(const std::string& s, int* out);
+
+ public:
+  void setUp();
+  void tearDown();
+
+ protected:
+  void tryParseDouble();
+  void tryParseDoubleRejects();
+  void tryParseInt();
+};
+
+#endif //CPP_UNIT_TESTSTRINGUTILS_H
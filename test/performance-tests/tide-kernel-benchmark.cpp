@@ -0,0 +1,725 @@
+/**
+ * \file tide-kernel-benchmark.cpp
+ * \brief Times the inner kernels of tide-search in isolation.
+ *
+ * Usage: tide-kernel-benchmark [options]
+ *
+ *   --index <dir>        tide index to take peptides and proteins from,
+ *                        rather than a synthetic one
+ *   --spectra <file>     spectrumrecords file to take spectra from, rather
+ *                        than synthetic ones
+ *   --kernel <name>      run only the kernels whose names contain name
+ *   --seconds <s>        minimum time to run each kernel (default 1)
+ *   --num-proteins <n>   size of the synthetic index (default 2000)
+ *   --num-spectra <n>    number of synthetic spectra (default 2000)
+ *
+ * Each kernel is run once to warm up, then repeatedly for at least the
+ * given time. A tab-delimited line is printed for each: the kernel, the
+ * number of operations, the time they took, and the time per operation and
+ * operations per second, where an operation is the unit named in the unit
+ * column. Results are only comparable between runs on the same inputs and
+ * machine.
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <boost/chrono.hpp>
+#include <boost/filesystem.hpp>
+
+#include "app/TideMatchSet.h"
+#include "app/TideSearchApplication.h"
+#include "app/tide/active_peptide_queue.h"
+#include "app/tide/mass_constants.h"
+#include "app/tide/max_mz.h"
+#include "app/tide/peptide.h"
+#include "app/tide/peptide_reader.h"
+#include "app/tide/records.h"
+#include "app/tide/records_to_vector-inl.h"
+#include "app/tide/score_engine.h"
+#include "app/tide/search_config.h"
+#include "app/tide/spectrum_collection.h"
+#include "app/tide/spectrum_preprocess.h"
+#include "app/tide/theoretical_peak_set.h"
+#include "io/carp.h"
+#include "model/objects.h"
+#include "util/FileUtils.h"
+#include "util/Params.h"
+#include "util/StringUtils.h"
+
+using namespace std;
+
+// Half-width, in Da, of the precursor window of the synthetic searches.
+static const double PRECURSOR_WINDOW = 3.0;
+// Half-width, in Da, of the window of peptides scored by the dot product
+// kernels. Wider than a search window, so that each pass does real work.
+static const double DOT_PRODUCT_WINDOW = 25.0;
+// Number of spectra run through the exact p-value dynamic program.
+static const size_t SCORE_COUNT_SPECTRA = 200;
+// Matches reported per spectrum by the result formatting kernel.
+static const int REPORT_TOP_MATCHES = 5;
+
+static double Seconds() {
+  return boost::chrono::duration<double>(
+    boost::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * One kernel. Pass() runs it once over its inputs and returns the number of
+ * operations done. Kernels that have to do untimed work within a pass add
+ * the time of just the timed part to *timed; the others leave it alone.
+ */
+class Kernel {
+ public:
+  Kernel(const string& name, const string& unit) : name_(name), unit_(unit) {}
+  virtual ~Kernel() {}
+  virtual int64_t Pass(double* timed) = 0;
+  const string& Name() const { return name_; }
+  const string& Unit() const { return unit_; }
+  // Folded from the results, so that the work is not optimized away.
+  static volatile int64_t sink_;
+ private:
+  string name_;
+  string unit_;
+};
+
+volatile int64_t Kernel::sink_ = 0;
+
+/**
+ * Exposes the protected search kernels of TideSearchApplication.
+ */
+class SearchKernels : public TideSearchApplication {
+ public:
+  typedef TideSearchApplication::DynProgWorkspace Workspace;
+  using TideSearchApplication::scorePeptides;
+  using TideSearchApplication::calcScoreCount;
+};
+
+/**
+ * The inputs shared by the kernels: an index, open as records of pb::Peptide
+ * in peptides_file, and spectrum-charge pairs sorted by neutral mass.
+ */
+struct Inputs {
+  string peptides_file;
+  string records_file;  // peptides as records, if they are in that format
+  ProteinVec proteins;
+  vector<const pb::AuxLocation*> locations;
+  SpectrumCollection spectra;
+  double bin_width;
+  double bin_offset;
+  const SearchConfig* config;
+  // Amino acid frequencies for the exact p-value program.
+  int nAA;
+  double* aaFreqN;
+  double* aaFreqI;
+  double* aaFreqC;
+  int* aaMass;
+};
+
+static PeptideReader* OpenPeptides(const Inputs& inputs) {
+  PeptideReader* reader = PeptideReader::Open(inputs.peptides_file);
+  if (reader == NULL) {
+    carp(CARP_FATAL, "Error reading %s", inputs.peptides_file.c_str());
+  }
+  return reader;
+}
+
+/**
+ * Write a synthetic tryptic index of num_proteins random proteins to
+ * peptides_file, keeping the proteins in memory.
+ */
+static void MakeIndex(int num_proteins, const string& peptides_file,
+                      ProteinVec* proteins) {
+  static const char AMINO_ACIDS[] = "ACDEFGHIKLMNPQRSTVWY";
+  const int PROTEIN_LENGTH = 400;
+  const int MIN_LENGTH = 7;
+  const int MAX_LENGTH = 30;
+
+  vector<pb::Peptide> peptides;
+  for (int p = 0; p < num_proteins; p++) {
+    pb::Protein* protein = new pb::Protein;
+    protein->set_id(p);
+    protein->set_name("protein_" + StringUtils::ToString(p));
+    string residues;
+    for (int i = 0; i < PROTEIN_LENGTH; i++) {
+      residues += AMINO_ACIDS[rand() % 20];
+    }
+    protein->set_residues(residues);
+    proteins->push_back(protein);
+
+    // Cleave after K and R, with no missed cleavages.
+    int start = 0;
+    for (int i = 0; i < PROTEIN_LENGTH; i++) {
+      if (residues[i] != 'K' && residues[i] != 'R' && i < PROTEIN_LENGTH - 1) {
+        continue;
+      }
+      int length = i - start + 1;
+      if (length >= MIN_LENGTH && length <= MAX_LENGTH) {
+        double mass = MassConstants::mono_h2o;
+        for (int j = start; j <= i; j++) {
+          mass += MassConstants::mono_table[residues[j]];
+        }
+        pb::Peptide peptide;
+        peptide.set_mass(mass);
+        peptide.set_length(length);
+        peptide.mutable_first_location()->set_protein_id(p);
+        peptide.mutable_first_location()->set_pos(start);
+        peptides.push_back(peptide);
+      }
+      start = i + 1;
+    }
+  }
+
+  vector< pair<double, int> > order;
+  for (size_t i = 0; i < peptides.size(); i++) {
+    order.push_back(make_pair(peptides[i].mass(), (int)i));
+  }
+  sort(order.begin(), order.end());
+
+  pb::Header header;
+  header.set_file_type(pb::Header::PEPTIDES);
+  header.set_command_line("tide-kernel-benchmark");
+  pb::Header::PeptidesHeader* peptides_header = header.mutable_peptides_header();
+  peptides_header->set_min_mass(order.empty() ? 0 : order.front().first);
+  peptides_header->set_max_mass(order.empty() ? 0 : order.back().first);
+  peptides_header->set_min_length(MIN_LENGTH);
+  peptides_header->set_max_length(MAX_LENGTH);
+  peptides_header->set_enzyme("trypsin");
+  peptides_header->set_monoisotopic_precursor(true);
+  peptides_header->mutable_mods();
+  peptides_header->mutable_nterm_mods();
+  peptides_header->mutable_cterm_mods();
+  peptides_header->set_decoys(0);
+  HeadedRecordWriter writer(peptides_file, header);
+  for (size_t i = 0; i < order.size(); i++) {
+    pb::Peptide& peptide = peptides[order[i].second];
+    peptide.set_id(i);
+    writer.Write(&peptide);
+  }
+  carp(CARP_INFO, "Synthetic index: %d proteins, %d peptides.",
+       num_proteins, (int)peptides.size());
+}
+
+/**
+ * Make num_spectra synthetic doubly charged spectra, each with a precursor
+ * mass taken from a random peptide of the index. They are added in order of
+ * mass, so the collection needs no sorting.
+ */
+static void MakeSpectra(int num_spectra, const Inputs& inputs,
+                        SpectrumCollection* spectra) {
+  const int NUM_PEAKS = 150;
+  vector<double> masses;
+  PeptideReader* reader = OpenPeptides(inputs);
+  pb::Peptide peptide;
+  while (!reader->Done()) {
+    reader->Read(&peptide);
+    masses.push_back(peptide.mass());
+  }
+  delete reader;
+  if (masses.empty()) {
+    carp(CARP_FATAL, "No peptides in %s", inputs.peptides_file.c_str());
+  }
+  vector<double> precursors;
+  for (int s = 0; s < num_spectra; s++) {
+    precursors.push_back(masses[rand() % masses.size()]);
+  }
+  sort(precursors.begin(), precursors.end());
+  for (int s = 0; s < num_spectra; s++) {
+    double mass = precursors[s];
+    const int charge = 2;
+    Spectrum* spectrum = new Spectrum(s + 1, mass / charge + MASS_PROTON);
+    vector<double> mz;
+    for (int i = 0; i < NUM_PEAKS; i++) {
+      mz.push_back(100.0 + (mass - 100.0) * rand() / RAND_MAX);
+    }
+    sort(mz.begin(), mz.end());
+    spectrum->ReservePeaks(NUM_PEAKS);
+    for (int i = 0; i < NUM_PEAKS; i++) {
+      // Exponentially distributed intensities, as a few peaks dominate.
+      spectrum->AddPeak(mz[i], -log((rand() + 1.0) / (RAND_MAX + 2.0)) * 1000.0);
+    }
+    spectra->AddSpecCharge(spectrum, charge);
+  }
+}
+
+class PreprocessKernel : public Kernel {
+ public:
+  explicit PreprocessKernel(Inputs* inputs)
+    : Kernel("preprocess-spectrum", "spectrum"), inputs_(inputs),
+      observed_(inputs->bin_width, inputs->bin_offset) {}
+  int64_t Pass(double* timed) {
+    const vector<SpectrumCollection::SpecCharge>* scs = inputs_->spectra.SpecCharges();
+    for (size_t i = 0; i < scs->size(); i++) {
+      observed_.PreprocessSpectrum(*(*scs)[i].spectrum, (*scs)[i].charge,
+                                   *inputs_->config);
+      sink_ += observed_.GetCache()[0];
+    }
+    return scs->size();
+  }
+ private:
+  Inputs* inputs_;
+  ObservedPeakSet observed_;
+};
+
+class EvidenceVectorKernel : public Kernel {
+ public:
+  explicit EvidenceVectorKernel(Inputs* inputs)
+    : Kernel("evidence-vector", "spectrum"), inputs_(inputs) {}
+  int64_t Pass(double* timed) {
+    const vector<SpectrumCollection::SpecCharge>* scs = inputs_->spectra.SpecCharges();
+    int max_bin = (int)floor(MaxBin::Global().CacheBinEnd() + 50.0);
+    for (size_t i = 0; i < scs->size(); i++) {
+      const SpectrumCollection::SpecCharge& sc = (*scs)[i];
+      vector<double> evidence = sc.spectrum->CreateEvidenceVector(
+        inputs_->bin_width, inputs_->bin_offset, sc.charge, sc.neutral_mass, max_bin,
+        *inputs_->config);
+      sink_ += (int64_t)evidence[evidence.size() / 2];
+    }
+    return scs->size();
+  }
+ private:
+  Inputs* inputs_;
+};
+
+/**
+ * SetActiveRange() across all the spectra in mass order, as a search does:
+ * decoding the peptides, computing their peaks and compiling their programs
+ * as they enter the window.
+ */
+class ActiveRangeKernel : public Kernel {
+ public:
+  explicit ActiveRangeKernel(Inputs* inputs)
+    : Kernel("set-active-range", "spectrum"), inputs_(inputs) {}
+  int64_t Pass(double* timed) {
+    PeptideReader* reader = OpenPeptides(*inputs_);
+    ActivePeptideQueue* queue = new ActivePeptideQueue(reader, inputs_->proteins);
+    queue->SetBinSize(inputs_->bin_width, inputs_->bin_offset);
+    const vector<SpectrumCollection::SpecCharge>* scs = inputs_->spectra.SpecCharges();
+    for (size_t i = 0; i < scs->size(); i++) {
+      double mass = (*scs)[i].neutral_mass;
+      vector<double> min_mass(1, mass - PRECURSOR_WINDOW);
+      vector<double> max_mass(1, mass + PRECURSOR_WINDOW);
+      vector<bool> status;
+      sink_ += queue->SetActiveRange(&min_mass, &max_mass, min_mass[0], max_mass[0],
+                                     &status);
+    }
+    delete queue;
+    delete reader;
+    return scs->size();
+  }
+ private:
+  Inputs* inputs_;
+};
+
+/**
+ * The peptides within DOT_PRODUCT_WINDOW of the median spectrum, with their
+ * compiled programs, and that spectrum's preprocessed cache.
+ */
+class DotProductInputs {
+ public:
+  explicit DotProductInputs(Inputs* inputs)
+    : observed_(inputs->bin_width, inputs->bin_offset) {
+    const vector<SpectrumCollection::SpecCharge>* scs = inputs->spectra.SpecCharges();
+    const SpectrumCollection::SpecCharge& sc = (*scs)[scs->size() / 2];
+    charge_ = sc.charge;
+    observed_.PreprocessSpectrum(*sc.spectrum, sc.charge, *inputs->config);
+    reader_ = OpenPeptides(*inputs);
+    queue_ = new ActivePeptideQueue(reader_, inputs->proteins);
+    queue_->SetBinSize(inputs->bin_width, inputs->bin_offset);
+    vector<double> min_mass(1, sc.neutral_mass - DOT_PRODUCT_WINDOW);
+    vector<double> max_mass(1, sc.neutral_mass + DOT_PRODUCT_WINDOW);
+    vector<bool> status;
+    queue_->SetActiveRange(&min_mass, &max_mass, min_mass[0], max_mass[0], &status);
+    num_peptides_ = status.size();
+
+    // The same peaks the score engine uses, for ObservedPeakSet::DotProd():
+    // charge 1 peaks, then charge 2 peaks for charges above 2, short of the
+    // end of the cache.
+    int end = MaxBin::Global().CacheBinEnd() * NUM_PEAK_TYPES;
+    ST_TheoreticalPeakSet workspace(2000);
+    deque<Peptide*>::const_iterator peptide = queue_->iter_;
+    for (int i = 0; i < num_peptides_; i++, ++peptide) {
+      workspace.Clear();
+      (*peptide)->ComputeTheoreticalPeaks(&workspace);
+      const TheoreticalPeakArr* peaks = workspace.GetPeaks();
+      TheoreticalPeakArr* arr = new TheoreticalPeakArr(peaks[0].size() + peaks[1].size());
+      for (int series = 0; series < (charge_ > 2 ? 2 : 1); series++) {
+        for (int j = 0; j < peaks[series].size(); j++) {
+          if (peaks[series][j].Code() < end) {
+            arr->push_back(peaks[series][j]);
+          }
+        }
+      }
+      peaks_.push_back(arr);
+    }
+  }
+  ~DotProductInputs() {
+    for (size_t i = 0; i < peaks_.size(); i++) {
+      delete peaks_[i];
+    }
+    delete queue_;
+    delete reader_;
+  }
+
+  ObservedPeakSet observed_;
+  int charge_;
+  PeptideReader* reader_;
+  ActivePeptideQueue* queue_;
+  int num_peptides_;
+  vector<TheoreticalPeakArr*> peaks_;
+};
+
+class CompiledDotProductKernel : public Kernel {
+ public:
+  explicit CompiledDotProductKernel(DotProductInputs* inputs)
+    : Kernel("dot-product-engine", "peptide"), inputs_(inputs),
+      results_(max(inputs->num_peptides_, 1)) {}
+  int64_t Pass(double* timed) {
+    if (inputs_->num_peptides_ > 0) {
+      SearchKernels::scorePeptides(inputs_->queue_->iter_, inputs_->num_peptides_,
+                                   inputs_->charge_, inputs_->observed_.GetCache(),
+                                   &results_[0]);
+      sink_ += results_[0].first;
+    }
+    return inputs_->num_peptides_;
+  }
+  int64_t Total() const {
+    int64_t total = 0;
+    for (int i = 0; i < inputs_->num_peptides_; i++) {
+      total += results_[i].first;
+    }
+    return total;
+  }
+ private:
+  DotProductInputs* inputs_;
+  vector< pair<int, int> > results_;
+};
+
+class ReferenceDotProductKernel : public Kernel {
+ public:
+  explicit ReferenceDotProductKernel(DotProductInputs* inputs)
+    : Kernel("dot-product-reference", "peptide"), inputs_(inputs), total_(0) {}
+  int64_t Pass(double* timed) {
+    total_ = 0;
+    for (int i = 0; i < inputs_->num_peptides_; i++) {
+      total_ += inputs_->observed_.DotProd(*inputs_->peaks_[i]);
+    }
+    sink_ += total_;
+    return inputs_->num_peptides_;
+  }
+  int64_t Total() const { return total_; }
+ private:
+  DotProductInputs* inputs_;
+  int64_t total_;
+};
+
+/**
+ * calcScoreCount(), the exact p-value dynamic program, for the first
+ * SCORE_COUNT_SPECTRA spectra, with inputs prepared as the search does.
+ */
+class ScoreCountKernel : public Kernel {
+ public:
+  explicit ScoreCountKernel(Inputs* inputs)
+    : Kernel("calc-score-count", "spectrum"), inputs_(inputs) {
+    const vector<SpectrumCollection::SpecCharge>* scs = inputs->spectra.SpecCharges();
+    max_bin_ = (int)floor(MaxBin::Global().CacheBinEnd() + 50.0);
+    for (size_t i = 0; i < scs->size() && i < SCORE_COUNT_SPECTRA; i++) {
+      const SpectrumCollection::SpecCharge& sc = (*scs)[i];
+      Program program;
+      program.pepMassInt = MassConstants::mass2bin(sc.neutral_mass);
+      double pepMassMonoMean =
+        (program.pepMassInt - 0.5 + inputs->bin_offset) * inputs->bin_width;
+      program.evidence = sc.spectrum->CreateEvidenceVectorDiscretized(
+        inputs->bin_width, inputs->bin_offset, sc.charge, pepMassMonoMean, max_bin_,
+        *inputs->config);
+      program.maxEvidence = *max_element(program.evidence.begin(), program.evidence.end());
+      program.minEvidence = *min_element(program.evidence.begin(), program.evidence.end());
+      int maxNResidue = (int)floor((double)program.pepMassInt / (double)inputs->aaMass[0]);
+      vector<int> sorted(program.evidence);
+      sort(sorted.begin(), sorted.end(), greater<int>());
+      program.maxScore = program.minScore = 0;
+      for (int j = 0; j < maxNResidue && j < max_bin_; j++) {
+        program.maxScore += sorted[j];
+        program.minScore += sorted[max_bin_ - 1 - j];
+      }
+      program.nRow = (program.maxEvidence + 1) - program.minScore + 1 +
+        program.maxScore - program.minEvidence;
+      programs_.push_back(program);
+    }
+  }
+  int64_t Pass(double* timed) {
+    for (size_t i = 0; i < programs_.size(); i++) {
+      Program& p = programs_[i];
+      vector<double> pvalues(p.nRow);
+      sink_ += search_.calcScoreCount(
+        max_bin_, &p.evidence[0], p.pepMassInt, p.maxEvidence, p.minEvidence,
+        p.maxScore, p.minScore, inputs_->nAA, inputs_->aaFreqN, inputs_->aaFreqI,
+        inputs_->aaFreqC, inputs_->aaMass, &pvalues[0], &workspace_);
+    }
+    return programs_.size();
+  }
+ private:
+  struct Program {
+    vector<int> evidence;
+    int pepMassInt;
+    int maxEvidence;
+    int minEvidence;
+    int maxScore;
+    int minScore;
+    int nRow;
+  };
+  Inputs* inputs_;
+  int max_bin_;
+  vector<Program> programs_;
+  SearchKernels search_;
+  SearchKernels::Workspace workspace_;
+};
+
+/**
+ * Reading the peptide records of the index with HeadedRecordReader.
+ */
+class RecordReadKernel : public Kernel {
+ public:
+  explicit RecordReadKernel(Inputs* inputs)
+    : Kernel("record-read", "peptide"), inputs_(inputs) {}
+  int64_t Pass(double* timed) {
+    HeadedRecordReader reader(inputs_->records_file);
+    pb::Peptide peptide;
+    int64_t count = 0;
+    while (!reader.Done()) {
+      reader.Read(&peptide);
+      ++count;
+    }
+    sink_ += peptide.length();
+    return count;
+  }
+ private:
+  Inputs* inputs_;
+};
+
+/**
+ * TideMatchSet::report() of the top matches of each spectrum to a string,
+ * as tab-delimited text. Only the report is timed; the search that finds
+ * the matches is not.
+ */
+class ReportKernel : public Kernel {
+ public:
+  explicit ReportKernel(Inputs* inputs)
+    : Kernel("report-matches", "spectrum"), inputs_(inputs),
+      observed_(inputs->bin_width, inputs->bin_offset) {}
+  int64_t Pass(double* timed) {
+    PeptideReader* reader = OpenPeptides(*inputs_);
+    ActivePeptideQueue* queue = new ActivePeptideQueue(reader, inputs_->proteins);
+    queue->SetBinSize(inputs_->bin_width, inputs_->bin_offset);
+    const vector<SpectrumCollection::SpecCharge>* scs = inputs_->spectra.SpecCharges();
+    ostringstream out;
+    int64_t reported = 0;
+    for (size_t i = 0; i < scs->size(); i++) {
+      const SpectrumCollection::SpecCharge& sc = (*scs)[i];
+      double mass = sc.neutral_mass;
+      vector<double> min_mass(1, mass - PRECURSOR_WINDOW);
+      vector<double> max_mass(1, mass + PRECURSOR_WINDOW);
+      vector<bool> status;
+      int candidates = queue->SetActiveRange(&min_mass, &max_mass, min_mass[0],
+                                             max_mass[0], &status);
+      if (candidates == 0) {
+        continue;
+      }
+      observed_.PreprocessSpectrum(*sc.spectrum, sc.charge, *inputs_->config);
+      vector< pair<int, int> > results(status.size());
+      SearchKernels::scorePeptides(queue->iter_, status.size(), sc.charge,
+                                   observed_.GetCache(), &results[0]);
+      TideMatchSet::Arr match_arr(candidates);
+      for (size_t j = 0; j < status.size(); j++) {
+        if (status[j]) {
+          TideMatchSet::Scores score;
+          score.xcorr_score = results[j].first / TideSearchApplication::XCORR_SCALING;
+          score.rank = results[j].second;
+          match_arr.push_back(score);
+        }
+      }
+      TideMatchSet matches(&match_arr, MaxBin::Global().MaxBinEnd(), *inputs_->config);
+      matches.cur_score_function_ = XCORR_SCORE;
+      out.str("");
+      double start = Seconds();
+      matches.report(&out, &out, REPORT_TOP_MATCHES, "benchmark.ms2", sc.spectrum,
+                     sc.charge, queue, inputs_->proteins, inputs_->locations,
+                     false, true, NULL);
+      *timed += Seconds() - start;
+      sink_ += out.tellp();
+      ++reported;
+    }
+    delete queue;
+    delete reader;
+    return reported;
+  }
+ private:
+  Inputs* inputs_;
+  ObservedPeakSet observed_;
+};
+
+static void RunKernel(Kernel* kernel, double min_seconds) {
+  double timed = 0;
+  kernel->Pass(&timed);  // warm up
+  int64_t ops = 0;
+  double elapsed = 0;
+  timed = 0;
+  double start = Seconds();
+  do {
+    ops += kernel->Pass(&timed);
+    elapsed = Seconds() - start;
+  } while (elapsed < min_seconds);
+  if (timed > 0) {
+    elapsed = timed;
+  }
+  cout << kernel->Name() << '\t' << kernel->Unit() << '\t' << ops << '\t'
+       << elapsed << '\t' << (ops > 0 ? elapsed * 1e9 / ops : 0.0) << '\t'
+       << (elapsed > 0 ? ops / elapsed : 0.0) << endl;
+}
+
+int main(int argc, char** argv) {
+  string index_dir, spectra_file, kernel_filter;
+  double min_seconds = 1.0;
+  int num_proteins = 2000;
+  int num_spectra = 2000;
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (i + 1 >= argc) {
+      carp(CARP_FATAL, "Missing value for %s", arg.c_str());
+    }
+    string value = argv[++i];
+    if (arg == "--index") {
+      index_dir = value;
+    } else if (arg == "--spectra") {
+      spectra_file = value;
+    } else if (arg == "--kernel") {
+      kernel_filter = value;
+    } else if (arg == "--seconds") {
+      min_seconds = StringUtils::FromString<double>(value);
+    } else if (arg == "--num-proteins") {
+      num_proteins = StringUtils::FromString<int>(value);
+    } else if (arg == "--num-spectra") {
+      num_spectra = StringUtils::FromString<int>(value);
+    } else {
+      carp(CARP_FATAL, "Unknown option %s", arg.c_str());
+    }
+  }
+  srand(1);
+
+  if (!ScoreEngine::Select(Params::GetString("score-engine"))) {
+    carp(CARP_FATAL, "Unknown score engine '%s'",
+         Params::GetString("score-engine").c_str());
+  }
+
+  SearchConfig config;
+  Inputs inputs;
+  inputs.config = &config;
+  inputs.bin_width = Params::GetDouble("mz-bin-width");
+  inputs.bin_offset = Params::GetDouble("mz-bin-offset");
+  string temp_file;
+  pb::Header peptides_header;
+  if (index_dir.empty()) {
+    pb::ModTable no_mods;
+    MassConstants::Init(&no_mods, &no_mods, &no_mods, inputs.bin_width, inputs.bin_offset);
+    temp_file = (boost::filesystem::temp_directory_path() /
+                 boost::filesystem::unique_path("tide-kernel-benchmark-%%%%%%.pepix")).string();
+    MakeIndex(num_proteins, temp_file, &inputs.proteins);
+    inputs.peptides_file = inputs.records_file = temp_file;
+  } else {
+    inputs.peptides_file = FileUtils::Join(index_dir, "pepix");
+    PeptideReader* reader = PeptideReader::Open(inputs.peptides_file, &peptides_header);
+    if (reader == NULL || !peptides_header.has_peptides_header()) {
+      carp(CARP_FATAL, "Error reading index (%s)", inputs.peptides_file.c_str());
+    }
+    // Only the records format is read with HeadedRecordReader.
+    if (dynamic_cast<RecordPeptideReader*>(reader) != NULL) {
+      inputs.records_file = inputs.peptides_file;
+    }
+    delete reader;
+    const pb::Header::PeptidesHeader& header = peptides_header.peptides_header();
+    MassConstants::Init(&header.mods(), &header.nterm_mods(), &header.cterm_mods(),
+                        inputs.bin_width, inputs.bin_offset);
+    if (!ReadRecordsToVector<pb::Protein, const pb::Protein>(
+          &inputs.proteins, FileUtils::Join(index_dir, "protix"))) {
+      carp(CARP_FATAL, "Error reading index (%s)", index_dir.c_str());
+    }
+    if (!ReadRecordsToVector<pb::AuxLocation>(
+          &inputs.locations, FileUtils::Join(index_dir, "auxlocs"))) {
+      carp(CARP_FATAL, "Error reading index (%s)", index_dir.c_str());
+    }
+  }
+
+  if (spectra_file.empty()) {
+    MakeSpectra(num_spectra, inputs, &inputs.spectra);
+  } else {
+    if (!inputs.spectra.ReadSpectrumRecords(spectra_file)) {
+      carp(CARP_FATAL, "Error reading spectrum file %s", spectra_file.c_str());
+    }
+    inputs.spectra.Sort();
+  }
+  if (inputs.spectra.SpecCharges()->empty()) {
+    carp(CARP_FATAL, "No spectra to search.");
+  }
+  // Large enough for the evidence vectors of the exact p-value kernels too.
+  MaxBin::SetGlobalMax(max(inputs.spectra.FindHighestMZ(),
+                           inputs.spectra.SpecCharges()->back().neutral_mass));
+
+  {
+    PeptideReader* reader = OpenPeptides(inputs);
+    ActivePeptideQueue queue(reader, inputs.proteins);
+    inputs.nAA = queue.CountAAFrequency(inputs.bin_width, inputs.bin_offset,
+                                        &inputs.aaFreqN, &inputs.aaFreqI,
+                                        &inputs.aaFreqC, &inputs.aaMass);
+    delete reader;
+  }
+
+  DotProductInputs dot_product_inputs(&inputs);
+  CompiledDotProductKernel compiled(&dot_product_inputs);
+  ReferenceDotProductKernel reference(&dot_product_inputs);
+  double unused;
+  compiled.Pass(&unused);
+  reference.Pass(&unused);
+  if (compiled.Total() != reference.Total()) {
+    carp(CARP_WARNING, "The %s score engine and ObservedPeakSet::DotProd() "
+         "disagree: %lld vs. %lld.", ScoreEngine::Description().c_str(),
+         (long long)compiled.Total(), (long long)reference.Total());
+  }
+
+  vector<Kernel*> kernels;
+  kernels.push_back(new PreprocessKernel(&inputs));
+  kernels.push_back(new EvidenceVectorKernel(&inputs));
+  kernels.push_back(new ActiveRangeKernel(&inputs));
+  kernels.push_back(&compiled);
+  kernels.push_back(&reference);
+  kernels.push_back(new ScoreCountKernel(&inputs));
+  if (!inputs.records_file.empty()) {
+    kernels.push_back(new RecordReadKernel(&inputs));
+  }
+  kernels.push_back(new ReportKernel(&inputs));
+
+  cout << "kernel\tunit\toperations\tseconds\tns-per-operation\toperations-per-second" << endl;
+  for (vector<Kernel*>::iterator i = kernels.begin(); i != kernels.end(); ++i) {
+    if (kernel_filter.empty() || (*i)->Name().find(kernel_filter) != string::npos) {
+      RunKernel(*i, min_seconds);
+    }
+    if (*i != &compiled && *i != &reference) {
+      delete *i;
+    }
+  }
+
+  delete[] inputs.aaFreqN;
+  delete[] inputs.aaFreqI;
+  delete[] inputs.aaFreqC;
+  delete[] inputs.aaMass;
+  for (ProteinVec::iterator i = inputs.proteins.begin(); i != inputs.proteins.end(); ++i) {
+    delete *i;
+  }
+  if (!temp_file.empty()) {
+    remove(temp_file.c_str());
+  }
+  return 0;
+}
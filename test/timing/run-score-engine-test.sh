@@ -0,0 +1,97 @@
+#!/bin/bash
+#$ -S "/bin/bash"
+#$ -cwd
+#$ -o "job.stdout"
+#$ -e "job.stderr"
+#$ -l m_mem_free=32.0G
+#$ -l h_rt=128:0:0
+#$ -q noble-long.q
+
+# Compare the tide-search score engines (--score-engine jit, simd and
+# scalar) on the same index and spectra. Each engine must report the same
+# PSMs; the elapsed time of each search is written to score-engines.html.
+
+hostname
+date
+echo PID=$$
+
+if [[ -e /etc/profile.d/modules.sh ]]; then
+  source /etc/profile.d/modules.sh
+  module load modules modules-init modules-gs modules-noble
+fi
+
+set -o nounset
+set -o pipefail
+set -o errexit
+set -o xtrace
+
+# Location of the data
+ms2_file=../performance-tests/051708-worm-ASMS-10.ms2
+fasta_file=../performance-tests/worm+contaminants.fa
+
+CRUX=../../src/crux
+
+# Avoid NFS overhead by using a scratch directory.
+scratch_dir=/scratch
+if [[ ! -e $scratch_dir ]]; then
+    scratch_dir=.
+else
+    cp $ms2_file $scratch_dir
+    ms2_file="$scratch_dir/$ms2_file"
+    cp $fasta_file $scratch_dir
+    fasta_file="$scratch_dir/$fasta_file"
+fi
+
+# Build the index.
+index=$scratch_dir/my_index
+if [[ ! -e $index ]]; then
+    $CRUX tide-index --decoy-format none \
+	  --output-dir $index \
+	  $fasta_file $index
+fi
+
+# Convert the MS2 to spectrumrecords
+spectrum_records=$scratch_dir/my_spectra
+if [[ ! -e $spectrum_records ]]; then
+    $CRUX tide-search \
+	  --output-dir tmp \
+	  --store-spectra $spectrum_records \
+	  $ms2_file $index
+    rm -r tmp
+fi
+
+html=score-engines.html
+echo "<html><body><pre>" > $html
+for fragment in 1 02; do
+
+    if [[ $fragment == 02 ]]; then
+	tide_fragment="--mz-bin-width 0.02"
+    else
+	tide_fragment=""
+    fi
+
+    for threads in 1 4; do
+	for engine in jit simd scalar; do
+	    root=$engine.frag$fragment.threads$threads
+	    log_file=$scratch_dir/$root/tide-search.log.txt
+
+	    if [[ ! -e $log_file ]]; then
+		$CRUX tide-search --top-match 1 \
+		      --score-engine $engine \
+		      $tide_fragment \
+		      --num-threads $threads \
+		      --output-dir $scratch_dir/$root --overwrite T \
+		      $spectrum_records $index
+	    fi
+	    echo -n "$root " >> $html
+	    awk -F ":" '$2 == " Elapsed time" {print $3}' $log_file >> $html
+
+	    # The engines differ only in speed.
+	    if [[ $engine != jit ]]; then
+		cmp <(sort $scratch_dir/jit.frag$fragment.threads$threads/tide-search.target.txt) \
+		    <(sort $scratch_dir/$root/tide-search.target.txt)
+	    fi
+	done
+    done
+done
+echo "</pre></body></html>" >> $html